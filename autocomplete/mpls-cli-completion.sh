@@ -6,17 +6,80 @@ _mpls_cli_completion() {
 
     # If the first argument (command)
     if [[ $cword -eq 1 ]]; then
-        COMPREPLY=( $(compgen -W "add_for" -- "$cur") )
+        COMPREPLY=( $(compgen -W "add_for replace del batch show sync save restore protect stats verify nexthop monitor netns" -- "$cur") )
+        return
+    fi
+
+    # "netns" takes the name of a namespace created with "ip netns add"; "verify" takes any number of them
+    if [[ ( $cword -eq 2 && "${words[1]}" == "netns" ) || "${words[1]}" == "verify" ]]; then
+        COMPREPLY=( $(compgen -W "$(ls /run/netns 2>/dev/null)" -- "$cur") )
+        return
+    fi
+
+    # "batch", "sync" and "protect" take a route file (or "-" for stdin)
+    if [[ $cword -eq 2 && ( "${words[1]}" == "batch" || "${words[1]}" == "sync" || "${words[1]}" == "protect" ) ]]; then
+        COMPREPLY=( $(compgen -f -- "$cur") )
+        return
+    fi
+
+    # "save" and "restore" take a snapshot file
+    if [[ $cword -eq 2 && ( "${words[1]}" == "save" || "${words[1]}" == "restore" ) ]]; then
+        COMPREPLY=( $(compgen -f -- "$cur") )
+        return
+    fi
+
+    # "sync [file]" may be followed by "dry_run"
+    if [[ $cword -eq 3 && "${words[1]}" == "sync" ]]; then
+        COMPREPLY=( $(compgen -W "dry_run" -- "$cur") )
+        return
+    fi
+
+    # "batch [file]" may be followed by "errors_only"
+    if [[ $cword -eq 3 && "${words[1]}" == "batch" ]]; then
+        COMPREPLY=( $(compgen -W "errors_only" -- "$cur") )
+        return
+    fi
+
+    # "show" and "monitor" take an optional output format
+    if [[ $cword -eq 2 && ( "${words[1]}" == "show" || "${words[1]}" == "monitor" ) ]]; then
+        COMPREPLY=( $(compgen -W "json" -- "$cur") )
+        return
+    fi
+
+    # "nexthop" takes a verb, then an object id; "add" and "replace" continue with a group or a next hop
+    if [[ "${words[1]}" == "nexthop" ]]; then
+        if [[ $cword -eq 2 ]]; then
+            COMPREPLY=( $(compgen -W "add replace del show" -- "$cur") )
+        elif [[ $cword -eq 3 && "${words[2]}" != "show" ]]; then
+            COMPREPLY=( "[Enter nexthop id]" )
+        elif [[ $cword -eq 4 && "${words[2]}" != "del" && "${words[2]}" != "show" ]]; then
+            COMPREPLY=( $(compgen -W "group push next_hop dev" -- "$cur") )
+        elif [[ $cword -ge 5 && $(( cword % 2 )) -eq 0 && "${words[4]}" != "group" ]]; then
+            COMPREPLY=( $(compgen -W "push ttl next_hop dev" -- "$cur") )
+        fi
+        return
+    fi
+
+    # "stats" takes an optional output format, then an optional "interval [seconds]"
+    if [[ "${words[1]}" == "stats" ]]; then
+        if [[ $cword -eq 2 ]]; then
+            COMPREPLY=( $(compgen -W "json prometheus interval" -- "$cur") )
+        elif [[ $cword -eq 3 && "${words[2]}" != "interval" ]]; then
+            COMPREPLY=( $(compgen -W "interval" -- "$cur") )
+        fi
         return
     fi
 
     # If the second argument (after "add_for")
-    if [[ $cword -eq 2 && "${words[1]}" == "add_for" ]]; then
+    if [[ $cword -eq 2 && ( "${words[1]}" == "add_for" || "${words[1]}" == "replace" || "${words[1]}" == "del" ) ]]; then
         COMPREPLY=()
         
         # Check for label (MPLS label must be within the range 0–1048575)
         if [[ "$cur" =~ ^[0-9]+$ ]] && ((cur >= 0 && cur <= 1048575)); then
             COMPREPLY=("$cur")  # Valid MPLS label
+        # "auto" lets mpls-cli pick a free label (not for "del")
+        elif [[ "${words[1]}" != "del" && "auto" == "$cur"* && -n "$cur" ]]; then
+            COMPREPLY=("auto")
         # Check for an IP address (with optional subnet mask /XX)
         elif [[ "$cur" =~ ^[0-9]+\.[0-9]+\.[0-9]+\.[0-9]+(/[0-9]{1,2})?$ ]]; then
             COMPREPLY=("$cur")  # Valid IP address or IP/subnet
@@ -29,15 +92,15 @@ _mpls_cli_completion() {
     # Determine whether the first argument is a label or dst_ip
     local first_arg="${words[2]}"  # Third argument (label or dst_ip)
 
-    # If the third argument is a label (number within 0-1048575), the next argument can be "dev", "next_hop", "swap_as"
-    if [[ "$first_arg" =~ ^[0-9]+$ && "$first_arg" -ge 0 && "$first_arg" -le 1048575 && $cword -eq 3 ]]; then
-        COMPREPLY=( $(compgen -W "dev next_hop swap_as" -- "$cur") )
+    # If the third argument is a label (number within 0-1048575), the next argument can be "dev", "next_hop", "swap_as", "multipath"
+    if [[ ( "$first_arg" == "auto" || ( "$first_arg" =~ ^[0-9]+$ && "$first_arg" -ge 0 && "$first_arg" -le 1048575 ) ) && $cword -eq 3 ]]; then
+        COMPREPLY=( $(compgen -W "dev next_hop swap_as multipath" -- "$cur") )
         return
     fi
 
-    # If the third argument is a dst_ip (IP or IP/subnet), the next argument must be "push"
+    # If the third argument is a dst_ip (IP or IP/subnet), the next argument is "push" or "nhid"
     if [[ "$first_arg" =~ ^[0-9]+\.[0-9]+\.[0-9]+\.[0-9]+(/[0-9]{1,2})?$ && $cword -eq 3 ]]; then
-        COMPREPLY=( $(compgen -W "push" -- "$cur") )
+        COMPREPLY=( $(compgen -W "push nhid" -- "$cur") )
         return
     fi
 
@@ -0,0 +1,325 @@
+/**
+ * @file mpls_bench.c
+ * @brief Measures how fast routes of one kind are installed and removed.
+ *
+ * Installs [count] routes of one kind through a pipelined mpls_batch, then
+ * deletes them again, and prints one JSON line per pass with the throughput
+ * and the per-route latency percentiles. A route's latency runs from the
+ * moment it is queued to the moment its ACK is handled, so it includes the
+ * time spent waiting for the send buffer and the ACK window.
+ *
+ * The "encode" mode needs no kernel support: it compares the time to encode
+ * each route kind with build_mpls_route() and with a request template, and
+ * checks that both produce identical bytes.
+ *
+ * With MPLS_BENCH_FAKE set, routes go to the in-process fake kernel of
+ * mpls_fake.h instead, so the pipeline can be measured without root or MPLS
+ * support. MPLS_FAKE_LATENCY_US adds a per-request handling time and
+ * MPLS_FAKE_ENOBUFS_EVERY drops every Nth ACK.
+ *
+ * Usage:
+ *  - mpls-bench [kind] [count] [device_name] [nexthop_ip]
+ *  - mpls-bench encode [count]
+ *
+ * Kinds: dev, next_hop, swap_dev, swap_next_hop, push_dev, push_next_hop.
+ * Meant to run in a throwaway namespace; see bench/run_bench.sh.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include "mpls_core.h"    // Include header file for core Netlink operations
+#include "mpls_routes.h"  // Include header file for MPLS route management functions
+#include "mpls_batch.h"   // Include header file for bulk route installation
+#include "mpls_ifcache.h" // Include header file for the interface name cache
+#include "mpls_stats.h"   // Include header file for hot-path instrumentation
+#include "mpls_fake.h"    // Include header file for the in-process fake kernel
+
+#define BENCH_FIRST_LABEL 16          // Labels 0-15 are reserved
+#define BENCH_LABELS (1 << 20)        // Size of the 20-bit label space
+#define BENCH_FIRST_DST 0x0B000000    // Push routes go to 11.0.0.0 + i
+
+static const struct {
+    const char *name;
+    enum mpls_route_kind kind;
+} bench_kinds[] = {
+    {"dev", MPLS_ROUTE_DEV},
+    {"next_hop", MPLS_ROUTE_NEXTHOP},
+    {"swap_dev", MPLS_ROUTE_SWAP_DEV},
+    {"swap_next_hop", MPLS_ROUTE_SWAP_NEXTHOP},
+    {"push_dev", MPLS_ROUTE_PUSH_DEV},
+    {"push_next_hop", MPLS_ROUTE_PUSH_NEXTHOP},
+};
+
+struct bench_pass {
+    uint64_t *queued;      // Time each request was queued
+    uint64_t *latency;     // Queue-to-ACK time of each request
+    unsigned long failed;
+    int first_error;
+};
+
+/**
+ * @brief Reads the monotonic clock.
+ *
+ * @return Nanoseconds since an arbitrary point.
+ */
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief Records the latency and outcome of one request.
+ *
+ * @param tag Index of the route.
+ * @param error 0 on success, negative errno on failure.
+ * @param detail Kernel's explanation of a failure (unused).
+ * @param arg The running pass.
+ */
+static void bench_result(unsigned long tag, int error, const char *detail, void *arg) {
+    (void)detail;
+    struct bench_pass *pass = (struct bench_pass *)arg;
+    pass->latency[tag] = now_ns() - pass->queued[tag];
+    if (error) {
+        pass->failed++;
+        if (!pass->first_error) pass->first_error = error;
+    }
+}
+
+/**
+ * @brief Orders latencies for the percentile lookup.
+ *
+ * @param a First latency.
+ * @param b Second latency.
+ * @return Negative, zero or positive as for qsort().
+ */
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Returns a percentile of sorted latencies, in microseconds.
+ *
+ * @param sorted Latencies in ascending order.
+ * @param count Number of latencies.
+ * @param p Percentile as a fraction (0.5 for p50).
+ * @return The latency below which a fraction @p p of the requests completed.
+ */
+static double percentile_us(const uint64_t *sorted, unsigned long count, double p) {
+    unsigned long i = (unsigned long)(p * count + 0.999999);
+    if (i > 0) i--;
+    if (i >= count) i = count - 1;
+    return sorted[i] / 1000.0;
+}
+
+/**
+ * @brief Builds the route with index @p i of a pass.
+ *
+ * @param kind Route kind.
+ * @param i Route index.
+ * @param dev Output interface.
+ * @param via Next-hop address.
+ * @param route Route description to fill in.
+ */
+static void bench_route(enum mpls_route_kind kind, unsigned long i, const char *dev, struct in_addr via,
+                        struct mpls_route *route) {
+    memset(route, 0, offsetof(struct mpls_route, nexthops));
+    route->kind = kind;
+    route->label = BENCH_FIRST_LABEL + i;
+    route->out_labels[0] = BENCH_FIRST_LABEL + i;
+    route->nout_labels = 1;
+    route->s_bit = 1;
+    route->dst.s_addr = htonl(BENCH_FIRST_DST + i);
+    route->via = via;
+    strncpy(route->ifname, dev, IF_NAMESIZE - 1);
+}
+
+/**
+ * @brief Installs or deletes @p count routes and prints the pass results as JSON.
+ *
+ * @param session Session the requests are sent on.
+ * @param name Name of the route kind.
+ * @param kind Route kind.
+ * @param op Add or delete.
+ * @param count Number of routes.
+ * @param dev Output interface.
+ * @param via Next-hop address.
+ * @param pass Buffers for the timestamps.
+ * @return 0 if every request succeeded, -1 otherwise.
+ */
+static int bench_run(struct mpls_session *session, const char *name, enum mpls_route_kind kind, enum mpls_route_op op,
+                     unsigned long count, const char *dev, struct in_addr via, struct bench_pass *pass) {
+    pass->failed = 0;
+    pass->first_error = 0;
+    struct mpls_batch *batch = mpls_batch_open(session, bench_result, pass);
+    if (!batch) {
+        perror("calloc");
+        return -1;
+    }
+
+    struct mpls_route route;
+    uint64_t start = now_ns();
+    for (unsigned long i = 0; i < count; i++) {
+        bench_route(kind, i, dev, via, &route);
+        pass->queued[i] = now_ns();
+        mpls_batch_queue(batch, &route, op, i);
+    }
+    mpls_batch_finish(batch, NULL);
+    double seconds = (now_ns() - start) / 1e9;
+
+    qsort(pass->latency, count, sizeof(uint64_t), compare_u64);
+    printf("{\"kind\":\"%s\",\"op\":\"%s\",\"routes\":%lu,\"failed\":%lu,\"seconds\":%.6f,\"routes_per_sec\":%.0f,"
+           "\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f",
+           name, op == MPLS_OP_DELETE ? "del" : "add", count, pass->failed, seconds, count / seconds,
+           percentile_us(pass->latency, count, 0.50), percentile_us(pass->latency, count, 0.99),
+           percentile_us(pass->latency, count, 0.999), pass->latency[count - 1] / 1000.0);
+    if (pass->first_error) printf(",\"error\":\"%s\"", strerror(-pass->first_error));
+    printf("}\n");
+    fflush(stdout);
+    return pass->failed ? -1 : 0;
+}
+
+/**
+ * @brief Times build_mpls_route() against template encoding for every kind and operation.
+ *
+ * @param count Number of routes per kind.
+ * @return EXIT_SUCCESS if both encoders agree byte for byte, EXIT_FAILURE otherwise.
+ */
+static int bench_encode(unsigned long count) {
+    struct mpls_route *routes = malloc(count * sizeof(*routes));
+    struct mpls_ifcache *ifcache = mpls_ifcache_open();
+    if (!routes) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    struct in_addr via;
+    inet_pton(AF_INET, "10.255.0.2", &via);
+
+    int status = EXIT_SUCCESS;
+    for (size_t k = 0; k < sizeof(bench_kinds) / sizeof(bench_kinds[0]); k++) {
+        for (unsigned long i = 0; i < count; i++) bench_route(bench_kinds[k].kind, i, "lo", via, &routes[i]);
+
+        for (int op = MPLS_OP_ADD; op <= MPLS_OP_DELETE; op += MPLS_OP_DELETE - MPLS_OP_ADD) {
+            union {
+                struct nlmsghdr nlh;
+                char buf[MPLS_ROUTE_MSG_MAX];
+            } a, b;
+            struct mpls_route_template tmpl;
+            if (mpls_route_template_init(&tmpl, &routes[0], op, ifcache) < 0) {
+                fprintf(stderr, "%s: cannot encode\n", bench_kinds[k].name);
+                status = EXIT_FAILURE;
+                continue;
+            }
+
+            // Both encoders must agree byte for byte (padding included, hence the zeroing)
+            unsigned long mismatches = 0;
+            for (unsigned long i = 0; i < count; i++) {
+                memset(&a, 0, sizeof(a));
+                memset(&b, 0, sizeof(b));
+                build_mpls_route(&a.nlh, sizeof(a), &routes[i], op, ifcache);
+                mpls_route_template_fill(&tmpl, &b.nlh, sizeof(b), &routes[i], ifcache);
+                if (a.nlh.nlmsg_len != b.nlh.nlmsg_len || memcmp(&a, &b, a.nlh.nlmsg_len) != 0) mismatches++;
+            }
+
+            uint64_t start = now_ns();
+            for (unsigned long i = 0; i < count; i++) build_mpls_route(&a.nlh, sizeof(a), &routes[i], op, ifcache);
+            double build_ns = (double)(now_ns() - start) / count;
+            start = now_ns();
+            for (unsigned long i = 0; i < count; i++) mpls_route_template_fill(&tmpl, &b.nlh, sizeof(b), &routes[i], ifcache);
+            double template_ns = (double)(now_ns() - start) / count;
+
+            printf("{\"kind\":\"%s\",\"op\":\"%s\",\"routes\":%lu,\"build_ns\":%.1f,\"template_ns\":%.1f,"
+                   "\"speedup\":%.2f,\"bytes\":%u,\"mismatches\":%lu}\n",
+                   bench_kinds[k].name, op == MPLS_OP_DELETE ? "del" : "add", count, build_ns, template_ns,
+                   build_ns / template_ns, a.nlh.nlmsg_len, mismatches);
+            if (mismatches) status = EXIT_FAILURE;
+        }
+    }
+
+    mpls_ifcache_close(ifcache);
+    free(routes);
+    return status;
+}
+
+/**
+ * @brief Main function: benchmarks one route kind at one table size.
+ *
+ * @param argc Number of command-line arguments.
+ * @param argv Array of command-line arguments.
+ * @return EXIT_SUCCESS (0) if every request succeeded, EXIT_FAILURE (1) otherwise.
+ */
+int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "encode") == 0) {
+        char *end;
+        unsigned long count = strtoul(argv[2], &end, 10);
+        if (*end != '\0' || count == 0 || count > BENCH_LABELS - BENCH_FIRST_LABEL) {
+            printf("Error: Invalid command format.\n");
+            return EXIT_FAILURE;
+        }
+        return bench_encode(count);
+    }
+    if (argc != 5) {
+        printf("Usage:\n  mpls-bench [kind] [count] [device_name] [nexthop_ip]\n  mpls-bench encode [count]\n");
+        printf("Kinds: dev, next_hop, swap_dev, swap_next_hop, push_dev, push_next_hop\n");
+        return EXIT_FAILURE;
+    }
+
+    if (mpls_stats_init() < 0) {
+        fprintf(stderr, "Warning: MPLS_STATS must be json[:path] or prometheus[:path], instrumentation is off\n");
+    }
+
+    int k = -1;
+    for (size_t i = 0; i < sizeof(bench_kinds) / sizeof(bench_kinds[0]); i++) {
+        if (strcmp(argv[1], bench_kinds[i].name) == 0) k = i;
+    }
+    char *end;
+    unsigned long count = strtoul(argv[2], &end, 10);
+    struct in_addr via;
+    if (k < 0 || *end != '\0' || count == 0 || count > BENCH_LABELS - BENCH_FIRST_LABEL ||
+        inet_pton(AF_INET, argv[4], &via) != 1) {
+        printf("Error: Invalid command format.\n");
+        return EXIT_FAILURE;
+    }
+
+    struct bench_pass pass;
+    pass.queued = malloc(count * sizeof(uint64_t));
+    pass.latency = malloc(count * sizeof(uint64_t));
+    if (!pass.queued || !pass.latency) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    struct mpls_session session;
+    struct mpls_fake *fake = NULL;
+    int ret = 0;
+    if (getenv("MPLS_BENCH_FAKE")) {
+        const char *latency = getenv("MPLS_FAKE_LATENCY_US");
+        const char *enobufs = getenv("MPLS_FAKE_ENOBUFS_EVERY");
+        struct mpls_fake_options options = {0, 0};
+        if (latency) options.latency_us = strtoul(latency, NULL, 10);
+        if (enobufs) options.enobufs_every = strtoul(enobufs, NULL, 10);
+        fake = mpls_fake_open(&session, MPLS_SESSION_SOCK_BUF, &options);
+        if (!fake) ret = -errno;
+    } else {
+        ret = mpls_session_open(&session, MPLS_SESSION_SOCK_BUF);
+    }
+    if (ret < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(-ret));
+        return EXIT_FAILURE;
+    }
+    session.ifcache = mpls_ifcache_open();
+
+    ret = bench_run(&session, argv[1], bench_kinds[k].kind, MPLS_OP_ADD, count, argv[3], via, &pass);
+    if (bench_run(&session, argv[1], bench_kinds[k].kind, MPLS_OP_DELETE, count, argv[3], via, &pass) < 0) ret = -1;
+
+    mpls_session_close(&session);
+    mpls_fake_close(fake);
+    free(pass.queued);
+    free(pass.latency);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,57 @@
+#!/bin/sh
+# run_bench.sh - Measures route installation speed inside a throwaway network namespace.
+#
+# Usage: run_bench.sh [path_to_mpls-bench]
+#   BENCH_SIZES  table sizes to test (default "1000 10000 100000 500000")
+#   BENCH_KINDS  route kinds to test (default: all of them)
+#   MPLS_BENCH_FAKE  when set, use the in-process fake kernel: no root, no namespace
+#
+# Prints one JSON object per line (kind, op, routes, failed, seconds,
+# routes_per_sec, p50_us, p99_us, p999_us, max_us), e.g. to append to a
+# results file and compare between releases.
+
+set -e
+
+BENCH=${1:-./mpls-bench}
+SIZES=${BENCH_SIZES:-"1000 10000 100000 500000"}
+KINDS=${BENCH_KINDS:-"dev next_hop swap_dev swap_next_hop push_dev push_next_hop"}
+
+# The fake kernel keeps its tables in memory and never checks interfaces, so lo will do
+if [ -n "$MPLS_BENCH_FAKE" ]; then
+    status=0
+    for size in $SIZES; do
+        for kind in $KINDS; do
+            "$BENCH" "$kind" "$size" lo 10.255.0.2 || status=1
+        done
+    done
+    exit $status
+fi
+
+# Re-run inside a private network namespace so the host's tables are never touched
+if [ -z "$MPLS_BENCH_NETNS" ]; then
+    exec env MPLS_BENCH_NETNS=1 unshare -n "$0" "$@"
+fi
+
+modprobe mpls_router 2>/dev/null || true
+modprobe mpls_iptunnel 2>/dev/null || true
+if [ ! -w /proc/sys/net/mpls/platform_labels ]; then
+    echo "run_bench.sh: the kernel has no MPLS support (load mpls_router and mpls_iptunnel)" >&2
+    exit 1
+fi
+echo 1048575 > /proc/sys/net/mpls/platform_labels
+
+# One output interface with a connected subnet for the next-hop routes
+ip link set lo up
+ip link add bench0 type dummy 2>/dev/null || ip link add bench0 type veth peer name bench1
+ip link set bench0 up
+ip link show bench1 >/dev/null 2>&1 && ip link set bench1 up
+ip addr add 10.255.0.1/16 dev bench0
+echo 1 > /proc/sys/net/mpls/conf/bench0/input
+
+status=0
+for size in $SIZES; do
+    for kind in $KINDS; do
+        "$BENCH" "$kind" "$size" bench0 10.255.0.2 || status=1
+    done
+done
+exit $status
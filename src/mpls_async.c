@@ -0,0 +1,134 @@
+// mpls_async.c
+
+#include "mpls_async.h"
+#include "mpls_batch.h"
+#include "mpls_core.h"
+
+#define ASYNC_NONE UINT32_MAX
+
+struct async_slot {
+    mpls_async_cb cb;
+    void *cookie;
+    int error;
+    char *detail;   // Copy of the kernel's explanation of a failure, NULL if none
+    uint32_t next;  // Next free slot, or next completed slot
+};
+
+struct mpls_async {
+    struct mpls_session *session;
+    struct mpls_batch *batch;
+    uint32_t free_head;            // Slots not tied to a request
+    uint32_t done_head, done_tail; // Completed requests whose callback has not run, oldest first
+    unsigned int pending;
+    struct async_slot slots[BATCH_WINDOW];
+};
+
+// Function to park the outcome of a request until the next dispatch
+static void async_complete(unsigned long tag, int error, const char *detail, void *arg) {
+    struct mpls_async *async = (struct mpls_async *)arg;
+    struct async_slot *slot = &async->slots[tag];
+
+    slot->error = error;
+    slot->detail = error && detail ? strdup(detail) : NULL;
+    slot->next = ASYNC_NONE;
+    if (async->done_head == ASYNC_NONE) {
+        async->done_head = tag;
+    } else {
+        async->slots[async->done_tail].next = tag;
+    }
+    async->done_tail = tag;
+}
+
+// Function to start asynchronous submission on a session
+struct mpls_async *mpls_async_open(struct mpls_session *session) {
+    struct mpls_async *async = malloc(sizeof(*async));
+    if (!async) return NULL;
+    async->batch = mpls_batch_open(session, async_complete, async);
+    if (!async->batch) {
+        free(async);
+        return NULL;
+    }
+
+    async->session = session;
+    async->done_head = async->done_tail = ASYNC_NONE;
+    async->pending = 0;
+    for (uint32_t i = 0; i < BATCH_WINDOW; i++) async->slots[i].next = i + 1 < BATCH_WINDOW ? i + 1 : ASYNC_NONE;
+    async->free_head = 0;
+    return async;
+}
+
+// Function to return the descriptor to watch
+int mpls_async_fd(const struct mpls_async *async) {
+    return async->session->fd;
+}
+
+// Function to queue one request with its completion callback
+int mpls_async_submit(struct mpls_async *async, const struct mpls_route *route, enum mpls_route_op op,
+                      mpls_async_cb cb, void *cookie) {
+    if (!async->batch) return -ESHUTDOWN;
+    // Out of slots means completions are waiting for a dispatch
+    if (async->free_head == ASYNC_NONE) return -EAGAIN;
+    if (mpls_batch_full(async->batch)) {
+        // Send what is packed and take in the ACKs that are already there, but never wait for more
+        mpls_batch_flush(async->batch);
+        if (mpls_batch_full(async->batch)) return -EAGAIN;
+    }
+
+    uint32_t tag = async->free_head;
+    struct async_slot *slot = &async->slots[tag];
+    async->free_head = slot->next;
+    slot->cb = cb;
+    slot->cookie = cookie;
+    async->pending++;
+    mpls_batch_queue(async->batch, route, op, tag);
+    return 0;
+}
+
+// Function to run the callbacks of every completed request
+static int async_run_callbacks(struct mpls_async *async) {
+    int n = 0;
+    while (async->done_head != ASYNC_NONE) {
+        uint32_t tag = async->done_head;
+        struct async_slot *slot = &async->slots[tag];
+        struct async_slot done = *slot;
+
+        // Free the slot first, so the callback can submit again
+        async->done_head = slot->next;
+        slot->next = async->free_head;
+        async->free_head = tag;
+        async->pending--;
+
+        if (done.cb) done.cb(done.error, done.detail, done.cookie);
+        free(done.detail);
+        n++;
+    }
+    return n;
+}
+
+// Function to send, take in ACKs and run callbacks without blocking
+int mpls_async_dispatch(struct mpls_async *async) {
+    int ret = mpls_batch_flush(async->batch) < 0 ? -EIO : mpls_batch_poll(async->batch);
+    int n = async_run_callbacks(async);
+    if (ret == -ENOBUFS) return ret;
+    return ret < 0 ? -EIO : n;
+}
+
+// Function to settle the requests whose ACKs were dropped, waiting for a dump
+int mpls_async_recover(struct mpls_async *async) {
+    mpls_batch_recover(async->batch);
+    return async_run_callbacks(async);
+}
+
+// Function to count the requests whose callback has not run
+unsigned int mpls_async_pending(const struct mpls_async *async) {
+    return async->pending;
+}
+
+// Function to finish every outstanding request and free the handle
+void mpls_async_close(struct mpls_async *async) {
+    if (!async) return;
+    mpls_batch_finish(async->batch, NULL);
+    async->batch = NULL;
+    async_run_callbacks(async);
+    free(async);
+}
@@ -0,0 +1,119 @@
+/**
+ * @file mpls_async.h
+ * @brief Non-blocking route API for callers that run their own event loop.
+ *
+ * Requests are submitted with a completion callback and a cookie, packed into
+ * shared send buffers and matched to their ACKs by sequence number, so
+ * thousands of routes can be in flight on one socket. The caller watches the
+ * session's file descriptor (poll, epoll, libevent...) and calls
+ * mpls_async_dispatch() when it is readable; callbacks only ever run from
+ * there, never from inside mpls_async_submit().
+ *
+ * Only mpls_async_close() and mpls_async_recover() wait for the kernel.
+ * Submission and dispatch read with MSG_DONTWAIT, and rtnetlink handles each
+ * request inside sendmsg(), so neither sleeps. When the ACK window is full,
+ * submission fails with -EAGAIN instead of blocking. When the kernel drops
+ * ACKs, or link notifications of the session's interface cache, dispatch
+ * returns -ENOBUFS and the caller picks the moment to recover. Until then,
+ * dev routes resolve their interface with if_nametoindex().
+ */
+
+ #ifndef MPLS_ASYNC_H
+ #define MPLS_ASYNC_H
+ 
+ #include "mpls_routes.h"
+ 
+ #pragma GCC visibility push(default)
+ 
+ struct mpls_session;
+ struct mpls_async;
+ 
+ /**
+  * @brief Callback invoked once per submitted request when its outcome is known.
+  * @param error 0 on success, negative errno on failure.
+  * @param detail Kernel's explanation of a failure (see format_mpls_ack()), or NULL.
+  * @param cookie Cookie given to mpls_async_submit().
+  */
+ typedef void (*mpls_async_cb)(int error, const char *detail, void *cookie);
+ 
+ /**
+  * @brief Starts asynchronous submission on an open session.
+  *
+  * The session must not be used for anything else until mpls_async_close().
+  * Setting its ack_errors field first makes the kernel ACK failures only.
+  *
+  * @param session Session the requests are sent on; open it with a large
+  *                socket buffer (e.g. MPLS_SESSION_SOCK_BUF) for a large window.
+  * @return The handle, or NULL if out of memory.
+  */
+ struct mpls_async *mpls_async_open(struct mpls_session *session);
+ 
+ /**
+  * @brief Returns the descriptor to watch for readability.
+  * @param async Handle.
+  * @return File descriptor of the session's Netlink socket.
+  */
+ int mpls_async_fd(const struct mpls_async *async);
+ 
+ /**
+  * @brief Queues one route request.
+  *
+  * Requests are sent by the next mpls_async_dispatch(), or as soon as a send
+  * buffer fills, so a burst of submissions costs one sendmsg() per 64 KB.
+  * A request that cannot be encoded (e.g. an unknown interface) is accepted
+  * and completes with the error on the next dispatch.
+  *
+  * @param async Handle.
+  * @param route Route to encode; copied, so it may be reused at once.
+  * @param op Add, replace or delete.
+  * @param cb Completion callback, may be NULL.
+  * @param cookie User argument for @p cb.
+  * @return 0 if the request was accepted, -EAGAIN if the ACK window is full
+  *         (dispatch, then submit again), -ESHUTDOWN during mpls_async_close().
+  */
+ int mpls_async_submit(struct mpls_async *async, const struct mpls_route *route, enum mpls_route_op op,
+                       mpls_async_cb cb, void *cookie);
+ 
+ /**
+  * @brief Sends the queued requests, takes in the ACKs that have arrived and runs their callbacks.
+  *
+  * Call it after submitting a burst and whenever the descriptor is readable.
+  * Callbacks may submit new requests.
+  *
+  * @param async Handle.
+  * @return Number of callbacks run, -ENOBUFS if the kernel dropped ACKs or
+  *         link notifications (call mpls_async_recover()), or -EIO if the socket failed (the
+  *         affected requests still complete, with the socket error).
+  */
+ int mpls_async_dispatch(struct mpls_async *async);
+ 
+ /**
+  * @brief Settles the requests whose ACKs the kernel dropped and runs their callbacks.
+  *
+  * Blocks for a dump of the tables those requests touched (see
+  * mpls_batch_recover()); until it runs, they stay outstanding.
+  *
+  * @param async Handle.
+  * @return Number of callbacks run.
+  */
+ int mpls_async_recover(struct mpls_async *async);
+ 
+ /**
+  * @brief Returns the number of accepted requests whose callback has not run yet.
+  * @param async Handle.
+  * @return Number of outstanding requests; watch the descriptor while it is non-zero.
+  */
+ unsigned int mpls_async_pending(const struct mpls_async *async);
+ 
+ /**
+  * @brief Sends what is left, waits for every outstanding ACK, runs the remaining callbacks and frees the handle.
+  *
+  * Submitting from a callback run here fails with -ESHUTDOWN.
+  *
+  * @param async Handle, may be NULL.
+  */
+ void mpls_async_close(struct mpls_async *async);
+ 
+ #pragma GCC visibility pop
+ 
+ #endif // MPLS_ASYNC_H
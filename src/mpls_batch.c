@@ -0,0 +1,792 @@
+// mpls_batch.c
+
+#include "mpls_batch.h"
+#include "mpls_core.h"
+#include "mpls_dump.h"
+#include "mpls_ifcache.h"
+#include "mpls_labels.h"
+#include "mpls_netns.h"
+#include "mpls_stats.h"
+#include <pthread.h>
+
+#define BATCH_MAX_ARGS 16
+#define BATCH_ACK_TRUESIZE 1024  // Receive buffer charged per queued ACK (skb overhead included)
+#define BATCH_RECV_SLOT 1024     // Room for one ACK, including an echoed request on error
+#define BATCH_RECV_VLEN (BATCH_BUF_SIZE / BATCH_RECV_SLOT)
+#define BATCH_WINDOW_MIN 16            // Smallest ACK window the flow control shrinks to
+#define BATCH_RETX_SIZE (1024 * 1024)  // Ring of sent requests, kept for retransmission and reconciliation
+#define BATCH_MAX_RETRIES 3            // Retransmissions of one request before its outcome is reported as lost
+#define BATCH_SEND_RETRIES 3           // Attempts at sending a buffer when sendmsg() runs out of memory
+#define BATCH_DUMP_RETRIES 3           // Attempts when the table changes under a reconciliation dump
+#define BATCH_RTT_SLACK_NS 200000      // ACK latency above twice the fastest by more than this is congestion
+#define BATCH_RTT_EPOCH 64             // Latency samples after which the fastest one is measured afresh
+
+struct batch_pending {
+    uint32_t seq;
+    int busy;
+    unsigned long tag;
+    unsigned long retx;  // Position of the request's copy in the retransmit ring
+    int retries;         // Times the request was sent again after its ACK was lost
+    int undone;          // A reconciliation dump saw its route without its change, so the retry makes it
+};
+
+struct mpls_batch {
+    struct mpls_session *session;
+    mpls_batch_result_cb cb;
+    void *arg;
+    struct mpls_batch_stats stats;
+    char sendbuf[BATCH_BUF_SIZE];
+    unsigned int sendlen;
+    uint32_t sendbuf_first_seq;  // Sequence number of the first request in sendbuf
+    unsigned int last_off;       // Offset of the last request in sendbuf
+    int ack_errors;              // Only the last request of each buffer asks for an ACK
+    uint32_t settled;            // Every request before this sequence number has its outcome
+    uint32_t oldest;             // No request before this sequence number awaits an ACK
+    char recvbuf[BATCH_BUF_SIZE];
+    char *retx;                  // Copies of the requests sent, BATCH_RETX_SIZE bytes used as a ring
+    unsigned long retx_head;     // Ring position of the next copy; only grows
+    unsigned int inflight;       // Requests built but not yet acknowledged
+    unsigned int window;         // ACK window, adapted to receive overruns and ACK latency
+    unsigned int window_max;     // Window whose ACKs fit in the receive buffer
+    int overrun;                 // The kernel dropped ACKs, and the requests that lost them are not settled yet
+    int recovering;              // Inside batch_recover()
+    int ifcache_stale;           // The session's interface cache lost notifications and awaits a dump
+    uint32_t rtt_seq;            // Last request of the buffer being timed
+    uint64_t rtt_start;          // When that buffer was sent, 0 if none is being timed
+    uint64_t rtt_min;            // Fastest answer to a buffer in the current epoch
+    uint64_t rtt_min_next;       // Fastest answer since the epoch started, the next baseline
+    unsigned int rtt_samples;
+    struct batch_pending pending[BATCH_WINDOW];
+    struct mpls_route_template templates[MPLS_ROUTE_PUSH_NHID + 1][MPLS_OP_DELETE + 1];  // Last shape per kind and op
+};
+
+// Key of the route a request changes, with the request it was taken from
+struct batch_key {
+    uint8_t family;
+    uint8_t dst_len;
+    uint32_t table;
+    uint32_t dst;      // Label, or IPv4 destination in network byte order
+    uint32_t seq;
+    int found;         // The reconciliation dump holds a route with this key
+    int matches;       // That route forwards the way the request asked for
+};
+
+static void batch_recover(struct mpls_batch *batch);
+
+// Function to refill the session's interface cache after it lost notifications; may block for a link dump
+static void batch_refill_ifcache(struct mpls_batch *batch) {
+    if (batch->ifcache_stale && mpls_ifcache_refresh(batch->session->ifcache) == 0) batch->ifcache_stale = 0;
+}
+
+// Function to record the outcome of a request and hand it to the caller
+static void batch_result(struct mpls_batch *batch, unsigned long tag, int error, const char *detail) {
+    if (error) {
+        batch->stats.failed++;
+    } else {
+        batch->stats.ok++;
+    }
+    if (batch->cb) batch->cb(tag, error, detail, batch->arg);
+}
+
+// Function to tell whether a request still awaits its ACK
+static int batch_busy(const struct mpls_batch *batch, uint32_t seq) {
+    const struct batch_pending *p = &batch->pending[seq % BATCH_WINDOW];
+    return p->busy && p->seq == seq;
+}
+
+// Function to set the ACK window within its bounds
+static void batch_set_window(struct mpls_batch *batch, unsigned int window) {
+    unsigned int min = batch->window_max < BATCH_WINDOW_MIN ? batch->window_max : BATCH_WINDOW_MIN;
+    batch->window = window < min ? min : window > batch->window_max ? batch->window_max : window;
+}
+
+// Function to adapt the ACK window to how long the kernel took to answer the buffer being timed
+static void batch_sample_rtt(struct mpls_batch *batch) {
+    uint64_t rtt = mpls_stats_now() - batch->rtt_start;
+    batch->rtt_start = 0;
+
+    // The baseline is the fastest answer of the last epoch, so a lasting change of pace is not taken for congestion
+    if (!batch->rtt_min || rtt < batch->rtt_min) batch->rtt_min = rtt;
+    if (!batch->rtt_min_next || rtt < batch->rtt_min_next) batch->rtt_min_next = rtt;
+    if (++batch->rtt_samples % BATCH_RTT_EPOCH == 0) {
+        batch->rtt_min = batch->rtt_min_next;
+        batch->rtt_min_next = 0;
+    }
+
+    // Slow answers mean our requests queue behind other rtnetlink work: back off a little, otherwise grow back.
+    // Both steps are multiplicative (1/8), not additive, so a halved window regains its size after about six buffers
+    if (rtt > 2 * batch->rtt_min + BATCH_RTT_SLACK_NS) {
+        batch_set_window(batch, batch->window - batch->window / 8);
+    } else if (batch->window < batch->window_max) {
+        batch_set_window(batch, batch->window + batch->window / 8 + 1);
+    }
+}
+
+// Function to complete a pending request with the kernel's verdict
+static void batch_complete(struct mpls_batch *batch, uint32_t seq, int error, const char *detail) {
+    struct batch_pending *p = &batch->pending[seq % BATCH_WINDOW];
+    if (!p->busy || p->seq != seq) return;  // Not one of ours, or already completed
+
+    p->busy = 0;
+    batch->inflight--;
+    if (batch->rtt_start && seq == batch->rtt_seq) batch_sample_rtt(batch);
+    while (batch->oldest != batch->session->seq && !batch_busy(batch, batch->oldest)) batch->oldest++;
+    batch_result(batch, p->tag, error, detail);
+}
+
+// Function to copy a request into the retransmit ring, returning its position
+static unsigned long batch_keep(struct mpls_batch *batch, const struct nlmsghdr *nlh) {
+    unsigned long pos = batch->retx_head;
+    if (pos % BATCH_RETX_SIZE + nlh->nlmsg_len > BATCH_RETX_SIZE) pos += BATCH_RETX_SIZE - pos % BATCH_RETX_SIZE;
+    memcpy(batch->retx + pos % BATCH_RETX_SIZE, nlh, nlh->nlmsg_len);
+    batch->retx_head = pos + NLMSG_ALIGN(nlh->nlmsg_len);
+    return pos;
+}
+
+// Function to find the copy of a sent request, answered or not, if the ring still holds it
+static struct nlmsghdr *batch_copy(const struct mpls_batch *batch, uint32_t seq) {
+    const struct batch_pending *p = &batch->pending[seq % BATCH_WINDOW];
+    if (p->seq != seq || batch->retx_head - p->retx > BATCH_RETX_SIZE) return NULL;
+    struct nlmsghdr *nlh = (struct nlmsghdr *)(batch->retx + p->retx % BATCH_RETX_SIZE);
+    return nlh->nlmsg_seq == seq ? nlh : NULL;
+}
+
+// Function to apply an ACK or error message to the request it answers
+static void batch_answer(struct mpls_batch *batch, const struct nlmsghdr *nlh) {
+    struct mpls_ack ack;
+    uint32_t seq = nlh->nlmsg_seq;
+    mpls_parse_ack(nlh, &ack);
+    MPLS_STAT_ACK(ack.error);
+
+    // Answers come in request order, so requests sent before this one without an error succeeded,
+    // unless answers were dropped: the requests around the gap are then settled by batch_reconcile()
+    if (batch->ack_errors && !batch->recovering && !batch->overrun) {
+        for (; batch->settled != seq && seq - batch->settled < BATCH_WINDOW; batch->settled++) {
+            batch_complete(batch, batch->settled, 0, NULL);
+        }
+        if (batch->settled == seq) batch->settled++;
+    }
+
+    char detail[MPLS_ERR_MSG_MAX];
+    if (ack.error && batch_busy(batch, seq) &&
+        format_mpls_ack(&ack, batch_copy(batch, seq), detail, sizeof(detail)) > 0) {
+        batch_complete(batch, seq, ack.error, detail);
+    } else {
+        batch_complete(batch, seq, ack.error, NULL);
+    }
+}
+
+// Function to fail every request that is still awaiting an ACK
+static void batch_fail_pending(struct mpls_batch *batch, int error) {
+    for (unsigned int i = 0; i < BATCH_WINDOW; i++) {
+        if (batch->pending[i].busy) batch_complete(batch, batch->pending[i].seq, error, NULL);
+    }
+}
+
+// Function to read and match whatever ACKs are available; blocks for the first one if 'wait' is set
+static int batch_recv_acks(struct mpls_batch *batch, int wait) {
+    struct mmsghdr msgs[BATCH_RECV_VLEN];
+    struct iovec iov[BATCH_RECV_VLEN];
+
+    // Lost ACKs never arrive, so a caller that is about to wait settles them first
+    int blocking = wait;
+    if (blocking) batch_refill_ifcache(batch);
+    if (blocking && batch->overrun && !batch->recovering) {
+        batch_recover(batch);
+        return 0;
+    }
+
+    // Every ACK is its own datagram, so pull up to BATCH_RECV_VLEN of them per syscall
+    for (;;) {
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < BATCH_RECV_VLEN; i++) {
+            iov[i].iov_base = batch->recvbuf + i * BATCH_RECV_SLOT;
+            iov[i].iov_len = BATCH_RECV_SLOT;
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        MPLS_STAT_TIME_START(start);
+        int n = mpls_session_recvmmsg(batch->session, msgs, BATCH_RECV_VLEN, wait ? MSG_WAITFORONE : MSG_DONTWAIT);
+        if (wait) MPLS_STAT_TIME_END(MPLS_HIST_ACK_WAIT, start);
+        if (n < 0 && errno == ENOBUFS) {
+            // ACKs were dropped, but those still queued are intact: read on, then settle what is missing
+            // Settling takes a dump, so non-blocking callers leave it to mpls_batch_recover()
+            MPLS_STAT_ERRNO(errno);
+            MPLS_STAT_ADD(MPLS_STAT_ENOBUFS, 1);
+            batch->overrun = 1;
+            if (batch->recovering || !blocking) continue;
+            batch_recover(batch);
+            return 0;
+        }
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+            MPLS_STAT_ERRNO(errno);
+            int error = -errno;
+            batch_fail_pending(batch, error);
+            return error;
+        }
+
+        MPLS_STAT_ADD(MPLS_STAT_RECV_CALLS, 1);
+        MPLS_STAT_ADD(MPLS_STAT_RECV_MESSAGES, n);
+        for (int i = 0; i < n; i++) {
+            int len = msgs[i].msg_len;
+            MPLS_STAT_ADD(MPLS_STAT_RECV_BYTES, len);
+            for (struct nlmsghdr *nlh = iov[i].iov_base; NLMSG_OK(nlh, (unsigned int)len); nlh = NLMSG_NEXT(nlh, len)) {
+                if (nlh->nlmsg_type == NLMSG_ERROR) batch_answer(batch, nlh);
+            }
+        }
+        if (n < BATCH_RECV_VLEN) return 0;
+        wait = 0;
+    }
+}
+
+// Function to take the key of the route a dumped route or a request is about
+static int batch_entry_key(const struct mpls_route_entry *entry, uint32_t seq, struct batch_key *key) {
+    memset(key, 0, sizeof(*key));
+    key->family = entry->rtm->rtm_family;
+    key->dst_len = entry->rtm->rtm_dst_len;
+    key->table = entry->tb[RTA_TABLE] ? *(const uint32_t *)RTA_DATA(entry->tb[RTA_TABLE]) : entry->rtm->rtm_table;
+    if (key->table == RT_TABLE_UNSPEC) key->table = RT_TABLE_MAIN;
+    key->seq = seq;
+
+    const struct rtattr *dst = entry->tb[RTA_DST];
+    if (key->family == AF_MPLS) return mpls_entry_labels(dst, &key->dst, 1) == 1 ? 0 : -1;
+    if (key->family != AF_INET) return -1;
+    if (dst && RTA_PAYLOAD(dst) >= sizeof(key->dst)) memcpy(&key->dst, RTA_DATA(dst), sizeof(key->dst));
+    return 0;
+}
+
+// Function to order keys by route
+static int batch_key_route_cmp(const void *a, const void *b) {
+    const struct batch_key *x = (const struct batch_key *)a, *y = (const struct batch_key *)b;
+    if (x->family != y->family) return x->family < y->family ? -1 : 1;
+    if (x->table != y->table) return x->table < y->table ? -1 : 1;
+    if (x->dst != y->dst) return x->dst < y->dst ? -1 : 1;
+    if (x->dst_len != y->dst_len) return x->dst_len < y->dst_len ? -1 : 1;
+    return 0;
+}
+
+// Function to order keys by route, then by the order the requests were sent in
+static int batch_key_cmp(const void *a, const void *b) {
+    int ret = batch_key_route_cmp(a, b);
+    if (ret) return ret;
+    uint32_t x = ((const struct batch_key *)a)->seq, y = ((const struct batch_key *)b)->seq;
+    return x == y ? 0 : (int32_t)(x - y) < 0 ? -1 : 1;
+}
+
+// Function to tell whether a dumped route forwards the way a request asked for
+static int batch_entry_matches(const struct nlmsghdr *req, const struct mpls_route_entry *kernel) {
+    struct mpls_route_entry want;
+    struct mpls_entry_nexthop a[MPLS_MAX_NEXTHOPS], b[MPLS_MAX_NEXTHOPS];
+    if (mpls_route_entry_parse(req, &want) < 0) return 0;
+    if (want.rtm->rtm_type != RTN_UNSPEC && want.rtm->rtm_type != kernel->rtm->rtm_type) return 0;
+    if (mpls_entry_nhid(&want) || mpls_entry_nhid(kernel)) return mpls_entry_nhid(&want) == mpls_entry_nhid(kernel);
+
+    int n = mpls_entry_nexthops(&want, a, MPLS_MAX_NEXTHOPS);
+    if (n != mpls_entry_nexthops(kernel, b, MPLS_MAX_NEXTHOPS)) return 0;
+    for (int i = 0; i < n; i++) {
+        // A request may leave the interface of a gateway for the kernel to find
+        if ((a[i].ifindex && a[i].ifindex != b[i].ifindex) || a[i].has_via != b[i].has_via ||
+            (a[i].has_via && a[i].via.s_addr != b[i].via.s_addr) || a[i].weight != b[i].weight ||
+            a[i].ttl != b[i].ttl || a[i].nlabels != b[i].nlabels ||
+            memcmp(a[i].labels, b[i].labels, a[i].nlabels * sizeof(a[i].labels[0]))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+struct batch_reconcile {
+    struct mpls_batch *batch;
+    struct batch_key *want;  // One key per route to check, sorted by route
+    size_t nwant;
+};
+
+// Function to check a dumped route against the request that lost its ACK for the same route
+static int batch_reconcile_visit(const struct mpls_route_entry *entry, void *arg) {
+    struct batch_reconcile *ctx = (struct batch_reconcile *)arg;
+    struct batch_key key;
+    if (batch_entry_key(entry, 0, &key) < 0) return 0;
+
+    struct batch_key *want = bsearch(&key, ctx->want, ctx->nwant, sizeof(key), batch_key_route_cmp);
+    if (!want) return 0;
+    const struct nlmsghdr *req = batch_copy(ctx->batch, want->seq);
+    want->found = 1;
+    want->matches = req && batch_entry_matches(req, entry);
+    return 0;
+}
+
+// Function to dump the tables that hold the routes to check, again if they change under the dump
+static int batch_reconcile_dump(struct batch_reconcile *ctx, int mpls, int inet) {
+    int ret = -EINTR;
+    for (int attempt = 0; attempt < BATCH_DUMP_RETRIES && ret == -EINTR; attempt++) {
+        if (attempt) MPLS_STAT_ADD(MPLS_STAT_DUMP_RETRIES, 1);
+        for (size_t i = 0; i < ctx->nwant; i++) ctx->want[i].found = ctx->want[i].matches = 0;
+        ret = mpls ? mpls_dump_routes(ctx->batch->session, AF_MPLS, batch_reconcile_visit, ctx) : 0;
+        if (ret == 0 && inet) ret = mpls_dump_routes(ctx->batch->session, AF_INET, batch_reconcile_visit, ctx);
+    }
+    return ret;
+}
+
+// Function to send a request that lost its ACK once more, this time asking for an ACK of its own
+static void batch_retransmit(struct mpls_batch *batch, uint32_t seq) {
+    struct nlmsghdr *nlh = batch_copy(batch, seq);
+    batch->pending[seq % BATCH_WINDOW].retries++;
+    nlh->nlmsg_flags |= NLM_F_ACK;
+    MPLS_STAT_ADD(MPLS_STAT_RETRANSMITS, 1);
+    int ret = mpls_session_send(batch->session, nlh, nlh->nlmsg_len);
+    if (ret < 0) batch_complete(batch, seq, ret, NULL);
+}
+
+// Function to settle the sent requests that have no answer by looking at the routes they change
+static void batch_reconcile(struct mpls_batch *batch) {
+    static const char superseded[] = "ACK lost in a receive overrun, and a later request changed the same route";
+    static const char lost[] = "ACK lost in a receive overrun";
+    static const char unknown[] = "ACK lost in a receive overrun, and the route may have been in the requested state before";
+    uint32_t end = batch->sendlen ? batch->sendbuf_first_seq : batch->session->seq;
+    if (!batch->inflight || batch->oldest == end) return;
+
+    // Answers to retransmitted requests say nothing about the requests sent around them
+    if (batch->ack_errors) batch->settled = end;
+
+    struct batch_key *keys = malloc(2 * BATCH_WINDOW * sizeof(*keys));
+    if (!keys) {
+        for (uint32_t seq = batch->oldest; seq != end; seq++) batch_complete(batch, seq, -ENOMEM, NULL);
+        return;
+    }
+    struct batch_reconcile ctx = {batch, keys + BATCH_WINDOW, 0};
+
+    // Every request still held, answered or not, so that one followed by another for the same route is spotted
+    size_t nkeys = 0;
+    for (uint32_t seq = batch->oldest; seq != end; seq++) {
+        struct mpls_route_entry entry;
+        const struct nlmsghdr *nlh = batch_copy(batch, seq);
+        if (!nlh) {
+            batch_complete(batch, seq, -ENOBUFS, lost);  // Only gaps in the sequence, which belong to no request
+            continue;
+        }
+        if ((nlh->nlmsg_type != RTM_NEWROUTE && nlh->nlmsg_type != RTM_DELROUTE) ||
+            mpls_route_entry_parse(nlh, &entry) < 0 || batch_entry_key(&entry, seq, &keys[nkeys]) < 0) {
+            batch_complete(batch, seq, -ENOBUFS, lost);
+            continue;
+        }
+        nkeys++;
+    }
+    qsort(keys, nkeys, sizeof(*keys), batch_key_cmp);
+
+    // The state of a route tells the fate of the last request for it only
+    int mpls = 0, inet = 0;
+    for (size_t i = 0; i < nkeys; i++) {
+        uint32_t seq = keys[i].seq;
+        if (!batch_busy(batch, seq)) continue;
+        if (i + 1 < nkeys && batch_key_route_cmp(&keys[i], &keys[i + 1]) == 0) {
+            batch_complete(batch, seq, -ENOBUFS, superseded);
+        } else if (batch->pending[seq % BATCH_WINDOW].retries >= BATCH_MAX_RETRIES) {
+            batch_complete(batch, seq, -ENOBUFS, lost);
+        } else {
+            ctx.want[ctx.nwant++] = keys[i];
+            mpls |= keys[i].family == AF_MPLS;
+            inet |= keys[i].family == AF_INET;
+        }
+    }
+
+    if (ctx.nwant && batch_reconcile_dump(&ctx, mpls, inet) < 0) {
+        for (size_t i = 0; i < ctx.nwant; i++) batch_complete(batch, ctx.want[i].seq, -ENOBUFS, lost);
+        ctx.nwant = 0;
+    }
+
+    // A request the tables already reflect succeeded, unless it would have failed on that state as well:
+    // an exclusive add of a route that exists, or a delete of an IPv4 route that does not (the kernel forgives
+    // a missing label), is only known to have made the change if an earlier dump saw the route without it.
+    // Any other request is sent again, a window at a time
+    unsigned int sent = 0;
+    for (size_t i = 0; i < ctx.nwant; i++) {
+        const struct batch_key *want = &ctx.want[i];
+        const struct nlmsghdr *req = batch_copy(batch, want->seq);
+        struct batch_pending *p = &batch->pending[want->seq % BATCH_WINDOW];
+        int del = req->nlmsg_type == RTM_DELROUTE;
+        if (del ? !want->found : want->matches) {
+            if ((del ? want->family != AF_MPLS : (req->nlmsg_flags & NLM_F_EXCL) != 0) && !p->undone) {
+                batch_complete(batch, want->seq, -ENOBUFS, unknown);
+                continue;
+            }
+            MPLS_STAT_ADD(MPLS_STAT_RECONCILED, 1);
+            batch_complete(batch, want->seq, 0, NULL);
+            continue;
+        }
+        p->undone = del || !want->found;
+        batch_retransmit(batch, want->seq);
+        if (++sent % batch->window == 0) batch_recv_acks(batch, 0);
+    }
+    if (sent) batch_recv_acks(batch, 0);
+    free(keys);
+}
+
+// Function to settle the requests whose ACKs the kernel dropped, and slow down so it happens less
+static void batch_recover(struct mpls_batch *batch) {
+    batch_set_window(batch, batch->window / 2);
+    batch->rtt_start = 0;  // The buffer being timed may have lost its ACK
+    batch->recovering = 1;
+    while (batch->overrun) {
+        batch->overrun = 0;
+        // rtnetlink answers inside sendmsg(), so once the queue is drained, a sent request without an answer lost it
+        batch_recv_acks(batch, 0);
+        if (!batch->overrun) batch_reconcile(batch);
+    }
+    batch->recovering = 0;
+}
+
+// Function to send the packed requests and pick up the ACKs they produced
+int mpls_batch_flush(struct mpls_batch *batch) {
+    if (batch->sendlen == 0) return 0;
+
+    // Pick up link changes once per buffer so later routes resolve against current names
+    // Refilling a cache that lost notifications takes a dump, so that is left to a caller that may block
+    if (batch->session->ifcache && mpls_ifcache_poll(batch->session->ifcache) == -ENOBUFS) batch->ifcache_stale = 1;
+
+    // The last request's ACK tells when the kernel is done with the whole buffer
+    struct nlmsghdr *last = (struct nlmsghdr *)(batch->sendbuf + batch->last_off);
+    if (batch->ack_errors) last->nlmsg_flags |= NLM_F_ACK;
+
+    // A sendmsg() that ran out of memory delivered nothing: read what is queued, shrink the window and try again
+    // The clock starts before the send: rtnetlink does its work for the whole buffer inside sendmsg()
+    uint32_t count = last->nlmsg_seq + 1 - batch->sendbuf_first_seq;
+    uint64_t start = mpls_stats_now();
+    int ret = mpls_session_send(batch->session, batch->sendbuf, batch->sendlen);
+    for (int attempt = 1; attempt < BATCH_SEND_RETRIES && (ret == -ENOBUFS || ret == -ENOMEM); attempt++) {
+        MPLS_STAT_ADD(MPLS_STAT_RETRANSMITS, count);
+        batch_set_window(batch, batch->window / 2);
+        batch_recv_acks(batch, 0);
+        start = mpls_stats_now();
+        ret = mpls_session_send(batch->session, batch->sendbuf, batch->sendlen);
+    }
+    batch->sendlen = 0;
+    if (ret < 0) {
+        for (uint32_t seq = batch->sendbuf_first_seq; seq != batch->sendbuf_first_seq + count; seq++) {
+            batch_complete(batch, seq, ret, NULL);
+        }
+        return ret;
+    }
+
+    // Time one buffer at a time, from the send to the ACK of its last request
+    if (!batch->rtt_start) {
+        batch->rtt_seq = last->nlmsg_seq;
+        batch->rtt_start = start;
+    }
+
+    // rtnetlink handles the whole buffer inside sendmsg(), so the ACKs are queued by now
+    return batch_recv_acks(batch, 0);
+}
+
+// Function to encode a request, from the template of its kind when the shape matches
+static int batch_build(struct mpls_batch *batch, struct nlmsghdr *nlh, unsigned int maxlen,
+                       const struct mpls_route *route, enum mpls_route_op op) {
+    struct mpls_ifcache *ifcache = batch->session->ifcache;
+    if (route->kind == MPLS_ROUTE_MULTIPATH) return build_mpls_route(nlh, maxlen, route, op, ifcache);
+
+    struct mpls_route_template *tmpl = &batch->templates[route->kind][op];
+    if (!mpls_route_template_matches(tmpl, route, op)) {
+        int ret = mpls_route_template_init(tmpl, route, op, ifcache);
+        if (ret < 0) return ret;
+    }
+    return mpls_route_template_fill(tmpl, nlh, maxlen, route, ifcache);
+}
+
+// Function to check whether another request may be put in flight
+static int batch_must_wait(const struct mpls_batch *batch) {
+    if (batch->inflight >= batch->window || batch->pending[batch->session->seq % BATCH_WINDOW].busy) return 1;
+
+    // The copy of the oldest request in flight must stay in the ring until it is answered
+    const struct batch_pending *oldest = &batch->pending[batch->oldest % BATCH_WINDOW];
+    return batch->inflight && batch->retx_head + 2 * MPLS_ROUTE_MSG_MAX - oldest->retx > BATCH_RETX_SIZE;
+}
+
+// Function to start a pipelined batch on an open session
+struct mpls_batch *mpls_batch_open(struct mpls_session *session, mpls_batch_result_cb cb, void *arg) {
+    struct mpls_batch *batch = calloc(1, sizeof(*batch));
+    if (!batch) return NULL;
+    batch->retx = malloc(BATCH_RETX_SIZE);
+    if (!batch->retx) {
+        free(batch);
+        return NULL;
+    }
+    batch->session = session;
+    batch->cb = cb;
+    batch->arg = arg;
+    batch->ack_errors = session->ack_errors;
+
+    // Bound the ACKs in flight so they always fit in the receive buffer
+    batch->window_max = session->rcvbuf / BATCH_ACK_TRUESIZE;
+    if (batch->window_max > BATCH_WINDOW) batch->window_max = BATCH_WINDOW;
+    if (batch->window_max < 1) batch->window_max = 1;
+    batch->window = batch->window_max;
+    return batch;
+}
+
+// Function to make room for one more request: a free slot in the ACK window and MPLS_ROUTE_MSG_MAX of buffer
+static void batch_reserve(struct mpls_batch *batch) {
+    // A later request for the same route would hide the fate of one that lost its ACK, so settle those first
+    if (batch->overrun) batch_recover(batch);
+    if (BATCH_BUF_SIZE - batch->sendlen < MPLS_ROUTE_MSG_MAX) {
+        mpls_batch_flush(batch);
+    }
+    if (batch_must_wait(batch)) {
+        mpls_batch_flush(batch);
+        while (batch_must_wait(batch) && batch_recv_acks(batch, 1) == 0)
+            ;
+    }
+}
+
+// Function to put the request just written at the end of the send buffer in flight
+static void batch_commit(struct mpls_batch *batch, struct nlmsghdr *nlh, unsigned long tag) {
+    if (batch->ack_errors) nlh->nlmsg_flags &= ~NLM_F_ACK;
+
+    uint32_t seq = mpls_session_stamp(batch->session, nlh);
+    if (batch->sendlen == 0) batch->sendbuf_first_seq = seq;
+    if (batch->inflight == 0) batch->settled = batch->oldest = seq;
+    batch->pending[seq % BATCH_WINDOW] = (struct batch_pending){seq, 1, tag, batch_keep(batch, nlh), 0, 0};
+    batch->inflight++;
+    batch->last_off = batch->sendlen;
+    batch->sendlen += NLMSG_ALIGN(nlh->nlmsg_len);
+}
+
+// Function to append one route request to the send buffer
+void mpls_batch_queue(struct mpls_batch *batch, const struct mpls_route *route, enum mpls_route_op op, unsigned long tag) {
+    batch->stats.routes++;
+    batch_reserve(batch);
+
+    struct nlmsghdr *nlh = (struct nlmsghdr *)(batch->sendbuf + batch->sendlen);
+    int ret = batch_build(batch, nlh, BATCH_BUF_SIZE - batch->sendlen, route, op);
+    if (ret < 0) {
+        batch_result(batch, tag, ret, NULL);
+        return;
+    }
+    batch_commit(batch, nlh, tag);
+}
+
+// Function to append an already encoded request to the send buffer
+void mpls_batch_queue_msg(struct mpls_batch *batch, const struct nlmsghdr *msg, unsigned long tag) {
+    batch->stats.routes++;
+    if (msg->nlmsg_len < NLMSG_HDRLEN || msg->nlmsg_len > MPLS_ROUTE_MSG_MAX) {
+        batch_result(batch, tag, -EMSGSIZE, NULL);
+        return;
+    }
+    batch_reserve(batch);
+
+    struct nlmsghdr *nlh = (struct nlmsghdr *)(batch->sendbuf + batch->sendlen);
+    memcpy(nlh, msg, msg->nlmsg_len);
+    nlh->nlmsg_flags |= NLM_F_ACK;
+    batch_commit(batch, nlh, tag);
+}
+
+// Function to record a request that never made it into the batch
+void mpls_batch_reject(struct mpls_batch *batch, unsigned long tag, int error) {
+    batch->stats.routes++;
+    batch_result(batch, tag, error, NULL);
+}
+
+// Function to pick up whatever ACKs have arrived, without blocking
+int mpls_batch_poll(struct mpls_batch *batch) {
+    int ret = batch_recv_acks(batch, 0);
+    return ret == 0 && (batch->overrun || batch->ifcache_stale) ? -ENOBUFS : ret;
+}
+
+// Function to settle the requests whose ACKs a receive overrun dropped, and refill a stale interface cache
+void mpls_batch_recover(struct mpls_batch *batch) {
+    if (batch->overrun) batch_recover(batch);
+    batch_refill_ifcache(batch);
+}
+
+// Function to tell whether queueing would block on the ACK window
+int mpls_batch_full(const struct mpls_batch *batch) {
+    return batch->overrun || batch_must_wait(batch);
+}
+
+// Function to count the requests still waiting for an ACK
+unsigned int mpls_batch_inflight(const struct mpls_batch *batch) {
+    return batch->inflight;
+}
+
+// Function to send the tail of a batch and wait for every outstanding ACK
+int mpls_batch_finish(struct mpls_batch *batch, struct mpls_batch_stats *stats) {
+    mpls_batch_flush(batch);
+    while (batch->inflight > 0) {
+        if (batch_recv_acks(batch, 1) < 0) break;
+    }
+
+    int ret = batch->stats.failed ? -1 : 0;
+    if (stats) *stats = batch->stats;
+    free(batch->retx);
+    free(batch);
+    return ret;
+}
+
+struct batch_input {
+    const char *name;
+    const char *reason;    // Parser diagnostic for the request being rejected
+    pthread_mutex_t lock;  // Namespace workers report from their own threads
+};
+
+// Function to print the diagnostic of a failed input line
+static void batch_print_failure(const struct batch_input *input, unsigned long line, int error, const char *reason,
+                                const char *detail) {
+    if (!reason) reason = error == -ENODEV && !detail ? "no such interface" : strerror(-error);
+    fprintf(stderr, "%s:%lu: %s%s%s\n", input->name, line, reason, detail ? ": " : "", detail ? detail : "");
+}
+
+// Function to report a failed input line
+static void batch_report(unsigned long line, int error, const char *detail, void *arg) {
+    struct batch_input *input = (struct batch_input *)arg;
+    if (!error) return;
+
+    pthread_mutex_lock(&input->lock);
+    batch_print_failure(input, line, error, input->reason, detail);
+    input->reason = NULL;
+    pthread_mutex_unlock(&input->lock);
+}
+
+// Function to report a failed input line from a namespace worker
+static void batch_report_netns(unsigned long line, int error, const char *detail, void *arg) {
+    struct batch_input *input = (struct batch_input *)arg;
+    if (!error) return;
+
+    // The parser diagnostic belongs to the producer thread, so it is never used here
+    pthread_mutex_lock(&input->lock);
+    batch_print_failure(input, line, error, NULL, detail);
+    pthread_mutex_unlock(&input->lock);
+}
+
+struct batch_labels {
+    struct mpls_labels *map;  // Labels of the LFIB plus those taken by earlier lines
+    int loaded;               // 1 once the LFIB was read, negative errno if that failed
+    const char *range;        // MPLS_LABEL_RANGE as given
+};
+
+// Function to keep the label of an explicit add or replace line away from "auto" lines
+static void batch_note_label(struct batch_labels *labels, const struct mpls_route *route, enum mpls_route_op op) {
+    if (!labels->map || op == MPLS_OP_DELETE || mpls_route_is_push(route)) return;
+    mpls_labels_reserve(labels->map, route->label);
+}
+
+// Function to choose the label of an "add_for auto" line, reading the LFIB on first use
+static int batch_pick_label(struct batch_labels *labels, struct mpls_route *route, const char **reason) {
+    if (!labels->map) {
+        uint32_t first, last;
+        if (mpls_labels_parse_range(labels->range, &first, &last) == 0) return -ENOMEM;
+        *reason = "MPLS_LABEL_RANGE must be first-last within 16-1048575";
+        return -EINVAL;
+    }
+    if (!labels->loaded) {
+        // A separate socket, so the dump does not interleave with the ACKs of this batch
+        struct mpls_session dump;
+        int ret = mpls_session_open(&dump, MPLS_SESSION_SOCK_BUF);
+        if (ret == 0) {
+            ret = mpls_labels_load(labels->map, &dump);
+            mpls_session_close(&dump);
+        }
+        labels->loaded = ret < 0 ? ret : 1;
+    }
+    if (labels->loaded < 0) {
+        *reason = "cannot read the kernel's labels";
+        return labels->loaded;
+    }
+
+    int ret = mpls_labels_alloc(labels->map, &route->label);
+    if (ret < 0) {
+        *reason = "no free label left in MPLS_LABEL_RANGE";
+        return ret;
+    }
+    route->auto_label = 0;
+    return 0;
+}
+
+// Function to install all routes listed in a stream over one session
+int mpls_batch_run(struct mpls_session *session, FILE *in, const char *name, struct mpls_batch_stats *stats) {
+    struct batch_input input = {name, NULL, PTHREAD_MUTEX_INITIALIZER};
+    struct mpls_netns_pool *pool = NULL;  // Started by the first "netns" line
+    struct batch_labels labels = {NULL, 0, getenv(MPLS_LABEL_RANGE_ENV)};
+    uint32_t first, last;
+    if (mpls_labels_parse_range(labels.range, &first, &last) == 0) labels.map = mpls_labels_open(first, last);
+    struct mpls_batch *batch = mpls_batch_open(session, batch_report, &input);
+    if (!batch) {
+        perror("calloc");
+        memset(stats, 0, sizeof(*stats));
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    unsigned long lineno = 0;
+    while (getline(&line, &cap, in) != -1) {
+        lineno++;
+        char *args[BATCH_MAX_ARGS];
+        char **argv = args;
+        int argc = mpls_split_route_args(line, args, BATCH_MAX_ARGS);
+        if (argc == 0 || (argc > 0 && argv[0][0] == '#')) continue;
+
+        enum mpls_route_op op;
+        struct mpls_route route;
+        if (argc < 0) {
+            input.reason = "too many arguments";
+            mpls_batch_reject(batch, lineno, -EINVAL);
+            continue;
+        }
+
+        // "netns [name] add_for ..." targets a named namespace instead of the current one
+        const char *netns = NULL;
+        if (strcmp(argv[0], "netns") == 0) {
+            if (argc < 2) {
+                input.reason = "netns expects a namespace name";
+                mpls_batch_reject(batch, lineno, -EINVAL);
+                continue;
+            }
+            netns = argv[1];
+            argv += 2;
+            argc -= 2;
+        }
+        if (parse_mpls_command(argc, argv, &op, &route, &input.reason) < 0) {
+            mpls_batch_reject(batch, lineno, -EINVAL);
+            continue;
+        }
+        if (route.auto_label && (op == MPLS_OP_DELETE || netns)) {
+            input.reason = netns ? "auto labels are not supported with netns" : "del needs an explicit label";
+            mpls_batch_reject(batch, lineno, -EINVAL);
+            continue;
+        }
+        if (route.auto_label) {
+            int ret = batch_pick_label(&labels, &route, &input.reason);
+            if (ret < 0) {
+                mpls_batch_reject(batch, lineno, ret);
+                continue;
+            }
+            printf("%s:%lu: label %u\n", name, lineno, route.label);
+        } else if (!netns) {
+            batch_note_label(&labels, &route, op);
+        }
+        if (!netns) {
+            mpls_batch_queue(batch, &route, op, lineno);
+            continue;
+        }
+
+        if (!pool) pool = mpls_netns_pool_open(session->ack_errors, batch_report_netns, &input);
+        int ret = pool ? mpls_netns_pool_queue(pool, netns, &route, op, lineno) : -ENOMEM;
+        if (ret < 0) {
+            input.reason = ret == -EMFILE ? "too many namespaces" : NULL;
+            mpls_batch_reject(batch, lineno, ret);
+        }
+    }
+    free(line);
+
+    int ret = mpls_batch_finish(batch, stats);
+    if (pool) {
+        struct mpls_batch_stats netns_stats;
+        if (mpls_netns_pool_finish(pool, &netns_stats) < 0) ret = -1;
+        stats->routes += netns_stats.routes;
+        stats->ok += netns_stats.ok;
+        stats->failed += netns_stats.failed;
+    }
+    mpls_labels_close(labels.map);
+    pthread_mutex_destroy(&input.lock);
+    return ret;
+}
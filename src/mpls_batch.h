@@ -0,0 +1,178 @@
+/**
+ * @file mpls_batch.h
+ * @brief Bulk installation of MPLS routes over a single Netlink session.
+ *
+ * Requests are packed back to back into large send buffers with unique sequence
+ * numbers, and their acknowledgements are matched back to the caller's tags as
+ * they arrive, so throughput is bound by the kernel rather than by syscalls.
+ *
+ * On a session with ack_errors set, only the last request of each send buffer
+ * asks for an ACK. The kernel still answers every failed request, and it
+ * answers in order, so the ACK of the last request settles every earlier
+ * request that got no error.
+ *
+ * The window of requests awaiting an ACK shrinks when the kernel drops ACKs
+ * (ENOBUFS) or answers slowly, and grows back while it keeps up. Requests
+ * whose ACK was dropped are checked against a dump of their table: those
+ * whose effect is visible succeeded, the others are sent again. Calls that
+ * wait anyway (queueing into a full window, finishing) do this by
+ * themselves; after the non-blocking ones, it takes mpls_batch_recover().
+ */
+
+ #ifndef MPLS_BATCH_H
+ #define MPLS_BATCH_H
+ 
+ #include <stdio.h>
+ #include "mpls_routes.h"
+ 
+ #pragma GCC visibility push(default)
+ 
+ struct mpls_session;
+ struct mpls_batch;
+ 
+ #define BATCH_BUF_SIZE (64 * 1024)  /**< Bytes of requests packed into one sendmsg(). */
+ #define BATCH_WINDOW 4096           /**< Largest window of requests awaiting an ACK. */
+ 
+ /**
+  * @brief Outcome counters of a batch run.
+  */
+ struct mpls_batch_stats {
+     unsigned long routes;  /**< Requests submitted (including ones that failed to parse or build). */
+     unsigned long ok;      /**< Requests acknowledged without error. */
+     unsigned long failed;  /**< Requests rejected by the parser, the builder or the kernel. */
+ };
+ 
+ /**
+  * @brief Callback invoked once per queued request when its outcome is known.
+  * @param tag Tag given to mpls_batch_queue().
+  * @param error 0 on success, negative errno on failure.
+  * @param detail Kernel's explanation of a failure (see format_mpls_ack()), or NULL.
+  * @param arg User argument given to mpls_batch_open().
+  */
+ typedef void (*mpls_batch_result_cb)(unsigned long tag, int error, const char *detail, void *arg);
+ 
+ /**
+  * @brief Starts a pipelined batch on an open session.
+  * @param session Session the requests are sent on; open it with a large
+  *                socket buffer (e.g. MPLS_SESSION_SOCK_BUF) for throughput.
+  * @param cb Result callback, may be NULL.
+  * @param arg User argument for @p cb.
+  * @return The batch, or NULL if out of memory.
+  */
+ struct mpls_batch *mpls_batch_open(struct mpls_session *session, mpls_batch_result_cb cb, void *arg);
+ 
+ /**
+  * @brief Queues one route request; sends when the buffer or ACK window is full.
+  *
+  * If the request cannot be built, the callback is invoked immediately.
+  *
+  * @param batch Batch to queue on.
+  * @param route Route to encode.
+  * @param op Add, replace or delete.
+  * @param tag Caller's identifier for the request, passed back to the callback.
+  */
+ void mpls_batch_queue(struct mpls_batch *batch, const struct mpls_route *route, enum mpls_route_op op, unsigned long tag);
+ 
+ /**
+  * @brief Queues a request that was encoded in advance, e.g. with build_mpls_route().
+  *
+  * The request is copied and stamped with the session's next sequence number,
+  * so one encoding can be sent any number of times. Keeping requests encoded
+  * ahead of time takes the encoder off the latency-critical path.
+  *
+  * @param batch Batch to queue on.
+  * @param msg Encoded request of at most MPLS_ROUTE_MSG_MAX bytes.
+  * @param tag Caller's identifier for the request, passed back to the callback.
+  */
+ void mpls_batch_queue_msg(struct mpls_batch *batch, const struct nlmsghdr *msg, unsigned long tag);
+ 
+ /**
+  * @brief Records a request that failed before it could be queued (e.g. a parse error).
+  * @param batch Batch the request belongs to.
+  * @param tag Caller's identifier for the request.
+  * @param error Negative errno passed to the callback.
+  */
+ void mpls_batch_reject(struct mpls_batch *batch, unsigned long tag, int error);
+ 
+ /**
+  * @brief Sends the queued requests now and handles the ACKs that are already available.
+  *
+  * Does not wait for ACKs that have not arrived; long-running callers use this
+  * to send everything they have collected in one go. It applies pending link
+  * notifications to the session's interface cache, but leaves the dump that
+  * refills a cache which lost some to a call that blocks. ACKs or link
+  * notifications it finds dropped are reported by the next mpls_batch_poll().
+  *
+  * @param batch Batch to flush.
+  * @return 0 on success, negative errno if sending or receiving failed (affected requests are reported as failed).
+  */
+ int mpls_batch_flush(struct mpls_batch *batch);
+ 
+ /**
+  * @brief Handles the ACKs that have arrived on the session, without blocking.
+  * @param batch Batch to poll.
+  * @return 0 on success, -ENOBUFS if the kernel dropped ACKs (the requests
+  *         that lost them stay in flight until mpls_batch_recover()) or link
+  *         notifications of the session's interface cache, other
+  *         negative errno if receiving failed (pending requests are reported as failed).
+  */
+ int mpls_batch_poll(struct mpls_batch *batch);
+ 
+ /**
+  * @brief Settles the requests whose ACKs the kernel dropped, after mpls_batch_poll() returned -ENOBUFS.
+  *
+  * Blocks for a dump of the tables those requests touched: the ones whose
+  * effect is visible succeeded, the others are sent again. A stale interface
+  * cache is refilled with a link dump. Does nothing if no ACK is missing and
+  * the cache is current.
+  *
+  * @param batch Batch to recover.
+  */
+ void mpls_batch_recover(struct mpls_batch *batch);
+ 
+ /**
+  * @brief Tells whether mpls_batch_queue() would have to wait for ACKs before taking another request.
+  * @param batch Batch to query.
+  * @return Non-zero if the ACK window is full, or if ACKs were dropped and
+  *         mpls_batch_recover() has not run yet.
+  */
+ int mpls_batch_full(const struct mpls_batch *batch);
+ 
+ /**
+  * @brief Returns the number of requests sent but not yet acknowledged.
+  * @param batch Batch to query.
+  * @return Number of outstanding requests.
+  */
+ unsigned int mpls_batch_inflight(const struct mpls_batch *batch);
+ 
+ /**
+  * @brief Sends what is left, waits for every outstanding ACK and frees the batch.
+  * @param batch Batch to finish.
+  * @param stats If not NULL, receives the outcome counters.
+  * @return 0 if every request succeeded, -1 otherwise.
+  */
+ int mpls_batch_finish(struct mpls_batch *batch, struct mpls_batch_stats *stats);
+ 
+ /**
+  * @brief Applies every route command listed in a stream.
+  *
+  * Each non-empty line that does not start with '#' must hold one command in the
+  * command-line syntax, e.g. "add_for 100 swap_as 200 next_hop 10.1.1.2",
+  * "replace 100 swap_as 300 next_hop 10.2.2.2" or "del 100". Failed
+  * lines are reported on stderr as "name:line: reason" and do not stop the batch.
+  *
+  * A command prefixed with "netns [name]" is applied inside that network
+  * namespace by a worker thread of an mpls_netns_pool, so the namespaces of a
+  * topology are programmed in parallel with each other and with @p session.
+  *
+  * @param session Session the requests are sent on.
+  * @param in Stream to read routes from.
+  * @param name Name of the stream used in diagnostics.
+  * @param stats Filled with the outcome counters.
+  * @return 0 if every command succeeded, -1 otherwise.
+  */
+ int mpls_batch_run(struct mpls_session *session, FILE *in, const char *name, struct mpls_batch_stats *stats);
+ 
+ #pragma GCC visibility pop
+ 
+ #endif // MPLS_BATCH_H
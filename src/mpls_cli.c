@@ -10,18 +10,64 @@
  * Usage:
  *  - mpls-cli add_for [label] dev [device_name]
  *  - mpls-cli add_for [label] next_hop [nexthop_ip]
- *  - mpls-cli add_for [label] swap_as [label_2] dev [device_name]
- *  - mpls-cli add_for [label] swap_as [label_2] next_hop [nexthop_ip]
- *  - mpls-cli add_for [dst_ip] push [label] next_hop [nexthop_ip]
- *  - mpls-cli add_for [dst_ip] push [label] dev [device_name]
+ *  - mpls-cli add_for [label] swap_as [label_2[/label_3...]] dev [device_name]
+ *  - mpls-cli add_for [label] swap_as [label_2[/label_3...]] next_hop [nexthop_ip]
+ *  - mpls-cli add_for [dst_ip] push [label[/label_2...]] [ttl [n]] next_hop [nexthop_ip]
+ *  - mpls-cli add_for [dst_ip] push [label[/label_2...]] [ttl [n]] dev [device_name]
+ *  - mpls-cli add_for [label] multipath next_hop|dev [target] [swap_as [label_2]] ...
+ *  - mpls-cli add_for [dst_ip] nhid [id]
+ *  - mpls-cli add_for auto [same arguments as a label route]
+ *  - mpls-cli replace [same arguments as add_for]
+ *  - mpls-cli del [label|dst_ip]
+ *  - mpls-cli del [same arguments as add_for]
+ *  - mpls-cli nexthop add|replace [id] [push [label[/label_2...]] [ttl [n]]] next_hop [nexthop_ip] [dev [device_name]]
+ *  - mpls-cli nexthop add|replace [id] [push [label[/label_2...]] [ttl [n]]] dev [device_name]
+ *  - mpls-cli nexthop add|replace [id] group [id[,weight]][/id[,weight]...]
+ *  - mpls-cli nexthop del [id]
+ *  - mpls-cli nexthop show
+ *  - mpls-cli batch [file|-] [errors_only]
+ *  - mpls-cli show [json]
+ *  - mpls-cli monitor [json]
+ *  - mpls-cli sync [file|-] [dry_run]
+ *  - mpls-cli save [file]
+ *  - mpls-cli restore [file]
+ *  - mpls-cli protect [file|-]
+ *  - mpls-cli stats [json|prometheus] [interval [seconds]]
+ *  - mpls-cli verify [netns...]
+ *  - mpls-cli netns [name] [any command above]
+ *
+ * Lines of batch files may also start with "netns [name]"; each namespace is
+ * programmed by its own worker thread.
+ *
+ * If MPLSD_SOCKET is set, add_for/replace/del are sent to the mplsd daemon
+ * listening on that socket instead of being applied directly.
+ *
+ * "auto" in place of a label picks the lowest label that has no route yet
+ * (within MPLS_LABEL_RANGE if set) and prints it.
  *
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <dirent.h>
 #include "mpls_routes.h" // Include header file for MPLS route management functions
 #include "mpls_core.h"   // Include header file for core Netlink operations
+#include "mpls_batch.h"  // Include header file for bulk route installation
+#include "mpls_dump.h"   // Include header file for reading routes back
+#include "mpls_sync.h"   // Include header file for desired-state synchronization
+#include "mpls_ifcache.h" // Include header file for the interface name cache
+#include "mpls_monitor.h" // Include header file for the route change monitor
+#include "mpls_daemon.h"  // Include header file for the mplsd client
+#include "mpls_netns.h"   // Include header file for network namespace support
+#include "mpls_stats.h"   // Include header file for hot-path instrumentation
+#include "mpls_labels.h"  // Include header file for the free-label allocator
+#include "mpls_snapshot.h" // Include header file for binary snapshots
+#include "mpls_frr.h"      // Include header file for fast reroute
+#include "mpls_ifstats.h"  // Include header file for per-interface MPLS counters
+#include "mpls_verify.h"   // Include header file for LSP verification
+#include "mpls_nhobj.h"    // Include header file for kernel nexthop objects
 
 /**
  * @brief Prints the usage instructions for the command-line tool.
@@ -30,10 +76,581 @@ void print_usage() {
     printf("Usage:\n");
     printf("  mpls-cli add_for [label] dev [device_name]\n");
     printf("  mpls-cli add_for [label] next_hop [nexthop_ip]\n");
-    printf("  mpls-cli add_for [label] swap_as [label_2] dev [device_name]\n");
-    printf("  mpls-cli add_for [label] swap_as [label_2] next_hop [nexthop_ip]\n");
-    printf("  mpls-cli add_for [dst_ip] push [label] next_hop [nexthop_ip]\n");
-    printf("  mpls-cli add_for [dst_ip] push [label] dev [device_name]\n");
+    printf("  mpls-cli add_for [label] swap_as [label_2[/label_3...]] dev [device_name]\n");
+    printf("  mpls-cli add_for [label] swap_as [label_2[/label_3...]] next_hop [nexthop_ip]\n");
+    printf("  mpls-cli add_for [dst_ip] push [label[/label_2...]] [ttl [n]] next_hop [nexthop_ip]\n");
+    printf("  mpls-cli add_for [dst_ip] push [label[/label_2...]] [ttl [n]] dev [device_name]\n");
+    printf("  mpls-cli add_for [label] multipath next_hop|dev [target] [swap_as [label_2]] ...\n");
+    printf("  mpls-cli add_for [dst_ip] nhid [id]   (push through a shared nexthop object)\n");
+    printf("  mpls-cli add_for auto [...]   (pick a free label, print it; range from MPLS_LABEL_RANGE=first-last)\n");
+    printf("  mpls-cli replace [same arguments as add_for]   (atomic NLM_F_REPLACE)\n");
+    printf("  mpls-cli del [label|dst_ip]\n");
+    printf("  mpls-cli del [same arguments as add_for]\n");
+    printf("  mpls-cli nexthop add|replace [id] [push [label[/label_2...]] [ttl [n]]] next_hop [nexthop_ip] "
+           "[dev [device_name]]\n");
+    printf("  mpls-cli nexthop add|replace [id] [push [label[/label_2...]] [ttl [n]]] dev [device_name]\n");
+    printf("  mpls-cli nexthop add|replace [id] group [id[,weight]][/id[,weight]...]   (replace re-points its routes)\n");
+    printf("  mpls-cli nexthop del [id]   (also removes the routes using it)\n");
+    printf("  mpls-cli nexthop show\n");
+    printf("  mpls-cli batch [file|-] [errors_only]   (one add_for/replace/del command per line)\n");
+    printf("  mpls-cli show [json]\n");
+    printf("  mpls-cli monitor [json]   (print route changes as they happen)\n");
+    printf("  mpls-cli sync [file|-] [dry_run]   (make the kernel match a desired state)\n");
+    printf("  mpls-cli save [file]   (write the MPLS routes to a binary snapshot)\n");
+    printf("  mpls-cli restore [file]   (install every route of a snapshot)\n");
+    printf("  mpls-cli protect [file|-]   (\"<route> backup <next hop>\" per line; switch on link down/up)\n");
+    printf("  mpls-cli stats [json|prometheus] [interval [seconds]]   (per-interface MPLS traffic counters and rates)\n");
+    printf("  mpls-cli verify [netns...]   (trace every LSP across namespaces, default all; report breaks)\n");
+    printf("  mpls-cli netns [name] [command...]   (run a command inside a network namespace)\n");
+    printf("Set MPLSD_SOCKET to send add_for/replace/del through a running mplsd.\n");
+}
+
+/**
+ * @brief Chooses the lowest free label for a route given as "auto".
+ *
+ * @param route Route whose label is filled in.
+ * @return 0 on success, -1 on error (reported on stderr).
+ */
+int pick_auto_label(struct mpls_route *route) {
+    uint32_t first, last;
+    if (mpls_labels_parse_range(getenv(MPLS_LABEL_RANGE_ENV), &first, &last) < 0) {
+        fprintf(stderr, "Error: %s must be first-last within 16-1048575.\n", MPLS_LABEL_RANGE_ENV);
+        return -1;
+    }
+    struct mpls_labels *labels = mpls_labels_open(first, last);
+    if (!labels) {
+        perror("malloc");
+        return -1;
+    }
+
+    struct mpls_session session;
+    int ret = mpls_session_open(&session, MPLS_SESSION_SOCK_BUF);
+    if (ret == 0) {
+        ret = mpls_labels_load(labels, &session);
+        mpls_session_close(&session);
+    }
+    if (ret < 0) {
+        fprintf(stderr, "Failed to read the kernel's labels: %s\n", strerror(-ret));
+    } else if ((ret = mpls_labels_alloc(labels, &route->label)) < 0) {
+        fprintf(stderr, "Error: no free label in %u-%u.\n", first, last);
+    }
+    mpls_labels_close(labels);
+    if (ret < 0) return -1;
+    route->auto_label = 0;
+    return 0;
+}
+
+/**
+ * @brief Prints the MPLS routes currently installed in the kernel.
+ *
+ * @param format Output format (plain text or JSON).
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
+ */
+int run_show(enum mpls_show_format format) {
+    struct mpls_session session;
+    int ret = mpls_session_open(&session, MPLS_SESSION_SOCK_BUF);
+    if (ret < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(-ret));
+        return EXIT_FAILURE;
+    }
+
+    ret = print_mpls_routes(&session, stdout, format);
+    mpls_session_close(&session);
+    if (ret == -EINTR) {
+        fprintf(stderr, "Warning: routes changed during the dump, output may be inconsistent\n");
+    } else if (ret < 0) {
+        fprintf(stderr, "Failed to dump routes: %s\n", strerror(-ret));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Prints MPLS route changes as they happen, until interrupted.
+ *
+ * @param format Output format (plain text or JSON lines).
+ * @return EXIT_FAILURE, since it only returns on error.
+ */
+int run_monitor(enum mpls_show_format format) {
+    struct mpls_session session;
+    int ret = mpls_session_open(&session, MPLS_SESSION_SOCK_BUF);
+    if (ret < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(-ret));
+        return EXIT_FAILURE;
+    }
+    session.ifcache = mpls_ifcache_open();
+
+    ret = mpls_monitor_run(&session, stdout, format);
+    mpls_session_close(&session);
+    fprintf(stderr, "Monitor stopped: %s\n", strerror(-ret));
+    return EXIT_FAILURE;
+}
+
+/**
+ * @brief Applies all route commands listed in a file (or stdin for "-") over one Netlink socket.
+ *
+ * @param path Path of the route list, or "-" for standard input.
+ * @param ack_errors If non-zero, the kernel only acknowledges failed requests.
+ * @return EXIT_SUCCESS if every command succeeded, EXIT_FAILURE otherwise.
+ */
+int run_batch(const char *path, int ack_errors) {
+    FILE *in = stdin;
+    if (strcmp(path, "-") != 0) {
+        in = fopen(path, "r");
+        if (!in) {
+            perror(path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct mpls_session session;
+    int ret = mpls_session_open(&session, MPLS_SESSION_SOCK_BUF);
+    if (ret < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(-ret));
+        if (in != stdin) fclose(in);
+        return EXIT_FAILURE;
+    }
+    // Resolve dev routes from one link dump instead of a syscall per route (NULL falls back to if_nametoindex)
+    session.ifcache = mpls_ifcache_open();
+    session.ack_errors = ack_errors;
+
+    struct mpls_batch_stats stats;
+    ret = mpls_batch_run(&session, in, strcmp(path, "-") == 0 ? "<stdin>" : path, &stats);
+    mpls_session_close(&session);
+    if (in != stdin) fclose(in);
+
+    printf("batch: %lu requests, %lu succeeded, %lu failed\n", stats.routes, stats.ok, stats.failed);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Adds, replaces or deletes one route over its own Netlink socket and reports any error.
+ *
+ * @param route Route to change.
+ * @param op Operation to perform.
+ * @return EXIT_SUCCESS if the kernel accepted the change, EXIT_FAILURE otherwise.
+ */
+int run_route(const struct mpls_route *route, enum mpls_route_op op) {
+    struct mpls_session session;
+    int ret = mpls_session_open(&session, 0);
+    if (ret < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(-ret));
+        return EXIT_FAILURE;
+    }
+
+    ret = session_apply_mpls_route(&session, route, op);
+    mpls_session_close(&session);
+    if (ret == -ENODEV && !session.err_msg[0]) {
+        fprintf(stderr, "Failed to get interface index for %s\n", route->ifname);
+        return EXIT_FAILURE;
+    }
+    if (ret < 0) {
+        fprintf(stderr, "Netlink error: %s (code=%d)%s%s\n", strerror(-ret), -ret, session.err_msg[0] ? ": " : "",
+                session.err_msg);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Adds, replaces or deletes one kernel nexthop object and reports any error.
+ *
+ * @param nh Object to change.
+ * @param op Operation to perform.
+ * @return EXIT_SUCCESS if the kernel accepted the change, EXIT_FAILURE otherwise.
+ */
+int run_nexthop(const struct mpls_nhobj *nh, enum mpls_route_op op) {
+    struct mpls_session session;
+    int ret = mpls_session_open(&session, 0);
+    if (ret < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(-ret));
+        return EXIT_FAILURE;
+    }
+
+    ret = session_apply_mpls_nhobj(&session, nh, op);
+    mpls_session_close(&session);
+    if (ret == -ENODEV && !session.err_msg[0]) {
+        fprintf(stderr, "Failed to get interface index for %s\n", nh->ifname);
+        return EXIT_FAILURE;
+    }
+    if (ret < 0) {
+        fprintf(stderr, "Netlink error: %s (code=%d)%s%s\n", strerror(-ret), -ret, session.err_msg[0] ? ": " : "",
+                session.err_msg);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Prints the kernel's nexthop objects in "nexthop add" syntax.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
+ */
+int run_nexthop_show(void) {
+    struct mpls_session session;
+    int ret = mpls_session_open(&session, MPLS_SESSION_SOCK_BUF);
+    if (ret < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(-ret));
+        return EXIT_FAILURE;
+    }
+
+    ret = print_mpls_nhobjs(&session, stdout);
+    mpls_session_close(&session);
+    if (ret == -EINTR) {
+        fprintf(stderr, "Warning: nexthops changed during the dump, output may be inconsistent\n");
+    } else if (ret < 0) {
+        fprintf(stderr, "Failed to dump nexthops: %s\n", strerror(-ret));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Hands one route command to the mplsd daemon and reports its result.
+ *
+ * @param path Control socket of the daemon.
+ * @param argc Number of arguments of the command.
+ * @param argv Command arguments, starting with the verb.
+ * @return EXIT_SUCCESS if the daemon applied the route, EXIT_FAILURE otherwise.
+ */
+int run_via_daemon(const char *path, int argc, char *argv[]) {
+    char cmd[MPLSD_LINE_MAX];
+    size_t len = 0;
+    for (int i = 0; i < argc; i++) {
+        int n = snprintf(cmd + len, sizeof(cmd) - len, "%s%s", i ? " " : "", argv[i]);
+        if (n < 0 || (size_t)n >= sizeof(cmd) - len) {
+            fprintf(stderr, "Error: command too long.\n");
+            return EXIT_FAILURE;
+        }
+        len += n;
+    }
+
+    char err[256];
+    int ret = mpls_daemon_request(path, cmd, err, sizeof(err));
+    if (ret < 0) {
+        fprintf(stderr, "Error: %s\n", err[0] ? err : strerror(-ret));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Brings the kernel's MPLS routes in line with a desired-state file.
+ *
+ * @param path Path of the desired state, or "-" for standard input.
+ * @param dry_run If non-zero, only print the changes that would be made.
+ * @return EXIT_SUCCESS if the kernel matches the desired state, EXIT_FAILURE otherwise.
+ */
+int run_sync(const char *path, int dry_run) {
+    FILE *in = stdin;
+    if (strcmp(path, "-") != 0) {
+        in = fopen(path, "r");
+        if (!in) {
+            perror(path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct mpls_session session;
+    int ret = mpls_session_open(&session, MPLS_SESSION_SOCK_BUF);
+    if (ret < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(-ret));
+        if (in != stdin) fclose(in);
+        return EXIT_FAILURE;
+    }
+    session.ifcache = mpls_ifcache_open();
+
+    struct mpls_sync_stats stats;
+    ret = mpls_sync_run(&session, in, strcmp(path, "-") == 0 ? "<stdin>" : path, dry_run, &stats);
+    mpls_session_close(&session);
+    if (in != stdin) fclose(in);
+
+    printf("sync%s: %lu unchanged, %lu added, %lu replaced, %lu deleted, %lu failed\n", dry_run ? " (dry run)" : "",
+           stats.unchanged, stats.added, stats.replaced, stats.deleted, stats.failed);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Writes the MPLS routes currently installed in the kernel to a snapshot file.
+ *
+ * @param path Path of the snapshot; replaced only once the new one is complete.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
+ */
+int run_save(const char *path) {
+    struct mpls_session session;
+    int ret = mpls_session_open(&session, MPLS_SESSION_SOCK_BUF);
+    if (ret < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(-ret));
+        return EXIT_FAILURE;
+    }
+    session.ifcache = mpls_ifcache_open();
+
+    struct mpls_snapshot_stats stats;
+    ret = mpls_snapshot_save(&session, path, &stats);
+    mpls_session_close(&session);
+    if (ret < 0) {
+        fprintf(stderr, "save %s: %s\n", path, strerror(-ret));
+        return EXIT_FAILURE;
+    }
+
+    printf("save: %lu routes written, %lu skipped\n", stats.routes, stats.skipped);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Installs every route of a snapshot file over one Netlink socket.
+ *
+ * @param path Path of the snapshot.
+ * @return EXIT_SUCCESS if every route was installed, EXIT_FAILURE otherwise.
+ */
+int run_restore(const char *path) {
+    struct mpls_session session;
+    int ret = mpls_session_open(&session, MPLS_SESSION_SOCK_BUF);
+    if (ret < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(-ret));
+        return EXIT_FAILURE;
+    }
+    session.ifcache = mpls_ifcache_open();
+
+    struct mpls_batch_stats stats;
+    ret = mpls_snapshot_restore(&session, path, &stats);
+    mpls_session_close(&session);
+    if (ret < -1) {
+        // A malformed file has already been explained
+        if (ret != -EINVAL) fprintf(stderr, "restore %s: %s\n", path, strerror(-ret));
+        return EXIT_FAILURE;
+    }
+
+    printf("restore: %lu requests, %lu succeeded, %lu failed\n", stats.routes, stats.ok, stats.failed);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Prints one switch made by the fast-reroute loop.
+ *
+ * @param event Outcome of the switch.
+ * @param arg Unused.
+ */
+void print_frr_event(const struct mpls_frr_event *event, void *arg) {
+    (void)arg;
+    printf("%s %s: %lu routes to %s in %.3f ms, %lu failed\n", event->ifname[0] ? event->ifname : "?",
+           event->down ? "down" : "up", event->routes, event->down ? "backup" : "primary",
+           event->elapsed_ns / 1e6, event->failed);
+    fflush(stdout);
+}
+
+/**
+ * @brief Installs protected routes from a file and switches them to their backups while their link is down.
+ *
+ * @param path Path of the protected route list, or "-" for standard input.
+ * @return EXIT_FAILURE, since it only returns on error.
+ */
+int run_protect(const char *path) {
+    FILE *in = stdin;
+    if (strcmp(path, "-") != 0) {
+        in = fopen(path, "r");
+        if (!in) {
+            perror(path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct mpls_session session;
+    int ret = mpls_session_open(&session, MPLS_SESSION_SOCK_BUF);
+    if (ret < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(-ret));
+        if (in != stdin) fclose(in);
+        return EXIT_FAILURE;
+    }
+    session.ifcache = mpls_ifcache_open();
+
+    struct mpls_frr *frr = mpls_frr_open(&session);
+    if (!frr) {
+        perror("protect");
+        mpls_session_close(&session);
+        if (in != stdin) fclose(in);
+        return EXIT_FAILURE;
+    }
+    // Invalid lines have been reported; protect the routes on the valid ones
+    mpls_frr_load(frr, in, strcmp(path, "-") == 0 ? "<stdin>" : path);
+    if (in != stdin) fclose(in);
+
+    struct mpls_batch_stats stats;
+    ret = mpls_frr_arm(frr, &stats);
+    if (ret < -1) {
+        fprintf(stderr, "protect: cannot read the links: %s\n", strerror(-ret));
+    } else {
+        size_t links;
+        size_t routes = mpls_frr_routes(frr, &links);
+        printf("protect: %zu routes armed over %zu interfaces, %lu failed\n", routes, links, stats.failed);
+        fflush(stdout);
+        ret = mpls_frr_run(frr, print_frr_event, NULL);
+        fprintf(stderr, "Protection stopped: %s\n", strerror(-ret));
+    }
+    mpls_frr_close(frr);
+    mpls_session_close(&session);
+    return EXIT_FAILURE;
+}
+
+/**
+ * @brief Prints the kernel's per-interface MPLS counters, once or every interval with rates.
+ *
+ * @param format Output format.
+ * @param interval Seconds between samples, or 0 to print one sample and exit.
+ * @return EXIT_SUCCESS after a single sample, EXIT_FAILURE on error.
+ */
+int run_stats(enum mpls_ifstats_format format, double interval) {
+    struct mpls_session session;
+    int ret = mpls_session_open(&session, 0);
+    if (ret < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(-ret));
+        return EXIT_FAILURE;
+    }
+    struct mpls_ifcache *names = mpls_ifcache_open();
+    struct mpls_ifstats *ifstats = mpls_ifstats_open();
+    if (!ifstats) {
+        perror("stats");
+        mpls_ifcache_close(names);
+        mpls_session_close(&session);
+        return EXIT_FAILURE;
+    }
+
+    // Samples are taken on a fixed schedule, so the time spent printing does not add up
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    int warned = 0;
+    for (;;) {
+        ret = mpls_ifstats_collect(ifstats, &session);
+        if (ret < 0) {
+            fprintf(stderr, "Failed to read the statistics: %s\n", strerror(-ret));
+            break;
+        }
+        if (ret == 0 && !warned) {
+            fprintf(stderr, "Warning: no interface has MPLS counters (is the mpls_router module loaded?)\n");
+            warned = 1;
+        }
+        ret = mpls_ifstats_write(ifstats, stdout, format, names);
+        if (ret < 0 || interval <= 0) break;
+        if (format != MPLS_IFSTATS_JSON) putchar('\n');
+
+        next.tv_sec += (time_t)interval;
+        next.tv_nsec += (long)((interval - (time_t)interval) * 1e9);
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+        }
+    }
+
+    mpls_ifstats_close(ifstats);
+    mpls_ifcache_close(names);
+    mpls_session_close(&session);
+    return ret < 0 || interval > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @brief Prints an ingress route whose LSP is broken.
+ *
+ * @param result Outcome of the trace.
+ * @param arg Unused.
+ */
+void print_verify_result(const struct mpls_verify_result *result, void *arg) {
+    static const char *const problems[] = {"ok", "label mismatch", "blackhole", "loop"};
+    (void)arg;
+    if (result->status == MPLS_VERIFY_OK) return;
+    char dst[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &result->dst, dst, sizeof(dst));
+    printf("%s %s/%d push %u: %s at %s, label %u after %d hops: %s\n", result->node, dst, result->dst_len,
+           result->push, problems[result->status], result->at, result->label, result->hops, result->reason);
+}
+
+/**
+ * @brief Orders namespace names for a stable report.
+ */
+int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @brief Checks every LSP that starts in the given namespaces, or in all named namespaces.
+ *
+ * @param count Number of namespace names, 0 for every namespace in MPLS_NETNS_RUN_DIR.
+ * @param names Namespace names.
+ * @return EXIT_SUCCESS if every LSP reaches its egress, EXIT_FAILURE otherwise.
+ */
+int run_verify(int count, char *names[]) {
+    struct mpls_verify *verify = mpls_verify_open();
+    if (!verify) {
+        perror("verify");
+        return EXIT_FAILURE;
+    }
+
+    char **listed = NULL;
+    if (count == 0) {
+        DIR *dir = opendir(MPLS_NETNS_RUN_DIR);
+        struct dirent *de;
+        while (dir && (de = readdir(dir)) != NULL) {
+            if (de->d_name[0] == '.') continue;
+            char **bigger = realloc(listed, (count + 1) * sizeof(*listed));
+            if (!bigger || !(bigger[count] = strdup(de->d_name))) {
+                listed = bigger ? bigger : listed;
+                break;
+            }
+            listed = bigger;
+            count++;
+        }
+        if (dir) closedir(dir);
+        qsort(listed, count, sizeof(*listed), compare_names);
+        names = listed;
+    }
+
+    int ret = count ? 0 : -ENOENT;
+    for (int i = 0; i < count && ret >= 0; i++) ret = mpls_verify_node(verify, names[i]);
+    if (ret < 0) {
+        fprintf(stderr, ret == -ENOENT ? "verify: no namespaces given and none in %s\n" : "verify: %s\n",
+                ret == -ENOENT ? MPLS_NETNS_RUN_DIR : strerror(-ret));
+        for (int i = 0; listed && i < count; i++) free(listed[i]);
+        free(listed);
+        mpls_verify_close(verify);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t t0 = mpls_stats_now(), t1 = 0, t2 = 0;
+    int *errors = calloc((unsigned int)count, sizeof(*errors));
+    ret = errors ? mpls_verify_load_netns(verify, errors) : -ENOMEM;
+    int failed = ret < 0 && !errors;
+    for (int i = 0; errors && i < count; i++) {
+        if (errors[i] == -EINTR) {
+            fprintf(stderr, "Warning: routes of %s changed during the dump, results may be inconsistent\n", names[i]);
+        } else if (errors[i] < 0) {
+            fprintf(stderr, "verify: netns %s: %s\n", names[i], strerror(-errors[i]));
+            failed = 1;
+        }
+    }
+    free(errors);
+
+    struct mpls_verify_stats stats;
+    if (!failed) {
+        t1 = mpls_stats_now();
+        ret = mpls_verify_run(verify, 0, print_verify_result, NULL, &stats);
+        t2 = mpls_stats_now();
+        if (ret < -1) {
+            fprintf(stderr, "verify: %s\n", strerror(-ret));
+            failed = 1;
+        } else {
+            printf("verify: %lu nodes, %lu label routes, %lu LSPs: %lu ok, %lu label mismatches, %lu blackholes, "
+                   "%lu loops (loaded in %.1f ms, traced in %.1f ms)\n", stats.nodes, stats.label_routes, stats.lsps,
+                   stats.ok, stats.mismatches, stats.blackholes, stats.loops,
+                   (t1 - t0) / 1e6, (t2 - t1) / 1e6);
+            failed = ret < 0;
+        }
+    }
+
+    for (int i = 0; listed && i < count; i++) free(listed[i]);
+    free(listed);
+    mpls_verify_close(verify);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 /**
@@ -44,65 +661,173 @@ void print_usage() {
  * @return EXIT_SUCCESS (0) on success, EXIT_FAILURE (1) on error.
  */
 int main(int argc, char *argv[]) {
-    // Check if the required minimum number of arguments is provided
-    if (argc < 5) {
-        printf("Error: Insufficient arguments.\n");
+    if (mpls_stats_init() < 0) {
+        fprintf(stderr, "Warning: MPLS_STATS must be json[:path] or prometheus[:path], instrumentation is off\n");
+    }
+
+    // Handle "netns [name] ..." by entering the namespace and running the rest as usual
+    if (argc >= 2 && strcmp(argv[1], "netns") == 0) {
+        if (argc < 4) {
+            printf("Error: netns expects a namespace name and a command.\n");
+            print_usage();
+            return EXIT_FAILURE;
+        }
+        int ret = mpls_netns_enter(argv[2]);
+        if (ret < 0) {
+            fprintf(stderr, "netns %s: %s\n", argv[2], strerror(-ret));
+            return EXIT_FAILURE;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+
+    // Handle "batch [file|-] [errors_only]" command
+    if (argc >= 2 && strcmp(argv[1], "batch") == 0) {
+        if (argc == 3) return run_batch(argv[2], 0);
+        if (argc == 4 && strcmp(argv[3], "errors_only") == 0) return run_batch(argv[2], 1);
+        printf("Error: batch expects a file name or \"-\", optionally followed by errors_only.\n");
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    // Handle "show [json]" command
+    if (argc >= 2 && strcmp(argv[1], "show") == 0) {
+        if (argc == 2) return run_show(MPLS_SHOW_PLAIN);
+        if (argc == 3 && strcmp(argv[2], "json") == 0) return run_show(MPLS_SHOW_JSON);
+        printf("Error: Invalid command format.\n");
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    // Handle "monitor [json]" command
+    if (argc >= 2 && strcmp(argv[1], "monitor") == 0) {
+        if (argc == 2) return run_monitor(MPLS_SHOW_PLAIN);
+        if (argc == 3 && strcmp(argv[2], "json") == 0) return run_monitor(MPLS_SHOW_JSON);
+        printf("Error: Invalid command format.\n");
         print_usage();
         return EXIT_FAILURE;
     }
 
-    // Validate the first argument (must be "add_for")
-    if (strcmp(argv[1], "add_for") != 0) {
-        printf("Error: Invalid command.\n");
+    // Handle "sync [file|-] [dry_run]" command
+    if (argc >= 2 && strcmp(argv[1], "sync") == 0) {
+        if (argc == 3) return run_sync(argv[2], 0);
+        if (argc == 4 && strcmp(argv[3], "dry_run") == 0) return run_sync(argv[2], 1);
+        printf("Error: Invalid command format.\n");
         print_usage();
         return EXIT_FAILURE;
     }
 
-    // Handle "add_for [label] dev [device_name]" command
-    if (strcmp(argv[3], "dev") == 0 && argc == 5) {
-        uint32_t label = atoi(argv[2]);
-        const char *device = argv[4];
-        return create_mpls_route_dev(device, label, 1);
-    }
-    
-    // Handle "add_for [label] next_hop [nexthop_ip]" command
-    if (strcmp(argv[3], "next_hop") == 0 && argc == 5) {
-        uint32_t label = atoi(argv[2]);
-        const char *nexthop_ip = argv[4];
-        return create_mpls_route_nexthop(nexthop_ip, label, 1);
-    }
-    
-    // Handle "add_for [label] swap_as [label_2] dev [device_name]" and
-    // "add_for [label] swap_as [label_2] next_hop [nexthop_ip]" commands
-    if (strcmp(argv[3], "swap_as") == 0 && argc == 7) {  
-        uint32_t label = atoi(argv[2]);
-        uint32_t new_label = atoi(argv[4]);
-        if (strcmp(argv[5], "dev") == 0) {
-            const char *device = argv[6]; 
-            return create_mpls_route_swap_dev(device, label, new_label, 1);
-        } else if (strcmp(argv[5], "next_hop") == 0) {
-            const char *nexthop_ip = argv[6];
-            return create_mpls_route_swap_nexthop(nexthop_ip, label, new_label, 1);
-        }
-    }
-    
-    // Handle "add_for [dst_ip] push [label] next_hop [nexthop_ip]" and
-    // "add_for [dst_ip] push [label] dev [device_name]" commands
-    if (strcmp(argv[3], "push") == 0 && argc == 7) { 
-        uint32_t mpls_label = atoi(argv[4]);
-        if (strcmp(argv[5], "next_hop") == 0) {
-            const char *dst_ip = argv[2];
-            const char *nexthop_ip = argv[6]; 
-            return create_mpls_encap_route_via(dst_ip, mpls_label, nexthop_ip);
-        } else if (strcmp(argv[5], "dev") == 0) {
-            const char *dst_ip = argv[2];
-            const char *device = argv[6];
-            return create_mpls_encap_route_dev(device, dst_ip, mpls_label);
-        }
-    }
-    
-    // Print an error message if the command format is incorrect
-    printf("Error: Invalid command format.\n");
+    // Handle "protect [file|-]" command
+    if (argc >= 2 && strcmp(argv[1], "protect") == 0) {
+        if (argc == 3) return run_protect(argv[2]);
+        printf("Error: protect expects a file name or \"-\".\n");
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    // Handle "stats [json|prometheus] [interval [seconds]]" command
+    if (argc >= 2 && strcmp(argv[1], "stats") == 0) {
+        enum mpls_ifstats_format format = MPLS_IFSTATS_PLAIN;
+        double interval = 0;
+        int i = 2;
+        if (i < argc && strcmp(argv[i], "json") == 0) {
+            format = MPLS_IFSTATS_JSON;
+            i++;
+        } else if (i < argc && strcmp(argv[i], "prometheus") == 0) {
+            format = MPLS_IFSTATS_PROMETHEUS;
+            i++;
+        }
+        if (i < argc && strcmp(argv[i], "interval") == 0) {
+            char *end = NULL;
+            interval = i + 1 < argc ? strtod(argv[i + 1], &end) : 1;
+            if (end && (*end || interval < 0.01 || interval > 86400)) {
+                printf("Error: interval expects a number of seconds between 0.01 and 86400.\n");
+                return EXIT_FAILURE;
+            }
+            i += end ? 2 : 1;
+        }
+        if (i == argc) return run_stats(format, interval);
+        printf("Error: Invalid command format.\n");
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    // Handle "nexthop add|replace|del|show ..." commands
+    if (argc >= 2 && strcmp(argv[1], "nexthop") == 0) {
+        struct mpls_nhobj nh;
+        const char *err = "insufficient arguments";
+        if (argc == 3 && strcmp(argv[2], "show") == 0) return run_nexthop_show();
+        if (argc == 4 && strcmp(argv[2], "del") == 0) {
+            if (parse_mpls_nhobj_id(argv[3], &nh) == 0) return run_nexthop(&nh, MPLS_OP_DELETE);
+            err = "invalid nexthop id (expected 1-4294967295)";
+        } else if (argc >= 4 && (strcmp(argv[2], "add") == 0 || strcmp(argv[2], "replace") == 0 ||
+                                 strcmp(argv[2], "del") == 0)) {
+            enum mpls_route_op nh_op = strcmp(argv[2], "add") == 0   ? MPLS_OP_ADD
+                                       : strcmp(argv[2], "del") == 0 ? MPLS_OP_DELETE
+                                                                     : MPLS_OP_REPLACE;
+            if (parse_mpls_nhobj(argc - 3, argv + 3, &nh, &err) == 0) return run_nexthop(&nh, nh_op);
+        }
+        printf("Error: Invalid command format (%s).\n", err);
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    // Handle "verify [netns...]" command
+    if (argc >= 2 && strcmp(argv[1], "verify") == 0) {
+        return run_verify(argc - 2, argv + 2);
+    }
+
+    // Handle "save [file]" and "restore [file]" commands
+    if (argc >= 2 && (strcmp(argv[1], "save") == 0 || strcmp(argv[1], "restore") == 0)) {
+        if (argc == 3) return strcmp(argv[1], "save") == 0 ? run_save(argv[2]) : run_restore(argv[2]);
+        printf("Error: %s expects a file name.\n", argv[1]);
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    // Handle "add_for ...", "replace ..." and "del ..." commands
+    enum mpls_route_op op;
+    if (argc >= 2 && parse_mpls_route_op(argv[1], &op) == 0) {
+        // Check if the required minimum number of arguments is provided
+        if (argc < (op == MPLS_OP_DELETE ? 3 : 5)) {
+            printf("Error: Insufficient arguments.\n");
+            print_usage();
+            return EXIT_FAILURE;
+        }
+
+        struct mpls_route route;
+        const char *err = NULL;
+        if (parse_mpls_command(argc - 1, argv + 1, &op, &route, &err) < 0) {
+            printf("Error: Invalid command format (%s).\n", err);
+            print_usage();
+            return EXIT_FAILURE;
+        }
+        // "auto" is resolved here, so the daemon only ever sees concrete labels
+        char label[16];
+        if (route.auto_label) {
+            if (op == MPLS_OP_DELETE) {
+                printf("Error: del needs an explicit label.\n");
+                return EXIT_FAILURE;
+            }
+            if (pick_auto_label(&route) < 0) return EXIT_FAILURE;
+            snprintf(label, sizeof(label), "%u", route.label);
+            argv[2] = label;
+        }
+
+        // Syntax is checked locally first so typos never reach the daemon
+        const char *daemon = getenv("MPLSD_SOCKET");
+        int ret;
+        if (daemon && daemon[0]) {
+            ret = run_via_daemon(daemon, argc - 1, argv + 1);
+        } else {
+            ret = run_route(&route, op);
+        }
+        if (ret == EXIT_SUCCESS && argv[2] == label) printf("%s\n", label);
+        return ret;
+    }
+
+    printf(argc < 2 ? "Error: Insufficient arguments.\n" : "Error: Invalid command.\n");
     print_usage();
     return EXIT_FAILURE;
 }
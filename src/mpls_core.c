@@ -1,34 +1,25 @@
 // mpls_core.c
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <errno.h>
-#include <unistd.h>
-#include <arpa/inet.h>
-#include <linux/netlink.h>
-#include <linux/rtnetlink.h>
-#include <sys/socket.h>
-#include <net/if.h>
-#include <netinet/in.h>
-
-#define BUF_SIZE 4096
-#define LWTUNNEL_ENCAP_MPLS 1
+#include "mpls_core.h"
+#include "mpls_ifcache.h"
+#include "mpls_stats.h"
 
 // Function to create a Netlink socket
 int create_netlink_socket() {
     int sockfd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
-    if (sockfd < 0) {
-        perror("socket");
-        return -1;
-    }
+    if (sockfd < 0) return -errno;
+
+    // Errors come back as a short extended ACK instead of an echo of the request
+    int one = 1;
+    setsockopt(sockfd, SOL_NETLINK, NETLINK_CAP_ACK, &one, sizeof(one));
+    setsockopt(sockfd, SOL_NETLINK, NETLINK_EXT_ACK, &one, sizeof(one));
 
     struct sockaddr_nl sa = {0};
     sa.nl_family = AF_NETLINK;
 
     if (bind(sockfd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
-        perror("bind");
+        int error = -errno;
         close(sockfd);
-        return -1;
+        return error;
     }
     return sockfd;
 }
@@ -53,100 +44,120 @@ void init_route_message(struct rtmsg *rtm, uint8_t family, uint8_t dst_len, uint
 }
 
 // Function to add an attribute to the Netlink message
-void add_attr(struct nlmsghdr *nlh, unsigned int maxlen, int type, void *data, int len) {
+int add_attr(struct nlmsghdr *nlh, unsigned int maxlen, int type, const void *data, int len) {
     struct rtattr *rta = (struct rtattr *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
     unsigned int rta_len = RTA_LENGTH(len);
-    if (NLMSG_ALIGN(nlh->nlmsg_len) + rta_len > maxlen) {
-        fprintf(stderr, "Attribute too big\n");
-        exit(EXIT_FAILURE);
-    }
+    if (NLMSG_ALIGN(nlh->nlmsg_len) + rta_len > maxlen) return -EMSGSIZE;
     rta->rta_type = type;
     rta->rta_len = rta_len;
-    memcpy(RTA_DATA(rta), data, len);
+    if (len) memcpy(RTA_DATA(rta), data, len);
     nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + rta_len;
+    return 0;
+}
+
+// Function to open a nested attribute
+struct rtattr *mpls_add_attr_nest(struct nlmsghdr *nlh, unsigned int maxlen, int type) {
+    struct rtattr *nest = (struct rtattr *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+    return add_attr(nlh, maxlen, type, NULL, 0) < 0 ? NULL : nest;
+}
+
+// Function to close a nested attribute
+void mpls_add_attr_nest_end(struct nlmsghdr *nlh, struct rtattr *nest) {
+    nest->rta_len = (char *)nlh + nlh->nlmsg_len - (char *)nest;
+}
+
+// Function to index attributes by type in place
+void mpls_parse_rtattr(const struct rtattr *tb[], int max, const struct rtattr *rta, int len) {
+    memset(tb, 0, sizeof(*tb) * (max + 1));
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        int type = rta->rta_type & NLA_TYPE_MASK;
+        if (type <= max && !tb[type]) tb[type] = rta;
+    }
 }
 
 
+// Function to decode an error message and its extended ACK attributes
+int mpls_parse_ack(const struct nlmsghdr *nlh, struct mpls_ack *ack) {
+    const struct nlmsgerr *err = (const struct nlmsgerr *)NLMSG_DATA(nlh);
+    ack->error = err->error;
+    ack->msg = NULL;
+    ack->offset = 0;
+    if (!(nlh->nlmsg_flags & NLM_F_ACK_TLVS)) return ack->error;
+
+    // The TLVs follow the echoed request, which is only its header when capped
+    unsigned int skip = sizeof(*err);
+    if (!(nlh->nlmsg_flags & NLM_F_CAPPED)) skip += err->msg.nlmsg_len - NLMSG_HDRLEN;
+    if (NLMSG_HDRLEN + NLMSG_ALIGN(skip) > nlh->nlmsg_len) return ack->error;
+
+    const struct rtattr *tb[NLMSGERR_ATTR_OFFS + 1];
+    mpls_parse_rtattr(tb, NLMSGERR_ATTR_OFFS, (const struct rtattr *)((const char *)err + NLMSG_ALIGN(skip)),
+                      nlh->nlmsg_len - NLMSG_HDRLEN - NLMSG_ALIGN(skip));
+    const struct rtattr *msg = tb[NLMSGERR_ATTR_MSG];
+    if (msg && RTA_PAYLOAD(msg) > 0 && ((const char *)RTA_DATA(msg))[RTA_PAYLOAD(msg) - 1] == '\0') {
+        ack->msg = (const char *)RTA_DATA(msg);
+    }
+    if (tb[NLMSGERR_ATTR_OFFS] && RTA_PAYLOAD(tb[NLMSGERR_ATTR_OFFS]) >= sizeof(uint32_t)) {
+        memcpy(&ack->offset, RTA_DATA(tb[NLMSGERR_ATTR_OFFS]), sizeof(uint32_t));
+    }
+    return ack->error;
+}
+
 // Function to process kernel response
 int process_kernel_response(int sockfd) {
     char buffer[BUF_SIZE];
+    MPLS_STAT_TIME_START(start);
     int len = recv(sockfd, buffer, sizeof(buffer), 0);
+    MPLS_STAT_TIME_END(MPLS_HIST_ACK_WAIT, start);
     if (len < 0) {
-        perror("Failed to receive response from kernel");
-        return -1;
+        MPLS_STAT_ERRNO(errno);
+        return -errno;
     }
+    MPLS_STAT_ADD(MPLS_STAT_RECV_CALLS, 1);
+    MPLS_STAT_ADD(MPLS_STAT_RECV_MESSAGES, 1);
+    MPLS_STAT_ADD(MPLS_STAT_RECV_BYTES, len);
 
     struct nlmsghdr *nlh = (struct nlmsghdr *)buffer;
     if (nlh->nlmsg_type == NLMSG_ERROR) {
-        struct nlmsgerr *err = (struct nlmsgerr *)NLMSG_DATA(nlh);
-        if (err->error) {
-            fprintf(stderr, "Netlink error: %s (code=%d)\n", strerror(-err->error), -err->error);
-            return -1;
-        }
+        struct mpls_ack ack;
+        mpls_parse_ack(nlh, &ack);
+        MPLS_STAT_ACK(ack.error);
+        return ack.error;
     }
     return 0;
 }
 
 // Function to create MPLS label with S-bit
 uint32_t create_mpls_label(uint32_t label, uint8_t s_bit) {
-    if (label > 0xFFFFF) {
-        fprintf(stderr, "Error: Label exceeds 20 bits (max 1048575)\n");
-        return 0;
-    }
-    if (s_bit != 0 && s_bit != 1) {
-        fprintf(stderr, "Error: S-bit must be 0 or 1\n");
-        return 0;
-    }
+    if (label > 0xFFFFF || s_bit > 1) return 0;
 
     uint32_t mpls_label = ((label & 0xFFFFF) << 12) | (s_bit << 8);
     return htonl(mpls_label);
 }
 
-// Function to create a full MPLS header for encapsulation
-uint64_t create_mpls_label_for_encap(uint32_t label, uint8_t s_bit, uint8_t tc) {
-    if (label > 0xFFFFF) {
-        fprintf(stderr, "Error: Label exceeds 20 bits (max 1048575)\n");
-        return 0;
-    }
-    if (s_bit > 1) {
-        fprintf(stderr, "Error: S-bit must be 0 or 1\n");
-        return 0;
-    }
-    if (tc > 7) {
-        fprintf(stderr, "Error: TC exceeds 3 bits (max 7)\n");
-        return 0;
-    }
-
-    uint64_t mpls_header = 0;
-    uint8_t bytes[8] = {0};
-
-    // First 4 bytes: attribute header
-    bytes[0] = 0x08;  // Length of 8 bytes
-    bytes[1] = 0x00;  // NLA_F_NESTED flag
-    bytes[2] = 0x01;  // Encapsulation type: MPLS
-    bytes[3] = 0x00;
-
-    // Construct the MPLS label
-    uint32_t mpls = (label << 12) | (tc << 9) | (s_bit << 8) | 0x00; // TTL = 0x00
-
-    // Store the label byte-by-byte
-    bytes[4] = (mpls >> 24) & 0xFF;
-    bytes[5] = (mpls >> 16) & 0xFF;
-    bytes[6] = (mpls >> 8) & 0xFF;
-    bytes[7] = mpls & 0xFF;
-
-    // Copy into the 64-bit header
-    memcpy(&mpls_header, bytes, sizeof(bytes));
+// Function to decode an MPLS label stack entry
+uint32_t decode_mpls_label(uint32_t entry, uint8_t *s_bit) {
+    uint32_t host = ntohl(entry);
+    if (s_bit) *s_bit = (host >> 8) & 0x1;
+    return host >> 12;
+}
 
-    return mpls_header;
+// Function to encode an MPLS label stack
+int create_mpls_label_stack(const uint32_t *labels, int count, uint8_t s_bit, uint32_t *stack) {
+    if (count < 1 || count > MPLS_MAX_LABELS || s_bit > 1) return -EINVAL;
+    for (int i = 0; i < count; i++) {
+        if (labels[i] > 0xFFFFF) return -EINVAL;
+        stack[i] = create_mpls_label(labels[i], i == count - 1 ? s_bit : 0);
+    }
+    return count * sizeof(uint32_t);
 }
 
 // Function to get interface index
 int get_interface_index(const char *ifname) {
+    MPLS_STAT_TIME_START(start);
     int ifindex = if_nametoindex(ifname);
-    if (ifindex == 0) {
-        perror("if_nametoindex");
-    }
+    MPLS_STAT_TIME_END(MPLS_HIST_IFINDEX, start);
+    MPLS_STAT_ADD(MPLS_STAT_IFINDEX_LOOKUPS, 1);
+    if (ifindex == 0) MPLS_STAT_ADD(MPLS_STAT_IFINDEX_MISSES, 1);
     return ifindex;
 }
 
@@ -156,10 +167,145 @@ int send_netlink_message(int sockfd, struct nlmsghdr *nlh, int len) {
     struct iovec iov = {nlh, len};
     struct msghdr msg = {&kernel, sizeof(kernel), &iov, 1, NULL, 0, 0};
 
-    if (sendmsg(sockfd, &msg, 0) < 0) {
-        perror("sendmsg");
-        return -1;
+    MPLS_STAT_TIME_START(start);
+    int ret = sendmsg(sockfd, &msg, 0);
+    MPLS_STAT_TIME_END(MPLS_HIST_SEND, start);
+    if (ret < 0) {
+        MPLS_STAT_ERRNO(errno);
+        return -errno;
     }
+    MPLS_STAT_ADD(MPLS_STAT_SEND_CALLS, 1);
+    MPLS_STAT_ADD(MPLS_STAT_SEND_MESSAGES, 1);
+    MPLS_STAT_ADD(MPLS_STAT_SEND_BYTES, len);
 
     return process_kernel_response(sockfd);
-}
\ No newline at end of file
+}
+
+// Function to set a socket buffer size, bypassing net.core.[rw]mem_max when privileged
+static int set_sock_buf(int fd, int force_opt, int opt, int size) {
+    if (setsockopt(fd, SOL_SOCKET, force_opt, &size, sizeof(size)) < 0 &&
+        setsockopt(fd, SOL_SOCKET, opt, &size, sizeof(size)) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+// Function to open a reusable Netlink route session
+int mpls_session_open(struct mpls_session *session, int sock_buf) {
+    memset(session, 0, sizeof(*session));
+    session->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (session->fd < 0) return -errno;
+
+    if (sock_buf > 0) {
+        set_sock_buf(session->fd, SO_SNDBUFFORCE, SO_SNDBUF, sock_buf);
+        set_sock_buf(session->fd, SO_RCVBUFFORCE, SO_RCVBUF, sock_buf);
+    }
+
+    // Best effort: older kernels echo the full request and give no detail
+    int one = 1;
+    setsockopt(session->fd, SOL_NETLINK, NETLINK_CAP_ACK, &one, sizeof(one));
+    setsockopt(session->fd, SOL_NETLINK, NETLINK_EXT_ACK, &one, sizeof(one));
+
+    struct sockaddr_nl sa = {.nl_family = AF_NETLINK};
+    socklen_t salen = sizeof(sa);
+    if (bind(session->fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 ||
+        getsockname(session->fd, (struct sockaddr *)&sa, &salen) < 0) {
+        int err = -errno;
+        close(session->fd);
+        session->fd = -1;
+        return err;
+    }
+    session->portid = sa.nl_pid;
+    session->seq = 1;
+
+    socklen_t optlen = sizeof(session->sndbuf);
+    getsockopt(session->fd, SOL_SOCKET, SO_SNDBUF, &session->sndbuf, &optlen);
+    optlen = sizeof(session->rcvbuf);
+    getsockopt(session->fd, SOL_SOCKET, SO_RCVBUF, &session->rcvbuf, &optlen);
+    return 0;
+}
+
+// Function to close a Netlink route session
+void mpls_session_close(struct mpls_session *session) {
+    if (session->fd >= 0) close(session->fd);
+    session->fd = -1;
+    mpls_ifcache_close(session->ifcache);
+    session->ifcache = NULL;
+}
+
+// Function to stamp a request with the session's identity and next sequence number
+uint32_t mpls_session_stamp(struct mpls_session *session, struct nlmsghdr *nlh) {
+    nlh->nlmsg_pid = session->portid;
+    nlh->nlmsg_seq = session->seq++;
+    MPLS_STAT_ADD(MPLS_STAT_SEND_MESSAGES, 1);
+    return nlh->nlmsg_seq;
+}
+
+// Function to send one or more packed requests to the kernel
+int mpls_session_send(struct mpls_session *session, const void *buf, unsigned int len) {
+    struct sockaddr_nl kernel = {.nl_family = AF_NETLINK};
+    struct iovec iov = {(void *)buf, len};
+    struct msghdr msg = {&kernel, sizeof(kernel), &iov, 1, NULL, 0, 0};
+
+    MPLS_STAT_TIME_START(start);
+    int ret = session->transport ? session->transport->send(session, buf, len) : sendmsg(session->fd, &msg, 0);
+    MPLS_STAT_TIME_END(MPLS_HIST_SEND, start);
+    if (ret < 0) {
+        MPLS_STAT_ERRNO(errno);
+        return -errno;
+    }
+    MPLS_STAT_ADD(MPLS_STAT_SEND_CALLS, 1);
+    MPLS_STAT_ADD(MPLS_STAT_SEND_BYTES, len);
+    return 0;
+}
+
+// Function to read one datagram from the kernel or the session's transport
+ssize_t mpls_session_recv(struct mpls_session *session, void *buf, size_t len, int flags) {
+    if (session->transport) return session->transport->recv(session, buf, len, flags);
+    return recv(session->fd, buf, len, flags);
+}
+
+// Function to read a burst of datagrams from the kernel or the session's transport
+int mpls_session_recvmmsg(struct mpls_session *session, struct mmsghdr *msgs, unsigned int vlen, int flags) {
+    if (session->transport) return session->transport->recvmmsg(session, msgs, vlen, flags);
+    return recvmmsg(session->fd, msgs, vlen, flags, NULL);
+}
+
+// Function to wait for the ACK matching a sequence number
+int mpls_session_wait_ack(struct mpls_session *session, uint32_t seq) {
+    char buffer[BUF_SIZE];
+    for (;;) {
+        MPLS_STAT_TIME_START(start);
+        int len = mpls_session_recv(session, buffer, sizeof(buffer), 0);
+        MPLS_STAT_TIME_END(MPLS_HIST_ACK_WAIT, start);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            MPLS_STAT_ERRNO(errno);
+            if (errno == ENOBUFS) MPLS_STAT_ADD(MPLS_STAT_ENOBUFS, 1);
+            return -errno;
+        }
+        MPLS_STAT_ADD(MPLS_STAT_RECV_CALLS, 1);
+        MPLS_STAT_ADD(MPLS_STAT_RECV_MESSAGES, 1);
+        MPLS_STAT_ADD(MPLS_STAT_RECV_BYTES, len);
+
+        for (struct nlmsghdr *nlh = (struct nlmsghdr *)buffer; NLMSG_OK(nlh, (unsigned int)len);
+             nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type == NLMSG_ERROR && nlh->nlmsg_seq == seq) {
+                struct mpls_ack ack;
+                mpls_parse_ack(nlh, &ack);
+                MPLS_STAT_ACK(ack.error);
+                snprintf(session->err_msg, sizeof(session->err_msg), "%s", ack.msg ? ack.msg : "");
+                session->err_offset = ack.offset;
+                return ack.error;
+            }
+        }
+    }
+}
+
+// Function to send a single request and wait for its ACK
+int mpls_session_request(struct mpls_session *session, struct nlmsghdr *nlh) {
+    uint32_t seq = mpls_session_stamp(session, nlh);
+    int ret = mpls_session_send(session, nlh, nlh->nlmsg_len);
+    if (ret < 0) return ret;
+    return mpls_session_wait_ack(session, seq);
+}
@@ -17,18 +17,87 @@
  #include <arpa/inet.h>
  #include <linux/netlink.h>
  #include <linux/rtnetlink.h>
+ #include <linux/lwtunnel.h>
  #include <sys/socket.h>
  #include <net/if.h>
  #include <netinet/in.h>
  
+ #pragma GCC visibility push(default)
+ 
+ /**
+  * @brief Keeps a Netlink helper the library uses internally out of the exports of libmplsnl.so.
+  *
+  * The library is built with -fvisibility=hidden, and the public headers
+  * export what they declare. These helpers predate the mpls_ prefix and
+  * would clash with other Netlink libraries loaded into the same process.
+  */
+ #define MPLSNL_LOCAL __attribute__((visibility("hidden")))
+ 
+ struct mpls_ifcache;
+ struct mpls_session;
+ struct mmsghdr;
+ 
  #define BUF_SIZE 4096  /**< Buffer size for Netlink messages. */
- #define LWTUNNEL_ENCAP_MPLS 1 /**< MPLS encapsulation type for lightweight tunnels. */
+ #define MPLS_SESSION_SOCK_BUF (4 * 1024 * 1024) /**< SO_SNDBUF/SO_RCVBUF requested by tuned sessions. */
+ #define MPLS_MAX_LABELS 30  /**< Deepest label stack the kernel accepts (MAX_NEW_LABELS). */
+ #define MPLS_ERR_MSG_MAX 256  /**< Longest error detail kept from an extended ACK. */
+ 
+ /**
+  * @brief Replacement for the socket calls of a session.
+  *
+  * Sessions talk to the kernel with plain sendmsg()/recv()/recvmmsg() on
+  * @c fd unless a transport is set, in which case every request and every
+  * read goes through these hooks instead (see mpls_fake.h for an in-process
+  * stand-in for the kernel). Each hook follows the contract of the system
+  * call it replaces: it returns -1 and sets errno on failure.
+  */
+ struct mpls_transport {
+     /** Sends one datagram of packed requests to the kernel. */
+     ssize_t (*send)(struct mpls_session *session, const void *buf, size_t len);
+     /** Reads one datagram, like recv(2); @p flags may include MSG_PEEK, MSG_TRUNC and MSG_DONTWAIT. */
+     ssize_t (*recv)(struct mpls_session *session, void *buf, size_t len, int flags);
+     /** Reads several datagrams, like recvmmsg(2) without a timeout. */
+     int (*recvmmsg)(struct mpls_session *session, struct mmsghdr *msgs, unsigned int vlen, int flags);
+ };
+ 
+ /**
+  * @brief A reusable Netlink route socket.
+  *
+  * Opened once and shared by every request, so socket setup is paid a single time.
+  * Requests are stamped with the kernel-assigned port id and a monotonically
+  * increasing sequence number.
+  */
+ struct mpls_session {
+     int fd;            /**< Netlink socket file descriptor. */
+     uint32_t portid;   /**< Port id assigned by the kernel at bind time. */
+     uint32_t seq;      /**< Next sequence number to hand out. */
+     int sndbuf;        /**< Effective send buffer size in bytes. */
+     int rcvbuf;        /**< Effective receive buffer size in bytes. */
+     struct mpls_ifcache *ifcache; /**< Interface cache used to resolve dev routes, NULL to use if_nametoindex(). */
+     int ack_errors;    /**< If set, batches on this session ask the kernel to ACK failed requests only. */
+     char err_msg[MPLS_ERR_MSG_MAX]; /**< Kernel's explanation of the last failed request, empty if none. */
+     uint32_t err_offset; /**< Offset in that request of the attribute the kernel rejected, 0 if unknown. */
+     const struct mpls_transport *transport; /**< Socket call hooks, NULL to talk to the kernel directly. */
+     void *transport_ctx; /**< Owner data for @c transport. */
+ };
+ 
+ /**
+  * @brief What an NLMSG_ERROR message says about the request it answers.
+  *
+  * Sessions enable NETLINK_CAP_ACK and NETLINK_EXT_ACK, so errors carry these
+  * TLVs instead of an echo of the whole request.
+  */
+ struct mpls_ack {
+     int error;          /**< 0 for an ACK, negative errno for a rejection. */
+     const char *msg;    /**< NLMSGERR_ATTR_MSG, pointing into the received message, or NULL. */
+     uint32_t offset;    /**< NLMSGERR_ATTR_OFFS: offset of the rejected attribute in the request, or 0. */
+ };
  
  /**
   * @brief Creates a Netlink socket for communication with the Linux kernel.
-  * @return File descriptor of the created socket, or -1 on failure.
+  * @return File descriptor of the created socket, or negative errno on failure.
   */
- int create_netlink_socket();
+ MPLSNL_LOCAL int create_netlink_socket();
  
  /**
   * @brief Initializes a Netlink message header.
@@ -38,7 +107,7 @@
   * @param pid Process ID or 0 for kernel communication.
   * @param seq Sequence number for message tracking.
   */
- void init_netlink_message(struct nlmsghdr *nlh, int type, int flags, pid_t pid, int seq);
+ MPLSNL_LOCAL void init_netlink_message(struct nlmsghdr *nlh, int type, int flags, pid_t pid, int seq);
  
  /**
   * @brief Initializes a routing message structure.
@@ -50,7 +119,7 @@
   * @param scope Scope of the route.
   * @param type Type of route (e.g., RTN_UNICAST).
   */
- void init_route_message(struct rtmsg *rtm, uint8_t family, uint8_t dst_len, uint8_t table, uint8_t protocol, uint8_t scope, uint8_t type);
+ MPLSNL_LOCAL void init_route_message(struct rtmsg *rtm, uint8_t family, uint8_t dst_len, uint8_t table, uint8_t protocol, uint8_t scope, uint8_t type);
  
  /**
   * @brief Adds an attribute to a Netlink message.
@@ -59,53 +128,172 @@
   * @param type Attribute type.
   * @param data Pointer to attribute data.
   * @param len Length of attribute data.
+  * @return 0 on success, -EMSGSIZE (message left unchanged) if the attribute does not fit in @p maxlen.
   */
- void add_attr(struct nlmsghdr *nlh, int maxlen, int type, void *data, int len);
+ MPLSNL_LOCAL int add_attr(struct nlmsghdr *nlh, unsigned int maxlen, int type, const void *data, int len);
+ 
+ /**
+  * @brief Opens a nested attribute; attributes added until mpls_add_attr_nest_end() go inside it.
+  * @param nlh Pointer to the Netlink message header.
+  * @param maxlen Maximum message length.
+  * @param type Attribute type, with NLA_F_NESTED or'ed in where the kernel expects it.
+  * @return The nest, to be passed to mpls_add_attr_nest_end(), or NULL if it does not fit in @p maxlen.
+  */
+ struct rtattr *mpls_add_attr_nest(struct nlmsghdr *nlh, unsigned int maxlen, int type);
+ 
+ /**
+  * @brief Closes a nested attribute opened with mpls_add_attr_nest(), fixing up its length.
+  * @param nlh Pointer to the Netlink message header.
+  * @param nest Nest returned by mpls_add_attr_nest().
+  */
+ void mpls_add_attr_nest_end(struct nlmsghdr *nlh, struct rtattr *nest);
+ 
+ /**
+  * @brief Indexes a run of attributes by type without copying them.
+  * @param tb Table of @p max + 1 entries; receives a pointer to the first attribute of each type.
+  * @param max Highest attribute type to record.
+  * @param rta First attribute.
+  * @param len Length in bytes of the attribute run.
+  */
+ void mpls_parse_rtattr(const struct rtattr *tb[], int max, const struct rtattr *rta, int len);
  
  /**
   * @brief Retrieves the index of a network interface.
   * @param ifname Name of the interface.
-  * @return Interface index on success, or -1 on failure.
+  * @return Interface index on success, or 0 with errno set on failure.
   */
- int get_interface_index(const char *ifname);
+ MPLSNL_LOCAL int get_interface_index(const char *ifname);
  
  /**
   * @brief Sends a Netlink message to the kernel.
   * @param sockfd Netlink socket file descriptor.
   * @param nlh Pointer to the Netlink message header.
   * @param len Length of the message.
-  * @return 0 on success, -1 on failure.
+  * @return 0 on success, negative errno on failure.
   */
- int send_netlink_message(int sockfd, struct nlmsghdr *nlh, int len);
+ MPLSNL_LOCAL int send_netlink_message(int sockfd, struct nlmsghdr *nlh, int len);
  
  /**
   * @brief Processes the response from the kernel after sending a Netlink message.
   * @param sockfd Netlink socket file descriptor.
-  * @return 0 on success, -1 on failure.
+  * @return 0 on success, negative errno on failure (a read error or the kernel's verdict).
   */
- int process_kernel_response(int sockfd);
+ MPLSNL_LOCAL int process_kernel_response(int sockfd);
+ 
+ /**
+  * @brief Decodes an NLMSG_ERROR message, including its extended ACK attributes.
+  * @param nlh Message of type NLMSG_ERROR.
+  * @param ack Receives the verdict; its message points into @p nlh.
+  * @return The error code of the message (0 for an ACK, negative errno otherwise).
+  */
+ int mpls_parse_ack(const struct nlmsghdr *nlh, struct mpls_ack *ack);
  
  /**
   * @brief Creates an MPLS label.
   * @param label MPLS label value (20 bits).
   * @param s_bit Bottom of Stack (BOS) bit (1 or 0).
-  * @return Encoded MPLS label as a 32-bit value.
+  * @return Encoded MPLS label as a 32-bit value, or 0 if @p label or @p s_bit is out of range.
   */
  uint32_t create_mpls_label(uint32_t label, uint8_t s_bit);
  
  /**
- * @brief Creates a full MPLS header for encapsulation.
- * 
- * This function constructs a 64-bit MPLS header, including label, 
- * Traffic Class (TC), and Bottom of Stack (S-bit), ensuring proper formatting 
- * for encapsulation in Netlink messages.
- * 
- * @param label MPLS label value (20-bit, max 1048575).
- * @param s_bit Bottom of Stack (BOS) bit (0 or 1).
- * @param tc Traffic Class (3-bit, max 7).
- * @return 64-bit encoded MPLS header.
- */
- uint64_t create_mpls_label_for_encap(uint32_t label, uint8_t s_bit, uint8_t tc);
+  * @brief Decodes an MPLS label stack entry; the reverse of create_mpls_label().
+  * @param entry Label stack entry in network byte order.
+  * @param s_bit If not NULL, receives the Bottom of Stack (BOS) bit.
+  * @return The 20-bit label value.
+  */
+ uint32_t decode_mpls_label(uint32_t entry, uint8_t *s_bit);
+ 
+ /**
+  * @brief Encodes a label stack, outermost label first.
+  *
+  * The Bottom of Stack bit is only ever set on the last entry, which is what the
+  * kernel requires for RTA_NEWDST and MPLS_IPTUNNEL_DST.
+  *
+  * @param labels Label values (20 bits each).
+  * @param count Number of labels, 1 to MPLS_MAX_LABELS.
+  * @param s_bit Bottom of Stack (BOS) bit for the last entry (1 or 0).
+  * @param stack Receives @p count label stack entries in network byte order.
+  * @return Size of the encoded stack in bytes, or -EINVAL.
+  */
+ int create_mpls_label_stack(const uint32_t *labels, int count, uint8_t s_bit, uint32_t *stack);
+ 
+ /**
+  * @brief Opens a Netlink route session.
+  *
+  * Capped and extended ACKs are requested where the kernel supports them, so a
+  * rejection costs a few dozen bytes and says which attribute was wrong.
+  *
+  * @param session Session to initialize.
+  * @param sock_buf Requested SO_SNDBUF/SO_RCVBUF size in bytes, or 0 to keep the system defaults.
+  * @return 0 on success, negative errno on failure.
+  */
+ int mpls_session_open(struct mpls_session *session, int sock_buf);
+ 
+ /**
+  * @brief Closes a session opened with mpls_session_open(), and its interface cache if it has one.
+  * @param session Session to close.
+  */
+ void mpls_session_close(struct mpls_session *session);
+ 
+ /**
+  * @brief Stamps a request with the session's port id and next sequence number.
+  * @param session Netlink session.
+  * @param nlh Request to stamp.
+  * @return The sequence number assigned to the request.
+  */
+ uint32_t mpls_session_stamp(struct mpls_session *session, struct nlmsghdr *nlh);
+ 
+ /**
+  * @brief Sends a buffer of one or more already stamped requests.
+  * @param session Netlink session.
+  * @param buf Requests packed back to back.
+  * @param len Total length of the requests.
+  * @return 0 on success, negative errno on failure.
+  */
+ int mpls_session_send(struct mpls_session *session, const void *buf, unsigned int len);
+ 
+ /**
+  * @brief Reads one datagram from the session, through its transport if it has one.
+  * @param session Netlink session.
+  * @param buf Receive buffer, may be NULL with @p len 0 for MSG_PEEK | MSG_TRUNC.
+  * @param len Size of @p buf.
+  * @param flags recv(2) flags.
+  * @return Same as recv(2): the length, or -1 with errno set.
+  */
+ ssize_t mpls_session_recv(struct mpls_session *session, void *buf, size_t len, int flags);
+ 
+ /**
+  * @brief Reads several datagrams from the session, through its transport if it has one.
+  * @param session Netlink session.
+  * @param msgs Message headers to fill in.
+  * @param vlen Number of entries in @p msgs.
+  * @param flags recvmmsg(2) flags.
+  * @return Same as recvmmsg(2): the number of datagrams, or -1 with errno set.
+  */
+ int mpls_session_recvmmsg(struct mpls_session *session, struct mmsghdr *msgs, unsigned int vlen, int flags);
+ 
+ /**
+  * @brief Waits for the ACK of a given sequence number, skipping unrelated messages.
+  *
+  * On failure, the kernel's extended ACK is left in @p session->err_msg and
+  * @p session->err_offset.
+  *
+  * @param session Netlink session.
+  * @param seq Sequence number to wait for.
+  * @return 0 if the kernel accepted the request, negative errno otherwise.
+  */
+ int mpls_session_wait_ack(struct mpls_session *session, uint32_t seq);
+ 
+ /**
+  * @brief Stamps, sends and waits for the ACK of a single request.
+  * @param session Netlink session.
+  * @param nlh Request built with NLM_F_ACK set.
+  * @return 0 if the kernel accepted the request, negative errno otherwise.
+  */
+ int mpls_session_request(struct mpls_session *session, struct nlmsghdr *nlh);
+ 
+ #pragma GCC visibility pop
  
  #endif // MPLS_CORE_H
  
\ No newline at end of file
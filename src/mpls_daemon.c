@@ -0,0 +1,505 @@
+// mpls_daemon.c
+
+#include "mpls_daemon.h"
+#include "mpls_core.h"
+#include "mpls_batch.h"
+#include "mpls_ifcache.h"
+#include <poll.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/un.h>
+
+#define DAEMON_MAX_ARGS 64
+#define DAEMON_ID_MAX 64                 // Longest request id echoed back
+#define DAEMON_OUT_MAX (1024 * 1024)     // Stop reading from a client that does not read its results
+#define DAEMON_MAX_PENDING (2 * BATCH_WINDOW)
+
+struct daemon_client {
+    int fd;                  // -1 if the slot is free
+    unsigned int gen;        // Bumped on every accept, so results for a previous client are dropped
+    unsigned int pending;    // Requests queued but not answered yet
+    int eof;                 // Client closed its side: drop it once every result is written
+    char in[MPLSD_LINE_MAX];
+    size_t inlen;
+    char *out;
+    size_t outlen;
+    size_t outcap;
+};
+
+struct daemon_request {
+    int client;              // Slot of the client, -1 if the request slot is free
+    unsigned int gen;        // Generation of the client when the request arrived
+    char id[DAEMON_ID_MAX];  // Raw JSON of the request id
+};
+
+struct daemon {
+    struct mpls_session session;
+    struct mpls_batch *batch;
+    int listen_fd;
+    struct daemon_client clients[MPLSD_MAX_CLIENTS];
+    struct daemon_request requests[DAEMON_MAX_PENDING];
+    unsigned int next_request;
+};
+
+// Function to append bytes to a client's output buffer
+static void client_write(struct daemon_client *c, const char *data, size_t len) {
+    if (c->outlen + len > c->outcap) {
+        size_t cap = c->outcap ? c->outcap : 4096;
+        while (cap < c->outlen + len) cap *= 2;
+        char *out = realloc(c->out, cap);
+        if (!out) return;  // Result is lost; the client will time out on it
+        c->out = out;
+        c->outcap = cap;
+    }
+    memcpy(c->out + c->outlen, data, len);
+    c->outlen += len;
+}
+
+// Function to append a JSON string literal, escaping what JSON requires
+static size_t json_quote(char *buf, size_t len, const char *s) {
+    size_t n = 0;
+    if (n < len) buf[n] = '"';
+    n++;
+    for (; *s; s++) {
+        unsigned char ch = (unsigned char)*s;
+        char esc[8];
+        int elen;
+        if (ch == '"' || ch == '\\') {
+            elen = snprintf(esc, sizeof(esc), "\\%c", ch);
+        } else if (ch < 0x20) {
+            elen = snprintf(esc, sizeof(esc), "\\u%04x", ch);
+        } else {
+            esc[0] = ch;
+            elen = 1;
+        }
+        for (int i = 0; i < elen; i++, n++) {
+            if (n < len) buf[n] = esc[i];
+        }
+    }
+    if (n < len) buf[n] = '"';
+    n++;
+    if (len) buf[n < len ? n : len - 1] = '\0';
+    return n;
+}
+
+// Function to send the result of one request to its client
+static void daemon_respond(struct daemon_client *c, const char *id, int error, const char *reason) {
+    char line[512];
+    int n;
+    if (!error) {
+        n = snprintf(line, sizeof(line), "{\"id\":%s,\"ok\":true}\n", id);
+    } else {
+        char msg[256];
+        json_quote(msg, sizeof(msg), reason ? reason : strerror(-error));
+        n = snprintf(line, sizeof(line), "{\"id\":%s,\"ok\":false,\"errno\":%d,\"error\":%s}\n", id, -error, msg);
+    }
+    if (n > 0 && (size_t)n < sizeof(line)) client_write(c, line, n);
+}
+
+// Function to route a kernel verdict back to the client that asked for it
+static void daemon_result(unsigned long tag, int error, const char *detail, void *arg) {
+    struct daemon *d = (struct daemon *)arg;
+    struct daemon_request *req = &d->requests[tag];
+    struct daemon_client *c = &d->clients[req->client];
+
+    if (c->fd >= 0 && c->gen == req->gen) {
+        if (!detail && error == -ENODEV) detail = "no such interface";
+        daemon_respond(c, req->id, error, detail);
+        c->pending--;
+    }
+    req->client = -1;
+}
+
+// Function to find a free request slot, waiting for ACKs if every slot is taken
+static int daemon_alloc_request(struct daemon *d) {
+    for (;;) {
+        for (unsigned int i = 0; i < DAEMON_MAX_PENDING; i++) {
+            unsigned int slot = (d->next_request + i) % DAEMON_MAX_PENDING;
+            if (d->requests[slot].client < 0) {
+                d->next_request = slot + 1;
+                return slot;
+            }
+        }
+        mpls_batch_flush(d->batch);
+        int ret = mpls_batch_poll(d->batch);
+        if (ret == -ENOBUFS) mpls_batch_recover(d->batch);
+        else if (ret < 0) return -1;
+    }
+}
+
+// Function to skip JSON whitespace
+static const char *json_skip(const char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    return p;
+}
+
+// Function to decode a JSON string literal starting at its opening quote; returns the end or NULL
+static const char *json_string(const char *p, char *out, size_t len) {
+    size_t n = 0;
+    if (*p++ != '"') return NULL;
+    while (*p != '"') {
+        char ch = *p++;
+        if (ch == '\0' || (unsigned char)ch < 0x20) return NULL;
+        if (ch == '\\') {
+            switch (*p++) {
+            case '"': ch = '"'; break;
+            case '\\': ch = '\\'; break;
+            case '/': ch = '/'; break;
+            case 'b': ch = '\b'; break;
+            case 'f': ch = '\f'; break;
+            case 'n': ch = '\n'; break;
+            case 'r': ch = '\r'; break;
+            case 't': ch = '\t'; break;
+            case 'u': {
+                // Commands are ASCII, so only \u0000-\u007f are meaningful
+                unsigned int cp;
+                if (sscanf(p, "%4x", &cp) != 1 || cp == 0 || cp > 0x7f) return NULL;
+                p += 4;
+                ch = (char)cp;
+                break;
+            }
+            default:
+                return NULL;
+            }
+        }
+        if (out) {
+            if (n + 1 >= len) return NULL;
+            out[n++] = ch;
+        }
+    }
+    if (out) out[n] = '\0';
+    return p + 1;
+}
+
+// Function to parse a request object {"id": <string|number>, "cmd": "<command>"}
+static int daemon_parse_request(const char *line, char *id, char *cmd, size_t cmdlen, const char **err) {
+    const char *p = json_skip(line);
+    strcpy(id, "null");
+    cmd[0] = '\0';
+
+    *err = "expected a JSON object";
+    if (*p++ != '{') return -1;
+    p = json_skip(p);
+    int more = *p != '}';
+    if (!more) p++;
+    while (more) {
+        char key[16];
+        p = json_string(p, key, sizeof(key));
+        if (!p) {
+            *err = "invalid member name";
+            return -1;
+        }
+        p = json_skip(p);
+        if (*p++ != ':') return -1;
+        p = json_skip(p);
+
+        const char *value = p;
+        if (*p == '"') {
+            p = json_string(p, strcmp(key, "cmd") == 0 ? cmd : NULL, cmdlen);
+            if (!p) {
+                *err = "invalid string";
+                return -1;
+            }
+        } else {
+            // Numbers, true, false and null; nested objects and arrays are not part of the protocol
+            while (*p && strchr("-+.0123456789eEtrufalsn", *p)) p++;
+            if (p == value) {
+                *err = "unsupported value";
+                return -1;
+            }
+        }
+        if (strcmp(key, "id") == 0) {
+            char *end = NULL;
+            if (*value != '"') strtod(value, &end);
+            if (*value != '"' && (end != p || !strchr("-0123456789", *value))) {
+                *err = "id must be a string or a number";
+                return -1;
+            }
+            if ((size_t)(p - value) >= DAEMON_ID_MAX) {
+                *err = "id too long";
+                return -1;
+            }
+            memcpy(id, value, p - value);
+            id[p - value] = '\0';
+        }
+
+        p = json_skip(p);
+        if (*p != ',' && *p != '}') return -1;
+        more = *p == ',';
+        p = json_skip(p + 1);
+    }
+    if (*json_skip(p) != '\0') return -1;
+
+    *err = "missing \"cmd\"";
+    return cmd[0] ? 0 : -1;
+}
+
+// Function to handle one request line from a client
+static void daemon_handle_line(struct daemon *d, int slot, const char *line) {
+    struct daemon_client *c = &d->clients[slot];
+    char id[DAEMON_ID_MAX];
+    char cmd[MPLSD_LINE_MAX];
+    const char *err;
+
+    if (daemon_parse_request(line, id, cmd, sizeof(cmd), &err) < 0) {
+        daemon_respond(c, id, -EINVAL, err);
+        return;
+    }
+
+    char *argv[DAEMON_MAX_ARGS];
+    int argc = mpls_split_route_args(cmd, argv, DAEMON_MAX_ARGS);
+    enum mpls_route_op op;
+    struct mpls_route route;
+    if (argc <= 0) {
+        daemon_respond(c, id, -EINVAL, argc < 0 ? "too many arguments" : "empty command");
+        return;
+    }
+    if (parse_mpls_command(argc, argv, &op, &route, &err) < 0) {
+        daemon_respond(c, id, -EINVAL, err);
+        return;
+    }
+    if (route.auto_label) {
+        // Clients allocate (mpls-cli does it before forwarding), so concurrent allocations cannot collide here
+        daemon_respond(c, id, -EINVAL, "auto labels must be resolved by the client");
+        return;
+    }
+
+    int tag = daemon_alloc_request(d);
+    if (tag < 0) {
+        daemon_respond(c, id, -EIO, NULL);
+        return;
+    }
+    d->requests[tag].client = slot;
+    d->requests[tag].gen = c->gen;
+    strcpy(d->requests[tag].id, id);
+    c->pending++;
+    mpls_batch_queue(d->batch, &route, op, tag);
+}
+
+// Function to accept a new client connection
+static void daemon_accept(struct daemon *d) {
+    int fd = accept4(d->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return;
+
+    for (int i = 0; i < MPLSD_MAX_CLIENTS; i++) {
+        struct daemon_client *c = &d->clients[i];
+        if (c->fd < 0) {
+            c->fd = fd;
+            c->gen++;
+            c->pending = 0;
+            c->eof = 0;
+            c->inlen = 0;
+            c->outlen = 0;
+            return;
+        }
+    }
+    close(fd);  // Too many clients
+}
+
+// Function to drop a client connection
+static void daemon_drop(struct daemon_client *c) {
+    close(c->fd);
+    c->fd = -1;
+}
+
+// Function to read from a client and handle every complete line
+static void daemon_read(struct daemon *d, int slot) {
+    struct daemon_client *c = &d->clients[slot];
+    ssize_t n = recv(c->fd, c->in + c->inlen, sizeof(c->in) - c->inlen, 0);
+    if (n == 0) {
+        c->eof = 1;
+        return;
+    }
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EINTR) daemon_drop(c);
+        return;
+    }
+    c->inlen += n;
+
+    char *start = c->in;
+    char *nl;
+    while ((nl = memchr(start, '\n', c->inlen - (start - c->in))) != NULL) {
+        *nl = '\0';
+        if (json_skip(start)[0] != '\0') daemon_handle_line(d, slot, start);
+        start = nl + 1;
+    }
+    c->inlen -= start - c->in;
+    memmove(c->in, start, c->inlen);
+
+    if (c->inlen == sizeof(c->in)) {
+        daemon_respond(c, "null", -EMSGSIZE, "request line too long");
+        c->inlen = 0;
+        c->eof = 1;  // The rest of the line cannot be told apart from the next request
+    }
+}
+
+// Function to write as much buffered output to a client as it accepts
+static void daemon_flush_client(struct daemon_client *c) {
+    size_t off = 0;
+    while (off < c->outlen) {
+        ssize_t n = send(c->fd, c->out + off, c->outlen - off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) break;
+            daemon_drop(c);
+            return;
+        }
+        off += n;
+    }
+    c->outlen -= off;
+    memmove(c->out, c->out + off, c->outlen);
+}
+
+// Function to create the listening socket, replacing a stale socket file
+static int daemon_listen(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) return -ENAMETOOLONG;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -errno;
+
+    // A socket file nobody answers on was left behind by a daemon that died
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 || errno == EAGAIN) {
+        close(fd);
+        return -EADDRINUSE;
+    }
+    close(fd);
+    unlink(path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -errno;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        int ret = -errno;
+        close(fd);
+        return ret;
+    }
+    return fd;
+}
+
+// Function to serve requests on a UNIX socket until asked to stop
+int mpls_daemon_run(const char *path, volatile sig_atomic_t *stop) {
+    struct daemon *d = calloc(1, sizeof(*d));
+    if (!d) return -ENOMEM;
+    for (int i = 0; i < MPLSD_MAX_CLIENTS; i++) d->clients[i].fd = -1;
+    for (int i = 0; i < DAEMON_MAX_PENDING; i++) d->requests[i].client = -1;
+
+    int ret = mpls_session_open(&d->session, MPLS_SESSION_SOCK_BUF);
+    if (ret < 0) {
+        free(d);
+        return ret;
+    }
+    d->session.ifcache = mpls_ifcache_open();
+    d->batch = mpls_batch_open(&d->session, daemon_result, d);
+    d->listen_fd = d->batch ? daemon_listen(path) : -ENOMEM;
+    if (d->listen_fd < 0) {
+        ret = d->listen_fd;
+        if (d->batch) mpls_batch_finish(d->batch, NULL);
+        mpls_session_close(&d->session);
+        free(d);
+        return ret;
+    }
+
+    // Signals are only delivered inside ppoll(), so a stop request can never land
+    // between the check of the flag and the wait, where it would go unnoticed
+    sigset_t all, waiting;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &waiting);
+
+    struct pollfd pfds[3 + MPLSD_MAX_CLIENTS];
+    ret = 0;
+    while (!*stop) {
+        int n = 0;
+        pfds[n++] = (struct pollfd){.fd = d->listen_fd, .events = POLLIN};
+        pfds[n++] = (struct pollfd){.fd = d->session.fd, .events = mpls_batch_inflight(d->batch) ? POLLIN : 0};
+        pfds[n++] = (struct pollfd){.fd = d->session.ifcache ? mpls_ifcache_fd(d->session.ifcache) : -1, .events = POLLIN};
+        for (int i = 0; i < MPLSD_MAX_CLIENTS; i++) {
+            struct daemon_client *c = &d->clients[i];
+            short events = 0;
+            if (c->fd >= 0 && !c->eof && c->outlen < DAEMON_OUT_MAX) events |= POLLIN;
+            if (c->fd >= 0 && c->outlen > 0) events |= POLLOUT;
+            pfds[n++] = (struct pollfd){.fd = events ? c->fd : -1, .events = events};
+        }
+
+        if (ppoll(pfds, n, NULL, &waiting) < 0) {
+            if (errno == EINTR) continue;
+            ret = -errno;
+            break;
+        }
+
+        if (pfds[0].revents & POLLIN) daemon_accept(d);
+        if (pfds[2].revents & POLLIN) mpls_ifcache_refresh(d->session.ifcache);
+        for (int i = 0; i < MPLSD_MAX_CLIENTS; i++) {
+            short revents = pfds[3 + i].revents;
+            if (d->clients[i].fd >= 0 && (revents & (POLLIN | POLLHUP | POLLERR))) daemon_read(d, i);
+        }
+
+        // Everything read in this pass goes out together
+        mpls_batch_flush(d->batch);
+        int lost = mpls_batch_inflight(d->batch) && mpls_batch_poll(d->batch) == -ENOBUFS;
+
+        for (int i = 0; i < MPLSD_MAX_CLIENTS; i++) {
+            struct daemon_client *c = &d->clients[i];
+            if (c->fd >= 0 && c->outlen > 0) daemon_flush_client(c);
+            if (c->fd >= 0 && c->eof && c->pending == 0 && c->outlen == 0) daemon_drop(c);
+        }
+
+        // Settling lost ACKs waits for a dump, so it runs only after the answers already known went out
+        if (lost) mpls_batch_recover(d->batch);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &waiting, NULL);
+    mpls_batch_finish(d->batch, NULL);
+    for (int i = 0; i < MPLSD_MAX_CLIENTS; i++) {
+        if (d->clients[i].fd >= 0) close(d->clients[i].fd);
+        free(d->clients[i].out);
+    }
+    close(d->listen_fd);
+    unlink(path);
+    mpls_session_close(&d->session);
+    free(d);
+    return ret;
+}
+
+// Function to send one command to a running daemon and wait for its result
+int mpls_daemon_request(const char *path, const char *cmd, char *err, size_t errlen) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) return -ENAMETOOLONG;
+    strcpy(addr.sun_path, path);
+    memset(err, 0, errlen);
+
+    char line[MPLSD_LINE_MAX];
+    int n = snprintf(line, sizeof(line), "{\"id\":1,\"cmd\":");
+    n += json_quote(line + n, sizeof(line) - n, cmd);
+    if ((size_t)n + 2 >= sizeof(line)) return -EMSGSIZE;
+    n += snprintf(line + n, sizeof(line) - n, "}\n");
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -errno;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || send(fd, line, n, MSG_NOSIGNAL) != n) {
+        int ret = -errno;
+        close(fd);
+        return ret;
+    }
+
+    // The daemon answers with exactly one line
+    size_t len = 0;
+    for (;;) {
+        ssize_t r = recv(fd, line + len, sizeof(line) - 1 - len, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        len += r;
+        if (memchr(line, '\n', len) || len == sizeof(line) - 1) break;
+    }
+    close(fd);
+    line[len] = '\0';
+
+    if (strstr(line, "\"ok\":true")) return 0;
+    const char *p = strstr(line, "\"error\":");
+    if (p && errlen) {
+        json_string(p + strlen("\"error\":"), err, errlen);
+        err[errlen - 1] = '\0';
+    }
+    p = strstr(line, "\"errno\":");
+    int error = p ? atoi(p + strlen("\"errno\":")) : 0;
+    return error > 0 ? -error : -EPROTO;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file mpls_daemon.h
+ * @brief Long-running route server (mplsd) with a line-delimited JSON API on a UNIX socket.
+ *
+ * The daemon keeps one tuned Netlink session and one interface cache open for
+ * its whole lifetime. Every request that arrives while the event loop is awake
+ * is queued into the same batch and sent with a single sendmsg(), and each
+ * request gets its own result line back.
+ *
+ * Protocol, one JSON object per line in each direction:
+ *   -> {"id": 7, "cmd": "add_for 100 swap_as 200 next_hop 10.1.1.2"}
+ *   <- {"id":7,"ok":true}
+ *   <- {"id":7,"ok":false,"errno":19,"error":"No such device"}
+ * "cmd" accepts the "add_for", "replace" and "del" commands of mpls-cli; "id"
+ * is any JSON string or number and is echoed back unchanged.
+ */
+
+ #ifndef MPLS_DAEMON_H
+ #define MPLS_DAEMON_H
+ 
+ #include <stddef.h>
+ #include <signal.h>
+ 
+ #pragma GCC visibility push(default)
+ 
+ #define MPLSD_SOCKET_PATH "/run/mplsd.sock" /**< Default path of the control socket. */
+ #define MPLSD_LINE_MAX 4096                 /**< Longest request line accepted. */
+ #define MPLSD_MAX_CLIENTS 64                /**< Concurrent client connections. */
+ 
+ /**
+  * @brief Serves requests on a UNIX socket until @p stop becomes non-zero.
+  *
+  * Fails with -EADDRINUSE if another daemon already answers on @p path; a stale
+  * socket file left by a dead daemon is replaced. While it runs, the calling
+  * thread's signals are blocked except while waiting in ppoll() with the mask
+  * it had on entry, so a handler that sets @p stop always ends the wait.
+  *
+  * @param path Filesystem path of the control socket.
+  * @param stop Flag set (typically by a signal handler) to shut down.
+  * @return 0 after a clean shutdown, negative errno on failure.
+  */
+ int mpls_daemon_run(const char *path, volatile sig_atomic_t *stop);
+ 
+ /**
+  * @brief Sends one command to a running daemon and waits for its result.
+  * @param path Filesystem path of the control socket.
+  * @param cmd Command in mpls-cli syntax, e.g. "add_for 100 dev eth0".
+  * @param err Receives the daemon's error message on failure.
+  * @param errlen Size of @p err.
+  * @return 0 on success, negative errno reported by the daemon or the connection.
+  */
+ int mpls_daemon_request(const char *path, const char *cmd, char *err, size_t errlen);
+ 
+ #pragma GCC visibility pop
+ 
+ #endif // MPLS_DAEMON_H
@@ -0,0 +1,450 @@
+// mpls_dump.c
+
+#include "mpls_dump.h"
+#include "mpls_core.h"
+#include "mpls_ifcache.h"
+#include "mpls_nhobj.h"
+#include <linux/mpls_iptunnel.h>
+
+#define DUMP_BUF_MIN (32 * 1024)  // Initial receive buffer; grown if a datagram is larger
+#define MPLS_SHOW_MAX_NEXTHOPS 64
+
+// Function to index a route message's attributes in place
+int mpls_route_entry_parse(const struct nlmsghdr *nlh, struct mpls_route_entry *entry) {
+    int len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(struct rtmsg));
+    if (len < 0) return -EINVAL;
+
+    entry->nlh = nlh;
+    entry->rtm = (const struct rtmsg *)NLMSG_DATA(nlh);
+    mpls_parse_rtattr(entry->tb, RTA_MAX, RTM_RTA(entry->rtm), len);
+    return 0;
+}
+
+// Function to receive one whole datagram, growing the buffer first if it is larger
+ssize_t mpls_dump_recv(struct mpls_session *session, char **buf, size_t *size, int flags) {
+    // Peek at the real datagram length so a large part is never truncated
+    ssize_t len = mpls_session_recv(session, NULL, 0, MSG_PEEK | MSG_TRUNC | flags);
+    if (len < 0) return -errno;
+    if ((size_t)len > *size) {
+        char *bigger = realloc(*buf, len);
+        if (!bigger) return -ENOMEM;
+        *buf = bigger;
+        *size = len;
+    }
+    len = mpls_session_recv(session, *buf, *size, flags);
+    return len < 0 ? -errno : len;
+}
+
+// Function to send a dump request and hand every message of the reply to a callback
+int mpls_dump_request(struct mpls_session *session, struct nlmsghdr *req, int flags, mpls_dump_msg_cb cb, void *arg) {
+    uint32_t seq = mpls_session_stamp(session, req);
+    int ret = mpls_session_send(session, req, req->nlmsg_len);
+    if (ret < 0) return ret;
+
+    size_t size = DUMP_BUF_MIN;
+    char *buf = malloc(size);
+    if (!buf) return -ENOMEM;
+
+    int notifications = flags & MPLS_DUMP_NOTIFICATIONS;
+    int result = 0, interrupted = 0, lost = 0, done = 0;
+    while (!done) {
+        ssize_t len = mpls_dump_recv(session, &buf, &size, 0);
+        if (len == -EINTR) continue;
+        // Notifications were dropped, but the dump itself is paced by the reader: keep reading it
+        if (len == -ENOBUFS && notifications) {
+            lost = 1;
+            continue;
+        }
+        if (len < 0) {
+            result = len;
+            break;
+        }
+
+        int remaining = len;
+        for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, (unsigned int)remaining);
+             nlh = NLMSG_NEXT(nlh, remaining)) {
+            // Notifications carry sequence number 0 and are handed over in arrival order with the dump
+            if (nlh->nlmsg_seq != seq && !(notifications && nlh->nlmsg_seq == 0)) continue;  // Stale reply
+
+            if (nlh->nlmsg_seq == seq && nlh->nlmsg_type == NLMSG_DONE) {
+                done = 1;
+                break;
+            }
+            if (nlh->nlmsg_seq == seq && nlh->nlmsg_type == NLMSG_ERROR) {
+                struct nlmsgerr *err = (struct nlmsgerr *)NLMSG_DATA(nlh);
+                if (err->error && result == 0) result = err->error;
+                done = 1;
+                break;
+            }
+            if (nlh->nlmsg_seq == seq && (nlh->nlmsg_flags & NLM_F_DUMP_INTR)) interrupted = 1;
+            if (result < 0) continue;
+
+            int r = cb(nlh, arg);
+            if (r < 0) result = r;  // Stop visiting, but keep draining the dump
+        }
+    }
+
+    free(buf);
+    if (result == 0 && lost) result = -ENOBUFS;
+    if (result == 0 && interrupted) result = -EINTR;
+    return result;
+}
+
+struct dump_routes {
+    mpls_dump_cb cb;
+    void *arg;
+    unsigned char family;
+};
+
+// Function to index one dumped route message and hand it to the route callback
+static int dump_route_msg(const struct nlmsghdr *nlh, void *arg) {
+    const struct dump_routes *routes = (const struct dump_routes *)arg;
+    struct mpls_route_entry entry;
+    if (nlh->nlmsg_type != RTM_NEWROUTE || mpls_route_entry_parse(nlh, &entry) < 0) return 0;
+    // A kernel without the family's route table answers with every family's routes
+    if (entry.rtm->rtm_family != routes->family) return 0;
+    return routes->cb(&entry, routes->arg);
+}
+
+// Function to dump all routes of a family, invoking a callback per route
+int mpls_dump_routes(struct mpls_session *session, unsigned char family, mpls_dump_cb cb, void *arg) {
+    struct {
+        struct nlmsghdr nlh;
+        struct rtmsg rtm;
+    } req;
+    memset(&req, 0, sizeof(req));
+    init_netlink_message(&req.nlh, RTM_GETROUTE, NLM_F_REQUEST | NLM_F_DUMP, 0, 0);
+    req.rtm.rtm_family = family;
+
+    struct dump_routes routes = {cb, arg, family};
+    return mpls_dump_request(session, &req.nlh, 0, dump_route_msg, &routes);
+}
+
+// Function to decode a label stack attribute
+int mpls_entry_labels(const struct rtattr *rta, uint32_t *labels, int max) {
+    if (!rta) return 0;
+    const uint32_t *stack = (const uint32_t *)RTA_DATA(rta);
+    int count = RTA_PAYLOAD(rta) / sizeof(uint32_t);
+    if (count > max) count = max;
+    for (int i = 0; i < count; i++) {
+        labels[i] = decode_mpls_label(stack[i], NULL);
+    }
+    return count;
+}
+
+// Function to find an MPLS_IPTUNNEL_* attribute inside an RTA_ENCAP attribute
+const struct rtattr *mpls_entry_encap_attr(const struct mpls_route_entry *entry, int type) {
+    const struct rtattr *encap_type = entry->tb[RTA_ENCAP_TYPE];
+    const struct rtattr *encap = entry->tb[RTA_ENCAP];
+    if (!encap_type || !encap || RTA_PAYLOAD(encap_type) < sizeof(uint16_t)) return NULL;
+    if (*(const uint16_t *)RTA_DATA(encap_type) != LWTUNNEL_ENCAP_MPLS) return NULL;
+    if (type < 0 || type > MPLS_IPTUNNEL_MAX) return NULL;
+
+    const struct rtattr *tb[MPLS_IPTUNNEL_MAX + 1];
+    mpls_parse_rtattr(tb, MPLS_IPTUNNEL_MAX, RTA_DATA(encap), RTA_PAYLOAD(encap));
+    return tb[type];
+}
+
+// Function to find the MPLS label stack inside an RTA_ENCAP attribute
+const struct rtattr *mpls_entry_encap_labels(const struct mpls_route_entry *entry) {
+    return mpls_entry_encap_attr(entry, MPLS_IPTUNNEL_DST);
+}
+
+// Function to extract the IPv4 next hop of a route
+int mpls_entry_via(const struct mpls_route_entry *entry, struct in_addr *via) {
+    const struct rtattr *rta = entry->tb[RTA_VIA];
+    if (rta && RTA_PAYLOAD(rta) >= sizeof(uint16_t) + sizeof(*via)) {
+        const struct rtvia *rv = (const struct rtvia *)RTA_DATA(rta);
+        if (rv->rtvia_family != AF_INET) return 0;
+        memcpy(via, rv->rtvia_addr, sizeof(*via));
+        return 1;
+    }
+    rta = entry->tb[RTA_GATEWAY];
+    if (rta && RTA_PAYLOAD(rta) == sizeof(*via)) {
+        memcpy(via, RTA_DATA(rta), sizeof(*via));
+        return 1;
+    }
+    return 0;
+}
+
+// Function to extract the output interface of a route
+int mpls_entry_oif(const struct mpls_route_entry *entry) {
+    const struct rtattr *rta = entry->tb[RTA_OIF];
+    if (!rta || RTA_PAYLOAD(rta) < sizeof(int)) return 0;
+    return *(const int *)RTA_DATA(rta);
+}
+
+// Function to extract the nexthop object a route uses
+uint32_t mpls_entry_nhid(const struct mpls_route_entry *entry) {
+    const struct rtattr *rta = entry->tb[RTA_NH_ID];
+    if (!rta || RTA_PAYLOAD(rta) < sizeof(uint32_t)) return 0;
+    return *(const uint32_t *)RTA_DATA(rta);
+}
+
+// Function to decode one leg from a set of route attributes
+static void dump_fill_nexthop(const struct mpls_route_entry *leg, struct mpls_entry_nexthop *nh) {
+    nh->has_via = mpls_entry_via(leg, &nh->via);
+    if (!nh->ifindex) nh->ifindex = mpls_entry_oif(leg);
+    if (leg->rtm->rtm_family == AF_MPLS) {
+        nh->nlabels = mpls_entry_labels(leg->tb[RTA_NEWDST], nh->labels, MPLS_MAX_LABELS);
+    } else {
+        nh->nlabels = mpls_entry_labels(mpls_entry_encap_labels(leg), nh->labels, MPLS_MAX_LABELS);
+        const struct rtattr *ttl = mpls_entry_encap_attr(leg, MPLS_IPTUNNEL_TTL);
+        if (ttl && RTA_PAYLOAD(ttl) >= sizeof(uint8_t)) nh->ttl = *(const uint8_t *)RTA_DATA(ttl);
+    }
+}
+
+// Function to decode the forwarding legs of a route
+int mpls_entry_nexthops(const struct mpls_route_entry *entry, struct mpls_entry_nexthop *nhs, int max) {
+    const struct rtattr *mp = entry->tb[RTA_MULTIPATH];
+    if (max < 1) return 0;
+
+    if (!mp) {
+        memset(&nhs[0], 0, sizeof(nhs[0]));
+        nhs[0].weight = 1;
+        dump_fill_nexthop(entry, &nhs[0]);
+        return 1;
+    }
+
+    int count = 0;
+    int len = RTA_PAYLOAD(mp);
+    const struct rtnexthop *rtnh = (const struct rtnexthop *)RTA_DATA(mp);
+    while (count < max && len >= (int)sizeof(*rtnh) && rtnh->rtnh_len >= sizeof(*rtnh) && rtnh->rtnh_len <= len) {
+        struct mpls_entry_nexthop *nh = &nhs[count++];
+        memset(nh, 0, sizeof(*nh));
+        nh->ifindex = rtnh->rtnh_ifindex;
+        nh->weight = rtnh->rtnh_hops + 1;
+
+        // Each leg carries its own RTA_VIA/RTA_GATEWAY and RTA_NEWDST/RTA_ENCAP
+        struct mpls_route_entry leg = {.nlh = entry->nlh, .rtm = entry->rtm};
+        mpls_parse_rtattr(leg.tb, RTA_MAX, RTNH_DATA(rtnh), rtnh->rtnh_len - RTNH_LENGTH(0));
+        dump_fill_nexthop(&leg, nh);
+
+        len -= RTNH_ALIGN(rtnh->rtnh_len);
+        rtnh = RTNH_NEXT(rtnh);
+    }
+    return count;
+}
+
+struct show_ctx {
+    FILE *out;
+    enum mpls_show_format format;
+    struct mpls_ifcache *ifcache;
+    char ifname[IF_NAMESIZE];
+};
+
+// Function to resolve an interface index to its name
+static const char *show_ifname(struct show_ctx *ctx, int ifindex) {
+    if (!mpls_ifcache_name(ctx->ifcache, ifindex, ctx->ifname)) {
+        snprintf(ctx->ifname, IF_NAMESIZE, "if%d", ifindex);
+    }
+    return ctx->ifname;
+}
+
+// Function to print a label stack as "a/b/c" or a JSON array
+static void show_labels(struct show_ctx *ctx, const uint32_t *labels, int count) {
+    if (ctx->format == MPLS_SHOW_JSON) fputc('[', ctx->out);
+    for (int i = 0; i < count; i++) {
+        if (i) fputc(ctx->format == MPLS_SHOW_JSON ? ',' : '/', ctx->out);
+        fprintf(ctx->out, "%u", labels[i]);
+    }
+    if (ctx->format == MPLS_SHOW_JSON) fputc(']', ctx->out);
+}
+
+// Function to print a JSON string, escaping quotes and backslashes
+static void show_json_string(FILE *out, const char *str) {
+    fputc('"', out);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') fputc('\\', out);
+        fputc(*str, out);
+    }
+    fputc('"', out);
+}
+
+// Function to print the target of one leg ("next_hop X" or "dev Y")
+static void show_target(struct show_ctx *ctx, const struct mpls_entry_nexthop *nh) {
+    char via[INET_ADDRSTRLEN];
+    if (nh->has_via) {
+        fprintf(ctx->out, " next_hop %s", inet_ntop(AF_INET, &nh->via, via, sizeof(via)));
+    } else {
+        fprintf(ctx->out, " dev %s", nh->ifindex ? show_ifname(ctx, nh->ifindex) : "?");
+    }
+}
+
+// Function to print one leg as a JSON object
+static void show_json_nexthop(struct show_ctx *ctx, const struct mpls_entry_nexthop *nh, int with_weight) {
+    char via[INET_ADDRSTRLEN];
+    FILE *out = ctx->out;
+    fputs("\"out_labels\":", out);
+    show_labels(ctx, nh->labels, nh->nlabels);
+    if (nh->has_via) fprintf(out, ",\"via\":\"%s\"", inet_ntop(AF_INET, &nh->via, via, sizeof(via)));
+    if (nh->ifindex) {
+        fputs(",\"dev\":", out);
+        show_json_string(out, show_ifname(ctx, nh->ifindex));
+    }
+    if (nh->ttl) fprintf(out, ",\"ttl\":%d", nh->ttl);
+    if (with_weight) fprintf(out, ",\"weight\":%d", nh->weight);
+}
+
+// Function to print the destination of an IPv4 route, with its prefix length unless it is a host route
+static void show_dst(const struct mpls_route_entry *entry, char *dst) {
+    struct in_addr addr = {0};
+    if (entry->tb[RTA_DST]) memcpy(&addr, RTA_DATA(entry->tb[RTA_DST]), sizeof(addr));
+    inet_ntop(AF_INET, &addr, dst, INET_ADDRSTRLEN);
+    if (entry->rtm->rtm_dst_len != 32) {
+        snprintf(dst + strlen(dst), 5, "/%u", entry->rtm->rtm_dst_len);
+    }
+}
+
+// Function to print a route through a nexthop object as "[dst_ip] nhid [id]"; the object holds the rest
+static void show_nhid_route(FILE *out, enum mpls_show_format format, const struct mpls_route_entry *entry,
+                            const char *prefix) {
+    char dst[INET_ADDRSTRLEN + 4];
+    show_dst(entry, dst);
+    fputs(prefix, out);
+    if (format == MPLS_SHOW_JSON) {
+        fprintf(out, "\"family\":\"inet\",\"dst\":\"%s\",\"nhid\":%u", dst, mpls_entry_nhid(entry));
+    } else {
+        fprintf(out, "%s nhid %u", dst, mpls_entry_nhid(entry));
+    }
+}
+
+// Function to print one route in "add_for" syntax or as the members of a JSON object
+int mpls_print_route_entry(FILE *out, enum mpls_show_format format, const struct mpls_route_entry *entry,
+                           struct mpls_ifcache *ifcache, const char *prefix) {
+    struct show_ctx show = {.out = out, .format = format, .ifcache = ifcache};
+    struct show_ctx *ctx = &show;
+    struct mpls_entry_nexthop nhs[MPLS_SHOW_MAX_NEXTHOPS];
+    char dst[INET_ADDRSTRLEN + 4] = "";
+    uint32_t in_label = 0;
+
+    if (entry->rtm->rtm_family == AF_MPLS) {
+        if (mpls_entry_labels(entry->tb[RTA_DST], &in_label, 1) != 1) return 0;
+    } else {
+        // Plain IPv4 routes are not ours to show
+        if (!entry->tb[RTA_MULTIPATH] && !mpls_entry_encap_labels(entry)) return 0;
+        show_dst(entry, dst);
+    }
+
+    int nnh = mpls_entry_nexthops(entry, nhs, MPLS_SHOW_MAX_NEXTHOPS);
+    if (entry->rtm->rtm_family == AF_INET) {
+        int has_encap = 0;
+        for (int i = 0; i < nnh; i++) has_encap |= nhs[i].nlabels > 0;
+        if (!has_encap) return 0;
+
+        // The kernel repeats the object's next hops in the route; show the reference instead
+        if (mpls_entry_nhid(entry)) {
+            show_nhid_route(out, format, entry, prefix);
+            return 1;
+        }
+    }
+    int multipath = entry->tb[RTA_MULTIPATH] != NULL;
+
+    fputs(prefix, out);
+    if (format == MPLS_SHOW_JSON) {
+        if (entry->rtm->rtm_family == AF_MPLS) {
+            fprintf(out, "\"family\":\"mpls\",\"label\":%u", in_label);
+        } else {
+            fprintf(out, "\"family\":\"inet\",\"dst\":\"%s\"", dst);
+        }
+        if (multipath) {
+            fputs(",\"nexthops\":[", out);
+            for (int i = 0; i < nnh; i++) {
+                fputs(i ? ",{" : "{", out);
+                show_json_nexthop(ctx, &nhs[i], 1);
+                fputc('}', out);
+            }
+            fputc(']', out);
+        } else if (nnh) {
+            fputc(',', out);
+            show_json_nexthop(ctx, &nhs[0], 0);
+        }
+    } else if (multipath) {
+        // "[label] multipath next_hop X swap_as Y weight W dev Z ..."
+        if (entry->rtm->rtm_family == AF_MPLS) {
+            fprintf(out, "%u multipath", in_label);
+        } else {
+            fprintf(out, "%s multipath", dst);
+        }
+        for (int i = 0; i < nnh; i++) {
+            show_target(ctx, &nhs[i]);
+            if (nhs[i].nlabels) {
+                fputs(entry->rtm->rtm_family == AF_MPLS ? " swap_as " : " push ", out);
+                show_labels(ctx, nhs[i].labels, nhs[i].nlabels);
+                if (nhs[i].ttl) fprintf(out, " ttl %d", nhs[i].ttl);
+            }
+            if (nhs[i].weight > 1) fprintf(out, " weight %d", nhs[i].weight);
+        }
+    } else if (nnh) {
+        // Same grammar as "add_for", so the output can be fed back to "batch"
+        if (entry->rtm->rtm_family == AF_MPLS) {
+            fprintf(out, "%u", in_label);
+            if (nhs[0].nlabels) {
+                fputs(" swap_as ", out);
+                show_labels(ctx, nhs[0].labels, nhs[0].nlabels);
+            }
+        } else {
+            fprintf(out, "%s push ", dst);
+            show_labels(ctx, nhs[0].labels, nhs[0].nlabels);
+            if (nhs[0].ttl) fprintf(out, " ttl %d", nhs[0].ttl);
+        }
+        show_target(ctx, &nhs[0]);
+    } else {
+        fprintf(out, "%u", in_label);
+    }
+    return 1;
+}
+
+struct show_list {
+    FILE *out;
+    enum mpls_show_format format;
+    struct mpls_ifcache *ifcache;
+    unsigned long count;
+    uint32_t *nh_ids;  // Nexthop objects that push labels (see mpls_nhobj_ids())
+    size_t nnh_ids;
+};
+
+// Function to print one dumped route as an element of the listing
+static int show_route(const struct mpls_route_entry *entry, void *arg) {
+    struct show_list *list = (struct show_list *)arg;
+    const char *prefix = list->format == MPLS_SHOW_JSON ? (list->count ? ",\n  {" : "\n  {") : "";
+    uint32_t nhid = entry->rtm->rtm_family == AF_INET ? mpls_entry_nhid(entry) : 0;
+
+    // Routes through a nexthop object are ours if the object pushes labels, whether or not the dump repeats them
+    if (nhid) {
+        if (!mpls_nhobj_has_id(list->nh_ids, list->nnh_ids, nhid)) return 0;
+        show_nhid_route(list->out, list->format, entry, prefix);
+    } else if (!mpls_print_route_entry(list->out, list->format, entry, list->ifcache, prefix)) {
+        return 0;
+    }
+    fputs(list->format == MPLS_SHOW_JSON ? "}" : "\n", list->out);
+    list->count++;
+    return 0;
+}
+
+// Function to print the LFIB and the MPLS-encap IPv4 routes
+int print_mpls_routes(struct mpls_session *session, FILE *out, enum mpls_show_format format) {
+    struct show_list list = {.out = out, .format = format, .ifcache = session->ifcache};
+
+    // Without a session cache, fill a private one: a single link dump instead of a lookup per route
+    struct mpls_ifcache *own = NULL;
+    if (!list.ifcache) list.ifcache = own = mpls_ifcache_open();
+
+    int ret = mpls_nhobj_ids(session, &list.nh_ids, &list.nnh_ids);
+    if (ret < 0) {
+        mpls_ifcache_close(own);
+        return ret;
+    }
+
+    if (format == MPLS_SHOW_JSON) fputc('[', out);
+    ret = mpls_dump_routes(session, AF_MPLS, show_route, &list);
+    if (ret == 0 || ret == -EINTR) {
+        int ret2 = mpls_dump_routes(session, AF_INET, show_route, &list);
+        if (ret == 0) ret = ret2;
+    }
+    if (format == MPLS_SHOW_JSON) fputs(list.count ? "\n]\n" : "]\n", out);
+
+    free(list.nh_ids);
+    mpls_ifcache_close(own);
+    return ret;
+}
@@ -0,0 +1,219 @@
+/**
+ * @file mpls_dump.h
+ * @brief Streaming dump of the MPLS forwarding table (LFIB) and MPLS-encap IPv4 routes.
+ *
+ * Routes are read with RTM_GETROUTE/NLM_F_DUMP and handed to a callback one at a
+ * time. Attributes are indexed in place inside the receive buffer, which is reused
+ * for every datagram, so memory use does not depend on the size of the table.
+ * The same reader, mpls_dump_request(), serves the other rtnetlink dumps of
+ * the library (links, addresses, statistics, nexthop objects).
+ */
+
+ #ifndef MPLS_DUMP_H
+ #define MPLS_DUMP_H
+ 
+ #include <stdio.h>
+ #include <stdint.h>
+ #include <netinet/in.h>
+ #include <linux/rtnetlink.h>
+ #include "mpls_core.h"
+ 
+ #pragma GCC visibility push(default)
+ 
+ /**
+  * @brief Output formats understood by print_mpls_routes().
+  */
+ enum mpls_show_format {
+     MPLS_SHOW_PLAIN,  /**< One route per line in "add_for" syntax. */
+     MPLS_SHOW_JSON    /**< A JSON array with one object per route. */
+ };
+ 
+ /**
+  * @brief One dumped route; all pointers refer to the receive buffer.
+  *
+  * Only valid for the duration of the callback.
+  */
+ struct mpls_route_entry {
+     const struct nlmsghdr *nlh;          /**< Route message as received. */
+     const struct rtmsg *rtm;             /**< Route header. */
+     const struct rtattr *tb[RTA_MAX + 1]; /**< Attributes indexed by type, NULL when absent. */
+ };
+ 
+ /**
+  * @brief One forwarding leg of a dumped route, decoded from RTA_MULTIPATH or the top-level attributes.
+  */
+ struct mpls_entry_nexthop {
+     int ifindex;                       /**< Output interface, 0 if absent. */
+     int has_via;                       /**< Non-zero if @c via holds an IPv4 next hop. */
+     struct in_addr via;                /**< IPv4 next hop. */
+     int weight;                        /**< rtnh_hops + 1; 1 for single-path routes. */
+     int nlabels;                       /**< Out labels: swapped for MPLS, pushed for IPv4. */
+     uint32_t labels[MPLS_MAX_LABELS];  /**< Out label values, outermost first. */
+     int ttl;                           /**< TTL of pushed labels (MPLS_IPTUNNEL_TTL), 0 if not set. */
+ };
+ 
+ /**
+  * @brief Callback invoked for every dumped route.
+  * @param entry Route being visited.
+  * @param arg User argument passed to mpls_dump_routes().
+  * @return 0 to continue, negative to stop visiting (the dump is still drained).
+  */
+ typedef int (*mpls_dump_cb)(const struct mpls_route_entry *entry, void *arg);
+ 
+ /**
+  * @brief Callback invoked for every message of a dump reply, other than NLMSG_DONE and NLMSG_ERROR.
+  * @param nlh Message, only valid for the duration of the callback.
+  * @param arg User argument passed to mpls_dump_request().
+  * @return 0 to continue, negative to stop visiting (the dump is still drained).
+  */
+ typedef int (*mpls_dump_msg_cb)(const struct nlmsghdr *nlh, void *arg);
+ 
+ #define MPLS_DUMP_NOTIFICATIONS 0x1  /**< mpls_dump_request(): also pass notifications, and read on past an overrun. */
+ 
+ /**
+  * @brief Receives one whole datagram, growing the buffer first if the datagram is larger.
+  * @param session Netlink session.
+  * @param buf Receive buffer allocated with malloc(); may be replaced by a larger one.
+  * @param size Size of @p *buf, updated when it grows.
+  * @param flags recv() flags, e.g. MSG_DONTWAIT.
+  * @return Length of the datagram, or negative errno (including -EINTR and -EAGAIN).
+  */
+ ssize_t mpls_dump_recv(struct mpls_session *session, char **buf, size_t *size, int flags);
+ 
+ /**
+  * @brief Sends a dump request and hands every message of the reply to a callback.
+  *
+  * Stamps @p req with the session's next sequence number, reads the multi-part
+  * reply (NLM_F_MULTI) up to NLMSG_DONE with mpls_dump_recv(), and skips
+  * replies to earlier requests. With MPLS_DUMP_NOTIFICATIONS, notifications
+  * (sequence number 0) read meanwhile go to @p cb as well, in arrival order, and
+  * an overrun of the socket does not stop the dump: it is read to the end and
+  * reported as -ENOBUFS.
+  *
+  * @param session Netlink session.
+  * @param req Request with NLM_F_DUMP set.
+  * @param flags 0 or MPLS_DUMP_NOTIFICATIONS.
+  * @param cb Callback invoked for each message.
+  * @param arg User argument for @p cb.
+  * @return 0 on success, the callback's negative return value, -EINTR if the table changed
+  *         under the dump (NLM_F_DUMP_INTR), -ENOBUFS if notifications were lost, or negative errno.
+  */
+ int mpls_dump_request(struct mpls_session *session, struct nlmsghdr *req, int flags, mpls_dump_msg_cb cb, void *arg);
+ 
+ /**
+  * @brief Indexes the attributes of an RTM_NEWROUTE/RTM_DELROUTE message in place.
+  * @param nlh Route message.
+  * @param entry Entry to fill in; keeps pointers into @p nlh.
+  * @return 0 on success, -EINVAL if the message is too short.
+  */
+ int mpls_route_entry_parse(const struct nlmsghdr *nlh, struct mpls_route_entry *entry);
+ 
+ /**
+  * @brief Dumps all routes of an address family.
+  *
+  * Reads the reply with mpls_dump_request(), so the receive buffer is sized
+  * with MSG_PEEK | MSG_TRUNC before each read. Routes of other families are
+  * skipped: a kernel without MPLS support answers an AF_MPLS dump with every
+  * family's routes rather than an error, so its LFIB reads as empty.
+  *
+  * @param session Netlink session.
+  * @param family AF_MPLS for the LFIB, AF_INET for IPv4 routes (all of them).
+  * @param cb Callback invoked for each route.
+  * @param arg User argument for @p cb.
+  * @return 0 on success, the callback's negative return value, or negative errno.
+  */
+ int mpls_dump_routes(struct mpls_session *session, unsigned char family, mpls_dump_cb cb, void *arg);
+ 
+ /**
+  * @brief Decodes a label stack attribute (RTA_DST, RTA_NEWDST or MPLS_IPTUNNEL_DST).
+  * @param rta Attribute holding label stack entries, may be NULL.
+  * @param labels Receives up to @p max label values.
+  * @param max Capacity of @p labels.
+  * @return Number of labels decoded.
+  */
+ int mpls_entry_labels(const struct rtattr *rta, uint32_t *labels, int max);
+ 
+ /**
+  * @brief Returns the MPLS_IPTUNNEL_DST label stack of an MPLS-encap IPv4 route.
+  * @param entry Dumped route.
+  * @return The nested label stack attribute, or NULL if the route has no MPLS encap.
+  */
+ const struct rtattr *mpls_entry_encap_labels(const struct mpls_route_entry *entry);
+ 
+ /**
+  * @brief Returns one MPLS_IPTUNNEL_* attribute from the RTA_ENCAP nest of an MPLS-encap IPv4 route.
+  * @param entry Dumped route.
+  * @param type Attribute type, e.g. MPLS_IPTUNNEL_DST or MPLS_IPTUNNEL_TTL.
+  * @return The nested attribute, or NULL if absent or the route has no MPLS encap.
+  */
+ const struct rtattr *mpls_entry_encap_attr(const struct mpls_route_entry *entry, int type);
+ 
+ /**
+  * @brief Returns the IPv4 next hop of a route (RTA_VIA for MPLS, RTA_GATEWAY for IPv4).
+  * @param entry Dumped route.
+  * @param via Receives the next hop.
+  * @return 1 if the route has an IPv4 next hop, 0 otherwise.
+  */
+ int mpls_entry_via(const struct mpls_route_entry *entry, struct in_addr *via);
+ 
+ /**
+  * @brief Returns the output interface of a route.
+  * @param entry Dumped route.
+  * @return Interface index, or 0 if the route has no RTA_OIF.
+  */
+ int mpls_entry_oif(const struct mpls_route_entry *entry);
+ 
+ /**
+  * @brief Returns the kernel nexthop object a route uses (RTA_NH_ID).
+  * @param entry Dumped route.
+  * @return Object id, or 0 if the route carries its own next hops.
+  */
+ uint32_t mpls_entry_nhid(const struct mpls_route_entry *entry);
+ 
+ /**
+  * @brief Decodes the forwarding legs of a route.
+  *
+  * Single-path routes yield one leg built from the top-level attributes;
+  * multipath routes yield one leg per struct rtnexthop in RTA_MULTIPATH.
+  *
+  * @param entry Dumped route.
+  * @param nhs Receives up to @p max legs.
+  * @param max Capacity of @p nhs.
+  * @return Number of legs decoded.
+  */
+ int mpls_entry_nexthops(const struct mpls_route_entry *entry, struct mpls_entry_nexthop *nhs, int max);
+ 
+ /**
+  * @brief Prints one route in "add_for" syntax, or as the members of a JSON object.
+  *
+  * Nothing is printed for routes without MPLS forwarding (plain IPv4 routes).
+  * A route through a nexthop object is printed as "[dst_ip] nhid [id]" when
+  * the kernel repeats the object's MPLS encap in the route.
+  * The caller adds the line break, or the braces around the JSON members.
+  *
+  * @param out Output stream.
+  * @param format Output format.
+  * @param entry Route to print.
+  * @param ifcache Interface cache used to name output interfaces, may be NULL.
+  * @param prefix Text printed just before the route, only if it is printed.
+  * @return 1 if the route was printed, 0 if it was skipped.
+  */
+ int mpls_print_route_entry(FILE *out, enum mpls_show_format format, const struct mpls_route_entry *entry,
+                            struct mpls_ifcache *ifcache, const char *prefix);
+ 
+ /**
+  * @brief Prints the LFIB followed by the MPLS-encap IPv4 routes.
+  *
+  * IPv4 routes through a nexthop object that pushes labels are listed as
+  * "[dst_ip] nhid [id]" (see mpls_nhobj_ids()).
+  *
+  * @param session Netlink session.
+  * @param out Output stream.
+  * @param format Output format.
+  * @return 0 on success, negative errno on failure.
+  */
+ int print_mpls_routes(struct mpls_session *session, FILE *out, enum mpls_show_format format);
+ 
+ #pragma GCC visibility pop
+ 
+ #endif // MPLS_DUMP_H
@@ -0,0 +1,658 @@
+// mpls_fake.c
+
+#include "mpls_fake.h"
+#include "mpls_core.h"
+#include "mpls_labels.h"
+#include <linux/nexthop.h>
+#include <time.h>
+
+#define FAKE_DUMP_CHUNK 16384   // Bytes of routes per dump datagram, about what the kernel packs
+#define FAKE_INET_BUCKETS 1024  // Initial size of the IPv4 hash, doubled when the load reaches 1
+#define FAKE_ACK_MAX (NLMSG_SPACE(sizeof(struct nlmsgerr)) + 256)
+
+struct fake_route {
+    struct fake_route *next;  // IPv4 hash chain, or the list of nexthop objects sorted by id
+    uint32_t dst;             // IPv4 key: destination, prefix length and table; the id of a nexthop object
+    uint8_t dst_len;
+    uint8_t table;
+    uint32_t nhid;            // Nexthop object an IPv4 route uses, 0 if none
+    unsigned int len;         // Length of the stored message
+    struct nlmsghdr msg[];    // The RTM_NEWROUTE that created the route, replayed by dumps
+};
+
+struct fake_cursor {
+    int inet;     // Walking the IPv4 table rather than the labels
+    size_t pos;   // Next label, or next IPv4 bucket
+    size_t skip;  // Routes of that bucket already dumped
+};
+
+struct mpls_fake {
+    int fd;                      // Our end of the socketpair
+    struct mpls_fake_options options;
+    struct fake_route **labels;  // Label routes indexed by label, allocated on first use
+    struct fake_route **inet;    // IPv4 routes hashed by destination
+    size_t inet_buckets, ninet, nlabels;
+    struct fake_route *nexthops; // Nexthop objects (RTM_NEWNEXTHOP messages), sorted by id
+    unsigned long acks;          // ACKs produced, for enobufs_every
+    int overrun;                 // A reply was dropped; the next read fails with ENOBUFS
+    struct {
+        int active;
+        int changed;             // Tables changed since the dump started: NLM_F_DUMP_INTR
+        int nexthops;            // Dumping nexthop objects rather than routes
+        unsigned char family;
+        uint32_t seq, portid;
+        struct fake_cursor cursor;
+    } dump;
+    char chunk[FAKE_DUMP_CHUNK];
+};
+
+// Function to queue a reply on the session's socket, dropping it like an overrun if the socket is full
+static int fake_reply(struct mpls_fake *fake, const void *buf, size_t len) {
+    if (send(fake->fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t)len) return 0;
+    return -errno;
+}
+
+// Function to answer a request with an ACK or a capped error carrying an extended ACK
+static void fake_ack(struct mpls_fake *fake, const struct nlmsghdr *req, int error, const char *msg,
+                     const struct rtattr *bad) {
+    if (!error && !(req->nlmsg_flags & NLM_F_ACK)) return;
+
+    char buf[FAKE_ACK_MAX] __attribute__((aligned(NLMSG_ALIGNTO)));
+    memset(buf, 0, NLMSG_SPACE(sizeof(struct nlmsgerr)));
+    struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct nlmsgerr));
+    nlh->nlmsg_type = NLMSG_ERROR;
+    nlh->nlmsg_flags = NLM_F_CAPPED;
+    nlh->nlmsg_seq = req->nlmsg_seq;
+    nlh->nlmsg_pid = req->nlmsg_pid;
+    struct nlmsgerr *err = (struct nlmsgerr *)NLMSG_DATA(nlh);
+    err->error = error;
+    err->msg = *req;
+
+    if (error && msg) {
+        nlh->nlmsg_flags |= NLM_F_ACK_TLVS;
+        add_attr(nlh, sizeof(buf), NLMSGERR_ATTR_MSG, msg, strlen(msg) + 1);
+        if (bad) {
+            uint32_t off = (const char *)bad - (const char *)req;
+            add_attr(nlh, sizeof(buf), NLMSGERR_ATTR_OFFS, &off, sizeof(off));
+        }
+    }
+
+    if (fake->options.enobufs_every && ++fake->acks % fake->options.enobufs_every == 0) {
+        fake->overrun = 1;
+        return;
+    }
+    if (fake_reply(fake, buf, nlh->nlmsg_len) == -EAGAIN) fake->overrun = 1;
+}
+
+// Function to find the IPv4 hash chain link that points at a route, or at the end of its chain
+static struct fake_route **fake_inet_slot(struct mpls_fake *fake, uint32_t dst, uint8_t dst_len, uint8_t table) {
+    size_t b = (ntohl(dst) * 2654435761u ^ dst_len) & (fake->inet_buckets - 1);
+    struct fake_route **link = &fake->inet[b];
+    while (*link && ((*link)->dst != dst || (*link)->dst_len != dst_len || (*link)->table != table)) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+// Function to double the IPv4 hash
+static int fake_inet_grow(struct mpls_fake *fake) {
+    size_t old_buckets = fake->inet_buckets;
+    struct fake_route **old = fake->inet;
+    fake->inet_buckets = old_buckets ? old_buckets * 2 : FAKE_INET_BUCKETS;
+    fake->inet = calloc(fake->inet_buckets, sizeof(*fake->inet));
+    if (!fake->inet) {
+        fake->inet = old;
+        fake->inet_buckets = old_buckets;
+        return -ENOMEM;
+    }
+    for (size_t b = 0; b < old_buckets; b++) {
+        while (old[b]) {
+            struct fake_route *r = old[b];
+            old[b] = r->next;
+            r->next = NULL;
+            *fake_inet_slot(fake, r->dst, r->dst_len, r->table) = r;
+        }
+    }
+    free(old);
+    return 0;
+}
+
+// Function to locate the table entry a route request refers to
+static struct fake_route **fake_lookup(struct mpls_fake *fake, const struct nlmsghdr *nlh, const struct rtattr *tb[],
+                                       const char **msg, const struct rtattr **bad) {
+    const struct rtmsg *rtm = (const struct rtmsg *)NLMSG_DATA(nlh);
+
+    if (rtm->rtm_family == AF_MPLS) {
+        const struct rtattr *dst = tb[RTA_DST];
+        *bad = dst;
+        if (!dst || RTA_PAYLOAD(dst) != sizeof(uint32_t)) {
+            *msg = "Invalid label";
+            return NULL;
+        }
+        if (rtm->rtm_dst_len != 20) {
+            *msg = "rtm_dst_len must be 20 for MPLS";
+            *bad = NULL;
+            return NULL;
+        }
+        uint32_t label = decode_mpls_label(*(const uint32_t *)RTA_DATA(dst), NULL);
+        if (label < MPLS_LABEL_FIRST_UNRESERVED) {
+            *msg = "Invalid label - must be MPLS_LABEL_FIRST_UNRESERVED or higher";
+            return NULL;
+        }
+        if (!fake->labels && !(fake->labels = calloc(MPLS_LABEL_MAX + 1, sizeof(*fake->labels)))) {
+            *msg = "Out of memory";
+            return NULL;
+        }
+        return &fake->labels[label];
+    }
+
+    uint32_t dst = 0;
+    if (tb[RTA_DST]) {
+        if (RTA_PAYLOAD(tb[RTA_DST]) != sizeof(dst)) {
+            *msg = "Invalid prefix";
+            *bad = tb[RTA_DST];
+            return NULL;
+        }
+        memcpy(&dst, RTA_DATA(tb[RTA_DST]), sizeof(dst));
+    }
+    if (rtm->rtm_dst_len > 32) {
+        *msg = "Invalid prefix length";
+        return NULL;
+    }
+    if (!fake->inet && fake_inet_grow(fake) < 0) {
+        *msg = "Out of memory";
+        return NULL;
+    }
+    return fake_inet_slot(fake, dst, rtm->rtm_dst_len, rtm->rtm_table);
+}
+
+// Function to index the attributes of a nexthop object message
+static void fake_nexthop_parse(const struct nlmsghdr *nlh, const struct rtattr *tb[]) {
+    const struct nhmsg *nhm = (const struct nhmsg *)NLMSG_DATA(nlh);
+    mpls_parse_rtattr(tb, NHA_MAX, (const struct rtattr *)((const char *)nhm + NLMSG_ALIGN(sizeof(*nhm))),
+                      nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*nhm)));
+}
+
+// Function to find the list link that points at a nexthop object, or at where it would go
+static struct fake_route **fake_nexthop_slot(struct mpls_fake *fake, uint32_t id) {
+    struct fake_route **link = &fake->nexthops;
+    while (*link && (*link)->dst < id) link = &(*link)->next;
+    return link;
+}
+
+// Function to find a nexthop object by id
+static struct fake_route *fake_nexthop_find(struct mpls_fake *fake, uint32_t id) {
+    struct fake_route *r = *fake_nexthop_slot(fake, id);
+    return r && r->dst == id ? r : NULL;
+}
+
+// Function to tell a group from a plain nexthop object
+static int fake_nexthop_is_group(const struct fake_route *r) {
+    const struct rtattr *tb[NHA_MAX + 1];
+    fake_nexthop_parse(r->msg, tb);
+    return tb[NHA_GROUP] != NULL;
+}
+
+// Function to remove the IPv4 routes that use a nexthop object, as the kernel does when the object goes
+static void fake_drop_routes(struct mpls_fake *fake, uint32_t nhid) {
+    for (size_t b = 0; b < fake->inet_buckets; b++) {
+        for (struct fake_route **link = &fake->inet[b]; *link;) {
+            struct fake_route *r = *link;
+            if (r->nhid != nhid) {
+                link = &r->next;
+                continue;
+            }
+            *link = r->next;
+            free(r);
+            fake->ninet--;
+        }
+    }
+}
+
+// Function to take a member out of a group, returning how many are left (-1 if the object holds no such member)
+static int fake_group_remove(struct fake_route *r, uint32_t id) {
+    const struct rtattr *tb[NHA_MAX + 1];
+    fake_nexthop_parse(r->msg, tb);
+    struct rtattr *rta = (struct rtattr *)tb[NHA_GROUP];
+    if (!rta) return -1;
+
+    struct nexthop_grp *grp = (struct nexthop_grp *)RTA_DATA(rta);
+    int count = RTA_PAYLOAD(rta) / sizeof(*grp), kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (grp[i].id != id) grp[kept++] = grp[i];
+    }
+    if (kept == count) return -1;
+
+    // Close the gap by moving the attributes that follow the group down; entries are 8 bytes, so alignment holds
+    unsigned int removed = (count - kept) * sizeof(*grp);
+    char *end = (char *)rta + RTA_ALIGN(rta->rta_len);
+    size_t tail = (char *)r->msg + r->msg->nlmsg_len - end;
+    rta->rta_len -= removed;
+    memmove((char *)rta + RTA_ALIGN(rta->rta_len), end, tail);
+    r->msg->nlmsg_len -= removed;
+    r->len = r->msg->nlmsg_len;
+    return kept;
+}
+
+// Function to apply RTM_NEWNEXTHOP or RTM_DELNEXTHOP to the nexthop objects
+static int fake_nexthop_change(struct mpls_fake *fake, const struct nlmsghdr *nlh, const char **msg,
+                               const struct rtattr **bad) {
+    if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(struct nhmsg))) return -EINVAL;
+    const struct rtattr *tb[NHA_MAX + 1];
+    fake_nexthop_parse(nlh, tb);
+
+    // The kernel picks an id when none is given; the fake leaves that to the caller
+    if (!tb[NHA_ID] || RTA_PAYLOAD(tb[NHA_ID]) != sizeof(uint32_t) || *(const uint32_t *)RTA_DATA(tb[NHA_ID]) == 0) {
+        *msg = "Invalid nexthop id";
+        *bad = tb[NHA_ID];
+        return -EINVAL;
+    }
+    uint32_t id = *(const uint32_t *)RTA_DATA(tb[NHA_ID]);
+    struct fake_route **link = fake_nexthop_slot(fake, id);
+    struct fake_route *old = *link && (*link)->dst == id ? *link : NULL;
+
+    // Deleting an object takes its routes with it, and it leaves every group; emptied groups go too
+    if (nlh->nlmsg_type == RTM_DELNEXTHOP) {
+        if (!old) return -ENOENT;
+        *link = old->next;
+        free(old);
+        fake_drop_routes(fake, id);
+        for (struct fake_route **g = &fake->nexthops; *g;) {
+            struct fake_route *r = *g;
+            if (fake_group_remove(r, id) != 0) {
+                g = &r->next;
+                continue;
+            }
+            *g = r->next;
+            fake_drop_routes(fake, r->dst);
+            free(r);
+        }
+        fake->dump.changed = 1;
+        return 0;
+    }
+
+    if (old && (nlh->nlmsg_flags & NLM_F_EXCL || !(nlh->nlmsg_flags & NLM_F_REPLACE))) return -EEXIST;
+    if (!old && !(nlh->nlmsg_flags & NLM_F_CREATE)) return -ENOENT;
+    if (tb[NHA_GROUP]) {
+        const struct nexthop_grp *grp = (const struct nexthop_grp *)RTA_DATA(tb[NHA_GROUP]);
+        size_t count = RTA_PAYLOAD(tb[NHA_GROUP]) / sizeof(*grp);
+        *bad = tb[NHA_GROUP];
+        if (count == 0 || RTA_PAYLOAD(tb[NHA_GROUP]) % sizeof(*grp)) {
+            *msg = "Invalid length for nexthop group attribute";
+            return -EINVAL;
+        }
+        for (size_t i = 0; i < count; i++) {
+            const struct fake_route *member = grp[i].id == id ? NULL : fake_nexthop_find(fake, grp[i].id);
+            if (!member) {
+                *msg = "Invalid nexthop id";
+                return -EINVAL;
+            }
+            if (fake_nexthop_is_group(member)) {
+                *msg = "Nested groups are not supported";
+                return -EINVAL;
+            }
+        }
+        *bad = NULL;
+    } else if (!tb[NHA_OIF] || RTA_PAYLOAD(tb[NHA_OIF]) != sizeof(int) || *(const int *)RTA_DATA(tb[NHA_OIF]) <= 0) {
+        *msg = "Device attribute required for non-blackhole and non-fdb nexthops";
+        return -EINVAL;
+    }
+    if (old && fake_nexthop_is_group(old) != (tb[NHA_GROUP] != NULL)) {
+        *msg = tb[NHA_GROUP] ? "Can not replace a nexthop with a nexthop group"
+                             : "Can not replace a nexthop group with a nexthop";
+        return -EINVAL;
+    }
+
+    struct fake_route *r = malloc(sizeof(*r) + nlh->nlmsg_len);
+    if (!r) return -ENOMEM;
+    memset(r, 0, sizeof(*r));
+    r->next = old ? old->next : *link;
+    r->dst = id;
+    r->len = nlh->nlmsg_len;
+    memcpy(r->msg, nlh, nlh->nlmsg_len);
+    *link = r;
+    free(old);
+    fake->dump.changed = 1;
+    return 0;
+}
+
+// Function to check the legs of an MPLS multipath route as mpls_nh_build_multi() does
+static int fake_check_mpls_multipath(const struct rtattr *mp) {
+    int len = RTA_PAYLOAD(mp);
+    const struct rtnexthop *rtnh = (const struct rtnexthop *)RTA_DATA(mp);
+    if (len < (int)sizeof(*rtnh)) return -EINVAL;
+    while (len >= (int)sizeof(*rtnh)) {
+        if (rtnh->rtnh_len < sizeof(*rtnh) || rtnh->rtnh_len > len) return -EINVAL;
+        // Neither weighted multipath nor any flags are supported
+        if (rtnh->rtnh_hops || rtnh->rtnh_flags) return -EINVAL;
+        len -= RTNH_ALIGN(rtnh->rtnh_len);
+        rtnh = RTNH_NEXT(rtnh);
+    }
+    return 0;
+}
+
+// Function to apply RTM_NEWROUTE or RTM_DELROUTE to the tables
+static int fake_route_change(struct mpls_fake *fake, const struct nlmsghdr *nlh, const char **msg,
+                             const struct rtattr **bad) {
+    const struct rtmsg *rtm = (const struct rtmsg *)NLMSG_DATA(nlh);
+    const struct rtattr *tb[RTA_MAX + 1];
+    mpls_parse_rtattr(tb, RTA_MAX, RTM_RTA(rtm), RTM_PAYLOAD(nlh));
+    int mpls = rtm->rtm_family == AF_MPLS;
+    if (!mpls && rtm->rtm_family != AF_INET) return -EAFNOSUPPORT;
+
+    struct fake_route **link = fake_lookup(fake, nlh, tb, msg, bad);
+    if (!link) return -EINVAL;
+    struct fake_route *old = *link;
+
+    if (nlh->nlmsg_type == RTM_DELROUTE) {
+        // The kernel forgives deleting a label that has no route, but not an IPv4 route
+        if (!old) return mpls ? 0 : -ESRCH;
+        *link = old->next;
+        free(old);
+        if (mpls) fake->nlabels--; else fake->ninet--;
+        fake->dump.changed = 1;
+        return 0;
+    }
+
+    if (old && (nlh->nlmsg_flags & NLM_F_EXCL || !(nlh->nlmsg_flags & NLM_F_REPLACE))) return -EEXIST;
+    if (!old && !(nlh->nlmsg_flags & NLM_F_CREATE)) return -ENOENT;
+    uint32_t nhid = 0;
+    if (tb[RTA_NH_ID]) {
+        // A route through a nexthop object takes everything else from the object
+        *bad = tb[RTA_NH_ID];
+        if (mpls) {
+            *msg = "Unknown attribute";
+            return -EINVAL;
+        }
+        if (RTA_PAYLOAD(tb[RTA_NH_ID]) != sizeof(nhid)) {
+            *msg = "Invalid nexthop id";
+            return -EINVAL;
+        }
+        nhid = *(const uint32_t *)RTA_DATA(tb[RTA_NH_ID]);
+        if (!fake_nexthop_find(fake, nhid)) {
+            *msg = "Nexthop id does not exist";
+            return -EINVAL;
+        }
+        if (tb[RTA_OIF] || tb[RTA_GATEWAY] || tb[RTA_MULTIPATH] || tb[RTA_ENCAP]) {
+            *msg = "Nexthop specification and nexthop id are mutually exclusive";
+            return -EINVAL;
+        }
+        *bad = NULL;
+    }
+    if (!nhid && !tb[RTA_OIF] && !tb[RTA_MULTIPATH] && !tb[mpls ? RTA_VIA : RTA_GATEWAY]) {
+        *msg = "Nexthop device required";
+        return -EINVAL;
+    }
+    if (mpls && tb[RTA_MULTIPATH] && fake_check_mpls_multipath(tb[RTA_MULTIPATH]) < 0) {
+        *bad = tb[RTA_MULTIPATH];
+        return -EINVAL;
+    }
+    if (tb[RTA_OIF] && (RTA_PAYLOAD(tb[RTA_OIF]) != sizeof(int) || *(const int *)RTA_DATA(tb[RTA_OIF]) <= 0)) {
+        *msg = "Invalid device";
+        *bad = tb[RTA_OIF];
+        return -ENODEV;
+    }
+
+    struct fake_route *r = malloc(sizeof(*r) + nlh->nlmsg_len);
+    if (!r) return -ENOMEM;
+    r->next = old ? old->next : NULL;
+    r->dst = 0;
+    if (!mpls && tb[RTA_DST]) memcpy(&r->dst, RTA_DATA(tb[RTA_DST]), sizeof(r->dst));
+    r->dst_len = rtm->rtm_dst_len;
+    r->table = rtm->rtm_table;
+    r->nhid = nhid;
+    r->len = nlh->nlmsg_len;
+    memcpy(r->msg, nlh, nlh->nlmsg_len);
+    r->msg->nlmsg_type = RTM_NEWROUTE;
+    *link = r;
+    free(old);
+
+    if (!old && mpls) fake->nlabels++;
+    if (!old && !mpls) fake->ninet++;
+    fake->dump.changed = 1;
+    if (!mpls && fake->ninet > fake->inet_buckets) fake_inet_grow(fake);
+    return 0;
+}
+
+// Function to return the route at a dump cursor and move the cursor past it
+static const struct fake_route *fake_dump_next(struct mpls_fake *fake, struct fake_cursor *c) {
+    if (fake->dump.nexthops) {
+        const struct fake_route *r = fake->nexthops;
+        for (size_t i = 0; r && i < c->pos; i++) r = r->next;
+        if (r) c->pos++;
+        return r;
+    }
+    if (!c->inet) {
+        while (fake->labels && c->pos <= MPLS_LABEL_MAX && !fake->labels[c->pos]) c->pos++;
+        if (fake->labels && c->pos <= MPLS_LABEL_MAX) return fake->labels[c->pos++];
+        if (fake->dump.family == AF_MPLS) return NULL;
+        *c = (struct fake_cursor){1, 0, 0};
+    }
+
+    for (; c->pos < fake->inet_buckets; c->pos++, c->skip = 0) {
+        const struct fake_route *r = fake->inet[c->pos];
+        for (size_t i = 0; r && i < c->skip; i++) r = r->next;
+        if (r) {
+            c->skip++;
+            return r;
+        }
+    }
+    return NULL;
+}
+
+// Function to send as much of the running dump as the session's socket takes
+static void fake_dump_continue(struct mpls_fake *fake) {
+    while (fake->dump.active) {
+        struct fake_cursor c = fake->dump.cursor;
+        uint16_t flags = NLM_F_MULTI | (fake->dump.changed ? NLM_F_DUMP_INTR : 0);
+        size_t len = 0;
+        int done = 0;
+
+        for (;;) {
+            struct fake_cursor before = c;
+            const struct fake_route *r = fake_dump_next(fake, &c);
+            if (!r) {
+                done = 1;
+                break;
+            }
+            if (len + NLMSG_ALIGN(r->len) > sizeof(fake->chunk)) {
+                c = before;
+                break;
+            }
+            struct nlmsghdr *nlh = (struct nlmsghdr *)(fake->chunk + len);
+            memcpy(nlh, r->msg, r->len);
+            nlh->nlmsg_flags = flags;
+            nlh->nlmsg_seq = fake->dump.seq;
+            nlh->nlmsg_pid = fake->dump.portid;
+            len += NLMSG_ALIGN(r->len);
+        }
+
+        // The kernel ends a dump with NLMSG_DONE carrying a zero status
+        if (done && len + NLMSG_SPACE(sizeof(int)) <= sizeof(fake->chunk)) {
+            struct nlmsghdr *nlh = (struct nlmsghdr *)(fake->chunk + len);
+            nlh->nlmsg_len = NLMSG_LENGTH(sizeof(int));
+            nlh->nlmsg_type = NLMSG_DONE;
+            nlh->nlmsg_flags = flags;
+            nlh->nlmsg_seq = fake->dump.seq;
+            nlh->nlmsg_pid = fake->dump.portid;
+            *(int *)NLMSG_DATA(nlh) = 0;
+            len += NLMSG_SPACE(sizeof(int));
+        } else {
+            done = 0;
+        }
+
+        // A full socket pauses the dump until the reader makes room, as in the kernel
+        if (fake_reply(fake, fake->chunk, len) < 0) return;
+        fake->dump.cursor = c;
+        if (done) fake->dump.active = 0;
+    }
+}
+
+// Function to answer a dump of something the fake does not model with an empty one
+static void fake_empty_dump(struct mpls_fake *fake, const struct nlmsghdr *req) {
+    struct nlmsghdr *nlh = (struct nlmsghdr *)fake->chunk;
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(int));
+    nlh->nlmsg_type = NLMSG_DONE;
+    nlh->nlmsg_flags = NLM_F_MULTI;
+    nlh->nlmsg_seq = req->nlmsg_seq;
+    nlh->nlmsg_pid = req->nlmsg_pid;
+    *(int *)NLMSG_DATA(nlh) = 0;
+    fake_reply(fake, fake->chunk, NLMSG_SPACE(sizeof(int)));
+}
+
+// Function to start a dump of routes or nexthop objects, or refuse it while another one runs
+static int fake_dump_start(struct mpls_fake *fake, const struct nlmsghdr *req, unsigned char family, int nexthops) {
+    if (fake->dump.active) return -EBUSY;
+    fake->dump.active = 1;
+    fake->dump.changed = 0;
+    fake->dump.nexthops = nexthops;
+    fake->dump.family = family;
+    fake->dump.seq = req->nlmsg_seq;
+    fake->dump.portid = req->nlmsg_pid;
+    // A family without a route table gets every table, as rtnl_dump_all() answers it
+    fake->dump.cursor = (struct fake_cursor){family == AF_INET, 0, 0};
+    fake_dump_continue(fake);
+    return 0;
+}
+
+// Function to handle one request, as rtnetlink would
+static void fake_handle(struct mpls_fake *fake, const struct nlmsghdr *nlh) {
+    const char *msg = NULL;
+    const struct rtattr *bad = NULL;
+    int error;
+
+    if (fake->options.latency_us) {
+        struct timespec ts = {fake->options.latency_us / 1000000, (fake->options.latency_us % 1000000) * 1000L};
+        nanosleep(&ts, NULL);
+    }
+
+    // No interfaces or addresses are modelled, so their dumps are empty
+    if ((nlh->nlmsg_type == RTM_GETLINK || nlh->nlmsg_type == RTM_GETADDR) &&
+        (nlh->nlmsg_flags & NLM_F_DUMP) == NLM_F_DUMP) {
+        fake_empty_dump(fake, nlh);
+        return;
+    }
+
+    if (nlh->nlmsg_type == RTM_NEWNEXTHOP || nlh->nlmsg_type == RTM_DELNEXTHOP) {
+        error = fake_nexthop_change(fake, nlh, &msg, &bad);
+    } else if (nlh->nlmsg_type == RTM_GETNEXTHOP && (nlh->nlmsg_flags & NLM_F_DUMP) == NLM_F_DUMP) {
+        error = fake_dump_start(fake, nlh, AF_UNSPEC, 1);
+        if (error == 0) return;
+    } else if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(struct rtmsg))) {
+        error = -EINVAL;
+    } else if (nlh->nlmsg_type == RTM_NEWROUTE || nlh->nlmsg_type == RTM_DELROUTE) {
+        error = fake_route_change(fake, nlh, &msg, &bad);
+    } else if (nlh->nlmsg_type == RTM_GETROUTE && (nlh->nlmsg_flags & NLM_F_DUMP) == NLM_F_DUMP) {
+        error = fake_dump_start(fake, nlh, ((const struct rtmsg *)NLMSG_DATA(nlh))->rtm_family, 0);
+        if (error == 0) return;
+    } else {
+        error = -EOPNOTSUPP;
+    }
+    fake_ack(fake, nlh, error, msg, bad);
+}
+
+// Function to handle a buffer of packed requests inside the send call
+static ssize_t fake_send(struct mpls_session *session, const void *buf, size_t len) {
+    struct mpls_fake *fake = (struct mpls_fake *)session->transport_ctx;
+    int remaining = len;
+    // The last message may end unaligned (e.g. on a 2-byte RTA_ENCAP_TYPE), which drives remaining below 0
+    for (const struct nlmsghdr *nlh = buf; remaining > 0 && NLMSG_OK(nlh, (unsigned int)remaining);
+         nlh = NLMSG_NEXT(nlh, remaining)) {
+        fake_handle(fake, nlh);
+    }
+    return len;
+}
+
+// Function to report a dropped reply, or make room for more of a running dump, before a read
+static int fake_before_read(struct mpls_fake *fake) {
+    if (fake->overrun) {
+        fake->overrun = 0;
+        errno = ENOBUFS;
+        return -1;
+    }
+    fake_dump_continue(fake);
+    return 0;
+}
+
+// Function to read one reply
+static ssize_t fake_recv(struct mpls_session *session, void *buf, size_t len, int flags) {
+    if (fake_before_read((struct mpls_fake *)session->transport_ctx) < 0) return -1;
+    return recv(session->fd, buf, len, flags);
+}
+
+// Function to read a burst of replies
+static int fake_recvmmsg(struct mpls_session *session, struct mmsghdr *msgs, unsigned int vlen, int flags) {
+    if (fake_before_read((struct mpls_fake *)session->transport_ctx) < 0) return -1;
+    return recvmmsg(session->fd, msgs, vlen, flags, NULL);
+}
+
+static const struct mpls_transport fake_transport = {fake_send, fake_recv, fake_recvmmsg};
+
+// Function to set a socket buffer size, bypassing net.core.[rw]mem_max when privileged
+static void fake_sock_buf(int fd, int force_opt, int opt, int size) {
+    if (setsockopt(fd, SOL_SOCKET, force_opt, &size, sizeof(size)) < 0) {
+        setsockopt(fd, SOL_SOCKET, opt, &size, sizeof(size));
+    }
+}
+
+// Function to open a session served by a new fake kernel
+struct mpls_fake *mpls_fake_open(struct mpls_session *session, int sock_buf, const struct mpls_fake_options *options) {
+    memset(session, 0, sizeof(*session));
+    session->fd = -1;
+    struct mpls_fake *fake = calloc(1, sizeof(*fake));
+    if (!fake) return NULL;
+    if (options) fake->options = *options;
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        free(fake);
+        return NULL;
+    }
+    fake->fd = sv[1];
+
+    // Replies wait in our send buffer until read, so it plays the part of the session's receive buffer
+    if (sock_buf > 0) {
+        fake_sock_buf(sv[1], SO_SNDBUFFORCE, SO_SNDBUF, sock_buf);
+        fake_sock_buf(sv[0], SO_SNDBUFFORCE, SO_SNDBUF, sock_buf);
+    }
+    session->fd = sv[0];
+    session->portid = getpid();
+    session->seq = 1;
+    socklen_t optlen = sizeof(session->rcvbuf);
+    getsockopt(sv[1], SOL_SOCKET, SO_SNDBUF, &session->rcvbuf, &optlen);
+    optlen = sizeof(session->sndbuf);
+    getsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &session->sndbuf, &optlen);
+    session->transport = &fake_transport;
+    session->transport_ctx = fake;
+    return fake;
+}
+
+// Function to count the routes of the fake tables
+size_t mpls_fake_routes(const struct mpls_fake *fake) {
+    return fake->nlabels + fake->ninet;
+}
+
+// Function to free a fake kernel
+void mpls_fake_close(struct mpls_fake *fake) {
+    if (!fake) return;
+    if (fake->labels) {
+        for (size_t label = 0; label <= MPLS_LABEL_MAX; label++) free(fake->labels[label]);
+        free(fake->labels);
+    }
+    for (size_t b = 0; b < fake->inet_buckets; b++) {
+        while (fake->inet[b]) {
+            struct fake_route *r = fake->inet[b];
+            fake->inet[b] = r->next;
+            free(r);
+        }
+    }
+    free(fake->inet);
+    while (fake->nexthops) {
+        struct fake_route *r = fake->nexthops;
+        fake->nexthops = r->next;
+        free(r);
+    }
+    close(fake->fd);
+    free(fake);
+}
@@ -0,0 +1,75 @@
+/**
+ * @file mpls_fake.h
+ * @brief In-process stand-in for the kernel's rtnetlink, for tests and benchmarks that need no root.
+ *
+ * A fake kernel installs itself as the transport of a session. Requests are
+ * decoded and applied to an in-memory LFIB and IPv4 table inside the send
+ * call, as rtnetlink applies them inside sendmsg(), and the replies are
+ * written to one end of a socketpair whose other end is the session's fd.
+ * Reading, polling and the MSG_PEEK/MSG_TRUNC sizing of dumps therefore
+ * behave as on a real Netlink socket:
+ *   - RTM_NEWROUTE honours NLM_F_CREATE, NLM_F_EXCL and NLM_F_REPLACE, and
+ *     rejects weights (rtnh_hops) and flags in MPLS multipath legs as the kernel does;
+ *   - RTM_DELROUTE removes a route by label or destination;
+ *   - RTM_NEWNEXTHOP, RTM_DELNEXTHOP and RTM_GETNEXTHOP manage nexthop objects
+ *     and groups; IPv4 routes may use them with RTA_NH_ID, and deleting an
+ *     object deletes its routes and takes it out of its groups;
+ *   - RTM_GETROUTE with NLM_F_DUMP replies with multi-part messages, paced by
+ *     the reader like a kernel dump, and NLMSG_DONE;
+ *   - errors are capped ACKs with extended-ACK messages and attribute offsets.
+ * Output interfaces are not checked against the system's interfaces, nexthop
+ * objects need an explicit id, and link and address dumps (RTM_GETLINK,
+ * RTM_GETADDR) come back empty.
+ *
+ * Replies are sent with MSG_DONTWAIT: when the reader lets them pile up past
+ * the socket buffer, the ACK is dropped and the next read fails with ENOBUFS,
+ * as it would on a Netlink socket that overran.
+ */
+
+ #ifndef MPLS_FAKE_H
+ #define MPLS_FAKE_H
+ 
+ #include <stddef.h>
+ 
+ #pragma GCC visibility push(default)
+ 
+ struct mpls_session;
+ struct mpls_fake;
+ 
+ /**
+  * @brief Behaviour that a test can inject.
+  */
+ struct mpls_fake_options {
+     unsigned int latency_us;     /**< Time spent handling each request, 0 for none. */
+     unsigned int enobufs_every;  /**< Drop every Nth ACK and fail the next read with ENOBUFS, 0 for never. */
+ };
+ 
+ /**
+  * @brief Opens a session whose requests are served by a new fake kernel.
+  *
+  * The session is initialized as by mpls_session_open() and closed with
+  * mpls_session_close(), before or after mpls_fake_close().
+  *
+  * @param session Session to initialize.
+  * @param sock_buf Requested receive buffer of the session in bytes, or 0 for the system default.
+  * @param options Injected behaviour, or NULL for none.
+  * @return The fake kernel, or NULL with errno set.
+  */
+ struct mpls_fake *mpls_fake_open(struct mpls_session *session, int sock_buf, const struct mpls_fake_options *options);
+ 
+ /**
+  * @brief Counts the routes the fake kernel holds.
+  * @param fake Fake kernel.
+  * @return Number of label routes plus IPv4 routes.
+  */
+ size_t mpls_fake_routes(const struct mpls_fake *fake);
+ 
+ /**
+  * @brief Frees a fake kernel and its tables.
+  * @param fake Fake kernel, may be NULL.
+  */
+ void mpls_fake_close(struct mpls_fake *fake);
+ 
+ #pragma GCC visibility pop
+ 
+ #endif // MPLS_FAKE_H
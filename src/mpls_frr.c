@@ -0,0 +1,456 @@
+// mpls_frr.c
+
+#include "mpls_frr.h"
+#include "mpls_core.h"
+#include "mpls_ifcache.h"
+#include "mpls_dump.h"
+#include "mpls_stats.h"
+#include <poll.h>
+
+#define FRR_MAX_ARGS 32
+#define FRR_BUF_MIN 32768  // Notification datagrams; grown if the kernel sends more
+#define FRR_DUMP_RETRIES 3
+
+struct frr_entry {
+    int oif;                // Interface the primary leaves through
+    size_t primary_off;     // Encoded NLM_F_REPLACE requests in the arena
+    size_t backup_off;
+};
+
+struct frr_link {
+    int ifindex;
+    int up;                 // -1 until the first link dump has seen the interface
+    int seen;               // Present in the dump being read
+    size_t first, count;    // Routes behind the interface, in the sorted entries
+};
+
+struct mpls_frr {
+    struct mpls_session *session;
+    struct mpls_session link;  // RTNLGRP_LINK socket
+    struct mpls_batch *batch;  // Open once armed, reused by every switch
+    struct frr_entry *entries;
+    size_t nentries, entries_cap;
+    char *arena;               // Requests back to back, NLMSG_ALIGN'ed
+    size_t arena_len, arena_cap;
+    struct frr_link *links;    // Sorted by ifindex
+    size_t nlinks;
+    char *buf;
+    size_t size;
+    unsigned long failed;      // Rejections counted by the batch callback
+    struct in_addr via;        // Last next hop resolved, and its interface
+    int via_oif;
+};
+
+// Function to count the rejected requests of a switch
+static void frr_result(unsigned long tag, int error, const char *detail, void *arg) {
+    (void)tag;
+    (void)detail;
+    if (error) ((struct mpls_frr *)arg)->failed++;
+}
+
+// Function to open the link notification socket
+static int frr_link_open(struct mpls_session *link) {
+    int ret = mpls_session_open(link, MPLS_FRR_SOCK_BUF);
+    if (ret < 0) return ret;
+
+    // Overruns must be reported: a lost "down" would leave routes blackholed
+    int off = 0, group = RTNLGRP_LINK;
+    if (setsockopt(link->fd, SOL_NETLINK, NETLINK_NO_ENOBUFS, &off, sizeof(off)) < 0 ||
+        setsockopt(link->fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group)) < 0) {
+        ret = -errno;
+        mpls_session_close(link);
+    }
+    return ret;
+}
+
+// Function to start a set of protected routes
+struct mpls_frr *mpls_frr_open(struct mpls_session *session) {
+    struct mpls_frr *frr = calloc(1, sizeof(*frr));
+    if (!frr) return NULL;
+    frr->session = session;
+    frr->size = FRR_BUF_MIN;
+    frr->buf = malloc(frr->size);
+    int ret = frr->buf ? frr_link_open(&frr->link) : -ENOMEM;
+    if (ret < 0) {
+        free(frr->buf);
+        free(frr);
+        errno = -ret;
+        return NULL;
+    }
+    return frr;
+}
+
+// Function to find the interface a next hop is reached through, remembering the last answer
+static int frr_nexthop_oif(struct mpls_frr *frr, struct in_addr via) {
+    if (frr->via_oif && frr->via.s_addr == via.s_addr) return frr->via_oif;
+
+    int oif = mpls_session_lookup_oif(frr->session, via);
+    if (oif < 0) return oif;
+    frr->via = via;
+    frr->via_oif = oif;
+    return oif;
+}
+
+// Function to append an encoded request to the arena
+static int frr_encode(struct mpls_frr *frr, const struct mpls_route *route, size_t *off) {
+    if (frr->arena_cap - frr->arena_len < MPLS_ROUTE_MSG_MAX) {
+        size_t cap = frr->arena_cap ? frr->arena_cap * 2 : 64 * MPLS_ROUTE_MSG_MAX;
+        char *grown = realloc(frr->arena, cap);
+        if (!grown) return -ENOMEM;
+        frr->arena = grown;
+        frr->arena_cap = cap;
+    }
+
+    struct nlmsghdr *nlh = (struct nlmsghdr *)(frr->arena + frr->arena_len);
+    int ret = build_mpls_route(nlh, MPLS_ROUTE_MSG_MAX, route, MPLS_OP_REPLACE, frr->session->ifcache);
+    if (ret < 0) return ret;
+    *off = frr->arena_len;
+    frr->arena_len += NLMSG_ALIGN(nlh->nlmsg_len);
+    return 0;
+}
+
+// Function to add a protected route
+int mpls_frr_add(struct mpls_frr *frr, const struct mpls_route *primary, const struct mpls_route *backup) {
+    if (frr->links) return -EBUSY;
+    if (primary->kind == MPLS_ROUTE_MULTIPATH || backup->kind == MPLS_ROUTE_MULTIPATH) return -EOPNOTSUPP;
+    // Routes through a nexthop object are re-pointed by replacing the object, not by this table
+    if (primary->kind == MPLS_ROUTE_PUSH_NHID || backup->kind == MPLS_ROUTE_PUSH_NHID) return -EOPNOTSUPP;
+    if (primary->auto_label || backup->auto_label) return -EINVAL;
+
+    // The backup must replace the very route the primary installs
+    int push = mpls_route_is_push(primary);
+    int backup_push = mpls_route_is_push(backup);
+    if (push != backup_push) return -EINVAL;
+    if (push ? primary->dst.s_addr != backup->dst.s_addr : primary->label != backup->label) return -EINVAL;
+
+    int oif;
+    enum mpls_route_kind kind = primary->kind;
+    if (kind == MPLS_ROUTE_DEV || kind == MPLS_ROUTE_SWAP_DEV || kind == MPLS_ROUTE_PUSH_DEV) {
+        oif = mpls_ifcache_index(frr->session->ifcache, primary->ifname);
+        if (oif == 0) return -ENODEV;
+    } else {
+        oif = frr_nexthop_oif(frr, primary->via);
+        if (oif < 0) return oif;
+    }
+
+    if (frr->nentries == frr->entries_cap) {
+        size_t cap = frr->entries_cap ? frr->entries_cap * 2 : 256;
+        struct frr_entry *grown = realloc(frr->entries, cap * sizeof(*grown));
+        if (!grown) return -ENOMEM;
+        frr->entries = grown;
+        frr->entries_cap = cap;
+    }
+    struct frr_entry *e = &frr->entries[frr->nentries];
+    size_t mark = frr->arena_len;
+    int ret = frr_encode(frr, primary, &e->primary_off);
+    if (ret == 0) ret = frr_encode(frr, backup, &e->backup_off);
+    if (ret < 0) {
+        frr->arena_len = mark;
+        return ret;
+    }
+    e->oif = oif;
+    frr->nentries++;
+    return 0;
+}
+
+// Function to print the diagnostic of a rejected input line
+static void frr_print_failure(const char *name, unsigned long line, int error, const char *reason) {
+    if (!reason) reason = error == -ENODEV ? "no such interface" : strerror(-error);
+    fprintf(stderr, "%s:%lu: %s\n", name, line, reason);
+}
+
+// Function to add the protected routes listed in a stream
+int mpls_frr_load(struct mpls_frr *frr, FILE *in, const char *name) {
+    char *line = NULL;
+    size_t cap = 0;
+    unsigned long lineno = 0;
+    int ret = 0;
+    while (getline(&line, &cap, in) != -1) {
+        lineno++;
+        char *args[FRR_MAX_ARGS];
+        int argc = mpls_split_route_args(line, args, FRR_MAX_ARGS);
+        if (argc == 0 || (argc > 0 && args[0][0] == '#')) continue;
+        if (argc < 0) {
+            frr_print_failure(name, lineno, -EINVAL, "too many arguments");
+            ret = -1;
+            continue;
+        }
+
+        // "<route> backup <next hop>": the backup is the route's key followed by its own next hop
+        int split = 0;
+        while (split < argc && strcmp(args[split], "backup") != 0) split++;
+        if (split == argc || split == argc - 1) {
+            frr_print_failure(name, lineno, -EINVAL, "expected \"backup\" followed by the backup next hop");
+            ret = -1;
+            continue;
+        }
+        const char *err = NULL;
+        struct mpls_route primary, backup;
+        if (parse_mpls_route(split, args, &primary, &err) < 0) {
+            frr_print_failure(name, lineno, -EINVAL, err);
+            ret = -1;
+            continue;
+        }
+        args[split] = args[0];
+        if (parse_mpls_route(argc - split, args + split, &backup, &err) < 0) {
+            frr_print_failure(name, lineno, -EINVAL, err);
+            ret = -1;
+            continue;
+        }
+
+        int error = mpls_frr_add(frr, &primary, &backup);
+        if (error < 0) {
+            if (error == -EOPNOTSUPP) {
+                err = primary.kind == MPLS_ROUTE_MULTIPATH || backup.kind == MPLS_ROUTE_MULTIPATH
+                          ? "multipath routes cannot be protected"
+                          : "nhid routes are re-pointed by replacing their nexthop object";
+            } else if (error == -EINVAL) {
+                err = primary.auto_label ? "auto labels cannot be protected" : "the backup must keep the route's key";
+            }
+            frr_print_failure(name, lineno, error, err);
+            ret = -1;
+        }
+    }
+    free(line);
+    return ret;
+}
+
+// Function to order protected routes by the interface they depend on
+static int frr_compare_oif(const void *a, const void *b) {
+    int x = ((const struct frr_entry *)a)->oif, y = ((const struct frr_entry *)b)->oif;
+    return x < y ? -1 : x > y;
+}
+
+// Function to build the interface index over the sorted routes
+static int frr_index(struct mpls_frr *frr) {
+    qsort(frr->entries, frr->nentries, sizeof(*frr->entries), frr_compare_oif);
+    frr->links = calloc(frr->nentries ? frr->nentries : 1, sizeof(*frr->links));
+    if (!frr->links) return -ENOMEM;
+    for (size_t i = 0; i < frr->nentries; i++) {
+        if (frr->nlinks == 0 || frr->links[frr->nlinks - 1].ifindex != frr->entries[i].oif) {
+            frr->links[frr->nlinks++] = (struct frr_link){frr->entries[i].oif, -1, 0, i, 0};
+        }
+        frr->links[frr->nlinks - 1].count++;
+    }
+    return 0;
+}
+
+// Function to find an indexed interface
+static struct frr_link *frr_find_link(struct mpls_frr *frr, int ifindex) {
+    size_t lo = 0, hi = frr->nlinks;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (frr->links[mid].ifindex == ifindex) return &frr->links[mid];
+        if (frr->links[mid].ifindex < ifindex) lo = mid + 1; else hi = mid;
+    }
+    return NULL;
+}
+
+// Function to send the prepared version of every route behind an interface and wait for the ACKs
+static int frr_switch(struct mpls_frr *frr, struct frr_link *link, int down, const char *ifname, uint64_t start,
+                      mpls_frr_cb cb, void *arg) {
+    frr->failed = 0;
+    for (size_t i = link->first; i < link->first + link->count; i++) {
+        size_t off = down ? frr->entries[i].backup_off : frr->entries[i].primary_off;
+        mpls_batch_queue_msg(frr->batch, (const struct nlmsghdr *)(frr->arena + off), i);
+    }
+
+    // rtnetlink answers inside sendmsg(), so the ACKs are normally all queued after the flush
+    int ret = mpls_batch_flush(frr->batch);
+    if (ret == 0) ret = mpls_batch_poll(frr->batch);
+    while (ret == -ENOBUFS || (ret == 0 && mpls_batch_inflight(frr->batch) > 0)) {
+        if (ret == -ENOBUFS) {
+            // The switch waits for its outcome anyway, so ACKs lost in an overrun are settled here
+            mpls_batch_recover(frr->batch);
+        } else {
+            struct pollfd pfd = {frr->session->fd, POLLIN, 0};
+            if (poll(&pfd, 1, -1) < 0 && errno != EINTR) return -errno;
+        }
+        ret = mpls_batch_poll(frr->batch);
+    }
+
+    if (cb) {
+        struct mpls_frr_event event = {link->ifindex, "", down, link->count, frr->failed, mpls_stats_now() - start};
+        if (ifname) snprintf(event.ifname, sizeof(event.ifname), "%s", ifname);
+        cb(&event, arg);
+    }
+    return ret < 0 ? ret : 1;
+}
+
+// Function to act on the state of one interface as reported by the kernel
+static int frr_link_state(struct mpls_frr *frr, int ifindex, int up, const char *ifname, uint64_t start,
+                          mpls_frr_cb cb, void *arg) {
+    struct frr_link *link = frr_find_link(frr, ifindex);
+    if (!link) return 0;
+    link->seen = 1;
+    if (link->up == up) return 0;
+
+    // Until armed, reports only record the state: arming installs the matching version,
+    // and a link that flaps during the first dump has no batch to switch with yet
+    int known = link->up >= 0;
+    link->up = up;
+    return known && frr->batch ? frr_switch(frr, link, !up, ifname, start, cb, arg) : 0;
+}
+
+// Function to apply one RTM_NEWLINK/RTM_DELLINK message
+static int frr_handle(struct mpls_frr *frr, const struct nlmsghdr *nlh, uint64_t start, mpls_frr_cb cb, void *arg) {
+    if (nlh->nlmsg_type != RTM_NEWLINK && nlh->nlmsg_type != RTM_DELLINK) return 0;
+    int len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    if (len < 0) return 0;
+
+    const struct ifinfomsg *ifi = (const struct ifinfomsg *)NLMSG_DATA(nlh);
+    const struct rtattr *tb[IFLA_MAX + 1];
+    mpls_parse_rtattr(tb, IFLA_MAX, IFLA_RTA(ifi), len);
+    const char *ifname = NULL;
+    if (tb[IFLA_IFNAME] && RTA_PAYLOAD(tb[IFLA_IFNAME]) > 0 &&
+        ((const char *)RTA_DATA(tb[IFLA_IFNAME]))[RTA_PAYLOAD(tb[IFLA_IFNAME]) - 1] == '\0') {
+        ifname = (const char *)RTA_DATA(tb[IFLA_IFNAME]);
+    }
+
+    // IFF_RUNNING is the kernel's netif_oper_up(): carrier present and operstate UP (or UNKNOWN)
+    int up = nlh->nlmsg_type == RTM_NEWLINK && (ifi->ifi_flags & IFF_UP) && (ifi->ifi_flags & IFF_RUNNING);
+    return frr_link_state(frr, ifi->ifi_index, up, ifname, start, cb, arg);
+}
+
+// Function to receive one datagram of link notifications and act on them
+static int frr_recv(struct mpls_frr *frr, int *switches, mpls_frr_cb cb, void *arg) {
+    ssize_t len = mpls_dump_recv(&frr->link, &frr->buf, &frr->size, MSG_DONTWAIT);
+    if (len < 0) return len == -EINTR ? 0 : len;
+    uint64_t start = mpls_stats_now();
+
+    int remaining = len;
+    for (struct nlmsghdr *nlh = (struct nlmsghdr *)frr->buf; NLMSG_OK(nlh, (unsigned int)remaining);
+         nlh = NLMSG_NEXT(nlh, remaining)) {
+        int ret = frr_handle(frr, nlh, start, cb, arg);
+        if (ret < 0) return ret;
+        *switches += ret;
+    }
+    return 0;
+}
+
+struct frr_dump_ctx {
+    struct mpls_frr *frr;
+    int *switches;
+    mpls_frr_cb cb;
+    void *arg;
+};
+
+// Function to act on one link message read during a dump, notifications included
+static int frr_dump_msg(const struct nlmsghdr *nlh, void *arg) {
+    struct frr_dump_ctx *ctx = (struct frr_dump_ctx *)arg;
+    int ret = frr_handle(ctx->frr, nlh, mpls_stats_now(), ctx->cb, ctx->arg);
+    if (ret < 0) return ret;
+    *ctx->switches += ret;
+    return 0;
+}
+
+// Function to read the state of every link; interfaces missing from the dump are down
+static int frr_dump(struct mpls_frr *frr, int *switches, mpls_frr_cb cb, void *arg) {
+    struct {
+        struct nlmsghdr nlh;
+        struct ifinfomsg ifi;
+        char buf[RTA_SPACE(sizeof(uint32_t))];
+    } req;
+    struct frr_dump_ctx ctx = {frr, switches, cb, arg};
+
+    for (int attempt = 0; attempt < FRR_DUMP_RETRIES; attempt++) {
+        memset(&req, 0, sizeof(req));
+        req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifi));
+        req.nlh.nlmsg_type = RTM_GETLINK;
+        req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        req.ifi.ifi_family = AF_UNSPEC;
+        uint32_t ext_mask = RTEXT_FILTER_SKIP_STATS;
+        add_attr(&req.nlh, sizeof(req), IFLA_EXT_MASK, &ext_mask, sizeof(ext_mask));
+
+        // Notifications keep being applied in order with the dump; an overrun or a change
+        // under the dump (-ENOBUFS, -EINTR) means the dump is read to its end and retried
+        for (size_t i = 0; i < frr->nlinks; i++) frr->links[i].seen = 0;
+        int ret = mpls_dump_request(&frr->link, &req.nlh, MPLS_DUMP_NOTIFICATIONS, frr_dump_msg, &ctx);
+        if (ret == -ENOBUFS || ret == -EINTR) continue;
+        if (ret < 0) return ret;
+
+        uint64_t start = mpls_stats_now();
+        for (size_t i = 0; i < frr->nlinks; i++) {
+            if (frr->links[i].seen) continue;
+            ret = frr_link_state(frr, frr->links[i].ifindex, 0, NULL, start, cb, arg);
+            if (ret < 0) return ret;
+            *switches += ret;
+        }
+        return 0;
+    }
+    return -EINTR;
+}
+
+// Function to read the link states and install every route in the matching version
+int mpls_frr_arm(struct mpls_frr *frr, struct mpls_batch_stats *stats) {
+    if (frr->links) return -EBUSY;
+    int ret = frr_index(frr);
+    int switches = 0;
+    if (ret == 0) ret = frr_dump(frr, &switches, NULL, NULL);
+    if (ret < 0) return ret;
+
+    // Install through a batch of its own, so its counters cover the installation only
+    struct mpls_batch *batch = mpls_batch_open(frr->session, NULL, NULL);
+    frr->batch = mpls_batch_open(frr->session, frr_result, frr);
+    if (!batch || !frr->batch) {
+        if (batch) mpls_batch_finish(batch, NULL);
+        return -ENOMEM;
+    }
+    for (size_t l = 0; l < frr->nlinks; l++) {
+        const struct frr_link *link = &frr->links[l];
+        for (size_t i = link->first; i < link->first + link->count; i++) {
+            size_t off = link->up ? frr->entries[i].primary_off : frr->entries[i].backup_off;
+            mpls_batch_queue_msg(batch, (const struct nlmsghdr *)(frr->arena + off), i);
+        }
+    }
+    return mpls_batch_finish(batch, stats);
+}
+
+// Function to return the descriptor to watch
+int mpls_frr_fd(const struct mpls_frr *frr) {
+    return frr->link.fd;
+}
+
+// Function to handle the link notifications that have arrived
+int mpls_frr_dispatch(struct mpls_frr *frr, mpls_frr_cb cb, void *arg) {
+    if (!frr->batch) return -EINVAL;
+    int switches = 0;
+    for (;;) {
+        int ret = frr_recv(frr, &switches, cb, arg);
+        if (ret == -EAGAIN || ret == -EWOULDBLOCK) return switches;
+        // Notifications were lost: the dump tells which links changed meanwhile
+        if (ret == -ENOBUFS) ret = frr_dump(frr, &switches, cb, arg);
+        if (ret < 0) return ret;
+    }
+}
+
+// Function to switch routes as links fail and recover
+int mpls_frr_run(struct mpls_frr *frr, mpls_frr_cb cb, void *arg) {
+    for (;;) {
+        struct pollfd pfd = {frr->link.fd, POLLIN, 0};
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+        int ret = mpls_frr_dispatch(frr, cb, arg);
+        if (ret < 0) return ret;
+    }
+}
+
+// Function to count the protected routes and their interfaces
+size_t mpls_frr_routes(const struct mpls_frr *frr, size_t *links) {
+    if (links) *links = frr->nlinks;
+    return frr->nentries;
+}
+
+// Function to free a set of protected routes
+void mpls_frr_close(struct mpls_frr *frr) {
+    if (!frr) return;
+    if (frr->batch) mpls_batch_finish(frr->batch, NULL);
+    mpls_session_close(&frr->link);
+    free(frr->entries);
+    free(frr->arena);
+    free(frr->links);
+    free(frr->buf);
+    free(frr);
+}
@@ -0,0 +1,140 @@
+/**
+ * @file mpls_frr.h
+ * @brief Precomputed backup paths, switched in when a link goes down (fast reroute).
+ *
+ * Each protected route has a primary and a backup version that differ only
+ * in their next hop (dev, next_hop and out-labels). Both are encoded once as
+ * NLM_F_REPLACE requests when they are added. The routes are indexed by the
+ * interface the primary leaves through; for a next-hop primary, the kernel
+ * resolves that interface when the route is added.
+ *
+ * A separate socket joins RTNLGRP_LINK. When an indexed interface loses its
+ * operational state (IFF_RUNNING) or is deleted, the backups of exactly the
+ * routes behind it are sent as one pipelined batch, straight from their
+ * prepared encodings. When it comes back, the primaries are sent the same way
+ * (revertive protection). If link notifications are lost, the link table is
+ * dumped again and any changed state is acted on.
+ */
+
+ #ifndef MPLS_FRR_H
+ #define MPLS_FRR_H
+ 
+ #include <stdio.h>
+ #include <stdint.h>
+ #include "mpls_batch.h"
+ 
+ #pragma GCC visibility push(default)
+ 
+ struct mpls_session;
+ struct mpls_frr;
+ 
+ #define MPLS_FRR_SOCK_BUF (4 * 1024 * 1024) /**< SO_RCVBUF requested for the link notification socket. */
+ 
+ /**
+  * @brief What happened to the routes behind one interface.
+  */
+ struct mpls_frr_event {
+     int ifindex;               /**< Interface that changed state. */
+     char ifname[IF_NAMESIZE];  /**< Its name, empty if unknown. */
+     int down;                  /**< 1 if the routes moved to their backups, 0 if back to their primaries. */
+     unsigned long routes;      /**< Routes switched. */
+     unsigned long failed;      /**< Of those, routes the kernel rejected. */
+     uint64_t elapsed_ns;       /**< From reading the link notification to the last ACK. */
+ };
+ 
+ /**
+  * @brief Callback invoked after the routes behind an interface were switched.
+  * @param event Outcome of the switch.
+  * @param arg User argument given to mpls_frr_dispatch() or mpls_frr_run().
+  */
+ typedef void (*mpls_frr_cb)(const struct mpls_frr_event *event, void *arg);
+ 
+ /**
+  * @brief Starts a set of protected routes.
+  * @param session Session the routes are installed on; its interface cache, if any,
+  *                resolves interface names. Open it with MPLS_SESSION_SOCK_BUF for a large window.
+  * @return The set, or NULL with errno set.
+  */
+ struct mpls_frr *mpls_frr_open(struct mpls_session *session);
+ 
+ /**
+  * @brief Adds a protected route; both versions are encoded now.
+  * @param frr Set of protected routes, not yet armed.
+  * @param primary Route to use while its output interface is up.
+  * @param backup Same label (or destination) with another next hop.
+  * @return 0 on success; -EINVAL if the keys differ or a route is invalid, -EOPNOTSUPP for
+  *         multipath and nhid routes, -ENODEV or -ENETUNREACH if the primary's interface cannot be
+  *         found, -EBUSY once the set is armed, another negative errno on failure.
+  */
+ int mpls_frr_add(struct mpls_frr *frr, const struct mpls_route *primary, const struct mpls_route *backup);
+ 
+ /**
+  * @brief Adds the protected routes listed in a stream.
+  *
+  * Each line is a route in "add_for" syntax, without the verb, followed by
+  * "backup" and the next hop of the backup, e.g.
+  * "100 swap_as 200 dev eth0 backup swap_as 300 dev eth1". Blank lines and
+  * lines starting with '#' are skipped; invalid lines are reported on stderr
+  * as "name:line: reason" and skipped.
+  *
+  * @param frr Set of protected routes, not yet armed.
+  * @param in Stream to read.
+  * @param name Name of the stream used in diagnostics.
+  * @return 0 if every line was added, -1 otherwise.
+  */
+ int mpls_frr_load(struct mpls_frr *frr, FILE *in, const char *name);
+ 
+ /**
+  * @brief Reads the state of the links and installs each route in the version that matches it.
+  *
+  * Link notifications are collected from the moment the set was opened, so a
+  * change during the installation is acted on by the next dispatch.
+  *
+  * @param frr Set of protected routes.
+  * @param stats If not NULL, receives the outcome counters of the installation.
+  * @return 0 if every route was installed, -1 if some failed, negative errno if the links could not be read.
+  */
+ int mpls_frr_arm(struct mpls_frr *frr, struct mpls_batch_stats *stats);
+ 
+ /**
+  * @brief Returns the descriptor to watch for link notifications.
+  * @param frr Set of protected routes.
+  * @return File descriptor of the RTNLGRP_LINK socket.
+  */
+ int mpls_frr_fd(const struct mpls_frr *frr);
+ 
+ /**
+  * @brief Handles the link notifications that have arrived, without blocking on the socket.
+  * @param frr Armed set of protected routes.
+  * @param cb Called once per interface whose routes were switched, may be NULL.
+  * @param arg User argument for @p cb.
+  * @return Number of switches made, or negative errno on failure.
+  */
+ int mpls_frr_dispatch(struct mpls_frr *frr, mpls_frr_cb cb, void *arg);
+ 
+ /**
+  * @brief Waits for link notifications and switches routes until an error occurs.
+  * @param frr Armed set of protected routes.
+  * @param cb Called once per interface whose routes were switched, may be NULL.
+  * @param arg User argument for @p cb.
+  * @return Negative errno on failure; does not return otherwise.
+  */
+ int mpls_frr_run(struct mpls_frr *frr, mpls_frr_cb cb, void *arg);
+ 
+ /**
+  * @brief Counts the protected routes and the interfaces they depend on.
+  * @param frr Set of protected routes.
+  * @param links If not NULL, receives the number of indexed interfaces (0 before arming).
+  * @return Number of protected routes.
+  */
+ size_t mpls_frr_routes(const struct mpls_frr *frr, size_t *links);
+ 
+ /**
+  * @brief Frees a set of protected routes; the installed routes are left as they are.
+  * @param frr Set of protected routes, may be NULL.
+  */
+ void mpls_frr_close(struct mpls_frr *frr);
+ 
+ #pragma GCC visibility pop
+ 
+ #endif // MPLS_FRR_H
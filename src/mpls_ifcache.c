@@ -0,0 +1,280 @@
+// mpls_ifcache.c
+
+#include "mpls_ifcache.h"
+#include "mpls_core.h"
+#include "mpls_dump.h"
+#include "mpls_stats.h"
+
+#define IFCACHE_MIN_SLOTS 64
+#define IFCACHE_DUMP_RETRIES 3       // Attempts when links change under a dump (NLM_F_DUMP_INTR)
+
+struct ifcache_entry {
+    int ifindex;
+    char name[IF_NAMESIZE];
+};
+
+struct mpls_ifcache {
+    struct mpls_session link;  // Subscribed to RTNLGRP_LINK, and used for the dumps
+    struct ifcache_entry *entries;
+    uint32_t count, cap;
+    uint32_t *by_name;   // Open-addressing hash: name -> 1 + entry, 0 if empty
+    uint32_t *by_index;  // Open-addressing hash: ifindex -> 1 + entry, 0 if empty
+    uint32_t mask;
+    int stale;           // Notifications were lost: lookups use the kernel until a dump refills the cache
+    char *buf;           // Notification datagrams, grown by mpls_dump_recv()
+    size_t size;
+};
+
+// Function to hash an interface name (FNV-1a)
+static uint32_t ifcache_hash_name(const char *name) {
+    uint32_t h = 2166136261u;
+    for (; *name; name++) h = (h ^ (unsigned char)*name) * 16777619u;
+    return h;
+}
+
+// Function to hash an interface index
+static uint32_t ifcache_hash_index(int ifindex) {
+    return (uint32_t)ifindex * 2654435761u;
+}
+
+// Function to find the entry of an interface index
+static int ifcache_find_index(const struct mpls_ifcache *cache, int ifindex) {
+    for (uint32_t i = ifcache_hash_index(ifindex) & cache->mask;; i = (i + 1) & cache->mask) {
+        uint32_t slot = cache->by_index[i];
+        if (slot == 0) return -1;
+        if (cache->entries[slot - 1].ifindex == ifindex) return slot - 1;
+    }
+}
+
+// Function to find the entry of an interface name
+static int ifcache_find_name(const struct mpls_ifcache *cache, const char *name) {
+    for (uint32_t i = ifcache_hash_name(name) & cache->mask;; i = (i + 1) & cache->mask) {
+        uint32_t slot = cache->by_name[i];
+        if (slot == 0) return -1;
+        if (strcmp(cache->entries[slot - 1].name, name) == 0) return slot - 1;
+    }
+}
+
+// Function to add an entry to both hash tables
+static void ifcache_link(struct mpls_ifcache *cache, uint32_t n) {
+    uint32_t i = ifcache_hash_name(cache->entries[n].name) & cache->mask;
+    while (cache->by_name[i]) i = (i + 1) & cache->mask;
+    cache->by_name[i] = n + 1;
+
+    i = ifcache_hash_index(cache->entries[n].ifindex) & cache->mask;
+    while (cache->by_index[i]) i = (i + 1) & cache->mask;
+    cache->by_index[i] = n + 1;
+}
+
+// Function to rebuild both hash tables with a given number of slots
+static int ifcache_rehash(struct mpls_ifcache *cache, uint32_t slots) {
+    uint32_t *by_name = calloc(slots, sizeof(*by_name));
+    uint32_t *by_index = calloc(slots, sizeof(*by_index));
+    if (!by_name || !by_index) {
+        free(by_name);
+        free(by_index);
+        return -ENOMEM;
+    }
+    free(cache->by_name);
+    free(cache->by_index);
+    cache->by_name = by_name;
+    cache->by_index = by_index;
+    cache->mask = slots - 1;
+    for (uint32_t n = 0; n < cache->count; n++) ifcache_link(cache, n);
+    return 0;
+}
+
+// Function to record a new or renamed interface
+static int ifcache_set(struct mpls_ifcache *cache, int ifindex, const char *name) {
+    int n = ifcache_find_index(cache, ifindex);
+    if (n >= 0) {
+        if (strcmp(cache->entries[n].name, name) == 0) return 0;
+        // Renames are rare, so the name table is simply rebuilt
+        strcpy(cache->entries[n].name, name);
+        return ifcache_rehash(cache, cache->mask + 1);
+    }
+
+    if (cache->count == cache->cap) {
+        uint32_t cap = cache->cap ? cache->cap * 2 : IFCACHE_MIN_SLOTS / 2;
+        struct ifcache_entry *grown = realloc(cache->entries, cap * sizeof(*grown));
+        if (!grown) return -ENOMEM;
+        cache->entries = grown;
+        cache->cap = cap;
+    }
+    cache->entries[cache->count].ifindex = ifindex;
+    strcpy(cache->entries[cache->count].name, name);
+    cache->count++;
+
+    // Keep the load factor at or below one half
+    if (cache->count * 2 > cache->mask + 1) return ifcache_rehash(cache, (cache->mask + 1) * 2);
+    ifcache_link(cache, cache->count - 1);
+    return 0;
+}
+
+// Function to forget a deleted interface
+static int ifcache_remove(struct mpls_ifcache *cache, int ifindex) {
+    int n = ifcache_find_index(cache, ifindex);
+    if (n < 0) return 0;
+    cache->entries[n] = cache->entries[--cache->count];
+    return ifcache_rehash(cache, cache->mask + 1);
+}
+
+// Function to apply one RTM_NEWLINK/RTM_DELLINK message
+static int ifcache_handle(struct mpls_ifcache *cache, const struct nlmsghdr *nlh) {
+    if (nlh->nlmsg_type != RTM_NEWLINK && nlh->nlmsg_type != RTM_DELLINK) return 0;
+    int len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    if (len < 0) return 0;
+
+    const struct ifinfomsg *ifi = (const struct ifinfomsg *)NLMSG_DATA(nlh);
+    if (nlh->nlmsg_type == RTM_DELLINK) return ifcache_remove(cache, ifi->ifi_index);
+
+    const struct rtattr *tb[IFLA_MAX + 1];
+    mpls_parse_rtattr(tb, IFLA_MAX, IFLA_RTA(ifi), len);
+    const struct rtattr *name = tb[IFLA_IFNAME];
+    if (!name || RTA_PAYLOAD(name) < 2 || RTA_PAYLOAD(name) > IF_NAMESIZE) return 0;
+    if (((const char *)RTA_DATA(name))[RTA_PAYLOAD(name) - 1] != '\0') return 0;
+    return ifcache_set(cache, ifi->ifi_index, (const char *)RTA_DATA(name));
+}
+
+// Function to apply one link message read during a dump, notifications included
+static int ifcache_dump_msg(const struct nlmsghdr *nlh, void *arg) {
+    return ifcache_handle((struct mpls_ifcache *)arg, nlh);
+}
+
+// Function to (re)fill the cache from an RTM_GETLINK dump
+static int ifcache_dump(struct mpls_ifcache *cache) {
+    struct {
+        struct nlmsghdr nlh;
+        struct ifinfomsg ifi;
+        char buf[RTA_SPACE(sizeof(uint32_t))];
+    } req;
+
+    for (int attempt = 0; attempt < IFCACHE_DUMP_RETRIES; attempt++) {
+        MPLS_STAT_ADD(attempt ? MPLS_STAT_DUMP_RETRIES : MPLS_STAT_IFCACHE_DUMPS, 1);
+        memset(&req, 0, sizeof(req));
+        req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifi));
+        req.nlh.nlmsg_type = RTM_GETLINK;
+        req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        req.ifi.ifi_family = AF_UNSPEC;
+        // Only the names are needed, so leave the per-link statistics out of the reply
+        uint32_t ext_mask = RTEXT_FILTER_SKIP_STATS;
+        add_attr(&req.nlh, sizeof(req), IFLA_EXT_MASK, &ext_mask, sizeof(ext_mask));
+
+        cache->count = 0;
+        memset(cache->by_name, 0, (cache->mask + 1) * sizeof(*cache->by_name));
+        memset(cache->by_index, 0, (cache->mask + 1) * sizeof(*cache->by_index));
+
+        // Notifications keep being applied in order with the dump; an overrun or a change
+        // under the dump (-ENOBUFS, -EINTR) means the dump is read to its end and retried
+        int ret = mpls_dump_request(&cache->link, &req.nlh, MPLS_DUMP_NOTIFICATIONS, ifcache_dump_msg, cache);
+        if (ret != -ENOBUFS && ret != -EINTR) return ret;
+    }
+    return -EINTR;
+}
+
+// Function to open the notification socket and fill the cache
+struct mpls_ifcache *mpls_ifcache_open(void) {
+    struct mpls_ifcache *cache = calloc(1, sizeof(*cache));
+    if (!cache) return NULL;
+    cache->link.fd = -1;
+
+    int ret = ifcache_rehash(cache, IFCACHE_MIN_SLOTS);
+    if (ret < 0) goto fail;
+
+    ret = mpls_session_open(&cache->link, 0);
+    if (ret < 0) goto fail;
+    int group = RTNLGRP_LINK;
+    if (setsockopt(cache->link.fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group)) < 0) {
+        ret = -errno;
+        goto fail;
+    }
+
+    // Subscribe before dumping, so no change can fall between the two
+    ret = ifcache_dump(cache);
+    if (ret < 0) goto fail;
+    return cache;
+
+fail:
+    mpls_ifcache_close(cache);
+    errno = -ret;
+    return NULL;
+}
+
+// Function to apply pending link notifications without blocking
+int mpls_ifcache_poll(struct mpls_ifcache *cache) {
+    for (;;) {
+        ssize_t len = mpls_dump_recv(&cache->link, &cache->buf, &cache->size, MSG_DONTWAIT);
+        if (len == -EINTR) continue;
+        if (len == -EAGAIN || len == -EWOULDBLOCK) return cache->stale ? -ENOBUFS : 0;
+        if (len == -ENOBUFS) {
+            MPLS_STAT_ADD(MPLS_STAT_ENOBUFS, 1);
+            cache->stale = 1;
+            continue;
+        }
+        if (len < 0) return len;
+
+        int remaining = len;
+        for (struct nlmsghdr *nlh = (struct nlmsghdr *)cache->buf; NLMSG_OK(nlh, (unsigned int)remaining);
+             nlh = NLMSG_NEXT(nlh, remaining)) {
+            int ret = ifcache_handle(cache, nlh);
+            if (ret < 0) return ret;
+        }
+    }
+}
+
+// Function to apply pending link notifications, refilling the cache from a dump if some were lost
+int mpls_ifcache_refresh(struct mpls_ifcache *cache) {
+    int ret = mpls_ifcache_poll(cache);
+    if (ret != -ENOBUFS) return ret;
+    ret = ifcache_dump(cache);
+    if (ret == 0) cache->stale = 0;
+    return ret;
+}
+
+// Function to resolve an interface name through the cache
+int mpls_ifcache_index(struct mpls_ifcache *cache, const char *ifname) {
+    MPLS_STAT_TIME_START(start);
+    int ifindex;
+    if (!cache) {
+        ifindex = if_nametoindex(ifname);
+    } else {
+        // A miss may be an interface created since the last poll
+        int n = cache->stale ? -1 : ifcache_find_name(cache, ifname);
+        if (n < 0 && !cache->stale && mpls_ifcache_poll(cache) == 0) n = ifcache_find_name(cache, ifname);
+        if (cache->stale) {
+            ifindex = if_nametoindex(ifname);
+        } else {
+            ifindex = n < 0 ? 0 : cache->entries[n].ifindex;
+        }
+    }
+    MPLS_STAT_TIME_END(MPLS_HIST_IFINDEX, start);
+    MPLS_STAT_ADD(MPLS_STAT_IFINDEX_LOOKUPS, 1);
+    if (ifindex == 0) MPLS_STAT_ADD(MPLS_STAT_IFINDEX_MISSES, 1);
+    return ifindex;
+}
+
+// Function to resolve an interface index through the cache
+char *mpls_ifcache_name(struct mpls_ifcache *cache, int ifindex, char *buf) {
+    if (!cache) return if_indextoname(ifindex, buf);
+    int n = cache->stale ? -1 : ifcache_find_index(cache, ifindex);
+    if (n < 0 && !cache->stale && mpls_ifcache_poll(cache) == 0) n = ifcache_find_index(cache, ifindex);
+    if (cache->stale) return if_indextoname(ifindex, buf);
+    if (n < 0) return NULL;
+    return strcpy(buf, cache->entries[n].name);
+}
+
+// Function to return the notification socket
+int mpls_ifcache_fd(const struct mpls_ifcache *cache) {
+    return cache->link.fd;
+}
+
+// Function to free the cache
+void mpls_ifcache_close(struct mpls_ifcache *cache) {
+    if (!cache) return;
+    mpls_session_close(&cache->link);
+    free(cache->entries);
+    free(cache->by_name);
+    free(cache->by_index);
+    free(cache->buf);
+    free(cache);
+}
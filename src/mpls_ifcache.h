@@ -0,0 +1,81 @@
+/**
+ * @file mpls_ifcache.h
+ * @brief Interface name <-> index cache fed by RTM_GETLINK and link notifications.
+ *
+ * The cache is filled by one RTM_GETLINK dump and kept current by a Netlink
+ * socket subscribed to RTNLGRP_LINK, so resolving the interface of a dev route
+ * is a hash lookup instead of an ioctl socket and syscall per route.
+ */
+
+ #ifndef MPLS_IFCACHE_H
+ #define MPLS_IFCACHE_H
+ 
+ #pragma GCC visibility push(default)
+ 
+ struct mpls_ifcache;
+ 
+ /**
+  * @brief Opens a link-notification socket and fills the cache with a link dump.
+  * @return New cache, or NULL on failure (errno is set).
+  */
+ struct mpls_ifcache *mpls_ifcache_open(void);
+ 
+ /**
+  * @brief Applies pending link notifications without blocking.
+  *
+  * If notifications were lost, the cache is marked stale: lookups then go to
+  * the kernel (if_nametoindex(), if_indextoname()) until
+  * mpls_ifcache_refresh() refills it.
+  *
+  * @param cache Cache to poll.
+  * @return 0 on success, -ENOBUFS if the cache is stale, other negative errno on failure.
+  */
+ int mpls_ifcache_poll(struct mpls_ifcache *cache);
+ 
+ /**
+  * @brief Applies pending link notifications, and refills a stale cache.
+  *
+  * Blocks for a link dump if notifications were lost (ENOBUFS).
+  *
+  * @param cache Cache to refresh.
+  * @return 0 on success, negative errno on failure.
+  */
+ int mpls_ifcache_refresh(struct mpls_ifcache *cache);
+ 
+ /**
+  * @brief Resolves an interface name to its index.
+  *
+  * A miss applies pending notifications and looks again, so interfaces created
+  * after the cache was filled are found. Never blocks.
+  *
+  * @param cache Cache, or NULL to fall back to if_nametoindex().
+  * @param ifname Interface name.
+  * @return Interface index, or 0 if there is no such interface.
+  */
+ int mpls_ifcache_index(struct mpls_ifcache *cache, const char *ifname);
+ 
+ /**
+  * @brief Resolves an interface index to its name.
+  * @param cache Cache, or NULL to fall back to if_indextoname().
+  * @param ifindex Interface index.
+  * @param buf Receives the name; at least IF_NAMESIZE bytes.
+  * @return @p buf, or NULL if there is no such interface.
+  */
+ char *mpls_ifcache_name(struct mpls_ifcache *cache, int ifindex, char *buf);
+ 
+ /**
+  * @brief Returns the notification socket, for callers that poll it in an event loop.
+  * @param cache Cache.
+  * @return File descriptor; call mpls_ifcache_refresh() when it is readable.
+  */
+ int mpls_ifcache_fd(const struct mpls_ifcache *cache);
+ 
+ /**
+  * @brief Closes the notification socket and frees the cache.
+  * @param cache Cache to free, may be NULL.
+  */
+ void mpls_ifcache_close(struct mpls_ifcache *cache);
+ 
+ #pragma GCC visibility pop
+ 
+ #endif // MPLS_IFCACHE_H
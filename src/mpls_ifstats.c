@@ -0,0 +1,245 @@
+// mpls_ifstats.c
+
+#include "mpls_ifstats.h"
+#include "mpls_core.h"
+#include "mpls_ifcache.h"
+#include "mpls_dump.h"
+#include "mpls_stats.h"
+#include <time.h>
+#include <linux/if_link.h>
+
+struct mpls_ifstats {
+    struct mpls_ifstats_entry *cur, *prev;  // Sorted by ifindex
+    size_t cur_count, prev_count, capacity;
+    uint64_t cur_ns, prev_ns;               // Monotonic time each sample was taken
+};
+
+static const char *ifstats_names[MPLS_IFSTATS_COUNTERS] = {
+    "rx_packets", "tx_packets", "rx_bytes", "tx_bytes", "rx_errors",
+    "tx_errors", "rx_dropped", "tx_dropped", "rx_noroute",
+};
+
+// Function to copy the counters of an entry into an array
+static void ifstats_counters(const struct mpls_ifstats_entry *entry, uint64_t counters[MPLS_IFSTATS_COUNTERS]) {
+    memcpy(counters, &entry->stats, MPLS_IFSTATS_COUNTERS * sizeof(uint64_t));
+}
+
+// Function to create an empty collector
+struct mpls_ifstats *mpls_ifstats_open(void) {
+    return calloc(1, sizeof(struct mpls_ifstats));
+}
+
+// Function to append the MPLS counters of one RTM_NEWSTATS message to the current sample
+static int ifstats_add(const struct nlmsghdr *nlh, void *arg) {
+    struct mpls_ifstats *ifstats = (struct mpls_ifstats *)arg;
+    if (nlh->nlmsg_type != RTM_NEWSTATS) return 0;
+    int len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(struct if_stats_msg));
+    if (len < 0) return 0;
+    const struct if_stats_msg *ifsm = (const struct if_stats_msg *)NLMSG_DATA(nlh);
+
+    const struct rtattr *tb[IFLA_STATS_MAX + 1];
+    mpls_parse_rtattr(tb, IFLA_STATS_MAX, (const struct rtattr *)((const char *)ifsm + NLMSG_ALIGN(sizeof(*ifsm))), len);
+    if (!tb[IFLA_STATS_AF_SPEC]) return 0;
+
+    const struct rtattr *af[AF_MAX + 1];
+    mpls_parse_rtattr(af, AF_MAX, RTA_DATA(tb[IFLA_STATS_AF_SPEC]), RTA_PAYLOAD(tb[IFLA_STATS_AF_SPEC]));
+    if (!af[AF_MPLS]) return 0;  // No MPLS device on this interface
+
+    const struct rtattr *mpls[MPLS_STATS_MAX + 1];
+    mpls_parse_rtattr(mpls, MPLS_STATS_MAX, RTA_DATA(af[AF_MPLS]), RTA_PAYLOAD(af[AF_MPLS]));
+    if (!mpls[MPLS_STATS_LINK]) return 0;
+
+    if (ifstats->cur_count == ifstats->capacity) {
+        size_t capacity = ifstats->capacity ? ifstats->capacity * 2 : 64;
+        struct mpls_ifstats_entry *cur = realloc(ifstats->cur, capacity * sizeof(*cur));
+        if (!cur) return -ENOMEM;
+        ifstats->cur = cur;
+        struct mpls_ifstats_entry *prev = realloc(ifstats->prev, capacity * sizeof(*prev));
+        if (!prev) return -ENOMEM;
+        ifstats->prev = prev;
+        ifstats->capacity = capacity;
+    }
+
+    // Older kernels may send a shorter struct; missing counters read as 0
+    struct mpls_ifstats_entry *entry = &ifstats->cur[ifstats->cur_count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->ifindex = ifsm->ifindex;
+    size_t size = RTA_PAYLOAD(mpls[MPLS_STATS_LINK]);
+    memcpy(&entry->stats, RTA_DATA(mpls[MPLS_STATS_LINK]), size < sizeof(entry->stats) ? size : sizeof(entry->stats));
+    return 0;
+}
+
+// Function to order sample entries by interface index
+static int ifstats_compare(const void *a, const void *b) {
+    const struct mpls_ifstats_entry *x = a, *y = b;
+    return (x->ifindex > y->ifindex) - (x->ifindex < y->ifindex);
+}
+
+// Function to take a new sample with one RTM_GETSTATS dump
+int mpls_ifstats_collect(struct mpls_ifstats *ifstats, struct mpls_session *session) {
+    struct {
+        struct nlmsghdr nlh;
+        struct if_stats_msg ifsm;
+    } req;
+    memset(&req, 0, sizeof(req));
+    init_netlink_message(&req.nlh, RTM_GETSTATS, NLM_F_REQUEST | NLM_F_DUMP, 0, 0);
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifsm));
+    req.ifsm.family = AF_UNSPEC;
+    req.ifsm.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_AF_SPEC);
+
+    // The current sample becomes the previous one; the array of the one before is refilled
+    struct mpls_ifstats_entry *swap = ifstats->prev;
+    ifstats->prev = ifstats->cur;
+    ifstats->cur = swap;
+    ifstats->prev_count = ifstats->cur_count;
+    ifstats->prev_ns = ifstats->cur_ns;
+    ifstats->cur_count = 0;
+    ifstats->cur_ns = mpls_stats_now();
+
+    // An interface added or removed meanwhile (NLM_F_DUMP_INTR) leaves the others' counters valid
+    int result = mpls_dump_request(session, &req.nlh, 0, ifstats_add, ifstats);
+    if (result == -EINTR) result = 0;
+    if (result < 0) {
+        // Keep the last complete sample as the current one; rates resume after the next sample
+        swap = ifstats->cur;
+        ifstats->cur = ifstats->prev;
+        ifstats->prev = swap;
+        ifstats->cur_count = ifstats->prev_count;
+        ifstats->cur_ns = ifstats->prev_ns;
+        ifstats->prev_count = 0;
+        return result;
+    }
+
+    // The dump walks the kernel's device hash, so the order is not the index order
+    qsort(ifstats->cur, ifstats->cur_count, sizeof(*ifstats->cur), ifstats_compare);
+    return (int)ifstats->cur_count;
+}
+
+// Function to return the current sample
+const struct mpls_ifstats_entry *mpls_ifstats_entries(const struct mpls_ifstats *ifstats, size_t *count) {
+    *count = ifstats->cur_count;
+    return ifstats->cur;
+}
+
+// Function to find an interface in a sorted sample
+static const struct mpls_ifstats_entry *ifstats_find(const struct mpls_ifstats_entry *entries, size_t count,
+                                                     int ifindex) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (entries[mid].ifindex == ifindex) return &entries[mid];
+        if (entries[mid].ifindex < ifindex) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+// Function to compute the per-second rates between two entries of one interface
+static void ifstats_delta(const struct mpls_ifstats_entry *prev, const struct mpls_ifstats_entry *cur,
+                          double seconds, double rates[MPLS_IFSTATS_COUNTERS]) {
+    uint64_t a[MPLS_IFSTATS_COUNTERS], b[MPLS_IFSTATS_COUNTERS];
+    ifstats_counters(prev, a);
+    ifstats_counters(cur, b);
+    for (int i = 0; i < MPLS_IFSTATS_COUNTERS; i++) {
+        // A counter that went backwards was reset; count from zero
+        uint64_t delta = b[i] >= a[i] ? b[i] - a[i] : b[i];
+        rates[i] = seconds > 0 ? delta / seconds : 0;
+    }
+}
+
+// Function to compute the rates of one interface
+int mpls_ifstats_rates(const struct mpls_ifstats *ifstats, int ifindex, double rates[MPLS_IFSTATS_COUNTERS]) {
+    const struct mpls_ifstats_entry *cur = ifstats_find(ifstats->cur, ifstats->cur_count, ifindex);
+    const struct mpls_ifstats_entry *prev = ifstats_find(ifstats->prev, ifstats->prev_count, ifindex);
+    if (!cur || !prev) return -ENOENT;
+    ifstats_delta(prev, cur, (ifstats->cur_ns - ifstats->prev_ns) / 1e9, rates);
+    return 0;
+}
+
+// Function to format the current wall-clock time
+static void ifstats_timestamp(char *buf, size_t len) {
+    struct timespec ts;
+    struct tm tm;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    localtime_r(&ts.tv_sec, &tm);
+    size_t n = strftime(buf, len, "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buf + n, len - n, ".%06ld", ts.tv_nsec / 1000);
+}
+
+// Function to write the current sample
+int mpls_ifstats_write(const struct mpls_ifstats *ifstats, FILE *out, enum mpls_ifstats_format format,
+                       struct mpls_ifcache *names) {
+    char now[40];
+    ifstats_timestamp(now, sizeof(now));
+    double seconds = (ifstats->cur_ns - ifstats->prev_ns) / 1e9;
+
+    if (format == MPLS_IFSTATS_PROMETHEUS) {
+        // Series are grouped per counter, as the exposition format requires
+        for (int i = 0; i < MPLS_IFSTATS_COUNTERS; i++) {
+            fprintf(out, "# TYPE mpls_link_%s_total counter\n", ifstats_names[i]);
+            for (size_t n = 0; n < ifstats->cur_count; n++) {
+                const struct mpls_ifstats_entry *entry = &ifstats->cur[n];
+                char ifname[IF_NAMESIZE];
+                if (!mpls_ifcache_name(names, entry->ifindex, ifname)) ifname[0] = '\0';
+                uint64_t counters[MPLS_IFSTATS_COUNTERS];
+                ifstats_counters(entry, counters);
+                fprintf(out, "mpls_link_%s_total{ifindex=\"%d\",ifname=\"%s\"} %llu\n", ifstats_names[i],
+                        entry->ifindex, ifname, (unsigned long long)counters[i]);
+            }
+        }
+        return fflush(out) == 0 && !ferror(out) ? 0 : -EIO;
+    }
+
+    // Both samples are sorted, so one merge walk pairs each interface with its previous counters
+    size_t p = 0;
+    for (size_t n = 0; n < ifstats->cur_count; n++) {
+        const struct mpls_ifstats_entry *entry = &ifstats->cur[n];
+        while (p < ifstats->prev_count && ifstats->prev[p].ifindex < entry->ifindex) p++;
+        const struct mpls_ifstats_entry *prev =
+            p < ifstats->prev_count && ifstats->prev[p].ifindex == entry->ifindex ? &ifstats->prev[p] : NULL;
+        double rates[MPLS_IFSTATS_COUNTERS];
+        if (prev) ifstats_delta(prev, entry, seconds, rates);
+
+        char ifname[IF_NAMESIZE];
+        if (!mpls_ifcache_name(names, entry->ifindex, ifname)) snprintf(ifname, sizeof(ifname), "if%d", entry->ifindex);
+        const struct mpls_link_stats *s = &entry->stats;
+
+        if (format == MPLS_IFSTATS_JSON) {
+            uint64_t counters[MPLS_IFSTATS_COUNTERS];
+            ifstats_counters(entry, counters);
+            fprintf(out, "{\"time\":\"%s\",\"ifindex\":%d,\"ifname\":\"%s\"", now, entry->ifindex, ifname);
+            for (int i = 0; i < MPLS_IFSTATS_COUNTERS; i++) {
+                fprintf(out, ",\"%s\":%llu", ifstats_names[i], (unsigned long long)counters[i]);
+            }
+            if (prev) {
+                fprintf(out, ",\"interval\":%.3f", seconds);
+                for (int i = 0; i < MPLS_IFSTATS_COUNTERS; i++) {
+                    fprintf(out, ",\"%s_per_sec\":%.1f", ifstats_names[i], rates[i]);
+                }
+            }
+            fputs("}\n", out);
+        } else if (prev) {
+            fprintf(out, "%-15s rx %.0f pkt/s %.0f B/s  tx %.0f pkt/s %.0f B/s  errors %.0f/%.0f/s  noroute %.0f/s\n",
+                    ifname, rates[0], rates[2], rates[1], rates[3], rates[4], rates[5], rates[8]);
+        } else {
+            fprintf(out, "%-15s rx %llu pkt %llu B  tx %llu pkt %llu B  errors %llu/%llu  dropped %llu/%llu  "
+                    "noroute %llu\n", ifname, (unsigned long long)s->rx_packets, (unsigned long long)s->rx_bytes,
+                    (unsigned long long)s->tx_packets, (unsigned long long)s->tx_bytes,
+                    (unsigned long long)s->rx_errors, (unsigned long long)s->tx_errors,
+                    (unsigned long long)s->rx_dropped, (unsigned long long)s->tx_dropped,
+                    (unsigned long long)s->rx_noroute);
+        }
+    }
+    return fflush(out) == 0 && !ferror(out) ? 0 : -EIO;
+}
+
+// Function to free a collector
+void mpls_ifstats_close(struct mpls_ifstats *ifstats) {
+    if (!ifstats) return;
+    free(ifstats->cur);
+    free(ifstats->prev);
+    free(ifstats);
+}
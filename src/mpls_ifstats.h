@@ -0,0 +1,98 @@
+/**
+ * @file mpls_ifstats.h
+ * @brief Per-interface MPLS traffic counters read with RTM_GETSTATS.
+ *
+ * One RTM_GETSTATS dump filtered to IFLA_STATS_AF_SPEC returns the kernel's
+ * AF_MPLS counters (struct mpls_link_stats) of every interface at once, so a
+ * sample costs one request whatever the number of interfaces. Samples are
+ * kept in flat arrays sorted by interface index: the previous one is kept to
+ * turn counters into rates, and both are reused from one sample to the next.
+ */
+
+ #ifndef MPLS_IFSTATS_H
+ #define MPLS_IFSTATS_H
+ 
+ #include <stdio.h>
+ #include <stdint.h>
+ #include <linux/mpls.h>
+ 
+ #pragma GCC visibility push(default)
+ 
+ struct mpls_session;
+ struct mpls_ifcache;
+ struct mpls_ifstats;
+ 
+ #define MPLS_IFSTATS_COUNTERS 9  /**< Number of __u64 counters in struct mpls_link_stats. */
+ 
+ /**
+  * @brief Output formats of mpls_ifstats_write().
+  */
+ enum mpls_ifstats_format {
+     MPLS_IFSTATS_PLAIN,      /**< One line per interface, for people. */
+     MPLS_IFSTATS_JSON,       /**< One JSON object per interface and sample. */
+     MPLS_IFSTATS_PROMETHEUS  /**< Prometheus text exposition format. */
+ };
+ 
+ /**
+  * @brief Counters of one interface in a sample.
+  */
+ struct mpls_ifstats_entry {
+     int ifindex;                   /**< Interface the counters belong to. */
+     struct mpls_link_stats stats;  /**< Counters as reported by the kernel. */
+ };
+ 
+ /**
+  * @brief Creates an empty collector.
+  * @return The collector, or NULL with errno set.
+  */
+ struct mpls_ifstats *mpls_ifstats_open(void);
+ 
+ /**
+  * @brief Takes a new sample with one RTM_GETSTATS dump; the current one becomes the previous one.
+  *
+  * Interfaces without MPLS counters (the kernel has no MPLS device for them)
+  * are left out of the sample.
+  *
+  * @param ifstats Collector.
+  * @param session Session the dump is sent on.
+  * @return Number of interfaces in the sample, or negative errno on failure.
+  */
+ int mpls_ifstats_collect(struct mpls_ifstats *ifstats, struct mpls_session *session);
+ 
+ /**
+  * @brief Returns the current sample.
+  * @param ifstats Collector.
+  * @param count Receives the number of entries.
+  * @return Entries sorted by interface index, valid until the next mpls_ifstats_collect().
+  */
+ const struct mpls_ifstats_entry *mpls_ifstats_entries(const struct mpls_ifstats *ifstats, size_t *count);
+ 
+ /**
+  * @brief Computes the per-second rates of an interface between the previous and the current sample.
+  * @param ifstats Collector.
+  * @param ifindex Interface to look up.
+  * @param rates Receives the rate of each counter, in the order of struct mpls_link_stats.
+  * @return 0 on success, -ENOENT if the interface is missing from either sample.
+  */
+ int mpls_ifstats_rates(const struct mpls_ifstats *ifstats, int ifindex, double rates[MPLS_IFSTATS_COUNTERS]);
+ 
+ /**
+  * @brief Writes the current sample, with rates when there is a previous one.
+  * @param ifstats Collector.
+  * @param out Stream to write to.
+  * @param format Output format.
+  * @param names Interface cache used to name interfaces, or NULL for if_indextoname().
+  * @return 0 on success, -EIO if the stream failed.
+  */
+ int mpls_ifstats_write(const struct mpls_ifstats *ifstats, FILE *out, enum mpls_ifstats_format format,
+                        struct mpls_ifcache *names);
+ 
+ /**
+  * @brief Frees a collector.
+  * @param ifstats Collector, may be NULL.
+  */
+ void mpls_ifstats_close(struct mpls_ifstats *ifstats);
+ 
+ #pragma GCC visibility pop
+ 
+ #endif // MPLS_IFSTATS_H
@@ -0,0 +1,178 @@
+// mpls_labels.c
+
+#include "mpls_labels.h"
+#include "mpls_core.h"
+#include "mpls_dump.h"
+#include "mpls_stats.h"
+
+#define LABELS_WORDS ((MPLS_LABEL_MAX + 1) / 64)
+#define LABELS_NONE UINT32_MAX
+#define LABELS_DUMP_RETRIES 3  // Attempts when the table changes under a dump (NLM_F_DUMP_INTR)
+
+struct mpls_labels {
+    uint32_t first;
+    uint32_t last;
+    uint32_t hint;                // No label below this one is free
+    uint32_t nfree;
+    uint64_t used[LABELS_WORDS];  // Bit set: label in use, reserved or outside the range
+};
+
+// Function to set or clear the bits of labels from..to, whole words at a time
+static void labels_mark(struct mpls_labels *labels, uint32_t from, uint32_t to, int used) {
+    while (from <= to) {
+        uint32_t bit = from % 64;
+        uint32_t n = to - from + 1 < 64 - bit ? to - from + 1 : 64 - bit;
+        uint64_t mask = (n == 64 ? ~0ull : (1ull << n) - 1) << bit;
+        if (used) {
+            labels->used[from / 64] |= mask;
+        } else {
+            labels->used[from / 64] &= ~mask;
+        }
+        from += n;
+    }
+}
+
+// Function to find the first label at or after 'from' whose bit is set ('used') or clear
+static uint32_t labels_find(const struct mpls_labels *labels, uint32_t from, int used) {
+    if (from > MPLS_LABEL_MAX) return LABELS_NONE;
+    uint32_t w = from / 64;
+    uint64_t flip = used ? 0 : ~0ull;
+    uint64_t word = (labels->used[w] ^ flip) & (~0ull << (from % 64));
+    while (!word) {
+        if (++w == LABELS_WORDS) return LABELS_NONE;
+        word = labels->used[w] ^ flip;
+    }
+    return w * 64 + __builtin_ctzll(word);
+}
+
+// Function to count the free labels from scratch
+static void labels_recount(struct mpls_labels *labels) {
+    uint32_t n = 0;
+    for (uint32_t w = 0; w < LABELS_WORDS; w++) n += __builtin_popcountll(~labels->used[w]);
+    labels->nfree = n;
+}
+
+// Function to create an allocator with a whole range free
+struct mpls_labels *mpls_labels_open(uint32_t first, uint32_t last) {
+    if (first < MPLS_LABEL_FIRST_UNRESERVED) first = MPLS_LABEL_FIRST_UNRESERVED;
+    if (last > MPLS_LABEL_MAX || first > last) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct mpls_labels *labels = malloc(sizeof(*labels));
+    if (!labels) return NULL;
+    memset(labels->used, 0xff, sizeof(labels->used));
+    labels_mark(labels, first, last, 0);
+    labels->first = first;
+    labels->last = last;
+    labels->hint = first;
+    labels->nfree = last - first + 1;
+    return labels;
+}
+
+// Function to parse a "first-last" label range
+int mpls_labels_parse_range(const char *spec, uint32_t *first, uint32_t *last) {
+    *first = MPLS_LABEL_FIRST_UNRESERVED;
+    *last = MPLS_LABEL_MAX;
+    if (!spec || !spec[0]) return 0;
+
+    char *end;
+    errno = 0;
+    unsigned long lo = strtoul(spec, &end, 10);
+    if (errno || end == spec || *end != '-' || spec[0] == '-') return -EINVAL;
+    const char *rest = end + 1;
+    unsigned long hi = strtoul(rest, &end, 10);
+    if (errno || end == rest || *end != '\0' || rest[0] == '-') return -EINVAL;
+    if (lo < MPLS_LABEL_FIRST_UNRESERVED || hi > MPLS_LABEL_MAX || lo > hi) return -EINVAL;
+    *first = lo;
+    *last = hi;
+    return 0;
+}
+
+// Function to mark the incoming label of a dumped LFIB route as used
+static int labels_visit(const struct mpls_route_entry *entry, void *arg) {
+    struct mpls_labels *labels = (struct mpls_labels *)arg;
+    uint32_t label;
+    if (mpls_entry_labels(entry->tb[RTA_DST], &label, 1) == 1 && label >= labels->first && label <= labels->last) {
+        labels->used[label / 64] |= 1ull << (label % 64);
+    }
+    return 0;
+}
+
+// Function to take every label the kernel already routes
+int mpls_labels_load(struct mpls_labels *labels, struct mpls_session *session) {
+    int ret = 0;
+    // Marks are only ever added, so a retried dump cannot lose a label seen by an interrupted one
+    for (int attempt = 0; attempt < LABELS_DUMP_RETRIES; attempt++) {
+        if (attempt) MPLS_STAT_ADD(MPLS_STAT_DUMP_RETRIES, 1);
+        ret = mpls_dump_routes(session, AF_MPLS, labels_visit, labels);
+        if (ret != -EINTR) break;
+    }
+    labels_recount(labels);
+    return ret;
+}
+
+// Function to take one given label
+int mpls_labels_reserve(struct mpls_labels *labels, uint32_t label) {
+    if (label < labels->first || label > labels->last) return -ERANGE;
+    uint64_t bit = 1ull << (label % 64);
+    if (labels->used[label / 64] & bit) return -EEXIST;
+    labels->used[label / 64] |= bit;
+    labels->nfree--;
+    return 0;
+}
+
+// Function to give a label back
+void mpls_labels_release(struct mpls_labels *labels, uint32_t label) {
+    if (label < labels->first || label > labels->last) return;
+    uint64_t bit = 1ull << (label % 64);
+    if (!(labels->used[label / 64] & bit)) return;
+    labels->used[label / 64] &= ~bit;
+    labels->nfree++;
+    if (label < labels->hint) labels->hint = label;
+}
+
+// Function to take the lowest free label
+int mpls_labels_alloc(struct mpls_labels *labels, uint32_t *label) {
+    // Labels past 'last' are marked used, so any hit is inside the range
+    uint32_t l = labels_find(labels, labels->hint, 0);
+    if (l == LABELS_NONE) return -ENOSPC;
+    labels->used[l / 64] |= 1ull << (l % 64);
+    labels->nfree--;
+    labels->hint = l + 1;
+    *label = l;
+    return 0;
+}
+
+// Function to take the lowest run of free labels long enough for a block
+int mpls_labels_alloc_block(struct mpls_labels *labels, uint32_t count, uint32_t *first) {
+    if (count == 0) return -EINVAL;
+    if (count > labels->nfree) return -ENOSPC;
+
+    uint32_t lowest = labels_find(labels, labels->hint, 0);
+    for (uint32_t start = lowest; start != LABELS_NONE;) {
+        if (count - 1 > labels->last - start) return -ENOSPC;
+        // The run ends at the next used label; jump past it if it is too short
+        uint32_t end = labels_find(labels, start, 1);
+        if (end == LABELS_NONE || end - start >= count) {
+            labels_mark(labels, start, start + count - 1, 1);
+            labels->nfree -= count;
+            if (start == lowest) labels->hint = start + count;
+            *first = start;
+            return 0;
+        }
+        start = labels_find(labels, end, 0);
+    }
+    return -ENOSPC;
+}
+
+// Function to count the free labels
+uint32_t mpls_labels_free(const struct mpls_labels *labels) {
+    return labels->nfree;
+}
+
+// Function to free an allocator
+void mpls_labels_close(struct mpls_labels *labels) {
+    free(labels);
+}
@@ -0,0 +1,101 @@
+/**
+ * @file mpls_labels.h
+ * @brief Free-label allocator over the 20-bit MPLS label space.
+ *
+ * One bit per label (128 KB for all 1,048,576 labels), set when the label is
+ * in use. The map is seeded from a dump of the kernel's LFIB and searched a
+ * 64-bit word at a time, so finding a free label or a run of free labels skips
+ * whole words of used labels with a single compare and lands on the first free
+ * bit with a count-trailing-zeros instruction.
+ *
+ * Labels 0-15 are reserved (RFC 3032) and never handed out, and allocation can
+ * be limited to a configurable range such as an SRGB.
+ */
+
+ #ifndef MPLS_LABELS_H
+ #define MPLS_LABELS_H
+ 
+ #include <stdint.h>
+ 
+ #pragma GCC visibility push(default)
+ 
+ struct mpls_session;
+ struct mpls_labels;
+ 
+ #define MPLS_LABEL_MAX 0xFFFFF            /**< Highest 20-bit label. */
+ #define MPLS_LABEL_FIRST_UNRESERVED 16    /**< Labels below this are reserved and never allocated. */
+ #define MPLS_LABEL_RANGE_ENV "MPLS_LABEL_RANGE" /**< Environment variable holding "first-last". */
+ 
+ /**
+  * @brief Creates an allocator in which every label of a range is free.
+  * @param first Lowest label to hand out; raised to MPLS_LABEL_FIRST_UNRESERVED if lower.
+  * @param last Highest label to hand out, at most MPLS_LABEL_MAX.
+  * @return The allocator, or NULL (errno is EINVAL for an empty range, ENOMEM otherwise).
+  */
+ struct mpls_labels *mpls_labels_open(uint32_t first, uint32_t last);
+ 
+ /**
+  * @brief Parses a label range written as "first-last", e.g. "16000-23999".
+  * @param spec Range text, or NULL/empty for the whole unreserved space.
+  * @param first Receives the lowest label.
+  * @param last Receives the highest label.
+  * @return 0 on success, -EINVAL if @p spec is malformed.
+  */
+ int mpls_labels_parse_range(const char *spec, uint32_t *first, uint32_t *last);
+ 
+ /**
+  * @brief Marks every label that has a route in the kernel's LFIB as used.
+  * @param labels Allocator.
+  * @param session Session to dump on; nothing else may be in flight on it.
+  * @return 0 on success, negative errno on failure.
+  */
+ int mpls_labels_load(struct mpls_labels *labels, struct mpls_session *session);
+ 
+ /**
+  * @brief Marks one label as used, e.g. one the caller picked by hand.
+  * @param labels Allocator.
+  * @param label Label to take.
+  * @return 0 on success, -EEXIST if it was already used, -ERANGE if it is outside the range.
+  */
+ int mpls_labels_reserve(struct mpls_labels *labels, uint32_t label);
+ 
+ /**
+  * @brief Returns a label to the pool.
+  * @param labels Allocator.
+  * @param label Label to free; ignored if outside the range.
+  */
+ void mpls_labels_release(struct mpls_labels *labels, uint32_t label);
+ 
+ /**
+  * @brief Takes the lowest free label of the range.
+  * @param labels Allocator.
+  * @param label Receives the label.
+  * @return 0 on success, -ENOSPC if the range is exhausted.
+  */
+ int mpls_labels_alloc(struct mpls_labels *labels, uint32_t *label);
+ 
+ /**
+  * @brief Takes the lowest run of @p count consecutive free labels.
+  * @param labels Allocator.
+  * @param count Number of labels, at least 1.
+  * @param first Receives the first label of the run.
+  * @return 0 on success, -ENOSPC if no run is long enough, -EINVAL if @p count is 0.
+  */
+ int mpls_labels_alloc_block(struct mpls_labels *labels, uint32_t count, uint32_t *first);
+ 
+ /**
+  * @brief Counts the free labels of the range.
+  * @param labels Allocator.
+  * @return Number of labels that mpls_labels_alloc() can still hand out.
+  */
+ uint32_t mpls_labels_free(const struct mpls_labels *labels);
+ 
+ /**
+  * @brief Frees the allocator.
+  * @param labels Allocator, may be NULL.
+  */
+ void mpls_labels_close(struct mpls_labels *labels);
+ 
+ #pragma GCC visibility pop
+ 
+ #endif // MPLS_LABELS_H
@@ -0,0 +1,169 @@
+// mpls_monitor.c
+
+#include "mpls_monitor.h"
+#include "mpls_core.h"
+#include "mpls_ifcache.h"
+#include "mpls_stats.h"
+#include <time.h>
+
+#define MONITOR_RECV_SLOT 8192  // Room for one notification, including a full multipath route
+#define MONITOR_RECV_VLEN 64    // Notifications pulled per recvmmsg() call
+#define MONITOR_DUMP_RETRIES 3  // Attempts when the table changes under a resync dump
+
+struct monitor_ctx {
+    FILE *out;
+    enum mpls_show_format format;
+    struct mpls_ifcache *ifcache;
+    const char *event;  // Event name used by monitor_dump_route()
+};
+
+// Function to format the current time as "YYYY-MM-DDTHH:MM:SS.uuuuuu"
+static void monitor_timestamp(char *buf, size_t len) {
+    struct timespec ts;
+    struct tm tm;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    localtime_r(&ts.tv_sec, &tm);
+    size_t n = strftime(buf, len, "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buf + n, len - n, ".%06ld", ts.tv_nsec / 1000);
+}
+
+// Function to print one event line, with or without a route
+static void monitor_print(struct monitor_ctx *ctx, const char *event, const struct mpls_route_entry *entry) {
+    char now[40], prefix[96];
+    monitor_timestamp(now, sizeof(now));
+
+    if (ctx->format == MPLS_SHOW_JSON) {
+        if (!entry) {
+            fprintf(ctx->out, "{\"time\":\"%s\",\"event\":\"%s\"}\n", now, event);
+            return;
+        }
+        snprintf(prefix, sizeof(prefix), "{\"time\":\"%s\",\"event\":\"%s\",", now, event);
+    } else {
+        if (!entry) {
+            fprintf(ctx->out, "%s %s\n", now, event);
+            return;
+        }
+        snprintf(prefix, sizeof(prefix), "%s %s ", now, event);
+    }
+    if (mpls_print_route_entry(ctx->out, ctx->format, entry, ctx->ifcache, prefix)) {
+        fputs(ctx->format == MPLS_SHOW_JSON ? "}\n" : "\n", ctx->out);
+    }
+}
+
+// Function to print one route change notification
+static void monitor_event(struct monitor_ctx *ctx, const struct nlmsghdr *nlh) {
+    const char *event;
+    if (nlh->nlmsg_type == RTM_NEWROUTE) {
+        event = (nlh->nlmsg_flags & NLM_F_REPLACE) ? "replace" : "add";
+    } else if (nlh->nlmsg_type == RTM_DELROUTE) {
+        event = "del";
+    } else {
+        return;
+    }
+
+    struct mpls_route_entry entry;
+    if (mpls_route_entry_parse(nlh, &entry) < 0) return;
+    monitor_print(ctx, event, &entry);
+}
+
+// Function to print one route of a resync dump
+static int monitor_dump_route(const struct mpls_route_entry *entry, void *arg) {
+    struct monitor_ctx *ctx = (struct monitor_ctx *)arg;
+    monitor_print(ctx, ctx->event, entry);
+    return 0;
+}
+
+// Function to dump the current table after notifications were lost
+static int monitor_resync(struct monitor_ctx *ctx, struct mpls_session *session) {
+    monitor_print(ctx, "overrun", NULL);
+
+    // Restart the dump if the table changes under it (NLM_F_DUMP_INTR); the events
+    // that caused the change are still queued on the notification socket
+    int ret = -EINTR;
+    for (int attempt = 0; attempt < MONITOR_DUMP_RETRIES && ret == -EINTR; attempt++) {
+        if (attempt) MPLS_STAT_ADD(MPLS_STAT_DUMP_RETRIES, 1);
+        ctx->event = "dump";
+        ret = mpls_dump_routes(session, AF_MPLS, monitor_dump_route, ctx);
+        if (ret == 0) ret = mpls_dump_routes(session, AF_INET, monitor_dump_route, ctx);
+    }
+    if (ret < 0 && ret != -EINTR) return ret;
+
+    monitor_print(ctx, "dump_done", NULL);
+    fflush(ctx->out);
+    return 0;
+}
+
+// Function to open the notification socket and join the route groups
+static int monitor_open(struct mpls_session *mon) {
+    int ret = mpls_session_open(mon, MPLS_MONITOR_SOCK_BUF);
+    if (ret < 0) return ret;
+
+    // Keep overrun reporting on: a silent drop would leave the consumer with a wrong view
+    int off = 0;
+    int groups[] = {RTNLGRP_MPLS_ROUTE, RTNLGRP_IPV4_ROUTE};
+    if (setsockopt(mon->fd, SOL_NETLINK, NETLINK_NO_ENOBUFS, &off, sizeof(off)) < 0) ret = -errno;
+    for (size_t i = 0; ret == 0 && i < sizeof(groups) / sizeof(groups[0]); i++) {
+        if (setsockopt(mon->fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &groups[i], sizeof(groups[i])) < 0) {
+            ret = -errno;
+        }
+    }
+    if (ret < 0) mpls_session_close(mon);
+    return ret;
+}
+
+// Function to print route changes as they happen
+int mpls_monitor_run(struct mpls_session *session, FILE *out, enum mpls_show_format format) {
+    struct monitor_ctx ctx = {.out = out, .format = format, .ifcache = session->ifcache};
+    struct mpls_session mon;
+    int ret = monitor_open(&mon);
+    if (ret < 0) return ret;
+
+    char *buf = malloc(MONITOR_RECV_VLEN * MONITOR_RECV_SLOT);
+    if (!buf) {
+        mpls_session_close(&mon);
+        return -ENOMEM;
+    }
+
+    struct mmsghdr msgs[MONITOR_RECV_VLEN];
+    struct iovec iov[MONITOR_RECV_VLEN];
+    for (;;) {
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < MONITOR_RECV_VLEN; i++) {
+            iov[i].iov_base = buf + i * MONITOR_RECV_SLOT;
+            iov[i].iov_len = MONITOR_RECV_SLOT;
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        // A burst is drained with one syscall per MONITOR_RECV_VLEN notifications
+        int n = recvmmsg(mon.fd, msgs, MONITOR_RECV_VLEN, MSG_WAITFORONE, NULL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == ENOBUFS) {
+                MPLS_STAT_ADD(MPLS_STAT_ENOBUFS, 1);
+                // The socket overflowed and notifications were dropped: resync from a dump
+                ret = monitor_resync(&ctx, session);
+                if (ret < 0) break;
+                continue;
+            }
+            ret = -errno;
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                monitor_print(&ctx, "truncated", NULL);
+                continue;
+            }
+            int len = msgs[i].msg_len;
+            for (struct nlmsghdr *nlh = iov[i].iov_base; NLMSG_OK(nlh, (unsigned int)len); nlh = NLMSG_NEXT(nlh, len)) {
+                monitor_event(&ctx, nlh);
+            }
+        }
+        fflush(out);
+    }
+
+    free(buf);
+    mpls_session_close(&mon);
+    return ret;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file mpls_monitor.h
+ * @brief Live stream of MPLS route changes from rtnetlink multicast groups.
+ *
+ * The monitor joins RTNLGRP_MPLS_ROUTE (LFIB changes) and RTNLGRP_IPV4_ROUTE
+ * (for MPLS-encap routes) and prints one timestamped line per change. When
+ * the kernel reports that notifications were dropped, the current table is
+ * dumped so the consumer can resynchronize.
+ */
+
+ #ifndef MPLS_MONITOR_H
+ #define MPLS_MONITOR_H
+ 
+ #include <stdio.h>
+ #include "mpls_dump.h"
+ 
+ #pragma GCC visibility push(default)
+ 
+ #define MPLS_MONITOR_SOCK_BUF (32 * 1024 * 1024) /**< SO_RCVBUF requested for the notification socket. */
+ 
+ /**
+  * @brief Prints route change events until an error occurs.
+  *
+  * Text lines look like "2026-01-01T12:00:00.000001 add 100 swap_as 200 dev eth0";
+  * JSON lines are objects with "time" and "event" members followed by the route.
+  * Events are "add", "replace" and "del". After an overrun, an "overrun" event
+  * is followed by one "dump" event per installed route and a "dump_done" event;
+  * a "truncated" event marks a notification too large to decode.
+  *
+  * @param session Session used for resync dumps; its interface cache, if any, names interfaces.
+  * @param out Output stream, flushed after every burst of events.
+  * @param format Output format (MPLS_SHOW_JSON for JSON lines).
+  * @return Negative errno on failure; does not return otherwise.
+  */
+ int mpls_monitor_run(struct mpls_session *session, FILE *out, enum mpls_show_format format);
+ 
+ #pragma GCC visibility pop
+ 
+ #endif // MPLS_MONITOR_H
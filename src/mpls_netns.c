@@ -0,0 +1,239 @@
+// mpls_netns.c
+
+#include "mpls_netns.h"
+#include "mpls_core.h"
+#include "mpls_ifcache.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+
+struct netns_item {
+    struct mpls_route route;
+    enum mpls_route_op op;
+    unsigned long tag;
+};
+
+struct netns_chunk {
+    unsigned int count;
+    struct netns_item items[MPLS_NETNS_CHUNK];
+};
+
+struct netns_worker {
+    struct mpls_netns_pool *pool;
+    char *name;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned int head;     // Chunks taken by the worker
+    unsigned int tail;     // Chunks handed over by the producer
+    int filling;           // Producer is filling queue[tail % MPLS_NETNS_QUEUE]
+    int closing;           // No more chunks will be handed over
+    struct mpls_batch_stats stats;
+    struct netns_chunk queue[MPLS_NETNS_QUEUE];
+};
+
+struct mpls_netns_pool {
+    int ack_errors;  // Passed on to the session of every worker
+    mpls_batch_result_cb cb;
+    void *arg;
+    pthread_mutex_t cb_lock;  // Serializes callbacks from different workers
+    struct netns_worker *workers[MPLS_NETNS_MAX];
+    unsigned int nworkers;
+    struct netns_worker *last;  // Worker of the previous request; route files tend to group by namespace
+};
+
+// Function to move the calling thread into a network namespace
+int mpls_netns_enter(const char *name) {
+    char path[PATH_MAX];
+    int n = name[0] == '/' ? snprintf(path, sizeof(path), "%s", name)
+                           : snprintf(path, sizeof(path), "%s/%s", MPLS_NETNS_RUN_DIR, name);
+    if (name[0] == '\0' || (name[0] != '/' && strchr(name, '/'))) return -EINVAL;
+    if (n < 0 || (size_t)n >= sizeof(path)) return -ENAMETOOLONG;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -errno;
+    int ret = setns(fd, CLONE_NEWNET) < 0 ? -errno : 0;
+    close(fd);
+    return ret;
+}
+
+// Function to hand a result to the pool's callback, one worker at a time
+static void netns_result(unsigned long tag, int error, const char *detail, void *arg) {
+    struct mpls_netns_pool *pool = (struct mpls_netns_pool *)arg;
+    if (!pool->cb) return;
+    pthread_mutex_lock(&pool->cb_lock);
+    pool->cb(tag, error, detail, pool->arg);
+    pthread_mutex_unlock(&pool->cb_lock);
+}
+
+// Function to program the routes of one namespace over a session opened inside it
+static void *netns_worker_main(void *arg) {
+    struct netns_worker *w = (struct netns_worker *)arg;
+    struct mpls_session session;
+    struct mpls_batch *batch = NULL;
+
+    // Sockets stay in the namespace they were created in, so this thread enters it once
+    int error = mpls_netns_enter(w->name);
+    if (!error) error = mpls_session_open(&session, MPLS_SESSION_SOCK_BUF);
+    if (!error) {
+        session.ifcache = mpls_ifcache_open();
+        session.ack_errors = w->pool->ack_errors;
+        batch = mpls_batch_open(&session, netns_result, w->pool);
+        if (!batch) {
+            mpls_session_close(&session);
+            error = -ENOMEM;
+        }
+    }
+    if (error) {
+        pthread_mutex_lock(&w->pool->cb_lock);
+        fprintf(stderr, "netns %s: %s\n", w->name, strerror(-error));
+        pthread_mutex_unlock(&w->pool->cb_lock);
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&w->lock);
+        while (w->head == w->tail && !w->closing) pthread_cond_wait(&w->cond, &w->lock);
+        if (w->head == w->tail) {
+            pthread_mutex_unlock(&w->lock);
+            break;
+        }
+        struct netns_chunk *chunk = &w->queue[w->head % MPLS_NETNS_QUEUE];
+        pthread_mutex_unlock(&w->lock);
+
+        for (unsigned int i = 0; i < chunk->count; i++) {
+            struct netns_item *item = &chunk->items[i];
+            if (batch) {
+                mpls_batch_queue(batch, &item->route, item->op, item->tag);
+            } else {
+                w->stats.routes++;
+                w->stats.failed++;
+                netns_result(item->tag, error, NULL, w->pool);
+            }
+        }
+        if (batch) mpls_batch_flush(batch);
+
+        pthread_mutex_lock(&w->lock);
+        w->head++;
+        pthread_cond_broadcast(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+    }
+
+    if (batch) {
+        mpls_batch_finish(batch, &w->stats);
+        mpls_session_close(&session);
+    }
+    return NULL;
+}
+
+// Function to create a pool with no workers yet
+struct mpls_netns_pool *mpls_netns_pool_open(int ack_errors, mpls_batch_result_cb cb, void *arg) {
+    struct mpls_netns_pool *pool = calloc(1, sizeof(*pool));
+    if (!pool) return NULL;
+    pool->ack_errors = ack_errors;
+    pool->cb = cb;
+    pool->arg = arg;
+    pthread_mutex_init(&pool->cb_lock, NULL);
+    return pool;
+}
+
+// Function to find the worker of a namespace, starting one on first use
+static int netns_worker_get(struct mpls_netns_pool *pool, const char *netns, struct netns_worker **out) {
+    if (pool->last && strcmp(pool->last->name, netns) == 0) {
+        *out = pool->last;
+        return 0;
+    }
+    for (unsigned int i = 0; i < pool->nworkers; i++) {
+        if (strcmp(pool->workers[i]->name, netns) == 0) {
+            *out = pool->last = pool->workers[i];
+            return 0;
+        }
+    }
+    if (pool->nworkers == MPLS_NETNS_MAX) return -EMFILE;
+
+    struct netns_worker *w = calloc(1, sizeof(*w));
+    if (!w) return -ENOMEM;
+    w->name = strdup(netns);
+    if (!w->name) {
+        free(w);
+        return -ENOMEM;
+    }
+    w->pool = pool;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    int ret = pthread_create(&w->thread, NULL, netns_worker_main, w);
+    if (ret != 0) {
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->lock);
+        free(w->name);
+        free(w);
+        return -ret;
+    }
+
+    pool->workers[pool->nworkers++] = w;
+    *out = pool->last = w;
+    return 0;
+}
+
+// Function to hand the chunk being filled over to its worker
+static void netns_publish(struct netns_worker *w) {
+    pthread_mutex_lock(&w->lock);
+    w->tail++;
+    w->filling = 0;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+// Function to queue one route request on the worker of its namespace
+int mpls_netns_pool_queue(struct mpls_netns_pool *pool, const char *netns, const struct mpls_route *route,
+                          enum mpls_route_op op, unsigned long tag) {
+    struct netns_worker *w = NULL;
+    int ret = netns_worker_get(pool, netns, &w);
+    if (ret < 0) return ret;
+
+    if (!w->filling) {
+        // Wait for a free chunk; the worker only touches chunks between head and tail
+        pthread_mutex_lock(&w->lock);
+        while (w->tail - w->head >= MPLS_NETNS_QUEUE) pthread_cond_wait(&w->cond, &w->lock);
+        pthread_mutex_unlock(&w->lock);
+        w->queue[w->tail % MPLS_NETNS_QUEUE].count = 0;
+        w->filling = 1;
+    }
+
+    struct netns_chunk *chunk = &w->queue[w->tail % MPLS_NETNS_QUEUE];
+    struct netns_item *item = &chunk->items[chunk->count++];
+    item->route = *route;
+    item->op = op;
+    item->tag = tag;
+    if (chunk->count == MPLS_NETNS_CHUNK) netns_publish(w);
+    return 0;
+}
+
+// Function to let every worker finish its routes and collect the counters
+int mpls_netns_pool_finish(struct mpls_netns_pool *pool, struct mpls_batch_stats *stats) {
+    struct mpls_batch_stats total = {0};
+    for (unsigned int i = 0; i < pool->nworkers; i++) {
+        struct netns_worker *w = pool->workers[i];
+        if (w->filling) netns_publish(w);
+        pthread_mutex_lock(&w->lock);
+        w->closing = 1;
+        pthread_cond_broadcast(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+    }
+    for (unsigned int i = 0; i < pool->nworkers; i++) {
+        struct netns_worker *w = pool->workers[i];
+        pthread_join(w->thread, NULL);
+        total.routes += w->stats.routes;
+        total.ok += w->stats.ok;
+        total.failed += w->stats.failed;
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->lock);
+        free(w->name);
+        free(w);
+    }
+    pthread_mutex_destroy(&pool->cb_lock);
+    free(pool);
+
+    if (stats) *stats = total;
+    return total.failed ? -1 : 0;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file mpls_netns.h
+ * @brief Parallel route programming across network namespaces.
+ *
+ * A pool runs one worker thread per target namespace. Each worker enters its
+ * namespace once, opens a Netlink session and an interface cache there, and
+ * pipelines the routes handed to it through its own mpls_batch, so the routes
+ * of a whole multi-router topology are installed in parallel from one process
+ * instead of one "ip netns exec" per route.
+ */
+
+ #ifndef MPLS_NETNS_H
+ #define MPLS_NETNS_H
+ 
+ #include "mpls_batch.h"
+ 
+ #pragma GCC visibility push(default)
+ 
+ struct mpls_netns_pool;
+ 
+ #define MPLS_NETNS_MAX 256       /**< Namespaces (and worker threads) per pool. */
+ #define MPLS_NETNS_CHUNK 128     /**< Routes handed to a worker at a time. */
+ #define MPLS_NETNS_QUEUE 4       /**< Chunks queued per worker before the producer waits. */
+ #define MPLS_NETNS_RUN_DIR "/run/netns" /**< Where "ip netns add" bind-mounts named namespaces. */
+ 
+ /**
+  * @brief Moves the calling thread into a network namespace.
+  * @param name Name created by "ip netns add" (looked up in MPLS_NETNS_RUN_DIR), or an
+  *             absolute path such as /proc/PID/ns/net.
+  * @return 0 on success, negative errno on failure.
+  */
+ int mpls_netns_enter(const char *name);
+ 
+ /**
+  * @brief Creates an empty pool; workers start when their namespace is first used.
+  * @param ack_errors If non-zero, workers ask the kernel to ACK failed requests only.
+  * @param cb Result callback, invoked from worker threads but never concurrently; may be NULL.
+  * @param arg User argument for @p cb.
+  * @return The pool, or NULL if out of memory.
+  */
+ struct mpls_netns_pool *mpls_netns_pool_open(int ack_errors, mpls_batch_result_cb cb, void *arg);
+ 
+ /**
+  * @brief Hands one route request to the worker of a namespace.
+  *
+  * Blocks while that worker's queue is full. If the namespace cannot be
+  * entered, every request for it is reported as failed through the callback.
+  *
+  * @param pool Pool to queue on.
+  * @param netns Target namespace (see mpls_netns_enter()).
+  * @param route Route to encode.
+  * @param op Add, replace or delete.
+  * @param tag Caller's identifier for the request, passed back to the callback.
+  * @return 0 on success, -EMFILE if @p netns would exceed MPLS_NETNS_MAX, other negative errno on failure.
+  */
+ int mpls_netns_pool_queue(struct mpls_netns_pool *pool, const char *netns, const struct mpls_route *route,
+                           enum mpls_route_op op, unsigned long tag);
+ 
+ /**
+  * @brief Waits until every worker has finished its routes, then frees the pool.
+  * @param pool Pool to finish.
+  * @param stats If not NULL, receives the outcome counters summed over all namespaces.
+  * @return 0 if every request succeeded, -1 otherwise.
+  */
+ int mpls_netns_pool_finish(struct mpls_netns_pool *pool, struct mpls_batch_stats *stats);
+ 
+ #pragma GCC visibility pop
+ 
+ #endif // MPLS_NETNS_H
@@ -0,0 +1,451 @@
+// mpls_nhobj.c
+
+#include "mpls_nhobj.h"
+#include "mpls_core.h"
+#include "mpls_dump.h"
+#include "mpls_ifcache.h"
+#include <linux/nexthop.h>
+#include <linux/mpls_iptunnel.h>
+
+
+// Function to parse a decimal number no larger than a maximum
+static int nhobj_parse_number(const char *arg, unsigned long max, unsigned long *value) {
+    char *end;
+    errno = 0;
+    *value = strtoul(arg, &end, 10);
+    if (errno || end == arg || *end != '\0' || arg[0] == '-' || *value > max) return -1;
+    return 0;
+}
+
+// Function to parse an object id (1-4294967295)
+static int nhobj_parse_id(const char *arg, uint32_t *id) {
+    unsigned long value;
+    if (nhobj_parse_number(arg, UINT32_MAX, &value) < 0 || value == 0) return -1;
+    *id = value;
+    return 0;
+}
+
+// Function to parse a pushed label stack ("label[/label...]", outermost first)
+static int nhobj_parse_labels(const char *arg, struct mpls_nhobj *nh) {
+    char copy[MPLS_MAX_LABELS * 8];
+    char *save = NULL;
+    nh->nout_labels = 0;
+    if (strlen(arg) >= sizeof(copy) || arg[0] == '/' || arg[strlen(arg) - 1] == '/' || strstr(arg, "//")) return -1;
+    strcpy(copy, arg);
+    for (char *tok = strtok_r(copy, "/", &save); tok; tok = strtok_r(NULL, "/", &save)) {
+        unsigned long label;
+        if (nh->nout_labels == MPLS_MAX_LABELS || nhobj_parse_number(tok, 0xFFFFF, &label) < 0) return -1;
+        nh->out_labels[nh->nout_labels++] = label;
+    }
+    return nh->nout_labels ? 0 : -1;
+}
+
+// Function to parse the members of a group ("id[,weight][/id[,weight]...]")
+static int nhobj_parse_group(const char *arg, struct mpls_nhobj *nh, const char **err) {
+    char copy[MPLS_NHOBJ_MAX_MEMBERS * 16];
+    char *save = NULL;
+    if (strlen(arg) >= sizeof(copy) || arg[0] == '/' || arg[strlen(arg) - 1] == '/' || strstr(arg, "//")) {
+        *err = "invalid group (expected id[,weight] separated by '/')";
+        return -1;
+    }
+    strcpy(copy, arg);
+    for (char *tok = strtok_r(copy, "/", &save); tok; tok = strtok_r(NULL, "/", &save)) {
+        if (nh->nmembers == MPLS_NHOBJ_MAX_MEMBERS) {
+            *err = "too many members in group";
+            return -1;
+        }
+        struct mpls_nhobj_member *m = &nh->members[nh->nmembers++];
+        char *comma = strchr(tok, ',');
+        if (comma) *comma = '\0';
+        if (nhobj_parse_id(tok, &m->id) < 0) {
+            *err = "invalid nexthop id (expected 1-4294967295)";
+            return -1;
+        }
+        if (m->id == nh->id) {
+            *err = "a group cannot contain itself";
+            return -1;
+        }
+        if (comma) {
+            unsigned long weight;
+            if (nhobj_parse_number(comma + 1, 256, &weight) < 0 || weight < 1) {
+                *err = "invalid weight (expected 1-256)";
+                return -1;
+            }
+            m->weight = weight;
+        }
+    }
+    return 0;
+}
+
+// Function to parse the arguments of "nexthop add" into an object description
+int parse_mpls_nhobj(int argc, char *argv[], struct mpls_nhobj *nh, const char **err) {
+    memset(nh, 0, sizeof(*nh));
+
+    if (argc < 3) {
+        *err = "insufficient arguments";
+        return -1;
+    }
+    if (nhobj_parse_id(argv[0], &nh->id) < 0) {
+        *err = "invalid nexthop id (expected 1-4294967295)";
+        return -1;
+    }
+
+    // "[id] group [id[,weight]][/id[,weight]...]"
+    if (strcmp(argv[1], "group") == 0) {
+        if (argc != 3) {
+            *err = "wrong number of arguments";
+            return -1;
+        }
+        return nhobj_parse_group(argv[2], nh, err);
+    }
+
+    // "[id] [push [labels] [ttl [n]]] next_hop [nexthop_ip] [dev [device_name]]", in any order after the id
+    int has_via = 0;
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            *err = "missing value after nexthop keyword";
+            return -1;
+        }
+        if (strcmp(argv[i], "push") == 0 && nh->nout_labels == 0) {
+            if (nhobj_parse_labels(argv[i + 1], nh) < 0) {
+                *err = "invalid label stack (expected up to 30 labels 0-1048575 separated by '/')";
+                return -1;
+            }
+        } else if (strcmp(argv[i], "ttl") == 0 && nh->ttl == 0) {
+            unsigned long ttl;
+            if (nhobj_parse_number(argv[i + 1], 255, &ttl) < 0 || ttl < 1) {
+                *err = "invalid TTL (expected 1-255)";
+                return -1;
+            }
+            nh->ttl = ttl;
+        } else if (strcmp(argv[i], "next_hop") == 0 && !has_via) {
+            if (inet_pton(AF_INET, argv[i + 1], &nh->via) != 1) {
+                *err = "invalid next hop IP address";
+                return -1;
+            }
+            has_via = 1;
+        } else if (strcmp(argv[i], "dev") == 0 && !nh->ifname[0]) {
+            if (strlen(argv[i + 1]) >= sizeof(nh->ifname) || !argv[i + 1][0]) {
+                *err = "invalid interface name";
+                return -1;
+            }
+            strcpy(nh->ifname, argv[i + 1]);
+        } else {
+            *err = "expected \"push\", \"ttl\", \"next_hop\" or \"dev\" once each";
+            return -1;
+        }
+    }
+
+    if (!has_via && !nh->ifname[0]) {
+        *err = "expected \"next_hop\" or \"dev\"";
+        return -1;
+    }
+    if (nh->ttl && !nh->nout_labels) {
+        *err = "\"ttl\" needs \"push\"";
+        return -1;
+    }
+    return 0;
+}
+
+// Function to parse the id of an object for deletion
+int parse_mpls_nhobj_id(const char *arg, struct mpls_nhobj *nh) {
+    memset(nh, 0, sizeof(*nh));
+    return nhobj_parse_id(arg, &nh->id);
+}
+
+// Function to format an object in "nexthop add" syntax
+int format_mpls_nhobj(const struct mpls_nhobj *nh, char *buf, size_t len) {
+    char addr[INET_ADDRSTRLEN];
+    int n = snprintf(buf, len, "%u", nh->id);
+    if (n < 0 || (size_t)n >= len) return -1;
+
+    if (nh->nmembers) {
+        for (int i = 0; i < nh->nmembers && (size_t)n < len; i++) {
+            const struct mpls_nhobj_member *m = &nh->members[i];
+            n += snprintf(buf + n, len - n, "%s%u", i ? "/" : " group ", m->id);
+            if (m->weight > 1 && (size_t)n < len) n += snprintf(buf + n, len - n, ",%u", m->weight);
+        }
+        return (size_t)n < len ? n : -1;
+    }
+
+    for (int i = 0; i < nh->nout_labels && (size_t)n < len; i++) {
+        n += snprintf(buf + n, len - n, i ? "/%u" : " push %u", nh->out_labels[i]);
+    }
+    if (nh->ttl && (size_t)n < len) n += snprintf(buf + n, len - n, " ttl %u", nh->ttl);
+    if (nh->via.s_addr && (size_t)n < len) {
+        n += snprintf(buf + n, len - n, " next_hop %s", inet_ntop(AF_INET, &nh->via, addr, sizeof(addr)));
+    }
+    if (nh->ifname[0] && (size_t)n < len) {
+        n += snprintf(buf + n, len - n, " dev %s", nh->ifname);
+    } else if (nh->ifindex && (size_t)n < len) {
+        n += snprintf(buf + n, len - n, " dev if%d", nh->ifindex);
+    }
+    return (size_t)n < len ? n : -1;
+}
+
+// Function to add the MPLS encapsulation of an object (NHA_ENCAP + NHA_ENCAP_TYPE)
+static int nhobj_add_encap(struct nlmsghdr *nlh, unsigned int maxlen, const struct mpls_nhobj *nh) {
+    uint32_t stack[MPLS_MAX_LABELS];
+    int len = create_mpls_label_stack(nh->out_labels, nh->nout_labels, 1, stack);
+    if (len < 0) return len;
+
+    // Same MPLS_IPTUNNEL_* nest as the RTA_ENCAP of a push route
+    struct rtattr *encap = mpls_add_attr_nest(nlh, maxlen, NHA_ENCAP | NLA_F_NESTED);
+    add_attr(nlh, maxlen, MPLS_IPTUNNEL_DST, stack, len);
+    if (nh->ttl) {
+        uint8_t ttl = nh->ttl;
+        add_attr(nlh, maxlen, MPLS_IPTUNNEL_TTL, &ttl, sizeof(ttl));
+    }
+    mpls_add_attr_nest_end(nlh, encap);
+
+    uint16_t encap_type = LWTUNNEL_ENCAP_MPLS;
+    add_attr(nlh, maxlen, NHA_ENCAP_TYPE, &encap_type, sizeof(encap_type));
+    return 0;
+}
+
+// Function to build an RTM_NEWNEXTHOP/RTM_DELNEXTHOP request
+int build_mpls_nhobj(struct nlmsghdr *nlh, unsigned int maxlen, const struct mpls_nhobj *nh, enum mpls_route_op op,
+                     struct mpls_ifcache *ifcache) {
+    // The largest request (a full group or label stack) fits in MPLS_NHOBJ_MSG_MAX, so add_attr() cannot fail below
+    if (maxlen < MPLS_NHOBJ_MSG_MAX) return -EMSGSIZE;
+    if (nh->id == 0 || nh->nout_labels > MPLS_MAX_LABELS || nh->nmembers > MPLS_NHOBJ_MAX_MEMBERS) return -EINVAL;
+
+    struct nhmsg *nhm = (struct nhmsg *)NLMSG_DATA(nlh);
+    memset(nlh, 0, NLMSG_SPACE(sizeof(*nhm)));
+
+    // A delete carries only the id; the kernel also removes the routes that use the object
+    if (op == MPLS_OP_DELETE) {
+        init_netlink_message(nlh, RTM_DELNEXTHOP, NLM_F_REQUEST | NLM_F_ACK, 0, 0);
+        nlh->nlmsg_len = NLMSG_LENGTH(sizeof(*nhm));
+        add_attr(nlh, maxlen, NHA_ID, &nh->id, sizeof(nh->id));
+        return 0;
+    }
+
+    int flags = NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE;
+    flags |= op == MPLS_OP_REPLACE ? NLM_F_REPLACE : NLM_F_EXCL;
+    init_netlink_message(nlh, RTM_NEWNEXTHOP, flags, 0, 0);
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(*nhm));
+    nhm->nh_protocol = MPLS_ROUTE_PROTOCOL;
+    add_attr(nlh, maxlen, NHA_ID, &nh->id, sizeof(nh->id));
+
+    // A group has no family of its own and carries nothing but its members
+    if (nh->nmembers) {
+        struct nexthop_grp grp[MPLS_NHOBJ_MAX_MEMBERS];
+        memset(grp, 0, sizeof(grp));
+        for (int i = 0; i < nh->nmembers; i++) {
+            if (nh->members[i].id == 0 || nh->members[i].weight > 256) return -EINVAL;
+            grp[i].id = nh->members[i].id;
+            grp[i].weight = nh->members[i].weight ? nh->members[i].weight - 1 : 0;
+        }
+        nhm->nh_family = AF_UNSPEC;
+        add_attr(nlh, maxlen, NHA_GROUP, grp, nh->nmembers * sizeof(grp[0]));
+        return 0;
+    }
+
+    // Every gateway or device nexthop needs its output interface
+    int ifindex = nh->ifindex;
+    if (nh->ifname[0]) {
+        ifindex = mpls_ifcache_index(ifcache, nh->ifname);
+        if (ifindex == 0) return -ENODEV;
+    }
+    if (ifindex <= 0) return -EDESTADDRREQ;
+
+    nhm->nh_family = AF_INET;
+    add_attr(nlh, maxlen, NHA_OIF, &ifindex, sizeof(ifindex));
+    if (nh->via.s_addr) add_attr(nlh, maxlen, NHA_GATEWAY, &nh->via, sizeof(nh->via));
+    return nh->nout_labels ? nhobj_add_encap(nlh, maxlen, nh) : 0;
+}
+
+// Function to add, replace or delete a nexthop object over an open session
+int session_apply_mpls_nhobj(struct mpls_session *session, const struct mpls_nhobj *nh, enum mpls_route_op op) {
+    struct {
+        struct nlmsghdr nlh;
+        struct nhmsg nhm;
+        char buf[MPLS_NHOBJ_MSG_MAX];
+    } req;
+
+    // Let the kernel's own routing decide the interface of a gateway given without one
+    struct mpls_nhobj resolved;
+    if (op != MPLS_OP_DELETE && !nh->nmembers && nh->via.s_addr && !nh->ifname[0] && nh->ifindex <= 0) {
+        resolved = *nh;
+        resolved.ifindex = mpls_session_lookup_oif(session, nh->via);
+        if (resolved.ifindex < 0) return resolved.ifindex;
+        nh = &resolved;
+    }
+
+    int ret = build_mpls_nhobj(&req.nlh, sizeof(req), nh, op, session->ifcache);
+    if (ret < 0) return ret;
+    return mpls_session_request(session, &req.nlh);
+}
+
+// Function to decode one RTM_NEWNEXTHOP message, -EOPNOTSUPP for objects this module does not describe
+static int nhobj_decode(const struct nlmsghdr *nlh, struct mpls_nhobj *nh, struct mpls_ifcache *ifcache) {
+    int len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(struct nhmsg));
+    if (len < 0) return -EINVAL;
+
+    const struct nhmsg *nhm = (const struct nhmsg *)NLMSG_DATA(nlh);
+    const struct rtattr *tb[NHA_MAX + 1];
+    mpls_parse_rtattr(tb, NHA_MAX, (const struct rtattr *)((const char *)nhm + NLMSG_ALIGN(sizeof(*nhm))), len);
+
+    memset(nh, 0, sizeof(*nh));
+    if (!tb[NHA_ID] || RTA_PAYLOAD(tb[NHA_ID]) < sizeof(uint32_t)) return -EINVAL;
+    nh->id = *(const uint32_t *)RTA_DATA(tb[NHA_ID]);
+    if (tb[NHA_BLACKHOLE] || tb[NHA_FDB]) return -EOPNOTSUPP;
+
+    if (tb[NHA_GROUP]) {
+        const struct nexthop_grp *grp = (const struct nexthop_grp *)RTA_DATA(tb[NHA_GROUP]);
+        size_t count = RTA_PAYLOAD(tb[NHA_GROUP]) / sizeof(*grp);
+        if (count == 0 || count > MPLS_NHOBJ_MAX_MEMBERS) return -EOPNOTSUPP;
+        for (size_t i = 0; i < count; i++) {
+            nh->members[i].id = grp[i].id;
+            nh->members[i].weight = grp[i].weight + 1;
+        }
+        nh->nmembers = count;
+        return 0;
+    }
+    if (nhm->nh_family != AF_INET) return -EOPNOTSUPP;
+
+    if (tb[NHA_OIF] && RTA_PAYLOAD(tb[NHA_OIF]) >= sizeof(int)) {
+        nh->ifindex = *(const int *)RTA_DATA(tb[NHA_OIF]);
+        if (!mpls_ifcache_name(ifcache, nh->ifindex, nh->ifname)) nh->ifname[0] = '\0';
+    }
+    if (tb[NHA_GATEWAY] && RTA_PAYLOAD(tb[NHA_GATEWAY]) == sizeof(nh->via)) {
+        memcpy(&nh->via, RTA_DATA(tb[NHA_GATEWAY]), sizeof(nh->via));
+    }
+
+    // Objects without MPLS encap are still described, with no labels
+    const struct rtattr *type = tb[NHA_ENCAP_TYPE];
+    if (type && tb[NHA_ENCAP] && RTA_PAYLOAD(type) >= sizeof(uint16_t) &&
+        *(const uint16_t *)RTA_DATA(type) == LWTUNNEL_ENCAP_MPLS) {
+        const struct rtattr *encap[MPLS_IPTUNNEL_MAX + 1];
+        mpls_parse_rtattr(encap, MPLS_IPTUNNEL_MAX, RTA_DATA(tb[NHA_ENCAP]), RTA_PAYLOAD(tb[NHA_ENCAP]));
+        uint32_t labels[MPLS_MAX_LABELS];
+        nh->nout_labels = mpls_entry_labels(encap[MPLS_IPTUNNEL_DST], labels, MPLS_MAX_LABELS);
+        memcpy(nh->out_labels, labels, nh->nout_labels * sizeof(labels[0]));
+        const struct rtattr *ttl = encap[MPLS_IPTUNNEL_TTL];
+        if (ttl && RTA_PAYLOAD(ttl) >= sizeof(uint8_t)) nh->ttl = *(const uint8_t *)RTA_DATA(ttl);
+    }
+    return 0;
+}
+
+struct nhobj_dump {
+    mpls_nhobj_cb cb;
+    void *arg;
+    struct mpls_ifcache *ifcache;
+};
+
+// Function to decode one dumped object message and hand it to the object callback
+static int nhobj_dump_msg(const struct nlmsghdr *nlh, void *arg) {
+    const struct nhobj_dump *dump = (const struct nhobj_dump *)arg;
+    struct mpls_nhobj nh;
+    if (nlh->nlmsg_type != RTM_NEWNEXTHOP || nhobj_decode(nlh, &nh, dump->ifcache) < 0) return 0;
+    return dump->cb(&nh, dump->arg);
+}
+
+// Function to dump all nexthop objects, invoking a callback per object
+int mpls_nhobj_dump(struct mpls_session *session, mpls_nhobj_cb cb, void *arg) {
+    struct {
+        struct nlmsghdr nlh;
+        struct nhmsg nhm;
+    } req;
+    memset(&req, 0, sizeof(req));
+    init_netlink_message(&req.nlh, RTM_GETNEXTHOP, NLM_F_REQUEST | NLM_F_DUMP, 0, 0);
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.nhm));
+
+    struct nhobj_dump dump = {cb, arg, session->ifcache};
+    return mpls_dump_request(session, &req.nlh, 0, nhobj_dump_msg, &dump);
+}
+
+struct nhobj_id_list {
+    uint32_t *ids;                 // Objects with MPLS encap, then the groups using them
+    size_t count, cap;
+    struct mpls_nhobj *groups;     // Groups, resolved once every object is known
+    size_t ngroups, groups_cap;
+};
+
+// Function to append an id to the list
+static int nhobj_list_add(struct nhobj_id_list *list, uint32_t id) {
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 64;
+        uint32_t *grown = realloc(list->ids, cap * sizeof(*grown));
+        if (!grown) return -ENOMEM;
+        list->ids = grown;
+        list->cap = cap;
+    }
+    list->ids[list->count++] = id;
+    return 0;
+}
+
+// Function to note one dumped object: its id if it pushes labels, or the whole group for later
+static int nhobj_collect(const struct mpls_nhobj *nh, void *arg) {
+    struct nhobj_id_list *list = (struct nhobj_id_list *)arg;
+    if (!nh->nmembers) return nh->nout_labels ? nhobj_list_add(list, nh->id) : 0;
+
+    if (list->ngroups == list->groups_cap) {
+        size_t cap = list->groups_cap ? list->groups_cap * 2 : 16;
+        struct mpls_nhobj *grown = realloc(list->groups, cap * sizeof(*grown));
+        if (!grown) return -ENOMEM;
+        list->groups = grown;
+        list->groups_cap = cap;
+    }
+    list->groups[list->ngroups++] = *nh;
+    return 0;
+}
+
+// Function to order ids for bsearch()
+static int nhobj_compare_ids(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Function to look an id up in a sorted list
+int mpls_nhobj_has_id(const uint32_t *ids, size_t count, uint32_t id) {
+    return count && bsearch(&id, ids, count, sizeof(*ids), nhobj_compare_ids) != NULL;
+}
+
+// Function to list the objects that push labels
+int mpls_nhobj_ids(struct mpls_session *session, uint32_t **ids, size_t *count) {
+    struct nhobj_id_list list = {0};
+    *ids = NULL;
+    *count = 0;
+
+    int ret = mpls_nhobj_dump(session, nhobj_collect, &list);
+    // A kernel without nexthop objects has none that push labels
+    if (ret == -EOPNOTSUPP || ret == -EAFNOSUPPORT) ret = 0;
+
+    // Groups cannot nest, so one pass over the sorted plain objects settles them all
+    size_t plain = list.count;
+    if (plain) qsort(list.ids, plain, sizeof(*list.ids), nhobj_compare_ids);
+    for (size_t g = 0; ret == 0 && g < list.ngroups; g++) {
+        const struct mpls_nhobj *grp = &list.groups[g];
+        for (int i = 0; i < grp->nmembers; i++) {
+            if (mpls_nhobj_has_id(list.ids, plain, grp->members[i].id)) {
+                ret = nhobj_list_add(&list, grp->id);
+                break;
+            }
+        }
+    }
+    free(list.groups);
+    if (ret < 0) {
+        free(list.ids);
+        return ret;
+    }
+
+    if (list.count > plain) qsort(list.ids, list.count, sizeof(*list.ids), nhobj_compare_ids);
+    *ids = list.ids;
+    *count = list.count;
+    return 0;
+}
+
+// Function to print one dumped object in "nexthop add" syntax
+static int nhobj_print(const struct mpls_nhobj *nh, void *arg) {
+    char text[512];
+    if (format_mpls_nhobj(nh, text, sizeof(text)) < 0) return 0;
+    fprintf((FILE *)arg, "%s\n", text);
+    return 0;
+}
+
+// Function to print every nexthop object
+int print_mpls_nhobjs(struct mpls_session *session, FILE *out) {
+    return mpls_nhobj_dump(session, nhobj_print, out);
+}
@@ -0,0 +1,178 @@
+/**
+ * @file mpls_nhobj.h
+ * @brief Kernel nexthop objects (RTM_NEWNEXTHOP) carrying MPLS encap, shared by many push routes.
+ *
+ * A nexthop object holds the gateway, the output interface and the label
+ * stack to push; a group object holds weighted references to other objects.
+ * IPv4 routes point at an object by id (RTA_NH_ID, see MPLS_ROUTE_PUSH_NHID)
+ * instead of embedding the next hop and encap, so re-pointing every route
+ * behind a gateway is a single RTM_NEWNEXTHOP with NLM_F_REPLACE rather than
+ * one route replace per destination. Deleting an object also deletes the
+ * routes that use it, as the kernel does.
+ *
+ * Label routes (AF_MPLS) cannot use nexthop objects; the kernel only accepts
+ * them for IPv4 and IPv6 routes.
+ */
+
+ #ifndef MPLS_NHOBJ_H
+ #define MPLS_NHOBJ_H
+ 
+ #include <stdio.h>
+ #include <stdint.h>
+ #include <stddef.h>
+ #include <net/if.h>
+ #include <netinet/in.h>
+ #include <linux/netlink.h>
+ #include "mpls_core.h"
+ #include "mpls_routes.h"
+ 
+ #pragma GCC visibility push(default)
+ 
+ #define MPLS_NHOBJ_MSG_MAX 512        /**< Upper bound on the encoded size of one nexthop request. */
+ #define MPLS_NHOBJ_MAX_MEMBERS 32     /**< Members accepted in one group. */
+ 
+ /**
+  * @brief One weighted member of a group.
+  */
+ struct mpls_nhobj_member {
+     uint32_t id;      /**< Member object; it must not be a group itself. */
+     uint16_t weight;  /**< Relative weight 1-256 (sent as weight - 1), 0 means 1. */
+ };
+ 
+ /**
+  * @brief Parsed description of a nexthop object or group, independent of any socket.
+  *
+  * A group has @c nmembers > 0 and uses only @c id and @c members. Any other
+  * object forwards to @c via (if set) through the interface named @c ifname,
+  * or with index @c ifindex when the name is empty, and pushes @c out_labels
+  * when @c nout_labels > 0.
+  */
+ struct mpls_nhobj {
+     uint32_t id;                          /**< Object id, 1-4294967295. */
+     uint32_t out_labels[MPLS_MAX_LABELS]; /**< Pushed label stack, outermost first. */
+     uint8_t nout_labels;                  /**< Number of entries in @c out_labels, 0 for no encap. */
+     uint8_t ttl;                          /**< TTL written into pushed labels, 0 to copy it from the IP header. */
+     struct in_addr via;                   /**< IPv4 gateway, 0 for a device-only next hop. */
+     char ifname[IF_NAMESIZE];             /**< Output interface name, may be empty. */
+     int ifindex;                          /**< Output interface index, used when @c ifname is empty. */
+     uint8_t nmembers;                     /**< Number of group members, 0 for a plain object. */
+     struct mpls_nhobj_member members[MPLS_NHOBJ_MAX_MEMBERS]; /**< Members of a group. */
+ };
+ 
+ /**
+  * @brief Callback invoked for every dumped nexthop object.
+  * @param nh Object being visited; @c ifname is filled in when the interface is known.
+  * @param arg User argument passed to mpls_nhobj_dump().
+  * @return 0 to continue, negative to stop visiting (the dump is still drained).
+  */
+ typedef int (*mpls_nhobj_cb)(const struct mpls_nhobj *nh, void *arg);
+ 
+ /**
+  * @brief Parses the arguments that follow "nexthop add" into an object description.
+  *
+  * Accepts "[id] [push [label[/label_2...]] [ttl [n]]] next_hop [nexthop_ip] [dev [device_name]]",
+  * "[id] [push ...] dev [device_name]" and "[id] group [id[,weight]][/id[,weight]...]",
+  * e.g. "7 push 16001 next_hop 10.1.1.2" or "9 group 7/8,3".
+  *
+  * @param argc Number of arguments.
+  * @param argv Arguments, starting with the id.
+  * @param nh Object description to fill in.
+  * @param err Set to a static description of the problem on failure.
+  * @return 0 on success, -1 on failure.
+  */
+ int parse_mpls_nhobj(int argc, char *argv[], struct mpls_nhobj *nh, const char **err);
+ 
+ /**
+  * @brief Parses a bare object id, as accepted by "nexthop del".
+  * @param arg Object id.
+  * @param nh Object description to fill in (only the id is set).
+  * @return 0 on success, -1 if @p arg is not an id 1-4294967295.
+  */
+ int parse_mpls_nhobj_id(const char *arg, struct mpls_nhobj *nh);
+ 
+ /**
+  * @brief Formats an object in "nexthop add" syntax (without the leading "nexthop add").
+  * @param nh Object to format.
+  * @param buf Output buffer.
+  * @param len Size of @p buf.
+  * @return Length of the text, or -1 if it did not fit.
+  */
+ int format_mpls_nhobj(const struct mpls_nhobj *nh, char *buf, size_t len);
+ 
+ /**
+  * @brief Builds an RTM_NEWNEXTHOP/RTM_DELNEXTHOP request into a caller-owned buffer.
+  *
+  * A replace changes the object in place, so every route using it follows at once.
+  * The sequence number and port id are left at 0 for the caller to fill in.
+  *
+  * @param nlh Start of the buffer that receives the message.
+  * @param maxlen Number of bytes available at @p nlh.
+  * @param nh Object to encode (only @c id is used for MPLS_OP_DELETE).
+  * @param op Whether to add, replace or delete the object.
+  * @param ifcache Interface cache used to resolve device names, or NULL to use if_nametoindex().
+  * @return 0 on success, negative errno on failure (-ENODEV for an unknown interface,
+  *         -EDESTADDRREQ if a gateway has no interface).
+  */
+ int build_mpls_nhobj(struct nlmsghdr *nlh, unsigned int maxlen, const struct mpls_nhobj *nh, enum mpls_route_op op,
+                      struct mpls_ifcache *ifcache);
+ 
+ /**
+  * @brief Adds, replaces or deletes a nexthop object over an open session.
+  *
+  * The kernel requires an output interface for a gateway; when @p nh names
+  * none, the interface the kernel routes the gateway through is looked up.
+  *
+  * @param session Session opened with mpls_session_open().
+  * @param nh Object to change.
+  * @param op Operation to perform.
+  * @return 0 on success, negative errno on failure.
+  */
+ int session_apply_mpls_nhobj(struct mpls_session *session, const struct mpls_nhobj *nh, enum mpls_route_op op);
+ 
+ /**
+  * @brief Dumps the IPv4 and group nexthop objects (RTM_GETNEXTHOP).
+  *
+  * IPv6, blackhole and bridge (fdb) objects are left out.
+  *
+  * @param session Netlink session.
+  * @param cb Callback invoked for each object, in id order.
+  * @param arg User argument for @p cb.
+  * @return 0 on success, the callback's negative return value, -EINTR if the objects changed
+  *         during the dump, or another negative errno.
+  */
+ int mpls_nhobj_dump(struct mpls_session *session, mpls_nhobj_cb cb, void *arg);
+ 
+ /**
+  * @brief Lists the objects that push labels: those with MPLS encap and the groups with such a member.
+  *
+  * Routes are told apart from plain IPv4 routes with this list, since route
+  * dumps do not always repeat the encap of the object a route uses.
+  * A kernel without nexthop objects yields an empty list.
+  *
+  * @param session Netlink session.
+  * @param ids Receives a sorted array to free(), or NULL if the list is empty.
+  * @param count Receives the number of ids.
+  * @return 0 on success, negative errno on failure.
+  */
+ int mpls_nhobj_ids(struct mpls_session *session, uint32_t **ids, size_t *count);
+ 
+ /**
+  * @brief Looks an id up in a list returned by mpls_nhobj_ids().
+  * @param ids Sorted ids.
+  * @param count Number of ids.
+  * @param id Id to look up.
+  * @return Non-zero if @p id is listed.
+  */
+ int mpls_nhobj_has_id(const uint32_t *ids, size_t count, uint32_t id);
+ 
+ /**
+  * @brief Prints every IPv4 and group nexthop object, one per line in "nexthop add" syntax.
+  * @param session Netlink session.
+  * @param out Output stream.
+  * @return 0 on success, negative errno on failure.
+  */
+ int print_mpls_nhobjs(struct mpls_session *session, FILE *out);
+ 
+ #pragma GCC visibility pop
+ 
+ #endif // MPLS_NHOBJ_H
@@ -2,275 +2,845 @@
 
 #include "mpls_routes.h"
 #include "mpls_core.h"
+#include "mpls_ifcache.h"
+#include "mpls_stats.h"
+#include <linux/mpls_iptunnel.h>
+#include <stddef.h>
+
+// Function to parse a label argument (decimal, 20 bits)
+static int parse_label(const char *arg, uint32_t *label) {
+    char *end;
+    errno = 0;
+    unsigned long value = strtoul(arg, &end, 10);
+    if (errno || end == arg || *end != '\0' || arg[0] == '-' || value > 0xFFFFF) {
+        return -1;
+    }
+    *label = (uint32_t)value;
+    return 0;
+}
 
-#define LWTUNNEL_ENCAP_MPLS 1
-
-// Function to create a simple MPLS route with interface
-int create_mpls_route_dev(const char *interface, uint32_t label, uint8_t s_bit) {
-    int sockfd = create_netlink_socket();
-    if (sockfd < 0) return -1;
-
-    struct {
-        struct nlmsghdr nlh;
-        struct rtmsg rtm;
-        char buf[BUF_SIZE];
-    } req = {0};
+// Function to parse a label stack argument ("label[/label...]", outermost first)
+static int parse_label_stack(const char *arg, struct mpls_route *route) {
+    char copy[MPLS_MAX_LABELS * 8];  // Tokenized in a copy, so the caller's argument is left intact
+    char *save = NULL;
+    route->nout_labels = 0;
+    if (strlen(arg) >= sizeof(copy) || arg[0] == '/' || arg[strlen(arg) - 1] == '/' || strstr(arg, "//")) return -1;
+    strcpy(copy, arg);
+    for (char *tok = strtok_r(copy, "/", &save); tok; tok = strtok_r(NULL, "/", &save)) {
+        if (route->nout_labels == MPLS_MAX_LABELS) return -1;
+        if (parse_label(tok, &route->out_labels[route->nout_labels++]) < 0) return -1;
+    }
+    return route->nout_labels ? 0 : -1;
+}
 
-    init_netlink_message(&req.nlh, RTM_NEWROUTE, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL, getpid(), 1);
-    init_route_message(&req.rtm, AF_MPLS, 20, RT_TABLE_MAIN, RTPROT_BOOT, RT_SCOPE_UNIVERSE, RTN_UNICAST);
+// Function to parse the "dev [device_name]" / "next_hop [nexthop_ip]" tail of a route
+static int parse_route_target(const char *type, const char *value, struct mpls_route *route,
+                              enum mpls_route_kind dev_kind, enum mpls_route_kind via_kind, const char **err) {
+    if (strcmp(type, "dev") == 0) {
+        if (strlen(value) >= sizeof(route->ifname)) {
+            *err = "interface name too long";
+            return -1;
+        }
+        strcpy(route->ifname, value);
+        route->kind = dev_kind;
+        return 0;
+    }
+    if (strcmp(type, "next_hop") == 0) {
+        if (inet_pton(AF_INET, value, &route->via) != 1) {
+            *err = "invalid next hop IP address";
+            return -1;
+        }
+        route->kind = via_kind;
+        return 0;
+    }
+    *err = "expected \"dev\" or \"next_hop\"";
+    return -1;
+}
 
-    uint32_t mpls_label = create_mpls_label(label, s_bit);
-    add_attr(&req.nlh, sizeof(req), RTA_DST, &mpls_label, sizeof(mpls_label));
+// Function to parse the legs of "[label] multipath ..."
+static int parse_multipath(int argc, char *argv[], struct mpls_route *route, const char **err) {
+    int i = 0;
+    while (i < argc) {
+        if (route->nnexthops == MPLS_MAX_NEXTHOPS) {
+            *err = "too many next hops in multipath route";
+            return -1;
+        }
+        struct mpls_nexthop *nh = &route->nexthops[route->nnexthops++];
+        if (i + 1 >= argc) {
+            *err = "missing value after multipath keyword";
+            return -1;
+        }
+
+        // Each leg starts with its target
+        if (strcmp(argv[i], "dev") == 0) {
+            if (strlen(argv[i + 1]) >= sizeof(nh->ifname)) {
+                *err = "interface name too long";
+                return -1;
+            }
+            strcpy(nh->ifname, argv[i + 1]);
+        } else if (strcmp(argv[i], "next_hop") == 0) {
+            if (inet_pton(AF_INET, argv[i + 1], &nh->via) != 1) {
+                *err = "invalid next hop IP address";
+                return -1;
+            }
+        } else {
+            *err = "expected \"dev\" or \"next_hop\" to start a multipath leg";
+            return -1;
+        }
+        i += 2;
+
+        // ... followed by its options, up to the next "dev" or "next_hop"
+        while (i < argc && strcmp(argv[i], "dev") != 0 && strcmp(argv[i], "next_hop") != 0) {
+            if (i + 1 >= argc) {
+                *err = "missing value after multipath keyword";
+                return -1;
+            }
+            if (strcmp(argv[i], "swap_as") == 0) {
+                if (parse_label(argv[i + 1], &nh->out_label) < 0) {
+                    *err = "invalid label (expected 0-1048575)";
+                    return -1;
+                }
+                nh->has_out_label = 1;
+            } else if (strcmp(argv[i], "weight") == 0) {
+                uint32_t weight;
+                if (parse_label(argv[i + 1], &weight) < 0 || weight != 1) {
+                    *err = "weighted multipath is not supported for label routes (the kernel rejects rtnh_hops)";
+                    return -1;
+                }
+                nh->weight = weight;
+            } else {
+                *err = "expected \"swap_as\" or \"weight\" in multipath leg";
+                return -1;
+            }
+            i += 2;
+        }
+    }
 
-    int ifindex = get_interface_index(interface);
-    if (ifindex == 0) {
-        close(sockfd);
+    if (route->nnexthops == 0) {
+        *err = "multipath route needs at least one next hop";
         return -1;
     }
-    add_attr(&req.nlh, sizeof(req), RTA_OIF, &ifindex, sizeof(ifindex));
+    route->kind = MPLS_ROUTE_MULTIPATH;
+    return 0;
+}
 
-    int ret = send_netlink_message(sockfd, &req.nlh, req.nlh.nlmsg_len);
-    close(sockfd);
-    return ret;
+// Function to parse the incoming label of a label route, where "auto" leaves the choice to the caller
+static int parse_route_label(const char *arg, struct mpls_route *route) {
+    if (strcmp(arg, "auto") == 0) {
+        route->auto_label = 1;
+        return 0;
+    }
+    return parse_label(arg, &route->label);
 }
 
-// Function to create an MPLS route with next hop IP
-int create_mpls_route_nexthop(const char *nexthop_ip, uint32_t label, uint8_t s_bit) {
-    int sockfd = create_netlink_socket();
-    if (sockfd < 0) return -1;
+// Function to tell IPv4 routes, keyed by destination, from label routes
+int mpls_route_is_push(const struct mpls_route *route) {
+    return route->kind == MPLS_ROUTE_PUSH_DEV || route->kind == MPLS_ROUTE_PUSH_NEXTHOP ||
+           route->kind == MPLS_ROUTE_PUSH_NHID;
+}
 
-    struct {
-        struct nlmsghdr nlh;
-        struct rtmsg rtm;
-        char buf[BUF_SIZE];
-    } req = {0};
+// Function to parse the arguments of "add_for" into a route description
+int parse_mpls_route(int argc, char *argv[], struct mpls_route *route, const char **err) {
+    memset(route, 0, sizeof(*route));
+    route->s_bit = 1;
 
-    // Initialize Netlink message
-    init_netlink_message(&req.nlh, RTM_NEWROUTE, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL, getpid(), 1);
-    init_route_message(&req.rtm, AF_MPLS, 20, RT_TABLE_MAIN, RTPROT_BOOT, RT_SCOPE_UNIVERSE, RTN_UNICAST);
+    if (argc < 3) {
+        *err = "insufficient arguments";
+        return -1;
+    }
 
-    // Add MPLS label
-    uint32_t mpls_label = create_mpls_label(label, s_bit);
-    add_attr(&req.nlh, sizeof(req), RTA_DST, &mpls_label, sizeof(mpls_label));
+    // "[label] dev [device_name]" and "[label] next_hop [nexthop_ip]"
+    if (strcmp(argv[1], "dev") == 0 || strcmp(argv[1], "next_hop") == 0) {
+        if (argc != 3) {
+            *err = "wrong number of arguments";
+            return -1;
+        }
+        if (parse_route_label(argv[0], route) < 0) {
+            *err = "invalid label (expected 0-1048575 or \"auto\")";
+            return -1;
+        }
+        return parse_route_target(argv[1], argv[2], route, MPLS_ROUTE_DEV, MPLS_ROUTE_NEXTHOP, err);
+    }
 
-    // Add next hop IP using RTA_VIA attribute manually
-    char via[sizeof(uint16_t) + 4] = {0};  // 2 байта family + 4 байта IP
-    uint16_t family = AF_INET;
-    memcpy(via, &family, sizeof(family));
+    // "[label] multipath next_hop|dev [target] [swap_as [label_2]] ..."
+    if (strcmp(argv[1], "multipath") == 0) {
+        if (parse_route_label(argv[0], route) < 0) {
+            *err = "invalid label (expected 0-1048575 or \"auto\")";
+            return -1;
+        }
+        return parse_multipath(argc - 2, argv + 2, route, err);
+    }
 
-    struct in_addr nh_ip;
-    if (inet_pton(AF_INET, nexthop_ip, &nh_ip) != 1) {
-        fprintf(stderr, "Invalid next hop IP address\n");
-        close(sockfd);
-        return -1;
+    // "[label] swap_as [label_2[/label_3...]] dev|next_hop [target]"
+    if (strcmp(argv[1], "swap_as") == 0) {
+        if (argc != 5) {
+            *err = "wrong number of arguments";
+            return -1;
+        }
+        if (parse_route_label(argv[0], route) < 0) {
+            *err = "invalid label (expected 0-1048575 or \"auto\")";
+            return -1;
+        }
+        if (parse_label_stack(argv[2], route) < 0) {
+            *err = "invalid label stack (expected up to 30 labels 0-1048575 separated by '/')";
+            return -1;
+        }
+        return parse_route_target(argv[3], argv[4], route, MPLS_ROUTE_SWAP_DEV, MPLS_ROUTE_SWAP_NEXTHOP, err);
     }
-    memcpy(via + sizeof(family), &nh_ip, sizeof(nh_ip));
 
-    add_attr(&req.nlh, sizeof(req), RTA_VIA, via, sizeof(via));
+    // "[dst_ip] push [label[/label_2...]] [ttl [n]] dev|next_hop [target]"
+    if (strcmp(argv[1], "push") == 0) {
+        if (argc != 5 && !(argc == 7 && strcmp(argv[3], "ttl") == 0)) {
+            *err = "wrong number of arguments";
+            return -1;
+        }
+        if (inet_pton(AF_INET, argv[0], &route->dst) != 1) {
+            *err = "invalid destination IP address";
+            return -1;
+        }
+        if (parse_label_stack(argv[2], route) < 0) {
+            *err = "invalid label stack (expected up to 30 labels 0-1048575 separated by '/')";
+            return -1;
+        }
+        if (argc == 7) {
+            uint32_t ttl;
+            if (parse_label(argv[4], &ttl) < 0 || ttl < 1 || ttl > 255) {
+                *err = "invalid TTL (expected 1-255)";
+                return -1;
+            }
+            route->ttl = ttl;
+        }
+        return parse_route_target(argv[argc - 2], argv[argc - 1], route, MPLS_ROUTE_PUSH_DEV, MPLS_ROUTE_PUSH_NEXTHOP, err);
+    }
 
-    // Send message
-    int ret = send_netlink_message(sockfd, &req.nlh, req.nlh.nlmsg_len);
-    close(sockfd);
-    return ret;
+    // "[dst_ip] nhid [id]": the labels and next hop live in a kernel nexthop object
+    if (strcmp(argv[1], "nhid") == 0) {
+        if (argc != 3) {
+            *err = "wrong number of arguments";
+            return -1;
+        }
+        if (inet_pton(AF_INET, argv[0], &route->dst) != 1) {
+            *err = "invalid destination IP address";
+            return -1;
+        }
+        char *end;
+        errno = 0;
+        unsigned long id = strtoul(argv[2], &end, 10);
+        if (errno || end == argv[2] || *end != '\0' || argv[2][0] == '-' || id == 0 || id > UINT32_MAX) {
+            *err = "invalid nexthop id (expected 1-4294967295)";
+            return -1;
+        }
+        route->nhid = id;
+        route->kind = MPLS_ROUTE_PUSH_NHID;
+        return 0;
+    }
+
+    *err = "unknown route type";
+    return -1;
 }
 
-// Function to create an MPLS route with label swap and next hop IP
-int create_mpls_route_swap_nexthop(const char *nexthop_ip, uint32_t label, uint32_t new_label, uint8_t s_bit) {
-    int sockfd = create_netlink_socket();
-    if (sockfd < 0) return -1;
+// Function to split a command line into whitespace-separated arguments
+int mpls_split_route_args(char *line, char *argv[], int max) {
+    int argc = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(line, " \t\r\n", &save); tok; tok = strtok_r(NULL, " \t\r\n", &save)) {
+        if (argc == max) return -1;
+        argv[argc++] = tok;
+    }
+    return argc;
+}
 
-    struct {
-        struct nlmsghdr nlh;
-        struct rtmsg rtm;
-        char buf[BUF_SIZE];
-    } req = {0};
+// Function to format a route in "add_for" syntax
+int format_mpls_route(const struct mpls_route *route, char *buf, size_t len) {
+    char addr[INET_ADDRSTRLEN];
+    int n;
+
+    switch (route->kind) {
+    case MPLS_ROUTE_SWAP_DEV:
+    case MPLS_ROUTE_SWAP_NEXTHOP:
+        n = snprintf(buf, len, "%u swap_as ", route->label);
+        break;
+    case MPLS_ROUTE_PUSH_DEV:
+    case MPLS_ROUTE_PUSH_NEXTHOP:
+        inet_ntop(AF_INET, &route->dst, addr, sizeof(addr));
+        n = snprintf(buf, len, "%s push ", addr);
+        break;
+    case MPLS_ROUTE_PUSH_NHID:
+        inet_ntop(AF_INET, &route->dst, addr, sizeof(addr));
+        n = snprintf(buf, len, "%s nhid %u", addr, route->nhid);
+        return n >= 0 && (size_t)n < len ? n : -1;
+    default:
+        n = snprintf(buf, len, "%u", route->label);
+        break;
+    }
+    if (n < 0 || (size_t)n >= len) return -1;
+
+    // Label stack as "a/b/c", then the push TTL if one was given
+    if (route->kind == MPLS_ROUTE_SWAP_DEV || route->kind == MPLS_ROUTE_SWAP_NEXTHOP ||
+        route->kind == MPLS_ROUTE_PUSH_DEV || route->kind == MPLS_ROUTE_PUSH_NEXTHOP) {
+        for (int i = 0; i < route->nout_labels && (size_t)n < len; i++) {
+            n += snprintf(buf + n, len - n, i ? "/%u" : "%u", route->out_labels[i]);
+        }
+        if (route->ttl && (size_t)n < len) n += snprintf(buf + n, len - n, " ttl %u", route->ttl);
+        if ((size_t)n >= len) return -1;
+    }
 
-    // Initialize Netlink message
-    init_netlink_message(&req.nlh, RTM_NEWROUTE, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL, getpid(), 1);
-    init_route_message(&req.rtm, AF_MPLS, 20, RT_TABLE_MAIN, RTPROT_BOOT, RT_SCOPE_UNIVERSE, RTN_UNICAST);
+    if (route->kind == MPLS_ROUTE_MULTIPATH) {
+        n += snprintf(buf + n, len - n, " multipath");
+        for (int i = 0; i < route->nnexthops && (size_t)n < len; i++) {
+            const struct mpls_nexthop *nh = &route->nexthops[i];
+            if (nh->ifname[0]) {
+                n += snprintf(buf + n, len - n, " dev %s", nh->ifname);
+            } else {
+                inet_ntop(AF_INET, &nh->via, addr, sizeof(addr));
+                n += snprintf(buf + n, len - n, " next_hop %s", addr);
+            }
+            if (nh->has_out_label && (size_t)n < len) n += snprintf(buf + n, len - n, " swap_as %u", nh->out_label);
+        }
+    } else if (route->kind == MPLS_ROUTE_NEXTHOP || route->kind == MPLS_ROUTE_SWAP_NEXTHOP ||
+        route->kind == MPLS_ROUTE_PUSH_NEXTHOP) {
+        inet_ntop(AF_INET, &route->via, addr, sizeof(addr));
+        n += snprintf(buf + n, len - n, " next_hop %s", addr);
+    } else {
+        n += snprintf(buf + n, len - n, " dev %s", route->ifname);
+    }
+    return (size_t)n < len ? n : -1;
+}
 
-    // Add MPLS label (RTA_DST)
-    uint32_t mpls_label = create_mpls_label(label, s_bit);
-    add_attr(&req.nlh, sizeof(req), RTA_DST, &mpls_label, sizeof(mpls_label));
+// Function to parse a command verb into a route operation
+int parse_mpls_route_op(const char *verb, enum mpls_route_op *op) {
+    if (strcmp(verb, "add_for") == 0) {
+        *op = MPLS_OP_ADD;
+    } else if (strcmp(verb, "replace") == 0) {
+        *op = MPLS_OP_REPLACE;
+    } else if (strcmp(verb, "del") == 0) {
+        *op = MPLS_OP_DELETE;
+    } else {
+        return -1;
+    }
+    return 0;
+}
 
-    // Add new MPLS label for swap (RTA_NEWDST)
-    uint32_t mpls_new_label = create_mpls_label(new_label, s_bit);
-    add_attr(&req.nlh, sizeof(req), RTA_NEWDST, &mpls_new_label, sizeof(mpls_new_label));
+// Function to parse the key of a route ("[label]" or "[dst_ip]") for deletion
+int parse_mpls_route_key(const char *arg, struct mpls_route *route, const char **err) {
+    memset(route, 0, sizeof(*route));
+    route->s_bit = 1;
+    if (parse_label(arg, &route->label) == 0) {
+        route->kind = MPLS_ROUTE_DEV;
+        return 0;
+    }
+    if (inet_pton(AF_INET, arg, &route->dst) == 1) {
+        route->kind = MPLS_ROUTE_PUSH_NEXTHOP;
+        return 0;
+    }
+    *err = "expected a label (0-1048575) or a destination IP address";
+    return -1;
+}
+
+// Function to parse a route command ("add_for ...", "replace ...", "del ...")
+int parse_mpls_command(int argc, char *argv[], enum mpls_route_op *op, struct mpls_route *route, const char **err) {
+    if (argc < 1 || parse_mpls_route_op(argv[0], op) < 0) {
+        *err = "expected \"add_for\", \"replace\" or \"del\"";
+        return -1;
+    }
+    if (*op == MPLS_OP_DELETE && argc == 2) {
+        return parse_mpls_route_key(argv[1], route, err);
+    }
+    return parse_mpls_route(argc - 1, argv + 1, route, err);
+}
 
-    // Add next hop IP using RTA_VIA attribute manually
+// Function to add an IPv4 next hop as an RTA_VIA attribute
+static void add_via_attr(struct nlmsghdr *nlh, unsigned int maxlen, struct in_addr nh_ip) {
     char via[sizeof(uint16_t) + 4] = {0};  // 2 байта family + 4 байта IP
     uint16_t family = AF_INET;
     memcpy(via, &family, sizeof(family));
+    memcpy(via + sizeof(family), &nh_ip, sizeof(nh_ip));
+    add_attr(nlh, maxlen, RTA_VIA, via, sizeof(via));
+}
 
-    struct in_addr nh_ip;
-    if (inet_pton(AF_INET, nexthop_ip, &nh_ip) != 1) {
-        fprintf(stderr, "Invalid next hop IP address\n");
-        close(sockfd);
-        return -1;
+// Function to add the MPLS encapsulation of a push route (RTA_ENCAP + RTA_ENCAP_TYPE)
+static int add_encap_attrs(struct nlmsghdr *nlh, unsigned int maxlen, const struct mpls_route *route) {
+    uint32_t stack[MPLS_MAX_LABELS];
+    int len = create_mpls_label_stack(route->out_labels, route->nout_labels, 1, stack);
+    if (len < 0) return len;
+
+    // The label stack and TTL go inside RTA_ENCAP as MPLS_IPTUNNEL_* attributes
+    struct rtattr *encap = mpls_add_attr_nest(nlh, maxlen, RTA_ENCAP | NLA_F_NESTED);
+    add_attr(nlh, maxlen, MPLS_IPTUNNEL_DST, stack, len);
+    if (route->ttl) {
+        uint8_t ttl = route->ttl;
+        add_attr(nlh, maxlen, MPLS_IPTUNNEL_TTL, &ttl, sizeof(ttl));
     }
-    memcpy(via + sizeof(family), &nh_ip, sizeof(nh_ip));
+    mpls_add_attr_nest_end(nlh, encap);
 
-    add_attr(&req.nlh, sizeof(req), RTA_VIA, via, sizeof(via));
+    // Add encapsulation type (RTA_ENCAP_TYPE)
+    uint16_t encap_type = LWTUNNEL_ENCAP_MPLS;
+    add_attr(nlh, maxlen, RTA_ENCAP_TYPE, &encap_type, sizeof(encap_type));
+    return 0;
+}
 
-    // Send message
-    int ret = send_netlink_message(sockfd, &req.nlh, req.nlh.nlmsg_len);
-    close(sockfd);
-    return ret;
+// Function to add the legs of a multipath label route as a nested RTA_MULTIPATH attribute
+static int add_multipath_attr(struct nlmsghdr *nlh, unsigned int maxlen, const struct mpls_route *route,
+                              struct mpls_ifcache *ifcache) {
+    struct rtattr *mp = mpls_add_attr_nest(nlh, maxlen, RTA_MULTIPATH);
+
+    for (int i = 0; i < route->nnexthops; i++) {
+        const struct mpls_nexthop *nh = &route->nexthops[i];
+        int ifindex = 0;
+        if (nh->ifname[0]) {
+            ifindex = mpls_ifcache_index(ifcache, nh->ifname);
+            if (ifindex == 0) return -ENODEV;
+        }
+
+        // struct rtnexthop, then the leg's own RTA_VIA / RTA_NEWDST attributes
+        struct rtnexthop *rtnh = (struct rtnexthop *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+        memset(rtnh, 0, sizeof(*rtnh));
+        // rtnh_hops stays 0: mpls_nh_build_multi() rejects weights and flags
+        rtnh->rtnh_ifindex = ifindex;
+        nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + RTNH_LENGTH(0);
+
+        if (!ifindex) add_via_attr(nlh, maxlen, nh->via);
+        if (nh->has_out_label) {
+            uint32_t mpls_new_label = create_mpls_label(nh->out_label, route->s_bit);
+            add_attr(nlh, maxlen, RTA_NEWDST, &mpls_new_label, sizeof(mpls_new_label));
+        }
+        rtnh->rtnh_len = (char *)nlh + nlh->nlmsg_len - (char *)rtnh;
+    }
+
+    mpls_add_attr_nest_end(nlh, mp);
+    return 0;
 }
 
-// Function to create an MPLS route with label swap to a specific interface
-int create_mpls_route_swap_dev(const char *interface, uint32_t label, uint32_t new_label, uint8_t s_bit) {
-    int sockfd = create_netlink_socket();
-    if (sockfd < 0) return -1;
+// Function to encode an RTM_NEWROUTE/RTM_DELROUTE request for any route kind
+static int build_route_request(struct nlmsghdr *nlh, unsigned int maxlen, const struct mpls_route *route,
+                               enum mpls_route_op op, struct mpls_ifcache *ifcache) {
+    // The largest request (a full multipath route) fits in MPLS_ROUTE_MSG_MAX, so add_attr() cannot fail below
+    if (maxlen < MPLS_ROUTE_MSG_MAX) return -EMSGSIZE;
+    if (route->label > 0xFFFFF || route->nout_labels > MPLS_MAX_LABELS || route->s_bit > 1) return -EINVAL;
+    if (route->auto_label) return -EINVAL;  // "auto" must be resolved to a label first
+    if (route->kind == MPLS_ROUTE_MULTIPATH) {
+        if (route->nnexthops < 1 || route->nnexthops > MPLS_MAX_NEXTHOPS) return -EINVAL;
+        for (int i = 0; i < route->nnexthops; i++) {
+            if (route->nexthops[i].out_label > 0xFFFFF || route->nexthops[i].weight > 1) return -EINVAL;
+        }
+    }
 
-    struct {
-        struct nlmsghdr nlh;
-        struct rtmsg rtm;
-        char buf[BUF_SIZE];
-    } req = {0};
-
-    // Initialize Netlink message
-    init_netlink_message(&req.nlh, RTM_NEWROUTE, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL, getpid(), 1);
-    init_route_message(&req.rtm, AF_MPLS, 20, RT_TABLE_MAIN, RTPROT_BOOT, RT_SCOPE_UNIVERSE, RTN_UNICAST);
-
-    // Add MPLS label (RTA_DST)
-    uint32_t mpls_label = create_mpls_label(label, s_bit);
-    add_attr(&req.nlh, sizeof(req), RTA_DST, &mpls_label, sizeof(mpls_label));
-
-    // Add new MPLS label for swap (RTA_NEWDST)
-    uint32_t mpls_new_label = create_mpls_label(new_label, s_bit);
-    add_attr(&req.nlh, sizeof(req), RTA_NEWDST, &mpls_new_label, sizeof(mpls_new_label));
-
-    // Get interface index
-    int ifindex = get_interface_index(interface);
-    if (ifindex == 0) {
-        fprintf(stderr, "Failed to get interface index for %s\n", interface);
-        close(sockfd);
-        return -1;
+    if (route->kind == MPLS_ROUTE_PUSH_NHID && route->nhid == 0) return -EINVAL;
+
+    int is_push = mpls_route_is_push(route);
+    struct rtmsg *rtm = (struct rtmsg *)NLMSG_DATA(nlh);
+    memset(nlh, 0, NLMSG_SPACE(sizeof(*rtm)));
+
+    // A delete carries only the key (label or destination), so it works even if the nexthop is gone
+    if (op == MPLS_OP_DELETE) {
+        init_netlink_message(nlh, RTM_DELROUTE, NLM_F_REQUEST | NLM_F_ACK, 0, 0);
+        if (is_push) {
+            init_route_message(rtm, AF_INET, 32, RT_TABLE_MAIN, RTPROT_UNSPEC, RT_SCOPE_NOWHERE, RTN_UNSPEC);
+            add_attr(nlh, maxlen, RTA_DST, &route->dst, sizeof(route->dst));
+        } else {
+            init_route_message(rtm, AF_MPLS, 20, RT_TABLE_MAIN, MPLS_ROUTE_PROTOCOL, RT_SCOPE_UNIVERSE, RTN_UNICAST);
+            uint32_t mpls_label = create_mpls_label(route->label, route->s_bit);
+            add_attr(nlh, maxlen, RTA_DST, &mpls_label, sizeof(mpls_label));
+        }
+        return 0;
+    }
+
+    int flags = NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE;
+    flags |= op == MPLS_OP_REPLACE ? NLM_F_REPLACE : NLM_F_EXCL;
+    init_netlink_message(nlh, RTM_NEWROUTE, flags, 0, 0);
+
+    int ifindex = 0;
+    if (route->kind == MPLS_ROUTE_DEV || route->kind == MPLS_ROUTE_SWAP_DEV || route->kind == MPLS_ROUTE_PUSH_DEV) {
+        ifindex = mpls_ifcache_index(ifcache, route->ifname);
+        if (ifindex == 0) return -ENODEV;
+    }
+
+    if (!is_push) {
+        init_route_message(rtm, AF_MPLS, 20, RT_TABLE_MAIN, MPLS_ROUTE_PROTOCOL, RT_SCOPE_UNIVERSE, RTN_UNICAST);
+
+        // Add MPLS label (RTA_DST)
+        uint32_t mpls_label = create_mpls_label(route->label, route->s_bit);
+        add_attr(nlh, maxlen, RTA_DST, &mpls_label, sizeof(mpls_label));
+
+        // Add the new label stack for swap (RTA_NEWDST)
+        if (route->kind == MPLS_ROUTE_SWAP_DEV || route->kind == MPLS_ROUTE_SWAP_NEXTHOP) {
+            uint32_t stack[MPLS_MAX_LABELS];
+            int len = create_mpls_label_stack(route->out_labels, route->nout_labels, route->s_bit, stack);
+            if (len < 0) return len;
+            add_attr(nlh, maxlen, RTA_NEWDST, stack, len);
+        }
+
+        // Multipath legs carry their own next hops and out-labels
+        if (route->kind == MPLS_ROUTE_MULTIPATH) return add_multipath_attr(nlh, maxlen, route, ifcache);
+    } else {
+        init_route_message(rtm, AF_INET, 32, RT_TABLE_MAIN, MPLS_ROUTE_PROTOCOL,
+                           ifindex ? RT_SCOPE_LINK : RT_SCOPE_UNIVERSE, RTN_UNICAST);
+
+        // Add the destination IP address (RTA_DST)
+        add_attr(nlh, maxlen, RTA_DST, &route->dst, sizeof(route->dst));
+
+        // The nexthop object carries the gateway, interface and encap, so the route holds only its id
+        if (route->kind == MPLS_ROUTE_PUSH_NHID) {
+            add_attr(nlh, maxlen, RTA_NH_ID, &route->nhid, sizeof(route->nhid));
+            return 0;
+        }
+
+        int ret = add_encap_attrs(nlh, maxlen, route);
+        if (ret < 0) return ret;
     }
 
-    // Add RTA_OIF for interface
-    add_attr(&req.nlh, sizeof(req), RTA_OIF, &ifindex, sizeof(ifindex));
+    if (ifindex) {
+        add_attr(nlh, maxlen, RTA_OIF, &ifindex, sizeof(ifindex));
+    } else if (!is_push) {
+        add_via_attr(nlh, maxlen, route->via);
+    } else {
+        add_attr(nlh, maxlen, RTA_GATEWAY, &route->via, sizeof(route->via));
+    }
+    return 0;
+}
 
-    // Send message
-    int ret = send_netlink_message(sockfd, &req.nlh, req.nlh.nlmsg_len);
-    close(sockfd);
+// Function to build an RTM_NEWROUTE/RTM_DELROUTE request for any route kind
+int build_mpls_route(struct nlmsghdr *nlh, unsigned int maxlen, const struct mpls_route *route, enum mpls_route_op op,
+                     struct mpls_ifcache *ifcache) {
+    MPLS_STAT_TIME_START(start);
+    int ret = build_route_request(nlh, maxlen, route, op, ifcache);
+    MPLS_STAT_TIME_END(MPLS_HIST_BUILD, start);
+    MPLS_STAT_ADD(ret < 0 ? MPLS_STAT_BUILD_ERRORS : MPLS_STAT_ROUTES_BUILT, 1);
     return ret;
 }
 
-// Function to create an MPLS route with IP encapsulation
-int create_mpls_encap_route_dev(const char *interface, const char *dst_ip, uint32_t mpls_label) {
-    // Create a Netlink socket
-    int sockfd = create_netlink_socket();
-    if (sockfd < 0) return -1;
+// Function to check whether a route has the shape a template was built for
+int mpls_route_template_matches(const struct mpls_route_template *tmpl, const struct mpls_route *route,
+                                enum mpls_route_op op) {
+    if (!tmpl->valid || tmpl->kind != route->kind || tmpl->op != op || tmpl->s_bit != route->s_bit) return 0;
+    if (route->auto_label) return 0;  // Still needs a label; rebuilding reports the error
+    // A delete carries only the key, so the rest of the shape does not matter
+    return op == MPLS_OP_DELETE || (tmpl->nout_labels == route->nout_labels && tmpl->ttl == route->ttl);
+}
 
-    // Structure for the Netlink request
-    struct {
-        struct nlmsghdr nlh;
-        struct rtmsg rtm;
-        char buf[BUF_SIZE];
-    } req = {0};
-
-    // Initialize the Netlink message
-    init_netlink_message(&req.nlh, RTM_NEWROUTE, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL, getpid(), 1);
-    init_route_message(&req.rtm, AF_INET, 32, RT_TABLE_MAIN, RTPROT_BOOT, RT_SCOPE_LINK, RTN_UNICAST);
-
-    // Convert and add the destination IP address (RTA_DST)
-    struct in_addr dst_addr;
-    if (inet_pton(AF_INET, dst_ip, &dst_addr) != 1) {
-        fprintf(stderr, "Invalid destination IP address\n");
-        close(sockfd);
-        return -1;
+// Function to record the offset of an attribute's payload, walking into RTA_ENCAP
+static void template_locate(struct mpls_route_template *tmpl, const struct rtattr *rta, int len, int nested) {
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        uint16_t off = (const char *)RTA_DATA(rta) - tmpl->msg;
+        int type = rta->rta_type & NLA_TYPE_MASK;
+        if (nested) {
+            if (type == MPLS_IPTUNNEL_DST) tmpl->stack_off = off;
+            continue;
+        }
+        switch (type) {
+        case RTA_DST: tmpl->dst_off = off; break;
+        case RTA_NEWDST: tmpl->stack_off = off; break;
+        case RTA_OIF: tmpl->oif_off = off; break;
+        case RTA_GATEWAY: tmpl->via_off = off; break;
+        case RTA_VIA: tmpl->via_off = off + offsetof(struct rtvia, rtvia_addr); break;
+        case RTA_NH_ID: tmpl->nhid_off = off; break;
+        case RTA_ENCAP: template_locate(tmpl, RTA_DATA(rta), RTA_PAYLOAD(rta), 1); break;
+        }
+    }
+}
+
+// Function to encode a route once and find its variable fields
+int mpls_route_template_init(struct mpls_route_template *tmpl, const struct mpls_route *route, enum mpls_route_op op,
+                             struct mpls_ifcache *ifcache) {
+    memset(tmpl, 0, sizeof(*tmpl));
+    if (route->kind == MPLS_ROUTE_MULTIPATH) return -EINVAL;
+
+    struct nlmsghdr *nlh = (struct nlmsghdr *)tmpl->msg;
+    int ret = build_route_request(nlh, sizeof(tmpl->msg), route, op, ifcache);
+    if (ret < 0) return ret;
+
+    tmpl->kind = route->kind;
+    tmpl->op = op;
+    tmpl->nout_labels = route->nout_labels;
+    tmpl->s_bit = route->s_bit;
+    tmpl->ttl = route->ttl;
+    tmpl->len = nlh->nlmsg_len;
+    template_locate(tmpl, RTM_RTA(NLMSG_DATA(nlh)), RTM_PAYLOAD(nlh), 0);
+    tmpl->valid = 1;
+    return 0;
+}
+
+// Function to encode a route from a matching template
+int mpls_route_template_fill(const struct mpls_route_template *tmpl, struct nlmsghdr *nlh, unsigned int maxlen,
+                             const struct mpls_route *route, struct mpls_ifcache *ifcache) {
+    MPLS_STAT_TIME_START(start);
+    int ret = 0;
+    if (maxlen < tmpl->len) {
+        ret = -EMSGSIZE;
+        goto out;
+    }
+    memcpy(nlh, tmpl->msg, tmpl->len);
+    char *msg = (char *)nlh;
+
+    // Key: the destination of a push route, otherwise the incoming label
+    if (mpls_route_is_push(route)) {
+        memcpy(msg + tmpl->dst_off, &route->dst, sizeof(route->dst));
+    } else {
+        if (route->label > 0xFFFFF) {
+            ret = -EINVAL;
+            goto out;
+        }
+        uint32_t mpls_label = create_mpls_label(route->label, route->s_bit);
+        memcpy(msg + tmpl->dst_off, &mpls_label, sizeof(mpls_label));
     }
-    add_attr(&req.nlh, sizeof(req), RTA_DST, &dst_addr, sizeof(dst_addr));
 
-    // Add encapsulation attribute (RTA_ENCAP) as NLA_F_NESTED
-    struct rtattr *rta_encap = (struct rtattr *)((char *)&req + NLMSG_ALIGN(req.nlh.nlmsg_len));
-    rta_encap->rta_type = RTA_ENCAP | NLA_F_NESTED;
-    rta_encap->rta_len = RTA_LENGTH(8);  // 12 bytes: 4 (rta header) + 8 (data)
+    if (tmpl->stack_off) {
+        // Push stacks always end with BOS; swap stacks end with the route's S-bit
+        uint8_t s_bit = route->kind == MPLS_ROUTE_PUSH_DEV || route->kind == MPLS_ROUTE_PUSH_NEXTHOP ? 1 : route->s_bit;
+        uint32_t stack[MPLS_MAX_LABELS];
+        int len = create_mpls_label_stack(route->out_labels, route->nout_labels, s_bit, stack);
+        if (len < 0) {
+            ret = len;
+            goto out;
+        }
+        memcpy(msg + tmpl->stack_off, stack, len);
+    }
+    if (tmpl->oif_off) {
+        int ifindex = mpls_ifcache_index(ifcache, route->ifname);
+        if (ifindex == 0) {
+            ret = -ENODEV;
+            goto out;
+        }
+        memcpy(msg + tmpl->oif_off, &ifindex, sizeof(ifindex));
+    }
+    if (tmpl->via_off) memcpy(msg + tmpl->via_off, &route->via, sizeof(route->via));
+    if (tmpl->nhid_off) {
+        if (route->nhid == 0) {
+            ret = -EINVAL;
+            goto out;
+        }
+        memcpy(msg + tmpl->nhid_off, &route->nhid, sizeof(route->nhid));
+    }
 
-    // Create the full MPLS header
-    uint64_t full_mpls_header = create_mpls_label_for_encap(mpls_label, 1, 0);
-    memcpy((char *)rta_encap + RTA_LENGTH(0), &full_mpls_header, sizeof(full_mpls_header));
+out:
+    MPLS_STAT_TIME_END(MPLS_HIST_BUILD, start);
+    MPLS_STAT_ADD(ret < 0 ? MPLS_STAT_BUILD_ERRORS : MPLS_STAT_ROUTES_BUILT, 1);
+    return ret;
+}
 
-    // Update the Netlink message length
-    req.nlh.nlmsg_len = NLMSG_ALIGN(req.nlh.nlmsg_len) + RTA_ALIGN(rta_encap->rta_len);
+// Function to name a route attribute type; nested ones are the MPLS_IPTUNNEL_* types of RTA_ENCAP
+static const char *route_attr_name(int type, int encap) {
+    if (encap) {
+        if (type == MPLS_IPTUNNEL_DST) return "MPLS_IPTUNNEL_DST";
+        if (type == MPLS_IPTUNNEL_TTL) return "MPLS_IPTUNNEL_TTL";
+        return NULL;
+    }
+    switch (type) {
+    case RTA_DST: return "RTA_DST";
+    case RTA_OIF: return "RTA_OIF";
+    case RTA_GATEWAY: return "RTA_GATEWAY";
+    case RTA_MULTIPATH: return "RTA_MULTIPATH";
+    case RTA_VIA: return "RTA_VIA";
+    case RTA_NEWDST: return "RTA_NEWDST";
+    case RTA_ENCAP_TYPE: return "RTA_ENCAP_TYPE";
+    case RTA_ENCAP: return "RTA_ENCAP";
+    case RTA_NH_ID: return "RTA_NH_ID";
+    }
+    return NULL;
+}
 
-    // Add encapsulation type (RTA_ENCAP_TYPE)
-    uint16_t encap_type = LWTUNNEL_ENCAP_MPLS;
-    add_attr(&req.nlh, sizeof(req), RTA_ENCAP_TYPE, &encap_type, sizeof(encap_type));
+// Function to name the attribute covering an offset of a request, descending into RTA_ENCAP and RTA_MULTIPATH
+static int route_attr_path(char *buf, size_t len, const char *base, const struct rtattr *rta, int rtalen,
+                           uint32_t offset, int encap) {
+    for (; RTA_OK(rta, rtalen); rta = RTA_NEXT(rta, rtalen)) {
+        uint32_t start = (const char *)rta - base;
+        if (offset < start || offset >= start + rta->rta_len) continue;
+
+        int type = rta->rta_type & NLA_TYPE_MASK;
+        const char *name = route_attr_name(type, encap);
+        char inner[64] = "";
+        if (offset != start && !encap && type == RTA_ENCAP) {
+            route_attr_path(inner, sizeof(inner), base, RTA_DATA(rta), RTA_PAYLOAD(rta), offset, 1);
+        } else if (offset != start && !encap && type == RTA_MULTIPATH) {
+            // Legs are a struct rtnexthop followed by the leg's own attributes
+            const struct rtnexthop *rtnh = (const struct rtnexthop *)RTA_DATA(rta);
+            int left = RTA_PAYLOAD(rta);
+            for (int i = 0; RTNH_OK(rtnh, left); i++) {
+                uint32_t leg = (const char *)rtnh - base;
+                if (offset >= leg && offset < leg + rtnh->rtnh_len) {
+                    int n = snprintf(inner, sizeof(inner), "nexthop %d", i);
+                    if (offset >= leg + RTNH_LENGTH(0) && n > 0 && (size_t)n + 1 < sizeof(inner)) {
+                        inner[n++] = '/';
+                        route_attr_path(inner + n, sizeof(inner) - n, base, RTNH_DATA(rtnh),
+                                        rtnh->rtnh_len - RTNH_LENGTH(0), offset, 0);
+                    }
+                    break;
+                }
+                left -= RTNH_ALIGN(rtnh->rtnh_len);
+                rtnh = RTNH_NEXT(rtnh);
+            }
+        }
+        if (name) return snprintf(buf, len, "%s%s%s", name, inner[0] ? "/" : "", inner);
+        return snprintf(buf, len, "attribute %d%s%s", type, inner[0] ? "/" : "", inner);
+    }
+    return 0;
+}
 
-    // Retrieve the interface index
-    int ifindex = get_interface_index(interface);
-    if (ifindex == 0) {
-        fprintf(stderr, "Failed to get interface index for %s\n", interface);
-        close(sockfd);
-        return -1;
+// Function to describe an extended ACK, naming the rejected attribute of the request
+int format_mpls_ack(const struct mpls_ack *ack, const struct nlmsghdr *req, char *buf, size_t len) {
+    char attr[96] = "";
+    if (ack->offset) {
+        unsigned int first = NLMSG_SPACE(sizeof(struct rtmsg));
+        if (req && ack->offset >= first && ack->offset < req->nlmsg_len) {
+            route_attr_path(attr, sizeof(attr), (const char *)req, (const struct rtattr *)((const char *)req + first),
+                            req->nlmsg_len - first, ack->offset, 0);
+        }
+        if (!attr[0]) snprintf(attr, sizeof(attr), "attribute at offset %u", ack->offset);
+    }
+
+    int n;
+    if (ack->msg && attr[0]) {
+        n = snprintf(buf, len, "%s (%s)", ack->msg, attr);
+    } else if (ack->msg) {
+        n = snprintf(buf, len, "%s", ack->msg);
+    } else {
+        n = snprintf(buf, len, attr[0] ? "invalid %s" : "%s", attr);
+    }
+    if (n < 0) return 0;
+    return (size_t)n < len ? n : (int)len - 1;
+}
+
+// Function to add, replace or delete a single route over an open session
+int session_apply_mpls_route(struct mpls_session *session, const struct mpls_route *route, enum mpls_route_op op) {
+    struct {
+        struct nlmsghdr nlh;
+        struct rtmsg rtm;
+        char buf[MPLS_ROUTE_MSG_MAX];
+    } req;
+
+    int ret = build_mpls_route(&req.nlh, sizeof(req), route, op, session->ifcache);
+    if (ret < 0) return ret;
+    ret = mpls_session_request(session, &req.nlh);
+
+    // Name the attribute the kernel pointed at while the request is still at hand
+    if (ret < 0 && (session->err_msg[0] || session->err_offset)) {
+        struct mpls_ack ack = {ret, NULL, session->err_offset};
+        char msg[MPLS_ERR_MSG_MAX];
+        snprintf(msg, sizeof(msg), "%s", session->err_msg);
+        if (msg[0]) ack.msg = msg;
+        format_mpls_ack(&ack, &req.nlh, session->err_msg, sizeof(session->err_msg));
     }
+    return ret;
+}
+
+// Function to install a single route over an open session
+int session_create_mpls_route(struct mpls_session *session, const struct mpls_route *route) {
+    return session_apply_mpls_route(session, route, MPLS_OP_ADD);
+}
 
-    // Add the output interface (RTA_OIF)
-    add_attr(&req.nlh, sizeof(req), RTA_OIF, &ifindex, sizeof(ifindex));
+// Function to add, replace or delete a single route over its own Netlink session
+int apply_mpls_route(const struct mpls_route *route, enum mpls_route_op op) {
+    struct mpls_session session;
+    int ret = mpls_session_open(&session, 0);
+    if (ret < 0) return ret;
 
-    // Send the Netlink message
-    int ret = send_netlink_message(sockfd, &req.nlh, req.nlh.nlmsg_len);
-    close(sockfd);
+    ret = session_apply_mpls_route(&session, route, op);
+    mpls_session_close(&session);
     return ret;
 }
 
-// Function to create an MPLS route with IP encapsulation via a gateway
-int create_mpls_encap_route_via(const char *dst_ip, uint32_t mpls_label, const char *gateway_ip) {
-    // Create a Netlink socket
-    int sockfd = create_netlink_socket();
-    if (sockfd < 0) return -1;
+// Function to install a single route over its own Netlink session
+int create_mpls_route(const struct mpls_route *route) {
+    return apply_mpls_route(route, MPLS_OP_ADD);
+}
 
-    // Structure for the Netlink request
+// Function to find the interface the kernel would use to reach an address
+int mpls_session_lookup_oif(struct mpls_session *session, struct in_addr addr) {
     struct {
         struct nlmsghdr nlh;
         struct rtmsg rtm;
-        char buf[BUF_SIZE];
-    } req = {0};
-
-    // Initialize the Netlink message
-    init_netlink_message(&req.nlh, RTM_NEWROUTE, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL, getpid(), 1);
-    init_route_message(&req.rtm, AF_INET, 32, RT_TABLE_MAIN, RTPROT_BOOT, RT_SCOPE_UNIVERSE, RTN_UNICAST);
-
-    // Convert and add the destination IP address (RTA_DST)
-    struct in_addr dst_addr;
-    if (inet_pton(AF_INET, dst_ip, &dst_addr) != 1) {
-        fprintf(stderr, "Invalid destination IP address\n");
-        close(sockfd);
-        return -1;
+        char buf[RTA_SPACE(sizeof(struct in_addr))];
+    } req;
+    memset(&req, 0, sizeof(req));
+    init_netlink_message(&req.nlh, RTM_GETROUTE, NLM_F_REQUEST, 0, 0);
+    init_route_message(&req.rtm, AF_INET, 32, RT_TABLE_UNSPEC, RTPROT_UNSPEC, RT_SCOPE_UNIVERSE, RTN_UNSPEC);
+    add_attr(&req.nlh, sizeof(req), RTA_DST, &addr, sizeof(addr));
+    uint32_t seq = mpls_session_stamp(session, &req.nlh);
+    int ret = mpls_session_send(session, &req, req.nlh.nlmsg_len);
+    if (ret < 0) return ret;
+
+    char buf[BUF_SIZE];
+    for (;;) {
+        int len = mpls_session_recv(session, buf, sizeof(buf), 0);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+        for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, (unsigned int)len);
+             nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_seq != seq) continue;
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                struct mpls_ack ack;
+                int error = mpls_parse_ack(nlh, &ack);
+                return error ? error : -ENETUNREACH;
+            }
+            if (nlh->nlmsg_type != RTM_NEWROUTE) continue;
+
+            const struct rtmsg *rtm = (const struct rtmsg *)NLMSG_DATA(nlh);
+            const struct rtattr *tb[RTA_MAX + 1];
+            mpls_parse_rtattr(tb, RTA_MAX, RTM_RTA(rtm), RTM_PAYLOAD(nlh));
+            if (!tb[RTA_OIF] || RTA_PAYLOAD(tb[RTA_OIF]) < sizeof(int)) return -ENETUNREACH;
+            return *(const int *)RTA_DATA(tb[RTA_OIF]);
+        }
     }
-    add_attr(&req.nlh, sizeof(req), RTA_DST, &dst_addr, sizeof(dst_addr));
+}
 
-    // Add encapsulation attribute (RTA_ENCAP) as NLA_F_NESTED
-    struct rtattr *rta_encap = (struct rtattr *)((char *)&req + NLMSG_ALIGN(req.nlh.nlmsg_len));
-    rta_encap->rta_type = RTA_ENCAP | NLA_F_NESTED;
-    rta_encap->rta_len = RTA_LENGTH(8);  // 12 bytes: 4 (rta header) + 8 (data)
+// Function to copy an interface name into a route description
+static int set_route_ifname(struct mpls_route *route, const char *interface) {
+    if (strlen(interface) >= sizeof(route->ifname)) return -ENAMETOOLONG;
+    strcpy(route->ifname, interface);
+    return 0;
+}
 
-    // Create the full MPLS header
-    uint64_t full_mpls_header = create_mpls_label_for_encap(mpls_label, 1, 0);
-    memcpy((char *)rta_encap + RTA_LENGTH(0), &full_mpls_header, sizeof(full_mpls_header));
+// Function to parse an IPv4 address argument
+static int set_route_addr(struct in_addr *addr, const char *ip) {
+    return inet_pton(AF_INET, ip, addr) == 1 ? 0 : -EINVAL;
+}
 
-    // Update the Netlink message length
-    req.nlh.nlmsg_len = NLMSG_ALIGN(req.nlh.nlmsg_len) + RTA_ALIGN(rta_encap->rta_len);
+// Function to create a simple MPLS route with interface
+int create_mpls_route_dev(const char *interface, uint32_t label, uint8_t s_bit) {
+    struct mpls_route route = {.kind = MPLS_ROUTE_DEV, .label = label, .s_bit = s_bit};
+    if (set_route_ifname(&route, interface) < 0) return -ENAMETOOLONG;
+    return create_mpls_route(&route);
+}
 
-    // Add encapsulation type (RTA_ENCAP_TYPE)
-    uint16_t encap_type = LWTUNNEL_ENCAP_MPLS;
-    add_attr(&req.nlh, sizeof(req), RTA_ENCAP_TYPE, &encap_type, sizeof(encap_type));
+// Function to create an MPLS route with next hop IP
+int create_mpls_route_nexthop(const char *nexthop_ip, uint32_t label, uint8_t s_bit) {
+    struct mpls_route route = {.kind = MPLS_ROUTE_NEXTHOP, .label = label, .s_bit = s_bit};
+    if (set_route_addr(&route.via, nexthop_ip) < 0) return -EINVAL;
+    return create_mpls_route(&route);
+}
 
-    // Convert and add the gateway IP address (RTA_GATEWAY)
-    struct in_addr gw_addr;
-    if (inet_pton(AF_INET, gateway_ip, &gw_addr) != 1) {
-        fprintf(stderr, "Invalid gateway IP address\n");
-        close(sockfd);
-        return -1;
-    }
-    add_attr(&req.nlh, sizeof(req), RTA_GATEWAY, &gw_addr, sizeof(gw_addr));
+// Function to create an MPLS route with label swap and next hop IP
+int create_mpls_route_swap_nexthop(const char *nexthop_ip, uint32_t label, uint32_t new_label, uint8_t s_bit) {
+    struct mpls_route route = {.kind = MPLS_ROUTE_SWAP_NEXTHOP, .label = label,
+                               .out_labels = {new_label}, .nout_labels = 1, .s_bit = s_bit};
+    if (set_route_addr(&route.via, nexthop_ip) < 0) return -EINVAL;
+    return create_mpls_route(&route);
+}
 
-    // Send the Netlink message
-    int ret = send_netlink_message(sockfd, &req.nlh, req.nlh.nlmsg_len);
-    close(sockfd);
-    return ret;
+// Function to create an MPLS route with label swap to a specific interface
+int create_mpls_route_swap_dev(const char *interface, uint32_t label, uint32_t new_label, uint8_t s_bit) {
+    struct mpls_route route = {.kind = MPLS_ROUTE_SWAP_DEV, .label = label,
+                               .out_labels = {new_label}, .nout_labels = 1, .s_bit = s_bit};
+    if (set_route_ifname(&route, interface) < 0) return -ENAMETOOLONG;
+    return create_mpls_route(&route);
 }
 
+// Function to create an MPLS route with IP encapsulation
+int create_mpls_encap_route_dev(const char *interface, const char *dst_ip, uint32_t mpls_label) {
+    struct mpls_route route = {.kind = MPLS_ROUTE_PUSH_DEV, .out_labels = {mpls_label}, .nout_labels = 1,
+                               .s_bit = 1};
+    if (set_route_addr(&route.dst, dst_ip) < 0) return -EINVAL;
+    if (set_route_ifname(&route, interface) < 0) return -ENAMETOOLONG;
+    return create_mpls_route(&route);
+}
+
+// Function to create an MPLS route with IP encapsulation via a gateway
+int create_mpls_encap_route_via(const char *dst_ip, uint32_t mpls_label, const char *gateway_ip) {
+    struct mpls_route route = {.kind = MPLS_ROUTE_PUSH_NEXTHOP, .out_labels = {mpls_label}, .nout_labels = 1,
+                               .s_bit = 1};
+    if (set_route_addr(&route.dst, dst_ip) < 0) return -EINVAL;
+    if (set_route_addr(&route.via, gateway_ip) < 0) return -EINVAL;
+    return create_mpls_route(&route);
+}
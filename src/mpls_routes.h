@@ -10,13 +10,299 @@
  #define MPLS_ROUTES_H
  
  #include <stdint.h>
+ #include <stddef.h>
+ #include <net/if.h>
+ #include <netinet/in.h>
+ #include <linux/netlink.h>
+ #include "mpls_core.h"
+ 
+ #pragma GCC visibility push(default)
+ 
+ #define MPLS_ROUTE_MSG_MAX 512  /**< Upper bound on the encoded size of one route request. */
+ #define MPLS_MAX_NEXTHOPS 8     /**< Legs accepted in one multipath route. */
+ #define MPLS_ROUTE_PROTOCOL RTPROT_BOOT  /**< rtm_protocol of the routes installed here; the only ones "sync" deletes. */
+ 
+ /**
+  * @brief Kinds of routes understood by the route builder.
+  */
+ enum mpls_route_kind {
+     MPLS_ROUTE_DEV,           /**< [label] dev [device_name] */
+     MPLS_ROUTE_NEXTHOP,       /**< [label] next_hop [nexthop_ip] */
+     MPLS_ROUTE_SWAP_DEV,      /**< [label] swap_as [label_2[/label_3...]] dev [device_name] */
+     MPLS_ROUTE_SWAP_NEXTHOP,  /**< [label] swap_as [label_2[/label_3...]] next_hop [nexthop_ip] */
+     MPLS_ROUTE_PUSH_DEV,      /**< [dst_ip] push [label[/label_2...]] [ttl [n]] dev [device_name] */
+     MPLS_ROUTE_PUSH_NEXTHOP,  /**< [dst_ip] push [label[/label_2...]] [ttl [n]] next_hop [nexthop_ip] */
+     MPLS_ROUTE_MULTIPATH,     /**< [label] multipath [leg] [leg] ... (RTA_MULTIPATH) */
+     MPLS_ROUTE_PUSH_NHID      /**< [dst_ip] nhid [id]: push through a kernel nexthop object (RTA_NH_ID) */
+ };
+ 
+ /**
+  * @brief What a request does with a route.
+  */
+ enum mpls_route_op {
+     MPLS_OP_ADD,      /**< RTM_NEWROUTE, NLM_F_CREATE | NLM_F_EXCL: fail if the route exists. */
+     MPLS_OP_REPLACE,  /**< RTM_NEWROUTE, NLM_F_CREATE | NLM_F_REPLACE: create or atomically replace. */
+     MPLS_OP_DELETE    /**< RTM_DELROUTE keyed by the label (or destination for push routes) only. */
+ };
+ 
+ /**
+  * @brief One leg of a multipath label route.
+  *
+  * Written as "next_hop [nexthop_ip]" or "dev [device_name]", optionally followed
+  * by "swap_as [label_2]". The kernel's MPLS multipath spreads flows evenly:
+  * it rejects any weight (rtnh_hops) or flag in a leg.
+  */
+ struct mpls_nexthop {
+     struct in_addr via;         /**< Next-hop IPv4 address, used when @c ifname is empty. */
+     char ifname[IF_NAMESIZE];   /**< Output interface name, empty for a next-hop leg. */
+     uint32_t out_label;         /**< Label to swap to on this leg. */
+     uint8_t has_out_label;      /**< Non-zero to swap, zero to pop and forward. */
+     uint16_t weight;            /**< Must be 0 or 1; build_mpls_route() rejects anything else with -EINVAL. */
+ };
+ 
+ /**
+  * @brief Parsed description of a single route, independent of any socket.
+  *
+  * Only the fields relevant to @c kind are used: @c label for label routes,
+  * @c dst and @c ttl for push routes, @c out_labels for swap and push routes,
+  * @c via for next-hop routes, @c ifname for device routes, @c nexthops for
+  * multipath routes and @c nhid for routes through a nexthop object.
+  */
+ struct mpls_route {
+     enum mpls_route_kind kind;
+     uint32_t label;             /**< Incoming MPLS label (20 bits). */
+     uint8_t auto_label;         /**< Set by "auto": @c label is still to be chosen (see mpls_labels.h). */
+     uint32_t out_labels[MPLS_MAX_LABELS]; /**< Swapped or pushed label stack, outermost first. */
+     uint8_t nout_labels;        /**< Number of entries in @c out_labels. */
+     uint8_t ttl;                /**< TTL written into pushed labels, 0 to copy it from the IP header. */
+     uint8_t s_bit;              /**< Bottom of Stack (BOS) bit of the last label (1 or 0). */
+     struct in_addr dst;         /**< Destination IPv4 address for push routes. */
+     struct in_addr via;         /**< Next-hop IPv4 address. */
+     char ifname[IF_NAMESIZE];   /**< Output interface name. */
+     uint8_t nnexthops;          /**< Number of legs of a multipath route. */
+     struct mpls_nexthop nexthops[MPLS_MAX_NEXTHOPS]; /**< Legs of a multipath route. */
+     uint32_t nhid;              /**< Nexthop object (see mpls_nhobj.h) carrying the encap of an nhid route. */
+ };
+ 
+ /**
+  * @brief Tells whether a route is an IPv4 route keyed by its destination rather than a label route.
+  * @param route Route to check.
+  * @return Non-zero for push and nhid routes.
+  */
+ int mpls_route_is_push(const struct mpls_route *route);
+ 
+ /**
+  * @brief Parses the arguments that follow "add_for" into a route description.
+  *
+  * Accepts the same grammar as the command line, e.g. "100 swap_as 200 dev eth0"
+  * or "10.0.0.1 push 16001/24005 ttl 64 next_hop 10.1.1.2" or "10.0.0.1 nhid 7". The incoming label
+  * of a label route may be "auto", which sets @c auto_label instead of @c label;
+  * such routes cannot be encoded until a label is filled in.
+  *
+  * @param argc Number of arguments.
+  * @param argv Arguments, starting with the label or destination IP.
+  * @param route Route description to fill in.
+  * @param err Set to a static description of the problem on failure.
+  * @return 0 on success, -1 on failure.
+  */
+ int parse_mpls_route(int argc, char *argv[], struct mpls_route *route, const char **err);
+ 
+ /**
+  * @brief Maps a command verb ("add_for", "replace", "del") to a route operation.
+  * @param verb Command verb.
+  * @param op Receives the operation.
+  * @return 0 on success, -1 if the verb is unknown.
+  */
+ int parse_mpls_route_op(const char *verb, enum mpls_route_op *op);
+ 
+ /**
+  * @brief Parses a bare route key, "[label]" or "[dst_ip]", as accepted by "del".
+  * @param arg Label or destination IP address.
+  * @param route Route description to fill in (only the key is set).
+  * @param err Set to a static description of the problem on failure.
+  * @return 0 on success, -1 on failure.
+  */
+ int parse_mpls_route_key(const char *arg, struct mpls_route *route, const char **err);
+ 
+ /**
+  * @brief Parses a full route command: a verb followed by a route or, for "del", a bare key.
+  *
+  * Examples: "add_for 100 dev eth0", "replace 100 swap_as 300 next_hop 10.2.2.2", "del 100".
+  *
+  * @param argc Number of arguments.
+  * @param argv Arguments, starting with the verb.
+  * @param op Receives the operation.
+  * @param route Route description to fill in.
+  * @param err Set to a static description of the problem on failure.
+  * @return 0 on success, -1 on failure.
+  */
+ int parse_mpls_command(int argc, char *argv[], enum mpls_route_op *op, struct mpls_route *route, const char **err);
+ 
+ /**
+  * @brief Splits a line into whitespace-separated arguments, in place.
+  * @param line Line to split; separators are overwritten.
+  * @param argv Receives pointers to the arguments.
+  * @param max Capacity of @p argv.
+  * @return Number of arguments, or -1 if there are more than @p max.
+  */
+ int mpls_split_route_args(char *line, char *argv[], int max);
+ 
+ /**
+  * @brief Formats a route in "add_for" syntax (without the leading "add_for").
+  * @param route Route to format.
+  * @param buf Output buffer.
+  * @param len Size of @p buf.
+  * @return Length of the text, or -1 if it did not fit.
+  */
+ int format_mpls_route(const struct mpls_route *route, char *buf, size_t len);
+ 
+ /**
+  * @brief Builds a route request into a caller-owned buffer.
+  *
+  * The sequence number and port id are left at 0 for the caller to fill in,
+  * so many requests can be packed back to back into one send buffer.
+  *
+  * @param nlh Start of the buffer that receives the message.
+  * @param maxlen Number of bytes available at @p nlh.
+  * @param route Route to encode.
+  * @param op Whether to add, replace or delete the route.
+  * @param ifcache Interface cache used to resolve device names, or NULL to use if_nametoindex().
+  * @return 0 on success, negative errno on failure (-ENODEV for an unknown interface).
+  */
+ int build_mpls_route(struct nlmsghdr *nlh, unsigned int maxlen, const struct mpls_route *route, enum mpls_route_op op,
+                      struct mpls_ifcache *ifcache);
+ 
+ /**
+  * @brief A request encoded once per route shape, patched in place for each route.
+  *
+  * Routes of the same kind, operation, stack depth, S-bit and TTL encode to
+  * the same bytes except for a few fixed-size fields. A template records the
+  * whole message plus the offsets of those fields, so bulk callers copy the
+  * message and patch the key, label stack, interface index or next hop
+  * instead of rebuilding headers and attributes. Multipath routes are not
+  * templated.
+  */
+ struct mpls_route_template {
+     int valid;                     /**< Non-zero once mpls_route_template_init() succeeded. */
+     enum mpls_route_kind kind;     /**< Shape key: route kind. */
+     enum mpls_route_op op;         /**< Shape key: operation. */
+     uint8_t nout_labels;           /**< Shape key: depth of the out-label stack. */
+     uint8_t s_bit;                 /**< Shape key: Bottom of Stack bit of the last label. */
+     uint8_t ttl;                   /**< Shape key: TTL of pushed labels. */
+     uint16_t len;                  /**< Length of the encoded request. */
+     uint16_t dst_off;              /**< Offset of the RTA_DST payload (label entry or IPv4 address). */
+     uint16_t stack_off;            /**< Offset of the RTA_NEWDST or MPLS_IPTUNNEL_DST payload, 0 if none. */
+     uint16_t oif_off;              /**< Offset of the RTA_OIF payload, 0 if none. */
+     uint16_t via_off;              /**< Offset of the RTA_VIA address or RTA_GATEWAY payload, 0 if none. */
+     uint16_t nhid_off;             /**< Offset of the RTA_NH_ID payload, 0 if none. */
+     char msg[MPLS_ROUTE_MSG_MAX];  /**< The encoded request. */
+ };
+ 
+ /**
+  * @brief Checks whether a route can be encoded from a template.
+  * @param tmpl Template.
+  * @param route Route to encode.
+  * @param op Operation.
+  * @return Non-zero if mpls_route_template_fill() applies.
+  */
+ int mpls_route_template_matches(const struct mpls_route_template *tmpl, const struct mpls_route *route,
+                                 enum mpls_route_op op);
+ 
+ /**
+  * @brief Encodes a route once and records where its variable fields are.
+  * @param tmpl Template to (re)initialize.
+  * @param route Route whose shape the template takes; it must not be multipath.
+  * @param op Operation.
+  * @param ifcache Interface cache used to resolve device names, or NULL to use if_nametoindex().
+  * @return 0 on success, negative errno if the route cannot be encoded.
+  */
+ int mpls_route_template_init(struct mpls_route_template *tmpl, const struct mpls_route *route, enum mpls_route_op op,
+                              struct mpls_ifcache *ifcache);
+ 
+ /**
+  * @brief Encodes a route by copying a matching template and patching its fields.
+  *
+  * Produces the same request as build_mpls_route().
+  *
+  * @param tmpl Template for which mpls_route_template_matches() holds.
+  * @param nlh Start of the buffer that receives the message.
+  * @param maxlen Number of bytes available at @p nlh.
+  * @param route Route to encode.
+  * @param ifcache Interface cache used to resolve device names, or NULL to use if_nametoindex().
+  * @return 0 on success, negative errno on failure (-ENODEV for an unknown interface).
+  */
+ int mpls_route_template_fill(const struct mpls_route_template *tmpl, struct nlmsghdr *nlh, unsigned int maxlen,
+                              const struct mpls_route *route, struct mpls_ifcache *ifcache);
+ 
+ /**
+  * @brief Describes an extended ACK, naming the attribute it points at.
+  *
+  * For example "Invalid label (RTA_NEWDST)" or "invalid RTA_MULTIPATH/nexthop 1/RTA_VIA".
+  *
+  * @param ack Decoded error message.
+  * @param req The request it answers, used to name the rejected attribute; may be NULL.
+  * @param buf Output buffer.
+  * @param len Size of @p buf.
+  * @return Length of the text, 0 if the kernel gave no detail.
+  */
+ int format_mpls_ack(const struct mpls_ack *ack, const struct nlmsghdr *req, char *buf, size_t len);
+ 
+ /**
+  * @brief Adds, replaces or deletes a single route over an open session.
+  *
+  * On a kernel error, @p session->err_msg is rewritten to name the rejected
+  * attribute (see format_mpls_ack()).
+  *
+  * A replace is a single kernel transaction, so re-pointing a label never
+  * leaves a window in which it is not forwarded.
+  *
+  * @param session Session opened with mpls_session_open().
+  * @param route Route to change (only the key is used for MPLS_OP_DELETE).
+  * @param op Operation to perform.
+  * @return 0 on success, negative errno on failure.
+  */
+ int session_apply_mpls_route(struct mpls_session *session, const struct mpls_route *route, enum mpls_route_op op);
+ 
+ /**
+  * @brief Installs a single route over an open session.
+  *
+  * This is the hot path for embedding: no socket is created or torn down.
+  *
+  * @param session Session opened with mpls_session_open().
+  * @param route Route to install.
+  * @return 0 on success, negative errno on failure.
+  */
+ int session_create_mpls_route(struct mpls_session *session, const struct mpls_route *route);
+ 
+ /**
+  * @brief Adds, replaces or deletes a single route using a dedicated Netlink socket.
+  * @param route Route to change.
+  * @param op Operation to perform.
+  * @return 0 on success, negative errno on failure.
+  */
+ int apply_mpls_route(const struct mpls_route *route, enum mpls_route_op op);
+ 
+ /**
+  * @brief Installs a single route using a dedicated Netlink socket.
+  * @param route Route to install.
+  * @return 0 on success, negative errno on failure.
+  */
+ int create_mpls_route(const struct mpls_route *route);
+ 
+ /**
+  * @brief Asks the kernel which interface it would use to reach an IPv4 address (RTM_GETROUTE).
+  * @param session Session opened with mpls_session_open().
+  * @param addr Address to look up.
+  * @return Interface index, or negative errno on failure (-ENETUNREACH if there is no route).
+  */
+ int mpls_session_lookup_oif(struct mpls_session *session, struct in_addr addr);
  
  /**
   * @brief Creates an MPLS route using a specific interface.
   * @param interface Name of the network interface.
   * @param label MPLS label value (20 bits).
   * @param s_bit Bottom of Stack (BOS) bit (1 or 0).
-  * @return 0 on success, -1 on failure.
+  * @return 0 on success, negative errno on failure.
   */
  int create_mpls_route_dev(const char *interface, uint32_t label, uint8_t s_bit);
  
@@ -25,7 +311,7 @@
   * @param nexthop_ip Next-hop IP address.
   * @param label MPLS label value (20 bits).
   * @param s_bit Bottom of Stack (BOS) bit (1 or 0).
-  * @return 0 on success, -1 on failure.
+  * @return 0 on success, negative errno on failure.
   */
  int create_mpls_route_nexthop(const char *nexthop_ip, uint32_t label, uint8_t s_bit);
  
@@ -35,7 +321,7 @@
   * @param label Existing MPLS label (20 bits).
   * @param new_label New MPLS label to swap to (20 bits).
   * @param s_bit Bottom of Stack (BOS) bit (1 or 0).
-  * @return 0 on success, -1 on failure.
+  * @return 0 on success, negative errno on failure.
   */
  int create_mpls_route_swap_dev(const char *interface, uint32_t label, uint32_t new_label, uint8_t s_bit);
  
@@ -45,7 +331,7 @@
   * @param label Existing MPLS label (20 bits).
   * @param new_label New MPLS label to swap to (20 bits).
   * @param s_bit Bottom of Stack (BOS) bit (1 or 0).
-  * @return 0 on success, -1 on failure.
+  * @return 0 on success, negative errno on failure.
   */
  int create_mpls_route_swap_nexthop(const char *nexthop_ip, uint32_t label, uint32_t new_label, uint8_t s_bit);
  
@@ -59,7 +345,7 @@
  * @param interface Name of the network interface to use for forwarding.
  * @param dst_ip Destination IP address for encapsulation.
  * @param mpls_label MPLS label to be pushed onto the packet.
- * @return 0 on success, -1 on failure.
+ * @return 0 on success, negative errno on failure.
  */
  int create_mpls_encap_route_dev(const char *interface, const char *dst_ip, uint32_t mpls_label);
  
@@ -73,9 +359,11 @@
  * @param dst_ip Destination IP address for encapsulation.
  * @param mpls_label MPLS label to be pushed onto the packet.
  * @param gateway_ip Gateway IP address for forwarding.
- * @return 0 on success, -1 on failure.
+ * @return 0 on success, negative errno on failure.
  */
  int create_mpls_encap_route_via(const char *dst_ip, uint32_t mpls_label, const char *gateway_ip);
  
+ #pragma GCC visibility pop
+ 
  #endif // MPLS_ROUTES_H
  
\ No newline at end of file
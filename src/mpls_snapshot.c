@@ -0,0 +1,538 @@
+// mpls_snapshot.c
+
+#include "mpls_snapshot.h"
+#include "mpls_core.h"
+#include "mpls_dump.h"
+#include "mpls_ifcache.h"
+#include "mpls_nhobj.h"
+#include "mpls_stats.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SNAPSHOT_DUMP_RETRIES 3  // Attempts when the table changes under a dump (NLM_F_DUMP_INTR)
+#define SNAPSHOT_ALIGN(off) (((off) + 7) & ~(uint64_t)7)
+
+struct snapshot_name {
+    int ifindex;      // 0 for an empty slot
+    uint32_t off;     // Offset in the string table, MPLS_SNAPSHOT_NO_NAME if the interface has no name
+};
+
+struct snapshot_writer {
+    struct mpls_ifcache *ifcache;
+    struct mpls_snapshot_stats *stats;
+    struct mpls_snapshot_route *routes;
+    size_t nroutes, routes_cap;
+    struct mpls_snapshot_nexthop *nexthops;
+    size_t nnexthops, nexthops_cap;
+    uint32_t *labels;
+    size_t nlabels, labels_cap;
+    char *strings;
+    size_t strings_len, strings_cap;
+    struct snapshot_name *names;  // Open-addressing hash of interface index -> string offset
+    size_t nnames, names_cap;
+    uint32_t *nh_ids;             // Nexthop objects that push labels, so their routes are ours
+    size_t nnh_ids;
+};
+
+struct snapshot_map {
+    const char *path;
+    void *base;
+    size_t size;
+    const struct mpls_snapshot_header *hdr;
+    const struct mpls_snapshot_route *routes;
+    const struct mpls_snapshot_nexthop *nexthops;
+    const uint32_t *labels;
+    const char *strings;
+};
+
+// Function to make room for 'need' items in a growable array; returns the array, or NULL if out of memory
+static void *snapshot_grow(void *items, size_t *cap, size_t need, size_t size) {
+    if (need <= *cap) return items;
+    size_t n = *cap ? *cap : 256;
+    while (n < need) n *= 2;
+    void *grown = realloc(items, n * size);
+    if (grown) *cap = n;
+    return grown;
+}
+
+// Function to find the hash slot of an interface index
+static struct snapshot_name *snapshot_name_slot(struct snapshot_writer *w, int ifindex) {
+    size_t mask = w->names_cap - 1;
+    size_t i = (uint32_t)ifindex * 2654435761u & mask;
+    while (w->names[i].ifindex && w->names[i].ifindex != ifindex) i = (i + 1) & mask;
+    return &w->names[i];
+}
+
+// Function to double the interface hash once it is half full
+static int snapshot_names_grow(struct snapshot_writer *w) {
+    if (w->names && (w->nnames + 1) * 2 <= w->names_cap) return 0;
+    struct snapshot_name *old = w->names;
+    size_t old_cap = w->names_cap;
+    w->names_cap = old_cap ? old_cap * 2 : 64;
+    w->names = calloc(w->names_cap, sizeof(*w->names));
+    if (!w->names) {
+        w->names = old;
+        w->names_cap = old_cap;
+        return -ENOMEM;
+    }
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i].ifindex) *snapshot_name_slot(w, old[i].ifindex) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+// Function to store an interface name once and return its offset in the string table
+static int snapshot_name(struct snapshot_writer *w, int ifindex, uint32_t *off) {
+    if (ifindex <= 0) return -ENODEV;
+    int ret = snapshot_names_grow(w);
+    if (ret < 0) return ret;
+
+    struct snapshot_name *slot = snapshot_name_slot(w, ifindex);
+    if (!slot->ifindex) {
+        // Unknown indexes are remembered too, so the cache is not refreshed once per route
+        char name[IF_NAMESIZE];
+        slot->ifindex = ifindex;
+        slot->off = MPLS_SNAPSHOT_NO_NAME;
+        w->nnames++;
+        if (mpls_ifcache_name(w->ifcache, ifindex, name)) {
+            size_t len = strlen(name) + 1;
+            char *strings = snapshot_grow(w->strings, &w->strings_cap, w->strings_len + len, 1);
+            if (!strings) return -ENOMEM;
+            w->strings = strings;
+            memcpy(w->strings + w->strings_len, name, len);
+            slot->off = w->strings_len;
+            w->strings_len += len;
+        }
+    }
+    if (slot->off == MPLS_SNAPSHOT_NO_NAME) return -ENODEV;
+    *off = slot->off;
+    return 0;
+}
+
+// Function to append an out-label stack and return the index of its first label
+static int snapshot_labels(struct snapshot_writer *w, const uint32_t *labels, int count, uint32_t *index) {
+    uint32_t *grown = snapshot_grow(w->labels, &w->labels_cap, w->nlabels + count, sizeof(*w->labels));
+    if (!grown) return -ENOMEM;
+    w->labels = grown;
+    memcpy(w->labels + w->nlabels, labels, count * sizeof(*labels));
+    *index = w->nlabels;
+    w->nlabels += count;
+    return 0;
+}
+
+// Function to append the legs of a multipath label route
+static int snapshot_multipath(struct snapshot_writer *w, const struct mpls_entry_nexthop *nhs, int nnh,
+                              struct mpls_snapshot_route *rec) {
+    struct mpls_snapshot_nexthop *grown = snapshot_grow(w->nexthops, &w->nexthops_cap, w->nnexthops + nnh,
+                                                        sizeof(*w->nexthops));
+    if (!grown) return -ENOMEM;
+    w->nexthops = grown;
+
+    int ret;
+    for (int i = 0; i < nnh; i++) {
+        // The route builder swaps to a single label per leg
+        if (nhs[i].nlabels > 1) return -EOPNOTSUPP;
+        struct mpls_snapshot_nexthop *leg = &w->nexthops[w->nnexthops + i];
+        memset(leg, 0, sizeof(*leg));
+        if (nhs[i].has_via) {
+            leg->via = nhs[i].via.s_addr;
+            leg->ifname = MPLS_SNAPSHOT_NO_NAME;
+        } else if ((ret = snapshot_name(w, nhs[i].ifindex, &leg->ifname)) < 0) {
+            return ret;
+        }
+        leg->has_out_label = nhs[i].nlabels == 1;
+        leg->out_label = nhs[i].nlabels == 1 ? nhs[i].labels[0] : 0;
+        leg->weight = nhs[i].weight > 256 ? 256 : nhs[i].weight;
+    }
+    rec->kind = MPLS_ROUTE_MULTIPATH;
+    rec->nnexthops = nnh;
+    rec->nexthops = w->nnexthops;
+    w->nnexthops += nnh;
+    return 0;
+}
+
+// Function to turn one dumped route into a snapshot record
+static int snapshot_record(struct snapshot_writer *w, const struct mpls_route_entry *entry,
+                           struct mpls_snapshot_route *rec) {
+    struct mpls_entry_nexthop nhs[MPLS_MAX_NEXTHOPS + 1];
+    int nnh = mpls_entry_nexthops(entry, nhs, MPLS_MAX_NEXTHOPS + 1);
+    int push = entry->rtm->rtm_family != AF_MPLS;
+
+    rec->ifname = MPLS_SNAPSHOT_NO_NAME;
+
+    // A route through a nexthop object is saved as the reference; the object holds its next hops
+    if (push && mpls_entry_nhid(entry)) {
+        rec->kind = MPLS_ROUTE_PUSH_NHID;
+        rec->via = mpls_entry_nhid(entry);
+        return 0;
+    }
+    if (entry->tb[RTA_MULTIPATH]) {
+        if (push || nnh < 1 || nnh > MPLS_MAX_NEXTHOPS) return -EOPNOTSUPP;
+        return snapshot_multipath(w, nhs, nnh, rec);
+    }
+
+    const struct mpls_entry_nexthop *nh = &nhs[0];
+    if (push && nh->nlabels == 0) return -EOPNOTSUPP;
+    if (nh->nlabels) {
+        int ret = snapshot_labels(w, nh->labels, nh->nlabels, &rec->labels);
+        if (ret < 0) return ret;
+        rec->nlabels = nh->nlabels;
+    }
+    rec->ttl = push ? nh->ttl : 0;
+
+    if (nh->has_via) {
+        rec->via = nh->via.s_addr;
+        rec->kind = push ? MPLS_ROUTE_PUSH_NEXTHOP : nh->nlabels ? MPLS_ROUTE_SWAP_NEXTHOP : MPLS_ROUTE_NEXTHOP;
+        return 0;
+    }
+    rec->kind = push ? MPLS_ROUTE_PUSH_DEV : nh->nlabels ? MPLS_ROUTE_SWAP_DEV : MPLS_ROUTE_DEV;
+    return snapshot_name(w, nh->ifindex, &rec->ifname);
+}
+
+// Function to append one dumped route to the snapshot
+static int snapshot_visit(const struct mpls_route_entry *entry, void *arg) {
+    struct snapshot_writer *w = (struct snapshot_writer *)arg;
+    struct mpls_snapshot_route rec = {0};
+
+    if (entry->rtm->rtm_family == AF_MPLS) {
+        if (mpls_entry_labels(entry->tb[RTA_DST], &rec.key, 1) != 1) return 0;
+    } else {
+        // Plain IPv4 routes are not ours; MPLS-encap ones we cannot re-create are counted as skipped
+        uint32_t nhid = mpls_entry_nhid(entry);
+        if (entry->rtm->rtm_table != RT_TABLE_MAIN) return 0;
+        if (nhid ? !mpls_nhobj_has_id(w->nh_ids, w->nnh_ids, nhid) : !mpls_entry_encap_labels(entry)) return 0;
+        if (!entry->tb[RTA_DST] || entry->rtm->rtm_dst_len != 32) {
+            w->stats->skipped++;
+            return 0;
+        }
+        memcpy(&rec.key, RTA_DATA(entry->tb[RTA_DST]), sizeof(rec.key));
+    }
+
+    // Stacks and legs appended for a route that turns out to be skipped are left unreferenced
+    size_t nlabels = w->nlabels, nnexthops = w->nnexthops;
+    int ret = snapshot_record(w, entry, &rec);
+    if (ret == -ENOMEM) return ret;
+    if (ret < 0) {
+        w->nlabels = nlabels;
+        w->nnexthops = nnexthops;
+        w->stats->skipped++;
+        return 0;
+    }
+
+    struct mpls_snapshot_route *routes = snapshot_grow(w->routes, &w->routes_cap, w->nroutes + 1, sizeof(*w->routes));
+    if (!routes) return -ENOMEM;
+    w->routes = routes;
+    w->routes[w->nroutes++] = rec;
+    w->stats->routes++;
+    return 0;
+}
+
+// Function to dump both tables into the writer, retrying if a dump was interrupted
+static int snapshot_dump(struct snapshot_writer *w, struct mpls_session *session) {
+    int ret = 0;
+    for (int attempt = 0; attempt < SNAPSHOT_DUMP_RETRIES; attempt++) {
+        if (attempt) MPLS_STAT_ADD(MPLS_STAT_DUMP_RETRIES, 1);
+        // Interface names already stored stay valid, so only the records start over
+        w->nroutes = w->nnexthops = w->nlabels = 0;
+        memset(w->stats, 0, sizeof(*w->stats));
+
+        free(w->nh_ids);
+        w->nh_ids = NULL;
+        ret = mpls_nhobj_ids(session, &w->nh_ids, &w->nnh_ids);
+        if (ret < 0) return ret;
+        ret = mpls_dump_routes(session, AF_MPLS, snapshot_visit, w);
+        if (ret == 0) ret = mpls_dump_routes(session, AF_INET, snapshot_visit, w);
+        if (ret != -EINTR) return ret;
+    }
+    return ret;
+}
+
+// Function to write a section at its offset, zero-padding up to it
+static int snapshot_write_section(FILE *out, uint64_t *pos, uint64_t off, const void *data, size_t len) {
+    static const char zeros[8];
+    if (off - *pos > sizeof(zeros) || fwrite(zeros, 1, off - *pos, out) != off - *pos) return -EIO;
+    if (len && fwrite(data, 1, len, out) != len) return -EIO;
+    *pos = off + len;
+    return 0;
+}
+
+// Function to write the collected sections behind a header
+static int snapshot_write(const struct snapshot_writer *w, FILE *out) {
+    struct mpls_snapshot_header hdr = {
+        .version = MPLS_SNAPSHOT_VERSION,
+        .byte_order = MPLS_SNAPSHOT_BYTE_ORDER,
+        .header_size = sizeof(struct mpls_snapshot_header),
+        .route_size = sizeof(struct mpls_snapshot_route),
+        .nexthop_size = sizeof(struct mpls_snapshot_nexthop),
+        .nroutes = w->nroutes,
+        .nnexthops = w->nnexthops,
+        .nlabels = w->nlabels,
+        .strings_len = w->strings_len,
+    };
+    memcpy(hdr.magic, MPLS_SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.routes_off = SNAPSHOT_ALIGN(sizeof(hdr));
+    hdr.nexthops_off = SNAPSHOT_ALIGN(hdr.routes_off + w->nroutes * sizeof(*w->routes));
+    hdr.labels_off = SNAPSHOT_ALIGN(hdr.nexthops_off + w->nnexthops * sizeof(*w->nexthops));
+    hdr.strings_off = SNAPSHOT_ALIGN(hdr.labels_off + w->nlabels * sizeof(*w->labels));
+
+    uint64_t pos = 0;
+    int ret = snapshot_write_section(out, &pos, 0, &hdr, sizeof(hdr));
+    if (ret == 0) ret = snapshot_write_section(out, &pos, hdr.routes_off, w->routes, w->nroutes * sizeof(*w->routes));
+    if (ret == 0) {
+        ret = snapshot_write_section(out, &pos, hdr.nexthops_off, w->nexthops, w->nnexthops * sizeof(*w->nexthops));
+    }
+    if (ret == 0) ret = snapshot_write_section(out, &pos, hdr.labels_off, w->labels, w->nlabels * sizeof(*w->labels));
+    if (ret == 0) ret = snapshot_write_section(out, &pos, hdr.strings_off, w->strings, w->strings_len);
+    return ret;
+}
+
+// Function to dump the MPLS routes into a snapshot file
+int mpls_snapshot_save(struct mpls_session *session, const char *path, struct mpls_snapshot_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    struct snapshot_writer w = {.ifcache = session->ifcache, .stats = stats};
+
+    int ret = snapshot_dump(&w, session);
+    if (ret == 0 && (w.nroutes > UINT32_MAX || w.nlabels > UINT32_MAX || w.strings_len > UINT32_MAX)) ret = -EFBIG;
+
+    // Write beside the target and rename, so a crash never leaves a truncated snapshot behind
+    char tmp[PATH_MAX + 8];
+    if (ret == 0 && (size_t)snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp)) ret = -ENAMETOOLONG;
+    if (ret == 0) {
+        FILE *out = fopen(tmp, "wb");
+        if (!out) {
+            ret = -errno;
+        } else {
+            ret = snapshot_write(&w, out);
+            if (ret == 0 && (fflush(out) != 0 || fsync(fileno(out)) != 0)) ret = -errno;
+            if (fclose(out) != 0 && ret == 0) ret = -errno;
+            if (ret == 0 && rename(tmp, path) != 0) ret = -errno;
+            if (ret < 0) unlink(tmp);
+        }
+    }
+
+    free(w.routes);
+    free(w.nexthops);
+    free(w.labels);
+    free(w.strings);
+    free(w.names);
+    free(w.nh_ids);
+    return ret;
+}
+
+// Function to check that a section of 'count' records of 'size' bytes lies inside the file
+static int snapshot_section_ok(const struct snapshot_map *map, uint64_t off, uint64_t count, uint64_t size) {
+    return off % 8 == 0 && off <= map->size && count * size <= map->size - off;
+}
+
+// Function to check the header and locate the sections of a mapped snapshot
+static const char *snapshot_check(struct snapshot_map *map) {
+    const struct mpls_snapshot_header *hdr = map->base;
+    if (map->size < sizeof(*hdr) || memcmp(hdr->magic, MPLS_SNAPSHOT_MAGIC, sizeof(hdr->magic)) != 0) {
+        return "not an MPLS snapshot";
+    }
+    if (hdr->byte_order != MPLS_SNAPSHOT_BYTE_ORDER) return "saved on a host of the other byte order";
+    if (hdr->version != MPLS_SNAPSHOT_VERSION) return "unsupported snapshot version";
+    if (hdr->header_size != sizeof(*hdr) || hdr->route_size != sizeof(struct mpls_snapshot_route) ||
+        hdr->nexthop_size != sizeof(struct mpls_snapshot_nexthop)) {
+        return "unexpected record size";
+    }
+    if (!snapshot_section_ok(map, hdr->routes_off, hdr->nroutes, hdr->route_size) ||
+        !snapshot_section_ok(map, hdr->nexthops_off, hdr->nnexthops, hdr->nexthop_size) ||
+        !snapshot_section_ok(map, hdr->labels_off, hdr->nlabels, sizeof(uint32_t)) ||
+        !snapshot_section_ok(map, hdr->strings_off, hdr->strings_len, 1)) {
+        return "truncated snapshot";
+    }
+
+    map->hdr = hdr;
+    map->routes = (const void *)((const char *)map->base + hdr->routes_off);
+    map->nexthops = (const void *)((const char *)map->base + hdr->nexthops_off);
+    map->labels = (const void *)((const char *)map->base + hdr->labels_off);
+    map->strings = (const char *)map->base + hdr->strings_off;
+    if (hdr->strings_len && map->strings[hdr->strings_len - 1] != '\0') return "unterminated string table";
+    return NULL;
+}
+
+// Function to map a snapshot file read-only and check its header
+static int snapshot_map_open(struct snapshot_map *map, const char *path) {
+    memset(map, 0, sizeof(*map));
+    map->path = path;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -errno;
+
+    struct stat st;
+    int ret = 0;
+    if (fstat(fd, &st) != 0) {
+        ret = -errno;
+    } else if ((size_t)st.st_size < sizeof(struct mpls_snapshot_header)) {
+        fprintf(stderr, "%s: not an MPLS snapshot\n", path);
+        ret = -EINVAL;
+    } else {
+        map->size = st.st_size;
+        map->base = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map->base == MAP_FAILED) {
+            map->base = NULL;
+            ret = -errno;
+        }
+    }
+    close(fd);
+    if (ret < 0) return ret;
+
+    // Records are read once, front to back
+    madvise(map->base, map->size, MADV_SEQUENTIAL);
+    const char *err = snapshot_check(map);
+    if (err) {
+        fprintf(stderr, "%s: %s\n", path, err);
+        munmap(map->base, map->size);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+// Function to copy an interface name out of the string table
+static int snapshot_copy_name(const struct snapshot_map *map, uint32_t off, char *ifname) {
+    if (off >= map->hdr->strings_len) return -1;
+    size_t len = strnlen(map->strings + off, IF_NAMESIZE);
+    if (len == 0 || len == IF_NAMESIZE) return -1;
+    memcpy(ifname, map->strings + off, len + 1);
+    return 0;
+}
+
+// Function to turn a snapshot record back into a route description
+static int snapshot_decode(const struct snapshot_map *map, size_t index, struct mpls_route *route, const char **err) {
+    const struct mpls_snapshot_route *rec = &map->routes[index];
+    memset(route, 0, sizeof(*route));
+    route->kind = rec->kind;
+    route->s_bit = 1;
+
+    int push = mpls_route_is_push(route);
+    int swap = rec->kind == MPLS_ROUTE_SWAP_DEV || rec->kind == MPLS_ROUTE_SWAP_NEXTHOP;
+    if (rec->kind > MPLS_ROUTE_PUSH_NHID) {
+        *err = "unknown route kind";
+        return -1;
+    }
+    if (push) {
+        route->dst.s_addr = rec->key;
+        route->ttl = rec->ttl;
+    } else if (rec->key > 0xFFFFF) {
+        *err = "label out of range";
+        return -1;
+    } else {
+        route->label = rec->key;
+    }
+
+    if (rec->kind == MPLS_ROUTE_PUSH_NHID) {
+        if (rec->via == 0) {
+            *err = "bad nexthop id";
+            return -1;
+        }
+        route->nhid = rec->via;
+        return 0;
+    }
+
+    if (push || swap) {
+        if (rec->nlabels < 1 || rec->nlabels > MPLS_MAX_LABELS || rec->nlabels > map->hdr->nlabels ||
+            rec->labels > map->hdr->nlabels - rec->nlabels) {
+            *err = "bad label stack";
+            return -1;
+        }
+        memcpy(route->out_labels, map->labels + rec->labels, rec->nlabels * sizeof(uint32_t));
+        route->nout_labels = rec->nlabels;
+    }
+
+    switch (rec->kind) {
+        case MPLS_ROUTE_NEXTHOP:
+        case MPLS_ROUTE_SWAP_NEXTHOP:
+        case MPLS_ROUTE_PUSH_NEXTHOP:
+            route->via.s_addr = rec->via;
+            return 0;
+        case MPLS_ROUTE_MULTIPATH:
+            break;
+        default:
+            if (snapshot_copy_name(map, rec->ifname, route->ifname) < 0) {
+                *err = "bad interface name";
+                return -1;
+            }
+            return 0;
+    }
+
+    if (rec->nnexthops < 1 || rec->nnexthops > MPLS_MAX_NEXTHOPS || rec->nexthops > map->hdr->nnexthops ||
+        rec->nnexthops > map->hdr->nnexthops - rec->nexthops) {
+        *err = "bad nexthop count";
+        return -1;
+    }
+    route->nnexthops = rec->nnexthops;
+    for (int i = 0; i < rec->nnexthops; i++) {
+        const struct mpls_snapshot_nexthop *leg = &map->nexthops[rec->nexthops + i];
+        struct mpls_nexthop *nh = &route->nexthops[i];
+        if (leg->ifname == MPLS_SNAPSHOT_NO_NAME) {
+            nh->via.s_addr = leg->via;
+        } else if (snapshot_copy_name(map, leg->ifname, nh->ifname) < 0) {
+            *err = "bad interface name";
+            return -1;
+        }
+        if (leg->out_label > 0xFFFFF || leg->weight > 256) {
+            *err = "bad nexthop";
+            return -1;
+        }
+        nh->out_label = leg->out_label;
+        nh->has_out_label = leg->has_out_label != 0;
+        nh->weight = leg->weight;
+    }
+    return 0;
+}
+
+// Function to report a route that could not be restored
+static void snapshot_result(unsigned long tag, int error, const char *detail, void *arg) {
+    const struct snapshot_map *map = (const struct snapshot_map *)arg;
+    if (!error) return;
+
+    struct mpls_route route;
+    const char *err = NULL;
+    if (snapshot_decode(map, tag, &route, &err) < 0) {
+        fprintf(stderr, "%s: record %lu: %s\n", map->path, tag, err);
+        return;
+    }
+
+    char key[INET_ADDRSTRLEN];
+    if (mpls_route_is_push(&route)) {
+        inet_ntop(AF_INET, &route.dst, key, sizeof(key));
+    } else {
+        snprintf(key, sizeof(key), "label %u", route.label);
+    }
+    fprintf(stderr, "%s: %s: %s%s%s\n", map->path, key,
+            error == -ENODEV && !detail ? "no such interface" : strerror(-error), detail ? ": " : "",
+            detail ? detail : "");
+}
+
+// Function to install every route of a snapshot file
+int mpls_snapshot_restore(struct mpls_session *session, const char *path, struct mpls_batch_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    struct snapshot_map map;
+    int ret = snapshot_map_open(&map, path);
+    if (ret < 0) return ret;
+
+    struct mpls_batch *batch = mpls_batch_open(session, snapshot_result, &map);
+    if (!batch) {
+        munmap(map.base, map.size);
+        return -ENOMEM;
+    }
+
+    // Replace rather than add, so restoring over routes that are already there is not an error
+    for (size_t n = 0; n < map.hdr->nroutes; n++) {
+        struct mpls_route route;
+        const char *err;
+        if (snapshot_decode(&map, n, &route, &err) < 0) {
+            mpls_batch_reject(batch, n, -EINVAL);
+        } else {
+            mpls_batch_queue(batch, &route, MPLS_OP_REPLACE, n);
+        }
+    }
+
+    ret = mpls_batch_finish(batch, stats);
+    munmap(map.base, map.size);
+    return ret;
+}
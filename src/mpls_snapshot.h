@@ -0,0 +1,120 @@
+/**
+ * @file mpls_snapshot.h
+ * @brief Binary snapshot of the MPLS routes, for saving a table and restoring it quickly.
+ *
+ * A snapshot holds the LFIB and the /32 MPLS-encap IPv4 routes of the main
+ * table in a versioned, mmap-able file. The file is a header followed by four
+ * 8-byte aligned sections:
+ *   - routes:   fixed-size struct mpls_snapshot_route records;
+ *   - nexthops: struct mpls_snapshot_nexthop legs of multipath routes;
+ *   - labels:   uint32_t out-label values, referenced by index;
+ *   - strings:  NUL-terminated interface names, each stored once.
+ * Restoring maps the file and turns each record straight into a route
+ * request, with no text parsing. Integers are in the byte order of the host
+ * that saved the file; addresses are in network byte order. Routes through a
+ * kernel nexthop object are saved as the object id only: the objects are not
+ * part of the snapshot and must exist again before such routes are restored.
+ */
+
+ #ifndef MPLS_SNAPSHOT_H
+ #define MPLS_SNAPSHOT_H
+ 
+ #include <stdint.h>
+ #include "mpls_batch.h"
+ 
+ #pragma GCC visibility push(default)
+ 
+ struct mpls_session;
+ 
+ #define MPLS_SNAPSHOT_MAGIC "MPLSSNAP"   /**< First 8 bytes of every snapshot. */
+ #define MPLS_SNAPSHOT_VERSION 1          /**< Format version written by this build. */
+ #define MPLS_SNAPSHOT_BYTE_ORDER 0x01020304u /**< Reads back differently on a host of the other endianness. */
+ #define MPLS_SNAPSHOT_NO_NAME UINT32_MAX /**< String offset meaning "no interface". */
+ 
+ /**
+  * @brief File header; section offsets are from the start of the file.
+  */
+ struct mpls_snapshot_header {
+     char magic[8];            /**< MPLS_SNAPSHOT_MAGIC, not NUL-terminated. */
+     uint32_t version;         /**< MPLS_SNAPSHOT_VERSION. */
+     uint32_t byte_order;      /**< MPLS_SNAPSHOT_BYTE_ORDER. */
+     uint32_t header_size;     /**< sizeof(struct mpls_snapshot_header). */
+     uint32_t route_size;      /**< sizeof(struct mpls_snapshot_route). */
+     uint32_t nexthop_size;    /**< sizeof(struct mpls_snapshot_nexthop). */
+     uint32_t nroutes;         /**< Records in the routes section. */
+     uint32_t nnexthops;       /**< Records in the nexthops section. */
+     uint32_t nlabels;         /**< Entries in the labels section. */
+     uint32_t strings_len;     /**< Bytes in the strings section. */
+     uint32_t reserved;        /**< Zero. */
+     uint64_t routes_off;      /**< Offset of the routes section. */
+     uint64_t nexthops_off;    /**< Offset of the nexthops section. */
+     uint64_t labels_off;      /**< Offset of the labels section. */
+     uint64_t strings_off;     /**< Offset of the strings section. */
+ };
+ 
+ /**
+  * @brief One route, in the terms of struct mpls_route.
+  */
+ struct mpls_snapshot_route {
+     uint8_t kind;             /**< enum mpls_route_kind. */
+     uint8_t nlabels;          /**< Out labels of swap and push routes. */
+     uint8_t ttl;              /**< TTL of pushed labels, 0 to copy it from the IP header. */
+     uint8_t nnexthops;        /**< Legs of a multipath route, 0 otherwise. */
+     uint32_t key;             /**< Incoming label, or destination of a push route. */
+     uint32_t via;             /**< IPv4 next hop of next-hop routes, object id of nhid routes, 0 otherwise. */
+     uint32_t ifname;          /**< Output interface of dev routes, or MPLS_SNAPSHOT_NO_NAME. */
+     uint32_t labels;          /**< Index of the first out label in the labels section. */
+     uint32_t nexthops;        /**< Index of the first leg in the nexthops section. */
+ };
+ 
+ /**
+  * @brief One leg of a multipath route.
+  */
+ struct mpls_snapshot_nexthop {
+     uint32_t via;             /**< IPv4 next hop, 0 for a dev leg. */
+     uint32_t ifname;          /**< Output interface of a dev leg, or MPLS_SNAPSHOT_NO_NAME. */
+     uint32_t out_label;       /**< Label swapped to on this leg. */
+     uint16_t weight;          /**< Relative weight 1-256. */
+     uint8_t has_out_label;    /**< Non-zero to swap, zero to pop. */
+     uint8_t reserved;         /**< Zero. */
+ };
+ 
+ /**
+  * @brief Outcome counters of mpls_snapshot_save().
+  */
+ struct mpls_snapshot_stats {
+     unsigned long routes;     /**< Routes written. */
+     unsigned long skipped;    /**< MPLS routes the route builder could not re-create (e.g. a non-/32 prefix). */
+ };
+ 
+ /**
+  * @brief Dumps the MPLS routes and writes them to a snapshot file.
+  *
+  * The file is written under a temporary name, synced and renamed into place,
+  * so an existing snapshot is only replaced by a complete one.
+  *
+  * @param session Session to dump on; its interface cache names the interfaces.
+  * @param path File to write.
+  * @param stats Filled with the outcome counters.
+  * @return 0 on success, negative errno on failure.
+  */
+ int mpls_snapshot_save(struct mpls_session *session, const char *path, struct mpls_snapshot_stats *stats);
+ 
+ /**
+  * @brief Maps a snapshot file and installs its routes through one pipelined batch.
+  *
+  * Routes are sent with NLM_F_REPLACE, so restoring over a partly populated
+  * table converges on the snapshot. Failed routes, and the reason a file is
+  * rejected as malformed, are reported on stderr.
+  *
+  * @param session Session the requests are sent on.
+  * @param path Snapshot file.
+  * @param stats Filled with the outcome counters.
+  * @return 0 if every route was installed, -1 if some failed, negative errno
+  *         (e.g. -EINVAL for a malformed file) if nothing could be restored.
+  */
+ int mpls_snapshot_restore(struct mpls_session *session, const char *path, struct mpls_batch_stats *stats);
+ 
+ #pragma GCC visibility pop
+ 
+ #endif // MPLS_SNAPSHOT_H
@@ -0,0 +1,234 @@
+// mpls_stats.c
+
+#include "mpls_stats.h"
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STATS_ERRNO_MAX 256         // Errnos at or above this share the last slot
+#define STATS_BUCKETS 65            // One bucket per bit length of the sample
+#define STATS_LE_FIRST 10           // Smallest reported bound: 2^10 ns (about 1 us)
+#define STATS_LE_LAST 34            // Largest reported bound: 2^34 ns (about 17 s)
+
+int mpls_stats_enabled;
+
+struct stats_hist {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t buckets[STATS_BUCKETS];  // buckets[b] counts samples with bit length b
+};
+
+static uint64_t stats_counters[MPLS_STAT_COUNTERS];
+static uint64_t stats_errnos[STATS_ERRNO_MAX];
+static struct stats_hist stats_hists[MPLS_STAT_HISTS];
+static int stats_prometheus;
+static char stats_path[PATH_MAX];   // Empty for stderr
+static pthread_mutex_t stats_report_lock = PTHREAD_MUTEX_INITIALIZER;  // SIGUSR1 and exit may report at once
+
+static const char *const stats_counter_names[MPLS_STAT_COUNTERS] = {
+    [MPLS_STAT_SEND_CALLS] = "sendmsg_calls",
+    [MPLS_STAT_SEND_BYTES] = "send_bytes",
+    [MPLS_STAT_SEND_MESSAGES] = "send_messages",
+    [MPLS_STAT_RECV_CALLS] = "recv_calls",
+    [MPLS_STAT_RECV_BYTES] = "recv_bytes",
+    [MPLS_STAT_RECV_MESSAGES] = "recv_messages",
+    [MPLS_STAT_ACKS] = "acks",
+    [MPLS_STAT_NACKS] = "nacks",
+    [MPLS_STAT_ENOBUFS] = "enobufs",
+    [MPLS_STAT_ROUTES_BUILT] = "routes_built",
+    [MPLS_STAT_BUILD_ERRORS] = "build_errors",
+    [MPLS_STAT_IFINDEX_LOOKUPS] = "ifindex_lookups",
+    [MPLS_STAT_IFINDEX_MISSES] = "ifindex_misses",
+    [MPLS_STAT_IFCACHE_DUMPS] = "ifcache_dumps",
+    [MPLS_STAT_DUMP_RETRIES] = "dump_retries",
+    [MPLS_STAT_RETRANSMITS] = "retransmits",
+    [MPLS_STAT_RECONCILED] = "reconciled",
+};
+
+static const char *const stats_hist_names[MPLS_STAT_HISTS] = {
+    [MPLS_HIST_BUILD] = "build",
+    [MPLS_HIST_SEND] = "sendmsg",
+    [MPLS_HIST_ACK_WAIT] = "ack_wait",
+    [MPLS_HIST_IFINDEX] = "ifindex",
+};
+
+// Function to read the monotonic clock
+uint64_t mpls_stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Function to add to a counter
+void mpls_stats_add(enum mpls_stat_counter counter, uint64_t n) {
+    __atomic_fetch_add(&stats_counters[counter], n, __ATOMIC_RELAXED);
+}
+
+// Function to count a failure by errno
+void mpls_stats_errno(int err) {
+    if (err < 0) err = -err;
+    if (err >= STATS_ERRNO_MAX) err = STATS_ERRNO_MAX - 1;
+    __atomic_fetch_add(&stats_errnos[err], 1, __ATOMIC_RELAXED);
+}
+
+// Function to record one latency sample
+void mpls_stats_observe(enum mpls_stat_hist hist, uint64_t ns) {
+    struct stats_hist *h = &stats_hists[hist];
+    int bits = ns ? 64 - __builtin_clzll(ns) : 0;
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->buckets[bits], 1, __ATOMIC_RELAXED);
+}
+
+// Function to read a counter that other threads may be updating
+static uint64_t stats_load(const uint64_t *v) {
+    return __atomic_load_n(v, __ATOMIC_RELAXED);
+}
+
+// Function to write the report as one JSON object
+static void stats_write_json(FILE *out) {
+    fprintf(out, "{\"counters\":{");
+    for (int i = 0; i < MPLS_STAT_COUNTERS; i++) {
+        fprintf(out, "%s\"%s\":%llu", i ? "," : "", stats_counter_names[i],
+                (unsigned long long)stats_load(&stats_counters[i]));
+    }
+
+    fprintf(out, "},\"errors\":{");
+    int first = 1;
+    for (int i = 1; i < STATS_ERRNO_MAX; i++) {
+        uint64_t n = stats_load(&stats_errnos[i]);
+        if (!n) continue;
+        fprintf(out, "%s\"%d\":%llu", first ? "" : ",", i, (unsigned long long)n);
+        first = 0;
+    }
+
+    fprintf(out, "},\"histograms\":{");
+    for (int i = 0; i < MPLS_STAT_HISTS; i++) {
+        const struct stats_hist *h = &stats_hists[i];
+        fprintf(out, "%s\"%s\":{\"count\":%llu,\"sum_ns\":%llu,\"buckets\":[", i ? "," : "", stats_hist_names[i],
+                (unsigned long long)stats_load(&h->count), (unsigned long long)stats_load(&h->sum_ns));
+        first = 1;
+        for (int b = 0; b < STATS_BUCKETS; b++) {
+            uint64_t n = stats_load(&h->buckets[b]);
+            if (!n) continue;
+            // A sample with bit length b is below 2^b ns
+            fprintf(out, "%s{\"le_ns\":%llu,\"count\":%llu}", first ? "" : ",",
+                    b < 64 ? (unsigned long long)1 << b : ULLONG_MAX, (unsigned long long)n);
+            first = 0;
+        }
+        fprintf(out, "]}");
+    }
+    fprintf(out, "}}\n");
+}
+
+// Function to write the report in the Prometheus text format
+static void stats_write_prometheus(FILE *out) {
+    for (int i = 0; i < MPLS_STAT_COUNTERS; i++) {
+        fprintf(out, "# TYPE mpls_%s_total counter\nmpls_%s_total %llu\n", stats_counter_names[i],
+                stats_counter_names[i], (unsigned long long)stats_load(&stats_counters[i]));
+    }
+
+    fprintf(out, "# TYPE mpls_errors_total counter\n");
+    for (int i = 1; i < STATS_ERRNO_MAX; i++) {
+        uint64_t n = stats_load(&stats_errnos[i]);
+        if (n) fprintf(out, "mpls_errors_total{errno=\"%d\"} %llu\n", i, (unsigned long long)n);
+    }
+
+    // Fixed bounds, so every report has the same series
+    for (int i = 0; i < MPLS_STAT_HISTS; i++) {
+        const struct stats_hist *h = &stats_hists[i];
+        const char *name = stats_hist_names[i];
+        fprintf(out, "# TYPE mpls_%s_seconds histogram\n", name);
+        uint64_t cumulative = 0;
+        int b = 0;
+        for (int le = STATS_LE_FIRST; le <= STATS_LE_LAST; le++) {
+            for (; b <= le; b++) cumulative += stats_load(&h->buckets[b]);
+            fprintf(out, "mpls_%s_seconds_bucket{le=\"%g\"} %llu\n", name, (double)(1ull << le) / 1e9,
+                    (unsigned long long)cumulative);
+        }
+        uint64_t count = stats_load(&h->count);
+        fprintf(out, "mpls_%s_seconds_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)count);
+        fprintf(out, "mpls_%s_seconds_sum %.9f\n", name, stats_load(&h->sum_ns) / 1e9);
+        fprintf(out, "mpls_%s_seconds_count %llu\n", name, (unsigned long long)count);
+    }
+}
+
+// Function to write the current counters and histograms
+void mpls_stats_write(FILE *out, int prometheus) {
+    if (prometheus) {
+        stats_write_prometheus(out);
+    } else {
+        stats_write_json(out);
+    }
+}
+
+// Function to write the report where MPLS_STATS asked for it
+static void stats_report(void) {
+    pthread_mutex_lock(&stats_report_lock);
+    if (!stats_path[0]) {
+        mpls_stats_write(stderr, stats_prometheus);
+        pthread_mutex_unlock(&stats_report_lock);
+        return;
+    }
+
+    // Collectors may read the file at any time, so replace it in one step
+    char tmp[PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", stats_path);
+    FILE *out = fopen(tmp, "w");
+    if (!out) {
+        perror(tmp);
+    } else {
+        mpls_stats_write(out, stats_prometheus);
+        if (fclose(out) != 0 || rename(tmp, stats_path) != 0) {
+            perror(stats_path);
+            unlink(tmp);
+        }
+    }
+    pthread_mutex_unlock(&stats_report_lock);
+}
+
+// Function to write a report every time SIGUSR1 arrives
+static void *stats_signal_thread(void *arg) {
+    sigset_t *set = (sigset_t *)arg;
+    for (;;) {
+        int sig;
+        if (sigwait(set, &sig) == 0) stats_report();
+    }
+    return NULL;
+}
+
+// Function to turn instrumentation on according to MPLS_STATS
+int mpls_stats_init(void) {
+    const char *spec = getenv("MPLS_STATS");
+    if (!spec || !spec[0]) return 0;
+
+    size_t len = strcspn(spec, ":");
+    if (len == 4 && strncmp(spec, "json", len) == 0) {
+        stats_prometheus = 0;
+    } else if (len == 10 && strncmp(spec, "prometheus", len) == 0) {
+        stats_prometheus = 1;
+    } else {
+        return -EINVAL;
+    }
+    if (spec[len] == ':') {
+        if (strlen(spec + len + 1) >= sizeof(stats_path)) return -EINVAL;
+        strcpy(stats_path, spec + len + 1);
+    }
+
+    // Blocked before any other thread exists, so only the reporting thread receives it
+    static sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, stats_signal_thread, &set) == 0) pthread_detach(thread);
+
+    atexit(stats_report);
+    mpls_stats_enabled = 1;
+    return 0;
+}
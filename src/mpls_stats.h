@@ -0,0 +1,116 @@
+/**
+ * @file mpls_stats.h
+ * @brief Built-in counters and latency histograms for the Netlink hot path.
+ *
+ * Instrumentation is off unless the MPLS_STATS environment variable is set
+ * when mpls_stats_init() runs. While off, every probe costs one load and one
+ * predictable branch. While on, counters are updated with relaxed atomics, so
+ * namespace workers can share them.
+ *
+ * MPLS_STATS takes the form "json[:path]" or "prometheus[:path]". The report
+ * is written at exit and on SIGUSR1, to @c path (replaced atomically via a
+ * temporary file) or to stderr if no path is given.
+ */
+
+ #ifndef MPLS_STATS_H
+ #define MPLS_STATS_H
+ 
+ #include <stdint.h>
+ #include <stdio.h>
+ 
+ #pragma GCC visibility push(default)
+ 
+ /**
+  * @brief Event counters.
+  */
+ enum mpls_stat_counter {
+     MPLS_STAT_SEND_CALLS,        /**< sendmsg() calls. */
+     MPLS_STAT_SEND_BYTES,        /**< Bytes passed to sendmsg(). */
+     MPLS_STAT_SEND_MESSAGES,     /**< Requests sent (several may share one sendmsg()). */
+     MPLS_STAT_RECV_CALLS,        /**< recv()/recvmmsg() calls that returned data. */
+     MPLS_STAT_RECV_BYTES,        /**< Bytes received. */
+     MPLS_STAT_RECV_MESSAGES,     /**< Datagrams received. */
+     MPLS_STAT_ACKS,              /**< Positive ACKs. */
+     MPLS_STAT_NACKS,             /**< Error ACKs (see the per-errno breakdown). */
+     MPLS_STAT_ENOBUFS,           /**< Receive overruns reported by the kernel. */
+     MPLS_STAT_ROUTES_BUILT,      /**< Route requests encoded. */
+     MPLS_STAT_BUILD_ERRORS,      /**< Route requests that could not be encoded. */
+     MPLS_STAT_IFINDEX_LOOKUPS,   /**< Interface name lookups. */
+     MPLS_STAT_IFINDEX_MISSES,    /**< Lookups that found no interface. */
+     MPLS_STAT_IFCACHE_DUMPS,     /**< RTM_GETLINK dumps taken by the interface cache. */
+     MPLS_STAT_DUMP_RETRIES,      /**< Dumps repeated because they were interrupted or lost data. */
+     MPLS_STAT_RETRANSMITS,       /**< Requests sent again because their ACK or their send was lost. */
+     MPLS_STAT_RECONCILED,        /**< Requests that lost their ACK, settled by finding their effect in a dump. */
+     MPLS_STAT_COUNTERS
+ };
+ 
+ /**
+  * @brief Latency histograms (nanoseconds, power-of-two buckets).
+  */
+ enum mpls_stat_hist {
+     MPLS_HIST_BUILD,     /**< Encoding one route request. */
+     MPLS_HIST_SEND,      /**< One sendmsg() call. */
+     MPLS_HIST_ACK_WAIT,  /**< Blocking in recv() for ACKs. */
+     MPLS_HIST_IFINDEX,   /**< Resolving one interface name. */
+     MPLS_STAT_HISTS
+ };
+ 
+ extern int mpls_stats_enabled; /**< Non-zero when instrumentation is on. */
+ 
+ /** @brief Adds @p n to a counter when instrumentation is on. */
+ #define MPLS_STAT_ADD(counter, n) \
+     do { if (__builtin_expect(mpls_stats_enabled, 0)) mpls_stats_add((counter), (n)); } while (0)
+ 
+ /** @brief Counts a failure by its (positive or negative) errno when instrumentation is on. */
+ #define MPLS_STAT_ERRNO(err) \
+     do { if (__builtin_expect(mpls_stats_enabled, 0)) mpls_stats_errno(err); } while (0)
+ 
+ /** @brief Counts an ACK: positive if @p error is 0, otherwise a NACK counted by errno. */
+ #define MPLS_STAT_ACK(error) \
+     do { \
+         if (__builtin_expect(mpls_stats_enabled, 0)) { \
+             mpls_stats_add((error) ? MPLS_STAT_NACKS : MPLS_STAT_ACKS, 1); \
+             if (error) mpls_stats_errno(error); \
+         } \
+     } while (0)
+ 
+ /** @brief Declares @p var and stores the start time in it when instrumentation is on. */
+ #define MPLS_STAT_TIME_START(var) \
+     uint64_t var = __builtin_expect(mpls_stats_enabled, 0) ? mpls_stats_now() : 0
+ 
+ /** @brief Records the time elapsed since MPLS_STAT_TIME_START(@p var). */
+ #define MPLS_STAT_TIME_END(hist, var) \
+     do { if (__builtin_expect((var) != 0, 0)) mpls_stats_observe((hist), mpls_stats_now() - (var)); } while (0)
+ 
+ /**
+  * @brief Turns instrumentation on if MPLS_STATS is set, and arranges the reports.
+  *
+  * Call it at the start of main(), before any thread is created: it blocks
+  * SIGUSR1 and starts a thread that writes a report each time the signal arrives.
+  *
+  * @return 0 on success (including when MPLS_STATS is unset), -EINVAL if it is malformed.
+  */
+ int mpls_stats_init(void);
+ 
+ /**
+  * @brief Writes the current counters and histograms.
+  * @param out Output stream.
+  * @param prometheus Non-zero for the Prometheus text format, zero for JSON.
+  */
+ void mpls_stats_write(FILE *out, int prometheus);
+ 
+ /** @brief Adds @p n to a counter (use MPLS_STAT_ADD()). */
+ void mpls_stats_add(enum mpls_stat_counter counter, uint64_t n);
+ 
+ /** @brief Counts a failure by errno (use MPLS_STAT_ERRNO()). */
+ void mpls_stats_errno(int err);
+ 
+ /** @brief Records one latency sample in nanoseconds (use MPLS_STAT_TIME_END()). */
+ void mpls_stats_observe(enum mpls_stat_hist hist, uint64_t ns);
+ 
+ /** @brief Reads the monotonic clock in nanoseconds. */
+ uint64_t mpls_stats_now(void);
+ 
+ #pragma GCC visibility pop
+ 
+ #endif // MPLS_STATS_H
@@ -0,0 +1,369 @@
+// mpls_sync.c
+
+#include "mpls_sync.h"
+#include "mpls_batch.h"
+#include "mpls_dump.h"
+#include "mpls_core.h"
+#include "mpls_ifcache.h"
+#include "mpls_nhobj.h"
+#include "mpls_stats.h"
+
+#define SYNC_MAX_ARGS 16
+#define SYNC_DUMP_RETRIES 3  // Attempts when the table changes under a dump (NLM_F_DUMP_INTR)
+
+enum sync_state {
+    SYNC_MISSING,    // Not in the kernel: add
+    SYNC_UNCHANGED,  // In the kernel and identical: leave alone
+    SYNC_CHANGED     // In the kernel but different: replace
+};
+
+struct sync_desired {
+    struct mpls_route route;
+    int ifindex;           // Resolved output interface for dev routes (0 if unknown)
+    unsigned long line;
+    enum sync_state state;
+};
+
+struct sync_ctx {
+    const char *name;
+    struct sync_desired *desired;
+    size_t ndesired, desired_cap;
+    uint32_t *label_index;  // Label -> 1 + index into desired, 0 if not desired
+    uint32_t *dst_index;    // Open-addressing hash of push destinations -> 1 + index
+    uint32_t dst_mask;
+    struct mpls_ifcache *ifcache;
+    struct mpls_route *stale;  // Kernel routes that are not desired (only the key is set)
+    size_t nstale, stale_cap;
+    uint32_t *nh_ids;          // Nexthop objects that push labels, so their routes are ours
+    size_t nnh_ids;
+    struct mpls_sync_stats *stats;
+};
+
+// Function to hash an IPv4 destination into the push-route table
+static uint32_t sync_dst_hash(const struct sync_ctx *ctx, struct in_addr dst) {
+    return (dst.s_addr * 2654435761u) & ctx->dst_mask;
+}
+
+// Function to find the desired push route for a destination
+static struct sync_desired *sync_find_dst(const struct sync_ctx *ctx, struct in_addr dst) {
+    if (!ctx->dst_index) return NULL;
+    for (uint32_t i = sync_dst_hash(ctx, dst);; i = (i + 1) & ctx->dst_mask) {
+        uint32_t slot = ctx->dst_index[i];
+        if (slot == 0) return NULL;
+        if (ctx->desired[slot - 1].route.dst.s_addr == dst.s_addr) return &ctx->desired[slot - 1];
+    }
+}
+
+// Function to append a desired route, rejecting duplicate keys
+static int sync_add_desired(struct sync_ctx *ctx, const struct mpls_route *route, unsigned long line) {
+    int is_push = mpls_route_is_push(route);
+    if (!is_push && ctx->label_index[route->label]) {
+        fprintf(stderr, "%s:%lu: duplicate label %u (first on line %lu)\n", ctx->name, line, route->label,
+                ctx->desired[ctx->label_index[route->label] - 1].line);
+        return -1;
+    }
+
+    if (ctx->ndesired == ctx->desired_cap) {
+        size_t cap = ctx->desired_cap ? ctx->desired_cap * 2 : 1024;
+        struct sync_desired *grown = realloc(ctx->desired, cap * sizeof(*grown));
+        if (!grown) {
+            perror("realloc");
+            return -1;
+        }
+        ctx->desired = grown;
+        ctx->desired_cap = cap;
+    }
+
+    struct sync_desired *d = &ctx->desired[ctx->ndesired];
+    d->route = *route;
+    d->line = line;
+    d->state = SYNC_MISSING;
+    d->ifindex = (route->kind == MPLS_ROUTE_DEV || route->kind == MPLS_ROUTE_SWAP_DEV ||
+                  route->kind == MPLS_ROUTE_PUSH_DEV) ? mpls_ifcache_index(ctx->ifcache, route->ifname) : 0;
+    ctx->ndesired++;
+    if (!is_push) ctx->label_index[route->label] = ctx->ndesired;
+    return 0;
+}
+
+// Function to index the desired push routes by destination once they are all known
+static int sync_index_dsts(struct sync_ctx *ctx) {
+    uint32_t size = 16;
+    while (size < ctx->ndesired * 2) size <<= 1;
+    ctx->dst_index = calloc(size, sizeof(*ctx->dst_index));
+    if (!ctx->dst_index) return -1;
+    ctx->dst_mask = size - 1;
+
+    for (size_t n = 0; n < ctx->ndesired; n++) {
+        const struct mpls_route *route = &ctx->desired[n].route;
+        if (!mpls_route_is_push(route)) continue;
+
+        const struct sync_desired *dup = sync_find_dst(ctx, route->dst);
+        if (dup) {
+            char addr[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &route->dst, addr, sizeof(addr));
+            fprintf(stderr, "%s:%lu: duplicate destination %s (first on line %lu)\n", ctx->name,
+                    ctx->desired[n].line, addr, dup->line);
+            return -1;
+        }
+        uint32_t i = sync_dst_hash(ctx, route->dst);
+        while (ctx->dst_index[i]) i = (i + 1) & ctx->dst_mask;
+        ctx->dst_index[i] = n + 1;
+    }
+    return 0;
+}
+
+// Function to read the desired-state file
+static int sync_read_desired(struct sync_ctx *ctx, FILE *in) {
+    char *line = NULL;
+    size_t cap = 0;
+    unsigned long lineno = 0;
+    int ret = 0;
+
+    while (getline(&line, &cap, in) != -1) {
+        lineno++;
+        char *argv[SYNC_MAX_ARGS];
+        int argc = mpls_split_route_args(line, argv, SYNC_MAX_ARGS);
+        if (argc == 0 || (argc > 0 && argv[0][0] == '#')) continue;
+
+        int skip = argc > 0 && strcmp(argv[0], "add_for") == 0;
+        struct mpls_route route;
+        const char *err = "too many arguments";
+        if (argc < 0 || parse_mpls_route(argc - skip, argv + skip, &route, &err) < 0) {
+            fprintf(stderr, "%s:%lu: %s\n", ctx->name, lineno, err);
+            ret = -1;
+            continue;
+        }
+        if (route.auto_label) {
+            fprintf(stderr, "%s:%lu: a desired state needs explicit labels, not \"auto\"\n", ctx->name, lineno);
+            ret = -1;
+            continue;
+        }
+        if (sync_add_desired(ctx, &route, lineno) < 0) ret = -1;
+    }
+    free(line);
+
+    if (ret == 0) ret = sync_index_dsts(ctx);
+    return ret;
+}
+
+// Function to compare one dumped leg with a desired target and out-label stack
+static int sync_leg_matches(const struct mpls_entry_nexthop *nh, const uint32_t *labels, int nlabels,
+                            const struct in_addr *via, int ifindex) {
+    if (nh->nlabels != nlabels) return 0;
+    for (int i = 0; i < nlabels; i++) {
+        if (nh->labels[i] != labels[i]) return 0;
+    }
+
+    // Next-hop routes also carry the resolved output interface, so only the gateway is compared
+    if (via) return nh->has_via && nh->via.s_addr == via->s_addr;
+    return !nh->has_via && ifindex && nh->ifindex == ifindex;
+}
+
+// Function to compare a dumped route with the desired one
+static int sync_matches(const struct sync_ctx *ctx, const struct sync_desired *d, const struct mpls_route_entry *entry) {
+    const struct mpls_route *route = &d->route;
+
+    // What a nexthop object holds is managed with the object; the route only has to point at the right one
+    if (route->kind == MPLS_ROUTE_PUSH_NHID) return mpls_entry_nhid(entry) == route->nhid;
+    if (mpls_entry_nhid(entry)) return 0;
+
+    struct mpls_entry_nexthop nhs[MPLS_MAX_NEXTHOPS + 1];
+    int nnh = mpls_entry_nexthops(entry, nhs, MPLS_MAX_NEXTHOPS + 1);
+
+    if (route->kind == MPLS_ROUTE_MULTIPATH) {
+        // Legs are compared in order; label routes have no weights
+        if (!entry->tb[RTA_MULTIPATH] || nnh != route->nnexthops) return 0;
+        for (int i = 0; i < nnh; i++) {
+            const struct mpls_nexthop *want = &route->nexthops[i];
+            int ifindex = want->ifname[0] ? mpls_ifcache_index(ctx->ifcache, want->ifname) : 0;
+            if (!sync_leg_matches(&nhs[i], &want->out_label, want->has_out_label,
+                                  want->ifname[0] ? NULL : &want->via, ifindex)) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    if (entry->tb[RTA_MULTIPATH] || nnh != 1) return 0;
+    int nlabels = route->kind != MPLS_ROUTE_DEV && route->kind != MPLS_ROUTE_NEXTHOP ? route->nout_labels : 0;
+    int by_via = route->kind == MPLS_ROUTE_NEXTHOP || route->kind == MPLS_ROUTE_SWAP_NEXTHOP ||
+                 route->kind == MPLS_ROUTE_PUSH_NEXTHOP;
+    if (nhs[0].ttl != route->ttl) return 0;
+    return sync_leg_matches(&nhs[0], route->out_labels, nlabels, by_via ? &route->via : NULL, d->ifindex);
+}
+
+// Function to remember a kernel route that has to go
+static int sync_add_stale(struct sync_ctx *ctx, const struct mpls_route *key) {
+    if (ctx->nstale == ctx->stale_cap) {
+        size_t cap = ctx->stale_cap ? ctx->stale_cap * 2 : 256;
+        struct mpls_route *grown = realloc(ctx->stale, cap * sizeof(*grown));
+        if (!grown) return -ENOMEM;
+        ctx->stale = grown;
+        ctx->stale_cap = cap;
+    }
+    ctx->stale[ctx->nstale++] = *key;
+    return 0;
+}
+
+// Function to classify one dumped route against the desired state
+static int sync_visit(const struct mpls_route_entry *entry, void *arg) {
+    struct sync_ctx *ctx = (struct sync_ctx *)arg;
+    struct mpls_route key = {.s_bit = 1};
+    struct sync_desired *d = NULL;
+
+    if (entry->rtm->rtm_family == AF_MPLS) {
+        if (mpls_entry_labels(entry->tb[RTA_DST], &key.label, 1) != 1) return 0;
+        key.kind = MPLS_ROUTE_DEV;
+        if (ctx->label_index[key.label]) d = &ctx->desired[ctx->label_index[key.label] - 1];
+    } else {
+        // Only MPLS-encap routes in the main table are managed here, directly or through a nexthop object
+        uint32_t nhid = mpls_entry_nhid(entry);
+        if (entry->rtm->rtm_table != RT_TABLE_MAIN) return 0;
+        if (nhid ? !mpls_nhobj_has_id(ctx->nh_ids, ctx->nnh_ids, nhid) : !mpls_entry_encap_labels(entry)) return 0;
+        if (!entry->tb[RTA_DST] || entry->rtm->rtm_dst_len != 32) return 0;
+        memcpy(&key.dst, RTA_DATA(entry->tb[RTA_DST]), sizeof(key.dst));
+        key.kind = MPLS_ROUTE_PUSH_NEXTHOP;
+        d = sync_find_dst(ctx, key.dst);
+    }
+
+    // Only routes this tool installed are removed; those of ldpd, bgpd or "proto static" are not ours
+    if (!d) return entry->rtm->rtm_protocol == MPLS_ROUTE_PROTOCOL ? sync_add_stale(ctx, &key) : 0;
+    d->state = sync_matches(ctx, d, entry) ? SYNC_UNCHANGED : SYNC_CHANGED;
+    return 0;
+}
+
+// Function to dump both tables and classify every route, retrying if a dump was interrupted
+static int sync_dump(struct sync_ctx *ctx, struct mpls_session *session) {
+    int ret = 0;
+    for (int attempt = 0; attempt < SYNC_DUMP_RETRIES; attempt++) {
+        if (attempt) MPLS_STAT_ADD(MPLS_STAT_DUMP_RETRIES, 1);
+        ctx->nstale = 0;
+        for (size_t n = 0; n < ctx->ndesired; n++) ctx->desired[n].state = SYNC_MISSING;
+
+        free(ctx->nh_ids);
+        ctx->nh_ids = NULL;
+        ret = mpls_nhobj_ids(session, &ctx->nh_ids, &ctx->nnh_ids);
+        if (ret < 0) return ret;
+        ret = mpls_dump_routes(session, AF_MPLS, sync_visit, ctx);
+        if (ret == 0) ret = mpls_dump_routes(session, AF_INET, sync_visit, ctx);
+        if (ret != -EINTR) return ret;
+    }
+    return ret;
+}
+
+// Function to print one planned change
+static void sync_print_change(const char *verb, const struct mpls_route *route) {
+    char text[128];
+    if (strcmp(verb, "del") == 0) {
+        if (route->kind == MPLS_ROUTE_PUSH_NEXTHOP) {
+            inet_ntop(AF_INET, &route->dst, text, sizeof(text));
+        } else {
+            snprintf(text, sizeof(text), "%u", route->label);
+        }
+    } else if (format_mpls_route(route, text, sizeof(text)) < 0) {
+        strcpy(text, "?");
+    }
+    printf("%s %s\n", verb, text);
+}
+
+// Function to account for the outcome of one change
+static void sync_result(unsigned long tag, int error, const char *detail, void *arg) {
+    struct sync_ctx *ctx = (struct sync_ctx *)arg;
+
+    if (tag < ctx->ndesired) {
+        const struct sync_desired *d = &ctx->desired[tag];
+        if (error) {
+            fprintf(stderr, "%s:%lu: %s%s%s\n", ctx->name, d->line,
+                    error == -ENODEV && !detail ? "no such interface" : strerror(-error), detail ? ": " : "",
+                    detail ? detail : "");
+            ctx->stats->failed++;
+        } else if (d->state == SYNC_MISSING) {
+            ctx->stats->added++;
+        } else {
+            ctx->stats->replaced++;
+        }
+        return;
+    }
+
+    const struct mpls_route *key = &ctx->stale[tag - ctx->ndesired];
+    if (error) {
+        char addr[INET_ADDRSTRLEN];
+        if (key->kind == MPLS_ROUTE_PUSH_NEXTHOP) {
+            fprintf(stderr, "delete %s: %s\n", inet_ntop(AF_INET, &key->dst, addr, sizeof(addr)), strerror(-error));
+        } else {
+            fprintf(stderr, "delete label %u: %s\n", key->label, strerror(-error));
+        }
+        ctx->stats->failed++;
+    } else {
+        ctx->stats->deleted++;
+    }
+}
+
+// Function to send only the changes needed to reach the desired state
+static int sync_apply(struct sync_ctx *ctx, struct mpls_session *session, int dry_run) {
+    struct mpls_batch *batch = NULL;
+    if (!dry_run) {
+        batch = mpls_batch_open(session, sync_result, ctx);
+        if (!batch) return -1;
+    }
+
+    // Make before break: new and changed routes first, then the ones to remove
+    for (size_t n = 0; n < ctx->ndesired; n++) {
+        struct sync_desired *d = &ctx->desired[n];
+        if (d->state == SYNC_UNCHANGED) {
+            ctx->stats->unchanged++;
+            continue;
+        }
+        enum mpls_route_op op = d->state == SYNC_MISSING ? MPLS_OP_ADD : MPLS_OP_REPLACE;
+        if (dry_run) {
+            sync_print_change(op == MPLS_OP_ADD ? "add_for" : "replace", &d->route);
+            if (op == MPLS_OP_ADD) ctx->stats->added++; else ctx->stats->replaced++;
+        } else {
+            mpls_batch_queue(batch, &d->route, op, n);
+        }
+    }
+    for (size_t n = 0; n < ctx->nstale; n++) {
+        if (dry_run) {
+            sync_print_change("del", &ctx->stale[n]);
+            ctx->stats->deleted++;
+        } else {
+            mpls_batch_queue(batch, &ctx->stale[n], MPLS_OP_DELETE, ctx->ndesired + n);
+        }
+    }
+
+    return batch ? mpls_batch_finish(batch, NULL) : 0;
+}
+
+// Function to bring the kernel's MPLS routes in line with a desired-state file
+int mpls_sync_run(struct mpls_session *session, FILE *in, const char *name, int dry_run, struct mpls_sync_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    struct sync_ctx ctx = {.name = name, .ifcache = session->ifcache, .stats = stats};
+    int ret = -1;
+
+    ctx.label_index = calloc(MPLS_LABEL_SPACE, sizeof(*ctx.label_index));
+    if (!ctx.label_index) {
+        perror("calloc");
+        return -1;
+    }
+
+    if (sync_read_desired(&ctx, in) < 0) {
+        fprintf(stderr, "%s: desired state rejected, kernel left untouched\n", name);
+        goto out;
+    }
+
+    int err = sync_dump(&ctx, session);
+    if (err < 0) {
+        fprintf(stderr, "Failed to dump routes: %s\n", strerror(-err));
+        goto out;
+    }
+
+    ret = sync_apply(&ctx, session, dry_run);
+
+out:
+    free(ctx.label_index);
+    free(ctx.dst_index);
+    free(ctx.desired);
+    free(ctx.stale);
+    free(ctx.nh_ids);
+    return ret;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file mpls_sync.h
+ * @brief Declarative synchronization of the kernel's MPLS routes with a desired state.
+ *
+ * The current table is dumped once and diffed against the desired routes using a
+ * direct-indexed table over the 20-bit label space (and a hash on the destination
+ * for push routes). Only the differences are sent: new routes are added, changed
+ * routes are replaced atomically and routes absent from the desired state are
+ * deleted if this library installed them (rtm_protocol MPLS_ROUTE_PROTOCOL);
+ * routes of other protocols are only touched when the desired state names them. Routes that already match are not touched. Routes through a kernel
+ * nexthop object ("[dst_ip] nhid [id]") are compared by the object id only; the
+ * objects themselves are managed with mpls_nhobj.h and left alone here.
+ */
+
+ #ifndef MPLS_SYNC_H
+ #define MPLS_SYNC_H
+ 
+ #include <stdio.h>
+ 
+ #pragma GCC visibility push(default)
+ 
+ struct mpls_session;
+ 
+ #define MPLS_LABEL_SPACE (1u << 20)  /**< Number of distinct 20-bit MPLS labels. */
+ 
+ /**
+  * @brief Outcome counters of a sync run.
+  */
+ struct mpls_sync_stats {
+     unsigned long unchanged;  /**< Routes already in the desired state. */
+     unsigned long added;      /**< Routes created. */
+     unsigned long replaced;   /**< Routes replaced with NLM_F_REPLACE. */
+     unsigned long deleted;    /**< Routes removed because they are not desired. */
+     unsigned long failed;     /**< Changes rejected by the kernel. */
+ };
+ 
+ /**
+  * @brief Brings the kernel's MPLS routes in line with a desired-state file.
+  *
+  * The file lists one route per line in "add_for" syntax, with or without the
+  * leading "add_for" (so the output of "mpls-cli show" can be used as is). Any
+  * syntax error or duplicate key aborts the sync before the kernel is touched.
+  *
+  * @param session Netlink session.
+  * @param in Stream holding the desired state.
+  * @param name Name of the stream used in diagnostics.
+  * @param dry_run If non-zero, print the planned changes instead of applying them.
+  * @param stats Filled with the outcome counters.
+  * @return 0 if the kernel now matches the desired state, -1 otherwise.
+  */
+ int mpls_sync_run(struct mpls_session *session, FILE *in, const char *name, int dry_run, struct mpls_sync_stats *stats);
+ 
+ #pragma GCC visibility pop
+ 
+ #endif // MPLS_SYNC_H
@@ -0,0 +1,659 @@
+// mpls_verify.c
+
+#include "mpls_verify.h"
+#include "mpls_core.h"
+#include "mpls_dump.h"
+#include "mpls_netns.h"
+#include <pthread.h>
+#include <linux/if_addr.h>
+
+#define VERIFY_MAX_NEXTHOPS 64      // Legs decoded per route
+#define VERIFY_MAX_STACK 32         // Deepest label stack followed
+#define VERIFY_MAX_THREADS 64
+#define VERIFY_CHUNK 256            // Ingress routes a tracing thread claims at a time
+
+struct verify_leg {
+    int ifindex;            // Output interface, 0 if absent
+    int has_via;
+    struct in_addr via;
+    uint32_t label_off;     // Out labels in the node's label pool, outermost first
+    int nlabels;
+    int peer;               // Node the leg leads to, -1 if none; set before tracing
+};
+
+struct verify_route {
+    uint32_t label;         // In label (LFIB) or outermost pushed label (ingress)
+    struct in_addr dst;     // Destination (ingress)
+    int dst_len;
+    uint32_t first_leg;
+    int nlegs;
+    int discard;            // Blackhole, unreachable or prohibit route
+};
+
+struct verify_addr {
+    struct in_addr addr;
+    int prefix_len;
+    int ifindex;
+    int node;
+};
+
+struct verify_node {
+    char *name;
+    struct verify_route *lfib;     // Sorted by label before tracing
+    size_t nlfib, lfib_cap;
+    struct verify_route *ingress;  // In dump order
+    size_t ningress, ingress_cap;
+    struct verify_leg *legs;
+    size_t nlegs, legs_cap;
+    uint32_t *labels;
+    size_t nlabels, labels_cap;
+    struct verify_addr *addrs;
+    size_t naddrs, addrs_cap;
+};
+
+struct mpls_verify {
+    struct verify_node *nodes;
+    size_t count, capacity;
+    struct verify_addr *owners;    // Every address, sorted by address
+    struct verify_addr *subnets;   // Every address, sorted by subnet
+    size_t naddrs;
+    size_t *ingress_base;          // Index of each node's first ingress route among all of them
+    size_t ningress;
+};
+
+// Function to make room for one more element in a growable array
+static int verify_grow(void **array, size_t *capacity, size_t count, size_t need, size_t size) {
+    if (count + need <= *capacity) return 0;
+    size_t grown = *capacity ? *capacity : 64;
+    while (grown < count + need) grown *= 2;
+    void *bigger = realloc(*array, grown * size);
+    if (!bigger) return -ENOMEM;
+    *array = bigger;
+    *capacity = grown;
+    return 0;
+}
+
+// Function to create an empty graph
+struct mpls_verify *mpls_verify_open(void) {
+    return calloc(1, sizeof(struct mpls_verify));
+}
+
+// Function to add a node
+int mpls_verify_node(struct mpls_verify *verify, const char *name) {
+    if (verify->ingress_base) return -EBUSY;
+    if (verify_grow((void **)&verify->nodes, &verify->capacity, verify->count, 1, sizeof(*verify->nodes)) < 0) {
+        return -ENOMEM;
+    }
+    struct verify_node *node = &verify->nodes[verify->count];
+    memset(node, 0, sizeof(*node));
+    node->name = strdup(name);
+    if (!node->name) return -ENOMEM;
+    return (int)verify->count++;
+}
+
+// Function to record an address of a node
+int mpls_verify_add_address(struct mpls_verify *verify, int node, int ifindex, struct in_addr addr, int prefix_len) {
+    if (node < 0 || (size_t)node >= verify->count || prefix_len < 0 || prefix_len > 32) return -EINVAL;
+    if (verify->ingress_base) return -EBUSY;
+    struct verify_node *n = &verify->nodes[node];
+    if (verify_grow((void **)&n->addrs, &n->addrs_cap, n->naddrs, 1, sizeof(*n->addrs)) < 0) return -ENOMEM;
+    n->addrs[n->naddrs++] = (struct verify_addr){addr, prefix_len, ifindex, node};
+    return 0;
+}
+
+// Function to store one dumped route of a node
+static int verify_route_cb(const struct mpls_route_entry *entry, void *arg) {
+    struct verify_node *n = (struct verify_node *)arg;
+    struct mpls_entry_nexthop nhs[VERIFY_MAX_NEXTHOPS];
+    struct verify_route route;
+    memset(&route, 0, sizeof(route));
+
+    uint8_t type = entry->rtm->rtm_type;
+    route.discard = type == RTN_BLACKHOLE || type == RTN_UNREACHABLE || type == RTN_PROHIBIT;
+    int nnh = route.discard ? 0 : mpls_entry_nexthops(entry, nhs, VERIFY_MAX_NEXTHOPS);
+
+    if (entry->rtm->rtm_family == AF_MPLS) {
+        if (mpls_entry_labels(entry->tb[RTA_DST], &route.label, 1) != 1) return 0;
+    } else {
+        // Only routes that push labels start an LSP
+        int pushes = -1;
+        for (int i = 0; i < nnh && pushes < 0; i++) {
+            if (nhs[i].nlabels > 0) pushes = i;
+        }
+        if (pushes < 0) return 0;
+        route.label = nhs[pushes].labels[0];
+        if (entry->tb[RTA_DST] && RTA_PAYLOAD(entry->tb[RTA_DST]) >= sizeof(route.dst)) {
+            memcpy(&route.dst, RTA_DATA(entry->tb[RTA_DST]), sizeof(route.dst));
+        }
+        route.dst_len = entry->rtm->rtm_dst_len;
+    }
+
+    size_t nlabels = 0;
+    for (int i = 0; i < nnh; i++) nlabels += nhs[i].nlabels;
+    if (verify_grow((void **)&n->legs, &n->legs_cap, n->nlegs, nnh, sizeof(*n->legs)) < 0 ||
+        verify_grow((void **)&n->labels, &n->labels_cap, n->nlabels, nlabels, sizeof(*n->labels)) < 0) {
+        return -ENOMEM;
+    }
+    route.first_leg = n->nlegs;
+    route.nlegs = nnh;
+    for (int i = 0; i < nnh; i++) {
+        struct verify_leg *leg = &n->legs[n->nlegs++];
+        leg->ifindex = nhs[i].ifindex;
+        leg->has_via = nhs[i].has_via;
+        leg->via = nhs[i].via;
+        leg->label_off = n->nlabels;
+        leg->nlabels = nhs[i].nlabels;
+        leg->peer = -1;
+        memcpy(&n->labels[n->nlabels], nhs[i].labels, nhs[i].nlabels * sizeof(uint32_t));
+        n->nlabels += nhs[i].nlabels;
+    }
+
+    if (entry->rtm->rtm_family == AF_MPLS) {
+        if (verify_grow((void **)&n->lfib, &n->lfib_cap, n->nlfib, 1, sizeof(*n->lfib)) < 0) return -ENOMEM;
+        n->lfib[n->nlfib++] = route;
+    } else {
+        if (verify_grow((void **)&n->ingress, &n->ingress_cap, n->ningress, 1, sizeof(*n->ingress)) < 0) {
+            return -ENOMEM;
+        }
+        n->ingress[n->ningress++] = route;
+    }
+    return 0;
+}
+
+struct verify_addrs {
+    struct mpls_verify *verify;
+    int node;
+};
+
+// Function to record one RTM_NEWADDR message of a node
+static int verify_addr_msg(const struct nlmsghdr *nlh, void *arg) {
+    const struct verify_addrs *addrs = (const struct verify_addrs *)arg;
+    if (nlh->nlmsg_type != RTM_NEWADDR) return 0;
+    int len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+    if (len < 0) return 0;
+    const struct ifaddrmsg *ifa = (const struct ifaddrmsg *)NLMSG_DATA(nlh);
+    if (ifa->ifa_family != AF_INET || ifa->ifa_scope == RT_SCOPE_HOST) return 0;  // Loopback addresses exist everywhere
+
+    const struct rtattr *tb[IFA_MAX + 1];
+    mpls_parse_rtattr(tb, IFA_MAX, IFA_RTA(ifa), len);
+    const struct rtattr *local = tb[IFA_LOCAL] ? tb[IFA_LOCAL] : tb[IFA_ADDRESS];
+    if (!local || RTA_PAYLOAD(local) < sizeof(struct in_addr)) return 0;
+
+    struct in_addr addr;
+    memcpy(&addr, RTA_DATA(local), sizeof(addr));
+    return mpls_verify_add_address(addrs->verify, addrs->node, ifa->ifa_index, addr, ifa->ifa_prefixlen);
+}
+
+// Function to read the IPv4 addresses of a node
+static int verify_dump_addrs(struct mpls_verify *verify, int node, struct mpls_session *session) {
+    struct {
+        struct nlmsghdr nlh;
+        struct ifaddrmsg ifa;
+    } req;
+    memset(&req, 0, sizeof(req));
+    init_netlink_message(&req.nlh, RTM_GETADDR, NLM_F_REQUEST | NLM_F_DUMP, 0, 0);
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifa));
+    req.ifa.ifa_family = AF_INET;
+
+    struct verify_addrs addrs = {verify, node};
+    return mpls_dump_request(session, &req.nlh, 0, verify_addr_msg, &addrs);
+}
+
+// Function to read the addresses and routes of a node
+int mpls_verify_load(struct mpls_verify *verify, int node, struct mpls_session *session) {
+    if (node < 0 || (size_t)node >= verify->count) return -EINVAL;
+    if (verify->ingress_base) return -EBUSY;
+    struct verify_node *n = &verify->nodes[node];
+
+    int ret = verify_dump_addrs(verify, node, session);
+    if (ret < 0 && ret != -EINTR) return ret;
+    int interrupted = ret == -EINTR;
+
+    ret = mpls_dump_routes(session, AF_MPLS, verify_route_cb, n);
+    if (ret < 0 && ret != -EINTR) return ret;
+    interrupted |= ret == -EINTR;
+
+    ret = mpls_dump_routes(session, AF_INET, verify_route_cb, n);
+    if (ret < 0 && ret != -EINTR) return ret;
+    interrupted |= ret == -EINTR;
+    return interrupted ? -EINTR : 0;
+}
+
+struct verify_loader {
+    struct mpls_verify *verify;
+    int node;
+    int error;
+};
+
+// Function to load one node from inside its namespace
+static void *verify_loader_main(void *arg) {
+    struct verify_loader *l = (struct verify_loader *)arg;
+    struct mpls_session session;
+
+    // Sockets stay in the namespace they were created in, so this thread enters it first
+    l->error = mpls_netns_enter(l->verify->nodes[l->node].name);
+    if (!l->error) l->error = mpls_session_open(&session, MPLS_SESSION_SOCK_BUF);
+    if (!l->error) {
+        l->error = mpls_verify_load(l->verify, l->node, &session);
+        mpls_session_close(&session);
+    }
+    return NULL;
+}
+
+// Function to load every node from its namespace, in parallel
+int mpls_verify_load_netns(struct mpls_verify *verify, int *errors) {
+    if (verify->count == 0) return 0;
+    struct verify_loader *loaders = calloc(verify->count, sizeof(*loaders));
+    pthread_t *threads = calloc(verify->count, sizeof(*threads));
+    if (!loaders || !threads) {
+        free(loaders);
+        free(threads);
+        return -ENOMEM;
+    }
+
+    for (size_t i = 0; i < verify->count; i++) {
+        loaders[i].verify = verify;
+        loaders[i].node = (int)i;
+        int ret = pthread_create(&threads[i], NULL, verify_loader_main, &loaders[i]);
+        if (ret != 0) {
+            loaders[i].error = -ret;
+            threads[i] = pthread_self();  // Marks a thread that never started
+        }
+    }
+
+    int result = 0;
+    for (size_t i = 0; i < verify->count; i++) {
+        if (!pthread_equal(threads[i], pthread_self())) pthread_join(threads[i], NULL);
+        if (errors) errors[i] = loaders[i].error;
+        if (loaders[i].error < 0 && result == 0) result = loaders[i].error;
+    }
+    free(loaders);
+    free(threads);
+    return result;
+}
+
+// Function to order routes by label
+static int verify_compare_label(const void *a, const void *b) {
+    const struct verify_route *x = a, *y = b;
+    return (x->label > y->label) - (x->label < y->label);
+}
+
+// Function to order addresses by value, then node
+static int verify_compare_addr(const void *a, const void *b) {
+    const struct verify_addr *x = a, *y = b;
+    uint32_t ax = ntohl(x->addr.s_addr), ay = ntohl(y->addr.s_addr);
+    if (ax != ay) return (ax > ay) - (ax < ay);
+    return (x->node > y->node) - (x->node < y->node);
+}
+
+// Function to compute the subnet of an address in host byte order
+static uint32_t verify_subnet(const struct verify_addr *a) {
+    uint32_t mask = a->prefix_len ? ~0u << (32 - a->prefix_len) : 0;
+    return ntohl(a->addr.s_addr) & mask;
+}
+
+// Function to order addresses by subnet, then prefix length, then node
+static int verify_compare_subnet(const void *a, const void *b) {
+    const struct verify_addr *x = a, *y = b;
+    uint32_t sx = verify_subnet(x), sy = verify_subnet(y);
+    if (sx != sy) return (sx > sy) - (sx < sy);
+    if (x->prefix_len != y->prefix_len) return (x->prefix_len > y->prefix_len) - (x->prefix_len < y->prefix_len);
+    return (x->node > y->node) - (x->node < y->node);
+}
+
+// Function to find the node that owns an address; -1 if none or if several do
+static int verify_owner(const struct mpls_verify *verify, struct in_addr addr) {
+    uint32_t key = ntohl(addr.s_addr);
+    size_t lo = 0, hi = verify->naddrs;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ntohl(verify->owners[mid].addr.s_addr) < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    int owner = -1;
+    for (size_t i = lo; i < verify->naddrs && verify->owners[i].addr.s_addr == addr.s_addr; i++) {
+        if (owner >= 0 && owner != verify->owners[i].node) return -1;
+        owner = verify->owners[i].node;
+    }
+    return owner;
+}
+
+// Function to find the only other node on the subnets of an interface; -1 if none or several
+static int verify_neighbor(const struct mpls_verify *verify, int node, int ifindex) {
+    const struct verify_node *n = &verify->nodes[node];
+    int peer = -1;
+    for (size_t a = 0; a < n->naddrs; a++) {
+        if (n->addrs[a].ifindex != ifindex) continue;
+        const struct verify_addr *key = &n->addrs[a];
+        size_t lo = 0, hi = verify->naddrs;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            const struct verify_addr *e = &verify->subnets[mid];
+            int below = verify_subnet(e) < verify_subnet(key) ||
+                        (verify_subnet(e) == verify_subnet(key) && e->prefix_len < key->prefix_len);
+            if (below) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        for (size_t i = lo; i < verify->naddrs; i++) {
+            const struct verify_addr *e = &verify->subnets[i];
+            if (verify_subnet(e) != verify_subnet(key) || e->prefix_len != key->prefix_len) break;
+            if (e->node == node) continue;
+            if (peer >= 0 && peer != e->node) return -1;
+            peer = e->node;
+        }
+    }
+    return peer;
+}
+
+// Function to index the addresses, sort the LFIBs and resolve every leg to a node
+static int verify_resolve(struct mpls_verify *verify) {
+    size_t naddrs = 0;
+    for (size_t i = 0; i < verify->count; i++) naddrs += verify->nodes[i].naddrs;
+    verify->owners = malloc((naddrs ? naddrs : 1) * sizeof(*verify->owners));
+    verify->subnets = malloc((naddrs ? naddrs : 1) * sizeof(*verify->subnets));
+    verify->ingress_base = malloc((verify->count + 1) * sizeof(*verify->ingress_base));
+    if (!verify->owners || !verify->subnets || !verify->ingress_base) return -ENOMEM;
+
+    verify->naddrs = 0;
+    verify->ningress = 0;
+    for (size_t i = 0; i < verify->count; i++) {
+        const struct verify_node *n = &verify->nodes[i];
+        memcpy(&verify->owners[verify->naddrs], n->addrs, n->naddrs * sizeof(*n->addrs));
+        verify->naddrs += n->naddrs;
+        verify->ingress_base[i] = verify->ningress;
+        verify->ningress += n->ningress;
+    }
+    verify->ingress_base[verify->count] = verify->ningress;
+    memcpy(verify->subnets, verify->owners, verify->naddrs * sizeof(*verify->owners));
+    qsort(verify->owners, verify->naddrs, sizeof(*verify->owners), verify_compare_addr);
+    qsort(verify->subnets, verify->naddrs, sizeof(*verify->subnets), verify_compare_subnet);
+
+    for (size_t i = 0; i < verify->count; i++) {
+        struct verify_node *n = &verify->nodes[i];
+        // The kernel dumps the LFIB in label order, so this is usually already sorted
+        qsort(n->lfib, n->nlfib, sizeof(*n->lfib), verify_compare_label);
+
+        // Legs through the same interface mostly follow each other, so remember the last answer
+        int last_ifindex = 0, last_peer = -1;
+        for (size_t l = 0; l < n->nlegs; l++) {
+            struct verify_leg *leg = &n->legs[l];
+            if (leg->has_via) {
+                leg->peer = verify_owner(verify, leg->via);
+            } else if (leg->ifindex) {
+                if (leg->ifindex != last_ifindex) {
+                    last_ifindex = leg->ifindex;
+                    last_peer = verify_neighbor(verify, (int)i, leg->ifindex);
+                }
+                leg->peer = last_peer;
+            }
+        }
+    }
+    return 0;
+}
+
+struct verify_hop {
+    int node;
+    int depth;
+    uint32_t stack[VERIFY_MAX_STACK];
+};
+
+struct verify_trace {
+    const struct mpls_verify *verify;
+    struct mpls_verify_result *result;  // Filled by the first problem found
+    unsigned int branches;
+    struct verify_hop path[MPLS_VERIFY_MAX_HOPS + 1];
+};
+
+// Function to record the first problem of a trace; returns 1 so the caller unwinds
+static int verify_fail(struct verify_trace *t, enum mpls_verify_status status, int node, uint32_t label, int hops,
+                       const char *reason) {
+    t->result->status = status;
+    t->result->at = t->verify->nodes[node].name;
+    t->result->label = label;
+    t->result->hops = hops;
+    t->result->reason = reason;
+    return 1;
+}
+
+// Function to find the LFIB entry of a label
+static const struct verify_route *verify_lookup(const struct verify_node *n, uint32_t label) {
+    size_t lo = 0, hi = n->nlfib;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (n->lfib[mid].label == label) return &n->lfib[mid];
+        if (n->lfib[mid].label < label) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+// Function to build the label stack a leg sends: its labels on top of what is left below the switched one
+// Returns the new depth, or -1 if it is too deep
+static int verify_stack(const struct verify_node *n, const struct verify_leg *leg, const uint32_t *below, int nbelow,
+                        uint32_t *out) {
+    int depth = 0;
+    for (int i = 0; i < leg->nlabels; i++) {
+        uint32_t label = n->labels[leg->label_off + i];
+        if (label == 3) continue;  // Implicit null: pop instead of swapping
+        if (depth == VERIFY_MAX_STACK) return -1;
+        out[depth++] = label;
+    }
+    if (depth + nbelow > VERIFY_MAX_STACK) return -1;
+    memcpy(out + depth, below, nbelow * sizeof(uint32_t));
+    return depth + nbelow;
+}
+
+// Function to tell whether a stack leaves the LSP at the next hop: nothing but explicit nulls is left
+static int verify_egress(const uint32_t *stack, int depth) {
+    for (int d = 0; d < depth; d++) {
+        if (stack[d] != 0 && stack[d] != 2) return 0;
+    }
+    return 1;
+}
+
+// Function to follow a packet that reaches a node with a label stack, through every leg
+// Returns 1 once a problem has been recorded, 0 otherwise
+static int verify_step(struct verify_trace *t, int node, const uint32_t *stack, int depth, int hop) {
+    // Explicit nulls are popped on arrival; the packet is then IP or the next label is looked up
+    while (depth > 0 && (stack[0] == 0 || stack[0] == 2)) {
+        stack++;
+        depth--;
+    }
+    if (depth == 0) {
+        if (hop > t->result->hops) t->result->hops = hop;
+        return 0;
+    }
+    if (hop == MPLS_VERIFY_MAX_HOPS) {
+        return verify_fail(t, MPLS_VERIFY_LOOP, node, stack[0], hop, "path longer than the MPLS TTL allows");
+    }
+    for (int h = 0; h < hop; h++) {
+        const struct verify_hop *seen = &t->path[h];
+        if (seen->node == node && seen->depth == depth && memcmp(seen->stack, stack, depth * sizeof(uint32_t)) == 0) {
+            return verify_fail(t, MPLS_VERIFY_LOOP, node, stack[0], hop, "node reached again with the same labels");
+        }
+    }
+    t->path[hop].node = node;
+    t->path[hop].depth = depth;
+    memcpy(t->path[hop].stack, stack, depth * sizeof(uint32_t));
+
+    const struct verify_node *n = &t->verify->nodes[node];
+    const struct verify_route *route = verify_lookup(n, stack[0]);
+    if (!route) return verify_fail(t, MPLS_VERIFY_MISMATCH, node, stack[0], hop, "no route for the label");
+    if (route->discard || route->nlegs == 0) {
+        return verify_fail(t, MPLS_VERIFY_BLACKHOLE, node, stack[0], hop, "route discards the packet");
+    }
+
+    for (int i = 0; i < route->nlegs; i++) {
+        if (++t->branches > MPLS_VERIFY_MAX_BRANCHES) return 0;
+        const struct verify_leg *leg = &n->legs[route->first_leg + i];
+        uint32_t next[VERIFY_MAX_STACK];
+        int next_depth = verify_stack(n, leg, stack + 1, depth - 1, next);
+        if (next_depth < 0) {
+            return verify_fail(t, MPLS_VERIFY_BLACKHOLE, node, stack[0], hop, "label stack too deep");
+        }
+        if (verify_egress(next, next_depth)) {
+            if (hop + 1 > t->result->hops) t->result->hops = hop + 1;
+            continue;
+        }
+        if (leg->peer < 0) {
+            return verify_fail(t, MPLS_VERIFY_BLACKHOLE, node, stack[0], hop,
+                               leg->has_via ? "next hop belongs to no node" : "interface leads to no node");
+        }
+        if (verify_step(t, leg->peer, next, next_depth, hop + 1)) return 1;
+    }
+    return 0;
+}
+
+// Function to trace one ingress route
+static void verify_ingress(struct verify_trace *t, int node, const struct verify_route *route,
+                           struct mpls_verify_result *result) {
+    const struct verify_node *n = &t->verify->nodes[node];
+    memset(result, 0, sizeof(*result));
+    result->node = n->name;
+    result->dst = route->dst;
+    result->dst_len = route->dst_len;
+    result->push = route->label;
+    result->status = MPLS_VERIFY_OK;
+    t->result = result;
+    t->branches = 0;
+
+    for (int i = 0; i < route->nlegs; i++) {
+        if (++t->branches > MPLS_VERIFY_MAX_BRANCHES) break;
+        const struct verify_leg *leg = &n->legs[route->first_leg + i];
+        uint32_t stack[VERIFY_MAX_STACK];
+        int depth = verify_stack(n, leg, NULL, 0, stack);
+        int fail = 0;
+        if (depth < 0) {
+            fail = verify_fail(t, MPLS_VERIFY_BLACKHOLE, node, route->label, 0, "label stack too deep");
+        } else if (verify_egress(stack, depth)) {
+            continue;
+        } else if (leg->peer < 0) {
+            fail = verify_fail(t, MPLS_VERIFY_BLACKHOLE, node, route->label, 0,
+                               leg->has_via ? "next hop belongs to no node" : "interface leads to no node");
+        } else {
+            fail = verify_step(t, leg->peer, stack, depth, 0);
+        }
+        if (fail) return;
+    }
+}
+
+struct verify_worker {
+    struct mpls_verify *verify;
+    struct mpls_verify_result *results;
+    size_t *next;            // Next unclaimed ingress route, shared by the workers
+    struct verify_trace *trace;
+};
+
+// Function to trace ingress routes, a chunk at a time, until none are left
+static void *verify_worker_main(void *arg) {
+    struct verify_worker *w = (struct verify_worker *)arg;
+    const struct mpls_verify *verify = w->verify;
+    w->trace->verify = verify;
+
+    for (;;) {
+        size_t first = __atomic_fetch_add(w->next, VERIFY_CHUNK, __ATOMIC_RELAXED);
+        if (first >= verify->ningress) break;
+        size_t last = first + VERIFY_CHUNK < verify->ningress ? first + VERIFY_CHUNK : verify->ningress;
+
+        // Find the node of the first route; the rest of the chunk follows in order
+        size_t node = 0;
+        while (verify->ingress_base[node + 1] <= first) node++;
+        for (size_t g = first; g < last; g++) {
+            while (verify->ingress_base[node + 1] <= g) node++;
+            const struct verify_node *n = &verify->nodes[node];
+            verify_ingress(w->trace, (int)node, &n->ingress[g - verify->ingress_base[node]], &w->results[g]);
+        }
+    }
+    return NULL;
+}
+
+// Function to resolve the graph and trace every ingress route
+int mpls_verify_run(struct mpls_verify *verify, int threads, mpls_verify_cb cb, void *arg,
+                    struct mpls_verify_stats *stats) {
+    struct mpls_verify_stats totals;
+    memset(&totals, 0, sizeof(totals));
+    if (stats) *stats = totals;
+    if (verify->ingress_base) return -EBUSY;
+
+    int ret = verify_resolve(verify);
+    if (ret < 0) return ret;
+    totals.nodes = verify->count;
+    for (size_t i = 0; i < verify->count; i++) totals.label_routes += verify->nodes[i].nlfib;
+
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    size_t chunks = (verify->ningress + VERIFY_CHUNK - 1) / VERIFY_CHUNK;
+    if ((size_t)threads > chunks) threads = (int)chunks;
+    if (threads > VERIFY_MAX_THREADS) threads = VERIFY_MAX_THREADS;
+    if (threads < 1) threads = 1;
+
+    struct mpls_verify_result *results = malloc((verify->ningress ? verify->ningress : 1) * sizeof(*results));
+    struct verify_trace *traces = malloc(threads * sizeof(*traces));
+    struct verify_worker *workers = malloc(threads * sizeof(*workers));
+    pthread_t *tids = malloc(threads * sizeof(*tids));
+    if (!results || !traces || !workers || !tids) {
+        free(results);
+        free(traces);
+        free(workers);
+        free(tids);
+        return -ENOMEM;
+    }
+
+    // The calling thread is worker 0; the graph is only read from here on
+    size_t next = 0;
+    int started = 1;
+    for (int i = 0; i < threads; i++) {
+        workers[i] = (struct verify_worker){verify, results, &next, &traces[i]};
+    }
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&tids[i], NULL, verify_worker_main, &workers[i]) != 0) break;
+        started++;
+    }
+    verify_worker_main(&workers[0]);
+    for (int i = 1; i < started; i++) pthread_join(tids[i], NULL);
+
+    for (size_t g = 0; g < verify->ningress; g++) {
+        switch (results[g].status) {
+        case MPLS_VERIFY_OK: totals.ok++; break;
+        case MPLS_VERIFY_MISMATCH: totals.mismatches++; break;
+        case MPLS_VERIFY_BLACKHOLE: totals.blackholes++; break;
+        case MPLS_VERIFY_LOOP: totals.loops++; break;
+        }
+        if (cb) cb(&results[g], arg);
+    }
+    totals.lsps = verify->ningress;
+    if (stats) *stats = totals;
+
+    free(results);
+    free(traces);
+    free(workers);
+    free(tids);
+    return totals.ok == totals.lsps ? 0 : -1;
+}
+
+// Function to free a graph
+void mpls_verify_close(struct mpls_verify *verify) {
+    if (!verify) return;
+    for (size_t i = 0; i < verify->count; i++) {
+        struct verify_node *n = &verify->nodes[i];
+        free(n->name);
+        free(n->lfib);
+        free(n->ingress);
+        free(n->legs);
+        free(n->labels);
+        free(n->addrs);
+    }
+    free(verify->nodes);
+    free(verify->owners);
+    free(verify->subnets);
+    free(verify->ingress_base);
+    free(verify);
+}
@@ -0,0 +1,143 @@
+/**
+ * @file mpls_verify.h
+ * @brief Static verification of label-switched paths across several nodes (network namespaces).
+ *
+ * The LFIB, the MPLS-encap IPv4 routes and the IPv4 addresses of every node
+ * are loaded into one graph. Next hops are resolved to nodes: a gateway
+ * address to the node that owns it, an interface without a gateway to the
+ * only other node with an address in the same subnet. Every ingress route
+ * (an IPv4 route that pushes labels) is then traced hop by hop, following
+ * every leg of multipath routes, until its label stack is empty. Traces run
+ * on several threads and only read the graph.
+ *
+ * Problems found on a path:
+ *   - label mismatch: a node receives a label it has no route for;
+ *   - blackhole: a route discards the packet (blackhole, unreachable or
+ *     prohibit type), or labels remain but the next hop is no known node;
+ *   - loop: a node is reached again with the same label stack, or the path
+ *     exceeds MPLS_VERIFY_MAX_HOPS.
+ */
+
+ #ifndef MPLS_VERIFY_H
+ #define MPLS_VERIFY_H
+ 
+ #include <stdint.h>
+ #include <netinet/in.h>
+ 
+ #pragma GCC visibility push(default)
+ 
+ struct mpls_session;
+ struct mpls_verify;
+ 
+ #define MPLS_VERIFY_MAX_HOPS 255        /**< Longest path traced, as bounded by the MPLS TTL. */
+ #define MPLS_VERIFY_MAX_BRANCHES 4096   /**< Multipath legs explored per ingress route; the rest are not traced. */
+ 
+ /**
+  * @brief Outcome of tracing one ingress route.
+  */
+ enum mpls_verify_status {
+     MPLS_VERIFY_OK,         /**< Every path reaches a node with an empty label stack. */
+     MPLS_VERIFY_MISMATCH,   /**< A node has no route for the label it receives. */
+     MPLS_VERIFY_BLACKHOLE,  /**< A route discards the packet or points at no known node. */
+     MPLS_VERIFY_LOOP        /**< A path revisits a state or is too long. */
+ };
+ 
+ /**
+  * @brief First problem found on the paths of an ingress route.
+  */
+ struct mpls_verify_result {
+     const char *node;               /**< Node holding the ingress route. */
+     struct in_addr dst;             /**< Destination of the ingress route. */
+     int dst_len;                    /**< Its prefix length. */
+     uint32_t push;                  /**< Outermost label it pushes. */
+     enum mpls_verify_status status; /**< What was found. */
+     const char *at;                 /**< Node where the problem was found, NULL if OK. */
+     uint32_t label;                 /**< Label being switched there (for an ingress hop, the pushed label). */
+     int hops;                       /**< Label-switching hops before the problem, or of the longest path if OK. */
+     const char *reason;             /**< Short explanation, NULL if OK. */
+ };
+ 
+ /**
+  * @brief Totals of a verification.
+  */
+ struct mpls_verify_stats {
+     unsigned long nodes;        /**< Nodes in the graph. */
+     unsigned long label_routes; /**< LFIB entries over all nodes. */
+     unsigned long lsps;         /**< Ingress routes traced. */
+     unsigned long ok;           /**< Ingress routes whose every path is correct. */
+     unsigned long mismatches;   /**< Ingress routes with a label mismatch. */
+     unsigned long blackholes;   /**< Ingress routes with a blackhole. */
+     unsigned long loops;        /**< Ingress routes with a loop. */
+ };
+ 
+ /**
+  * @brief Callback invoked for every ingress route, in the order the nodes and routes were loaded.
+  * @param result Outcome of the trace.
+  * @param arg User argument given to mpls_verify_run().
+  */
+ typedef void (*mpls_verify_cb)(const struct mpls_verify_result *result, void *arg);
+ 
+ /**
+  * @brief Creates an empty graph.
+  * @return The graph, or NULL with errno set.
+  */
+ struct mpls_verify *mpls_verify_open(void);
+ 
+ /**
+  * @brief Adds a node.
+  * @param verify Graph.
+  * @param name Name of the node; for mpls_verify_load_netns(), the network namespace.
+  * @return Index of the node, or negative errno on failure.
+  */
+ int mpls_verify_node(struct mpls_verify *verify, const char *name);
+ 
+ /**
+  * @brief Records an IPv4 address of a node, used to resolve next hops.
+  * @param verify Graph.
+  * @param node Index of the node.
+  * @param ifindex Interface holding the address.
+  * @param addr Address.
+  * @param prefix_len Length of its subnet.
+  * @return 0 on success, negative errno on failure.
+  */
+ int mpls_verify_add_address(struct mpls_verify *verify, int node, int ifindex, struct in_addr addr, int prefix_len);
+ 
+ /**
+  * @brief Reads the addresses, the LFIB and the MPLS-encap IPv4 routes of a node over a session.
+  * @param verify Graph.
+  * @param node Index of the node.
+  * @param session Session opened in the node's namespace.
+  * @return 0 on success, -EINTR if the routes changed during a dump (what was read is kept),
+  *         another negative errno on failure.
+  */
+ int mpls_verify_load(struct mpls_verify *verify, int node, struct mpls_session *session);
+ 
+ /**
+  * @brief Loads every node from the network namespace of the same name, one thread per node.
+  * @param verify Graph.
+  * @param errors If not NULL, receives the result of mpls_verify_load() for each node.
+  * @return 0 if every node was loaded, otherwise the first negative errno.
+  */
+ int mpls_verify_load_netns(struct mpls_verify *verify, int *errors);
+ 
+ /**
+  * @brief Resolves next hops and traces every ingress route.
+  * @param verify Graph; nothing may be added afterwards.
+  * @param threads Number of tracing threads, or 0 for one per online CPU.
+  * @param cb Called for every ingress route from the calling thread, may be NULL.
+  * @param arg User argument for @p cb.
+  * @param stats If not NULL, receives the totals.
+  * @return 0 if every path is correct, -1 if a problem was found, negative errno on failure.
+  */
+ int mpls_verify_run(struct mpls_verify *verify, int threads, mpls_verify_cb cb, void *arg,
+                     struct mpls_verify_stats *stats);
+ 
+ /**
+  * @brief Frees a graph.
+  * @param verify Graph, may be NULL.
+  */
+ void mpls_verify_close(struct mpls_verify *verify);
+ 
+ #pragma GCC visibility pop
+ 
+ #endif // MPLS_VERIFY_H
@@ -0,0 +1,63 @@
+/**
+ * @file mplsd.c
+ * @brief Route server that applies MPLS route commands received over a UNIX socket.
+ *
+ * Keeps one Netlink session and one interface cache open, so clients pay for
+ * neither, and sends the requests of concurrent clients in shared batches.
+ *
+ * Usage:
+ *  - mplsd [socket_path]   (default /run/mplsd.sock)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include "mpls_daemon.h" // Include header file for the route server
+#include "mpls_stats.h"  // Include header file for hot-path instrumentation
+
+static volatile sig_atomic_t stop_requested;
+
+/**
+ * @brief Asks the event loop to shut down.
+ *
+ * @param sig Signal number (unused).
+ */
+static void request_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+/**
+ * @brief Main function: serves requests until SIGINT or SIGTERM.
+ *
+ * @param argc Number of command-line arguments.
+ * @param argv Array of command-line arguments.
+ * @return EXIT_SUCCESS (0) after a clean shutdown, EXIT_FAILURE (1) on error.
+ */
+int main(int argc, char *argv[]) {
+    if (argc > 2) {
+        printf("Usage:\n  mplsd [socket_path]   (default %s)\n", MPLSD_SOCKET_PATH);
+        return EXIT_FAILURE;
+    }
+    const char *path = argc == 2 ? argv[1] : MPLSD_SOCKET_PATH;
+    if (mpls_stats_init() < 0) {
+        fprintf(stderr, "mplsd: MPLS_STATS must be json[:path] or prometheus[:path], instrumentation is off\n");
+    }
+
+    // No SA_RESTART: ppoll() must return so the loop sees the flag
+    struct sigaction sa = {.sa_handler = request_stop};
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "mplsd: serving %s\n", path);
+    int ret = mpls_daemon_run(path, &stop_requested);
+    if (ret < 0) {
+        fprintf(stderr, "mplsd: %s: %s\n", path, strerror(-ret));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
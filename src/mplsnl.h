@@ -0,0 +1,46 @@
+/**
+ * @file mplsnl.h
+ * @brief Public interface of libmplsnl, the route programming library behind mpls-cli and mplsd.
+ *
+ * Include this header and link with -lmplsnl (libmplsnl.a or libmplsnl.so)
+ * to program MPLS routes from a control-plane process instead of running
+ * mpls-cli once per route.
+ *
+ * Conventions that hold across the library:
+ *   - functions return 0 or a count on success and a negative errno on
+ *     failure; constructors return NULL with errno set; nothing calls exit();
+ *   - the session, batch and async paths never write to stdout or stderr.
+ *     Only the functions documented as reporting to a stream do: the file
+ *     front-ends of batch, sync and restore, the show/monitor printers, and
+ *     a namespace worker that cannot enter its namespace;
+ *   - a struct mpls_session and everything opened on it belong to one thread
+ *     at a time; separate sessions may be used from separate threads at once.
+ *     The MPLS_STATS counters are the only shared state and are atomic.
+ */
+
+ #ifndef MPLSNL_H
+ #define MPLSNL_H
+ 
+ #define MPLSNL_VERSION_MAJOR 3  /**< Changes when a declaration in these headers changes incompatibly. */
+ #define MPLSNL_VERSION_MINOR 0  /**< Changes when declarations are added. */
+ 
+ #include "mpls_core.h"
+ #include "mpls_routes.h"
+ #include "mpls_batch.h"
+ #include "mpls_async.h"
+ #include "mpls_dump.h"
+ #include "mpls_sync.h"
+ #include "mpls_ifcache.h"
+ #include "mpls_monitor.h"
+ #include "mpls_labels.h"
+ #include "mpls_snapshot.h"
+ #include "mpls_netns.h"
+ #include "mpls_daemon.h"
+ #include "mpls_stats.h"
+ #include "mpls_fake.h"
+ #include "mpls_frr.h"
+ #include "mpls_ifstats.h"
+ #include "mpls_verify.h"
+ #include "mpls_nhobj.h"
+ 
+ #endif // MPLSNL_H
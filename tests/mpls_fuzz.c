@@ -0,0 +1,310 @@
+/**
+ * @file mpls_fuzz.c
+ * @brief Fuzz target for the route parser, the request builders and the route message decoder.
+ *
+ * An input starting with 'M' is a route message as a dump would deliver it:
+ * it is decoded and printed in both "show" formats. Any other input is a
+ * route line in "add_for" syntax. A line that parses must satisfy:
+ *  - its formatted text parses back to the same text;
+ *  - build_mpls_route() and a request template encode it to the same bytes;
+ *  - the encoded request decodes, and "show" prints it back as the same route;
+ *  - the fake kernel, which refuses what rtnetlink refuses, does not reject
+ *    it as malformed (-EINVAL).
+ * A broken invariant aborts, so the fuzzer reports the input.
+ *
+ * Built with -DMPLS_FUZZ_LIBFUZZER, the file is a libFuzzer target. Otherwise
+ * it carries its own driver, which mutates a built-in set of routes:
+ *
+ * Usage:
+ *  - mpls-fuzz [iterations] [seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <linux/rtnetlink.h>
+#include "mplsnl.h"       // Include header file for the whole library
+
+#define FUZZ_LINE_MAX 512        // Longest route line tried
+#define FUZZ_ARGS_MAX 64         // Most arguments in one line
+#define FUZZ_ITERATIONS 200000   // Default number of inputs of the built-in driver
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static struct mpls_session fuzz_session;
+static struct mpls_fake *fuzz_fake;
+static FILE *fuzz_null;
+
+// Function to stop on a broken invariant, showing the input that broke it
+#define FUZZ_ASSERT(cond, text)                                                       \
+    do {                                                                              \
+        if (!(cond)) {                                                                \
+            fprintf(stderr, "%s:%d: %s: \"%s\"\n", __FILE__, __LINE__, #cond, text);  \
+            abort();                                                                  \
+        }                                                                             \
+    } while (0)
+
+/**
+ * @brief Parses a route line, in place.
+ *
+ * @param line Line to split; overwritten.
+ * @param route Receives the route.
+ * @return 0 on success, -1 if the line does not parse.
+ */
+static int fuzz_parse(char *line, struct mpls_route *route) {
+    char *argv[FUZZ_ARGS_MAX];
+    const char *err = NULL;
+    int argc = mpls_split_route_args(line, argv, FUZZ_ARGS_MAX);
+    if (argc <= 0) return -1;
+    return parse_mpls_route(argc, argv, route, &err);
+}
+
+/**
+ * @brief Decodes a route message and prints it in both formats.
+ *
+ * @param nlh Message whose length fits the buffer it is in.
+ * @param len Bytes available at @p nlh.
+ * @param plain Receives the plain text, if not NULL.
+ * @param size Size of @p plain.
+ * @return 1 if the plain format printed the route, 0 if it skipped it, -1 if the message does not decode.
+ */
+static int fuzz_show(const struct nlmsghdr *nlh, size_t len, char *plain, size_t size) {
+    struct mpls_route_entry entry;
+    if (!NLMSG_OK(nlh, (unsigned int)len) || mpls_route_entry_parse(nlh, &entry) < 0) return -1;
+    mpls_print_route_entry(fuzz_null, MPLS_SHOW_JSON, &entry, NULL, "");
+    if (!plain) return mpls_print_route_entry(fuzz_null, MPLS_SHOW_PLAIN, &entry, NULL, "");
+
+    FILE *out = fmemopen(plain, size, "w");
+    if (!out) return -1;
+    int printed = mpls_print_route_entry(out, MPLS_SHOW_PLAIN, &entry, NULL, "");
+    fclose(out);
+    plain[size - 1] = '\0';
+    return printed;
+}
+
+/**
+ * @brief Checks the invariants of one route line that parses.
+ *
+ * @param route Parsed route.
+ * @param text The line, for reports.
+ */
+static void fuzz_route(const struct mpls_route *route, const char *text) {
+    char formatted[FUZZ_LINE_MAX], again[FUZZ_LINE_MAX], scratch[FUZZ_LINE_MAX];
+    struct mpls_route reparsed;
+
+    // The text form is what "show" prints and "sync" reads back
+    FUZZ_ASSERT(format_mpls_route(route, formatted, sizeof(formatted)) > 0, text);
+    memcpy(scratch, formatted, sizeof(scratch));
+    FUZZ_ASSERT(fuzz_parse(scratch, &reparsed) == 0, formatted);
+    FUZZ_ASSERT(format_mpls_route(&reparsed, again, sizeof(again)) > 0, formatted);
+    FUZZ_ASSERT(strcmp(formatted, again) == 0, formatted);
+    if (route->auto_label) return;
+
+    for (int op = MPLS_OP_ADD; op <= MPLS_OP_DELETE; op++) {
+        char msg[MPLS_ROUTE_MSG_MAX], filled[MPLS_ROUTE_MSG_MAX];
+        struct nlmsghdr *nlh = (struct nlmsghdr *)msg;
+        memset(msg, 0, sizeof(msg));
+        if (build_mpls_route(nlh, sizeof(msg), route, op, NULL) < 0) continue;
+        FUZZ_ASSERT(nlh->nlmsg_len <= sizeof(msg), text);
+
+        if (route->kind != MPLS_ROUTE_MULTIPATH) {
+            static struct mpls_route_template tmpl;
+            memset(filled, 0, sizeof(filled));
+            FUZZ_ASSERT(mpls_route_template_init(&tmpl, route, op, NULL) == 0, text);
+            FUZZ_ASSERT(mpls_route_template_matches(&tmpl, route, op), text);
+            FUZZ_ASSERT(mpls_route_template_fill(&tmpl, (struct nlmsghdr *)filled, sizeof(filled), route, NULL) == 0,
+                        text);
+            FUZZ_ASSERT(memcmp(msg, filled, nlh->nlmsg_len) == 0, text);
+        }
+
+        // What the kernel would hold after an add prints back as the route that was added
+        if (op != MPLS_OP_ADD) {
+            FUZZ_ASSERT(fuzz_show(nlh, nlh->nlmsg_len, NULL, 0) >= 0, text);
+            continue;
+        }
+        int printed = fuzz_show(nlh, nlh->nlmsg_len, scratch, sizeof(scratch));
+        FUZZ_ASSERT(printed >= 0, text);
+        if (printed && route->kind != MPLS_ROUTE_PUSH_NHID) {
+            FUZZ_ASSERT(fuzz_parse(scratch, &reparsed) == 0, text);
+            FUZZ_ASSERT(format_mpls_route(&reparsed, again, sizeof(again)) > 0, text);
+            FUZZ_ASSERT(strcmp(formatted, again) == 0, text);
+        }
+    }
+
+    // A route through a nexthop object names one the fake kernel does not hold, and reserved
+    // incoming labels (0-15) are refused by policy, with the kernel's own message
+    if (route->kind == MPLS_ROUTE_PUSH_NHID) return;
+    if (!mpls_route_is_push(route) && route->label < 16) return;
+    int ret = session_apply_mpls_route(&fuzz_session, route, MPLS_OP_REPLACE);
+    if (ret == -ENODEV) return;
+    FUZZ_ASSERT(ret == 0, text);
+    FUZZ_ASSERT(session_apply_mpls_route(&fuzz_session, route, MPLS_OP_DELETE) == 0, text);
+}
+
+// Function to check one input: a route line, or 'M' and a route message
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (!fuzz_fake) {
+        fuzz_fake = mpls_fake_open(&fuzz_session, 0, NULL);
+        fuzz_null = fopen("/dev/null", "w");
+        if (!fuzz_fake || !fuzz_null) abort();
+    }
+
+    if (size > 0 && data[0] == 'M') {
+        // Aligned like a receive buffer, and no longer than what was received
+        static uint32_t buf[MPLS_ROUTE_MSG_MAX * 4 / sizeof(uint32_t)];
+        size_t len = size - 1 < sizeof(buf) ? size - 1 : sizeof(buf);
+        memcpy(buf, data + 1, len);
+        fuzz_show((const struct nlmsghdr *)buf, len, NULL, 0);
+        return 0;
+    }
+
+    char line[FUZZ_LINE_MAX], text[FUZZ_LINE_MAX];
+    if (size >= sizeof(line) || memchr(data, '\0', size)) return 0;
+    memcpy(line, data, size);
+    line[size] = '\0';
+    memcpy(text, line, size + 1);
+
+    struct mpls_route route;
+    memset(&route, 0, sizeof(route));
+    if (fuzz_parse(line, &route) == 0) fuzz_route(&route, text);
+    return 0;
+}
+
+#ifndef MPLS_FUZZ_LIBFUZZER
+
+static const char *const fuzz_seeds[] = {
+    "100 dev lo",
+    "101 next_hop 10.0.0.1",
+    "102 swap_as 200 dev lo",
+    "103 swap_as 200/300/400 next_hop 10.0.0.2",
+    "10.1.0.1 push 16001 dev lo",
+    "10.1.0.2 push 16001/16002 ttl 64 next_hop 10.0.0.3",
+    "104 multipath next_hop 10.0.0.1 swap_as 201 next_hop 10.0.0.2 swap_as 202",
+    "105 multipath dev lo weight 1 next_hop 10.0.0.4",
+    "10.1.0.3 nhid 7",
+    "auto swap_as 300 dev lo",
+    "106 s_bit 0 dev lo",
+};
+
+static const char *const fuzz_words[] = {
+    "dev", "lo", "next_hop", "swap_as", "push", "ttl", "multipath", "weight", "nhid", "auto", "s_bit",
+    "0", "1", "2", "15", "16", "255", "256", "1048575", "1048576", "4294967295", "-1",
+    "10.0.0.1", "0.0.0.0", "255.255.255.255", "1/2", "16/17/18/19/20/21/22/23/24", "1//2", "/", "lo0",
+    "0x10", "010", "1e3", "",
+};
+
+/**
+ * @brief Returns a pseudo-random number from the driver's own generator.
+ *
+ * @param state Generator state.
+ * @return Next number.
+ */
+static uint32_t fuzz_rand(uint64_t *state) {
+    *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+    return (uint32_t)(*state >> 33);
+}
+
+/**
+ * @brief Mutates a route line: swaps, inserts or drops a word, or flips a byte.
+ *
+ * @param line Line to mutate, FUZZ_LINE_MAX bytes.
+ * @param state Generator state.
+ */
+static void fuzz_mutate_line(char *line, uint64_t *state) {
+    char copy[FUZZ_LINE_MAX];
+    char *words[FUZZ_ARGS_MAX + 1];
+    memcpy(copy, line, FUZZ_LINE_MAX);
+    int n = mpls_split_route_args(copy, words, FUZZ_ARGS_MAX);
+    if (n < 0) n = 0;
+
+    const char *word = fuzz_words[fuzz_rand(state) % (sizeof(fuzz_words) / sizeof(fuzz_words[0]))];
+    uint32_t at = fuzz_rand(state) % (n + 1);
+    switch (fuzz_rand(state) % 4) {
+    case 0:  // Replace a word
+        if (at < (uint32_t)n) words[at] = (char *)word;
+        break;
+    case 1:  // Insert a word
+        if (n == FUZZ_ARGS_MAX) break;
+        memmove(&words[at + 1], &words[at], (n - at) * sizeof(words[0]));
+        words[at] = (char *)word;
+        n++;
+        break;
+    case 2:  // Drop a word
+        if (at == (uint32_t)n) break;
+        memmove(&words[at], &words[at + 1], (n - at - 1) * sizeof(words[0]));
+        n--;
+        break;
+    default: {  // Flip a bit
+        size_t len = strlen(line);
+        if (len) line[fuzz_rand(state) % len] ^= (char)(1u << (fuzz_rand(state) % 7));
+        return;
+    }
+    }
+
+    char out[FUZZ_LINE_MAX];
+    size_t len = 0;
+    out[0] = '\0';
+    for (int i = 0; i < n; i++) {
+        int w = snprintf(out + len, sizeof(out) - len, "%s%s", i ? " " : "", words[i]);
+        if (w < 0 || (size_t)w >= sizeof(out) - len) break;
+        len += w;
+    }
+    memcpy(line, out, len + 1);
+}
+
+/**
+ * @brief Builds a route message from a seed and flips bytes in it.
+ *
+ * @param buf Receives 'M' and the message.
+ * @param size Size of @p buf.
+ * @param state Generator state.
+ * @return Length of the input.
+ */
+static size_t fuzz_mutate_msg(uint8_t *buf, size_t size, uint64_t *state) {
+    char line[FUZZ_LINE_MAX];
+    char msg[MPLS_ROUTE_MSG_MAX];
+    struct nlmsghdr *nlh = (struct nlmsghdr *)msg;
+    struct mpls_route route;
+    snprintf(line, sizeof(line), "%s", fuzz_seeds[fuzz_rand(state) % (sizeof(fuzz_seeds) / sizeof(fuzz_seeds[0]))]);
+    buf[0] = 'M';
+    if (fuzz_parse(line, &route) < 0 || route.auto_label ||
+        build_mpls_route(nlh, sizeof(msg), &route, MPLS_OP_ADD, NULL) < 0 || nlh->nlmsg_len >= size) {
+        return 1;
+    }
+
+    size_t len = nlh->nlmsg_len;
+    memcpy(buf + 1, msg, len);
+    for (uint32_t flips = 1 + fuzz_rand(state) % 8; flips > 0; flips--) {
+        buf[1 + fuzz_rand(state) % len] = (uint8_t)fuzz_rand(state);
+    }
+    // Sometimes cut short, as a truncated datagram would be
+    if (fuzz_rand(state) % 4 == 0) len -= fuzz_rand(state) % len;
+    return 1 + len;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : FUZZ_ITERATIONS;
+    uint64_t state = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    char line[FUZZ_LINE_MAX];
+    uint8_t msg[1 + MPLS_ROUTE_MSG_MAX];
+
+    for (unsigned long i = 0; i < iterations; i++) {
+        if (i % 4 == 3) {
+            LLVMFuzzerTestOneInput(msg, fuzz_mutate_msg(msg, sizeof(msg), &state));
+            continue;
+        }
+        snprintf(line, sizeof(line), "%s", fuzz_seeds[fuzz_rand(&state) % (sizeof(fuzz_seeds) / sizeof(fuzz_seeds[0]))]);
+        for (uint32_t steps = 1 + fuzz_rand(&state) % 3; steps > 0; steps--) fuzz_mutate_line(line, &state);
+        LLVMFuzzerTestOneInput((const uint8_t *)line, strlen(line));
+    }
+    printf("%lu inputs\n", iterations);
+
+    mpls_session_close(&fuzz_session);
+    mpls_fake_close(fuzz_fake);
+    fclose(fuzz_null);
+    return 0;
+}
+
+#endif // MPLS_FUZZ_LIBFUZZER
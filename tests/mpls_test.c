@@ -0,0 +1,550 @@
+/**
+ * @file mpls_test.c
+ * @brief Regression tests of the route path, run against the in-process fake kernel.
+ *
+ * Each test opens a session on a fresh fake kernel from mpls_fake.h, so the
+ * suite needs neither root nor MPLS support. It covers:
+ *  - add, replace, delete and dump through a pipelined mpls_batch, with and
+ *    without ack_errors, and with every Nth ACK dropped (ENOBUFS);
+ *  - the asynchronous API, whose dispatch must not block on an overrun;
+ *  - multipath legs, which the kernel rejects when they carry a weight;
+ *  - "sync", which must leave routes of other protocols alone;
+ *  - arming protected routes while their link flaps, in a network namespace
+ *    of its own (skipped when one cannot be created).
+ *
+ * Usage:
+ *  - mpls-test
+ *
+ * Prints one line per test and exits non-zero if any of them failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <net/if.h>
+#include <linux/rtnetlink.h>
+#include "mplsnl.h"       // Include header file for the whole library
+
+#define TEST_ROUTES 2000   // Routes per batch phase, more than one send buffer and ACK window
+#define TEST_SKIP 77       // Exit status of a test that cannot run here
+
+static int test_failures;
+
+// Function to record a failed expectation without stopping the test
+#define CHECK(cond)                                                                \
+    do {                                                                           \
+        if (!(cond)) {                                                             \
+            fprintf(stderr, "  %s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++;                                                       \
+        }                                                                          \
+    } while (0)
+
+/**
+ * @brief Parses one route line.
+ *
+ * @param line Route in "add_for" syntax, without the verb.
+ * @param route Receives the route.
+ * @return 0 on success, -1 if the line does not parse.
+ */
+static int test_parse(const char *line, struct mpls_route *route) {
+    char buf[256];
+    char *argv[64];
+    const char *err = NULL;
+    snprintf(buf, sizeof(buf), "%s", line);
+    int argc = mpls_split_route_args(buf, argv, 64);
+    return argc < 0 ? -1 : parse_mpls_route(argc, argv, route, &err);
+}
+
+struct test_phase {
+    unsigned long ok;
+    unsigned long failed;  // Failures other than ENOBUFS
+    unsigned long lost;    // Failures with ENOBUFS: the ACK was lost and the outcome is unknown
+    unsigned long mixed;   // Failures with another error than the one before
+    int error;             // Last error other than ENOBUFS
+};
+
+/**
+ * @brief Counts the outcome of one request in the phase its tag names.
+ *
+ * @param tag Phase times TEST_ROUTES plus the route index.
+ * @param error 0 on success, negative errno on failure.
+ * @param detail Kernel's explanation of a failure (unused).
+ * @param arg Array of phases.
+ */
+static void test_result(unsigned long tag, int error, const char *detail, void *arg) {
+    (void)detail;
+    struct test_phase *phase = &((struct test_phase *)arg)[tag / TEST_ROUTES];
+    if (error == -ENOBUFS) {
+        phase->lost++;
+    } else if (error) {
+        if (phase->failed && error != phase->error) phase->mixed++;
+        phase->failed++;
+        phase->error = error;
+    } else {
+        phase->ok++;
+    }
+}
+
+/**
+ * @brief Tells whether every request of a phase had the expected outcome or, with ACKs dropped, an unknown one.
+ *
+ * @param phase Phase to check.
+ * @param count Requests in the phase.
+ * @param error Expected outcome, 0 for success.
+ * @param enobufs_every Whether ACKs were dropped.
+ * @return 1 if the phase went as expected, 0 otherwise.
+ */
+static int test_outcome(const struct test_phase *phase, unsigned long count, int error, unsigned int enobufs_every) {
+    if (phase->lost && !enobufs_every) return 0;
+    if (error == 0) return phase->failed == 0 && phase->ok + phase->lost == count;
+    return phase->ok == 0 && phase->mixed == 0 && phase->failed + phase->lost == count &&
+           (phase->failed == 0 || phase->error == error);
+}
+
+struct test_dump {
+    unsigned long routes;
+    unsigned long swapped;  // Routes whose out label is the expected one
+    uint32_t out_label;
+};
+
+/**
+ * @brief Counts one dumped label route and checks its out label.
+ *
+ * @param entry Dumped route.
+ * @param arg Dump counters.
+ * @return 0 to continue the dump.
+ */
+static int test_dump_route(const struct mpls_route_entry *entry, void *arg) {
+    struct test_dump *dump = (struct test_dump *)arg;
+    uint32_t labels[MPLS_MAX_LABELS];
+    dump->routes++;
+    if (mpls_entry_labels(entry->tb[RTA_NEWDST], labels, MPLS_MAX_LABELS) == 1 && labels[0] == dump->out_label) {
+        dump->swapped++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Queues one phase of route requests on a batch.
+ *
+ * @param batch Batch to queue on.
+ * @param phase Phase number, encoded in the tags.
+ * @param count Number of routes, labels 100 and up.
+ * @param inet Whether the routes are IPv4 destinations 10.0.0.1 and up rather than labels.
+ * @param action Route after the label or destination (ignored for deletes).
+ * @param op Operation.
+ */
+static void test_queue(struct mpls_batch *batch, int phase, int count, int inet, const char *action,
+                       enum mpls_route_op op) {
+    for (int i = 0; i < count; i++) {
+        char line[128];
+        struct mpls_route route;
+        if (inet) {
+            snprintf(line, sizeof(line), "10.0.%d.%d %s", (i + 1) / 256, (i + 1) % 256, action);
+        } else {
+            snprintf(line, sizeof(line), "%d %s", 100 + i, action);
+        }
+        if (test_parse(line, &route) < 0) {
+            mpls_batch_reject(batch, (unsigned long)phase * TEST_ROUTES + i, -EINVAL);
+            continue;
+        }
+        mpls_batch_queue(batch, &route, op, (unsigned long)phase * TEST_ROUTES + i);
+    }
+    // Non-blocking on purpose: an overrun found here is settled by the next queue
+    mpls_batch_flush(batch);
+}
+
+/**
+ * @brief Runs adds, duplicate adds, replaces and deletes through batches and checks every outcome.
+ *
+ * A request whose ACK is dropped may end with ENOBUFS instead of its outcome, but never with another one.
+ *
+ * @param ack_errors Whether the kernel only ACKs failures.
+ * @param enobufs_every Drop every Nth ACK, 0 for never.
+ */
+static void test_batch(int ack_errors, unsigned int enobufs_every) {
+    struct mpls_session session;
+    struct mpls_fake_options options = {0, enobufs_every};
+    struct mpls_fake *fake = mpls_fake_open(&session, MPLS_SESSION_SOCK_BUF, &options);
+    CHECK(fake != NULL);
+    if (!fake) return;
+    session.ack_errors = ack_errors;
+
+    struct test_phase phases[6];
+    memset(phases, 0, sizeof(phases));
+    struct mpls_batch *batch = mpls_batch_open(&session, test_result, phases);
+    test_queue(batch, 0, TEST_ROUTES, 0, "dev lo", MPLS_OP_ADD);
+    // The same routes again: the tables look as if the add succeeded, but it meets EEXIST
+    test_queue(batch, 1, TEST_ROUTES, 0, "dev lo", MPLS_OP_ADD);
+    // Different routes under the same labels: a lost EEXIST is retried and met again
+    test_queue(batch, 2, TEST_ROUTES, 0, "swap_as 600 dev lo", MPLS_OP_ADD);
+    test_queue(batch, 3, TEST_ROUTES, 0, "swap_as 500 dev lo", MPLS_OP_REPLACE);
+    struct mpls_batch_stats stats;
+    CHECK(mpls_batch_finish(batch, &stats) < 0);  // Phases 1 and 2 fail on purpose
+    CHECK(stats.routes == 4 * TEST_ROUTES);
+
+    CHECK(test_outcome(&phases[0], TEST_ROUTES, 0, enobufs_every));
+    CHECK(test_outcome(&phases[1], TEST_ROUTES, -EEXIST, enobufs_every));
+    CHECK(test_outcome(&phases[2], TEST_ROUTES, -EEXIST, enobufs_every));
+    // A replace that the tables reflect succeeded whatever was there before
+    CHECK(phases[3].ok == TEST_ROUTES && phases[3].failed == 0 && phases[3].lost == 0);
+
+    struct test_dump dump = {0, 0, 500};
+    CHECK(mpls_dump_routes(&session, AF_MPLS, test_dump_route, &dump) == 0);
+    CHECK(dump.routes == TEST_ROUTES && dump.swapped == TEST_ROUTES);
+
+    // The kernel forgives deleting a label without a route, but not an IPv4 route that is not there
+    batch = mpls_batch_open(&session, test_result, phases);
+    test_queue(batch, 4, TEST_ROUTES / 2, 0, "dev lo", MPLS_OP_DELETE);
+    test_queue(batch, 5, TEST_ROUTES / 2, 1, "push 100 dev lo", MPLS_OP_DELETE);
+    CHECK(mpls_batch_finish(batch, &stats) < 0);
+    CHECK(phases[4].ok == TEST_ROUTES / 2 && phases[4].failed == 0 && phases[4].lost == 0);
+    CHECK(test_outcome(&phases[5], TEST_ROUTES / 2, -ESRCH, enobufs_every));
+    CHECK(mpls_fake_routes(fake) == TEST_ROUTES / 2);
+
+    mpls_session_close(&session);
+    mpls_fake_close(fake);
+}
+
+struct test_async {
+    unsigned long ok;
+    unsigned long failed;
+    unsigned long lost;  // Lost ACKs of adds whose route was in place: the outcome is unknown
+};
+
+/**
+ * @brief Counts the outcome of one asynchronous request.
+ *
+ * @param error 0 on success, negative errno on failure.
+ * @param detail Kernel's explanation of a failure (unused).
+ * @param cookie Counters.
+ */
+static void test_async_done(int error, const char *detail, void *cookie) {
+    (void)detail;
+    struct test_async *counts = (struct test_async *)cookie;
+    if (error == -ENOBUFS) {
+        counts->lost++;
+    } else if (error) {
+        counts->failed++;
+    } else {
+        counts->ok++;
+    }
+}
+
+/**
+ * @brief Submits routes asynchronously while ACKs are dropped and checks that all of them land.
+ *
+ * @param ack_errors Whether the kernel only ACKs failures.
+ * @param enobufs_every Drop every Nth ACK, 0 for never.
+ */
+static void test_async(int ack_errors, unsigned int enobufs_every) {
+    struct mpls_session session;
+    struct mpls_fake_options options = {0, enobufs_every};
+    struct mpls_fake *fake = mpls_fake_open(&session, MPLS_SESSION_SOCK_BUF, &options);
+    CHECK(fake != NULL);
+    if (!fake) return;
+    session.ack_errors = ack_errors;
+
+    struct test_async counts = {0, 0, 0};
+    struct mpls_async *async = mpls_async_open(&session);
+    int overruns = 0;
+    for (int i = 0; i < 2 * TEST_ROUTES; i++) {
+        char line[64];
+        struct mpls_route route;
+        snprintf(line, sizeof(line), "%d dev lo", 100 + i);
+        CHECK(test_parse(line, &route) == 0);
+        while (mpls_async_submit(async, &route, MPLS_OP_ADD, test_async_done, &counts) == -EAGAIN) {
+            int ret = mpls_async_dispatch(async);
+            CHECK(ret >= 0 || ret == -ENOBUFS);
+            if (ret == -ENOBUFS) {
+                overruns++;
+                mpls_async_recover(async);
+            }
+        }
+    }
+
+    // Whatever is still outstanding must either have an ACK queued or be waiting for a recovery
+    while (mpls_async_pending(async) > 0) {
+        int ret = mpls_async_dispatch(async);
+        if (ret == -ENOBUFS) {
+            overruns++;
+            mpls_async_recover(async);
+            continue;
+        }
+        CHECK(ret >= 0);
+        if (ret < 0 || mpls_async_pending(async) == 0) break;
+        struct pollfd pfd = {mpls_async_fd(async), POLLIN, 0};
+        int ready = poll(&pfd, 1, 1000);
+        CHECK(ready == 1);
+        if (ready != 1) break;
+    }
+    mpls_async_close(async);
+
+    CHECK(counts.ok + counts.lost == 2 * TEST_ROUTES && counts.failed == 0);
+    CHECK(enobufs_every || counts.lost == 0);
+    CHECK(mpls_fake_routes(fake) == 2 * TEST_ROUTES);
+    // Dropping every third ACK is sure to hit one; with ack_errors, 97 may never be reached
+    CHECK(enobufs_every == 0 ? overruns == 0 : enobufs_every > 3 || overruns > 0);
+    mpls_session_close(&session);
+    mpls_fake_close(fake);
+}
+
+/**
+ * @brief Returns the first leg of the RTA_MULTIPATH attribute of an encoded route.
+ *
+ * @param nlh Encoded route request.
+ * @return The leg, or NULL if the request has no RTA_MULTIPATH.
+ */
+static struct rtnexthop *test_first_leg(struct nlmsghdr *nlh) {
+    struct rtmsg *rtm = (struct rtmsg *)NLMSG_DATA(nlh);
+    int len = RTM_PAYLOAD(nlh);
+    for (struct rtattr *rta = RTM_RTA(rtm); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if (rta->rta_type == RTA_MULTIPATH) return (struct rtnexthop *)RTA_DATA(rta);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Checks that multipath weights are refused, and that a weight the kernel would reject never reaches it.
+ */
+static void test_multipath_weight(void) {
+    struct mpls_route route;
+    CHECK(test_parse("100 multipath next_hop 10.0.0.1 weight 2 next_hop 10.0.0.2", &route) < 0);
+    CHECK(test_parse("100 multipath next_hop 10.0.0.1 weight 1 swap_as 200 next_hop 10.0.0.2", &route) == 0);
+
+    struct mpls_session session;
+    struct mpls_fake *fake = mpls_fake_open(&session, 0, NULL);
+    CHECK(fake != NULL);
+    if (!fake) return;
+    CHECK(session_apply_mpls_route(&session, &route, MPLS_OP_ADD) == 0);
+
+    char msg[MPLS_ROUTE_MSG_MAX];
+    struct nlmsghdr *nlh = (struct nlmsghdr *)msg;
+    route.label = 101;
+    route.nexthops[0].weight = 2;
+    CHECK(build_mpls_route(nlh, sizeof(msg), &route, MPLS_OP_ADD, NULL) == -EINVAL);
+
+    // The fake kernel must refuse what the real one refuses
+    route.nexthops[0].weight = 1;
+    CHECK(build_mpls_route(nlh, sizeof(msg), &route, MPLS_OP_ADD, NULL) == 0);
+    struct rtnexthop *leg = test_first_leg(nlh);
+    CHECK(leg != NULL && leg->rtnh_hops == 0);
+    if (leg) leg->rtnh_hops = 1;
+    struct test_phase phase = {0, 0, 0, 0, 0};
+    struct mpls_batch *batch = mpls_batch_open(&session, test_result, &phase);
+    mpls_batch_queue_msg(batch, nlh, 0);
+    mpls_batch_finish(batch, NULL);
+    CHECK(phase.failed == 1 && phase.error == -EINVAL);
+    CHECK(mpls_fake_routes(fake) == 1);
+
+    mpls_session_close(&session);
+    mpls_fake_close(fake);
+}
+
+/**
+ * @brief Checks that "sync" deletes stale routes of its own protocol only.
+ */
+static void test_sync_scope(void) {
+    struct mpls_session session;
+    struct mpls_fake *fake = mpls_fake_open(&session, 0, NULL);
+    CHECK(fake != NULL);
+    if (!fake) return;
+
+    static const char *const lines[] = {"100 dev lo", "200 dev lo", "300 dev lo"};
+    struct mpls_batch *batch = mpls_batch_open(&session, NULL, NULL);
+    for (int i = 0; i < 3; i++) {
+        struct mpls_route route;
+        char msg[MPLS_ROUTE_MSG_MAX];
+        struct nlmsghdr *nlh = (struct nlmsghdr *)msg;
+        CHECK(test_parse(lines[i], &route) == 0);
+        CHECK(build_mpls_route(nlh, sizeof(msg), &route, MPLS_OP_ADD, NULL) == 0);
+        // Label 300 stands for a route some other daemon installed
+        if (i == 2) ((struct rtmsg *)NLMSG_DATA(nlh))->rtm_protocol = RTPROT_STATIC;
+        mpls_batch_queue_msg(batch, nlh, i);
+    }
+    CHECK(mpls_batch_finish(batch, NULL) == 0);
+
+    char desired[] = "100 dev lo\n";
+    FILE *in = fmemopen(desired, strlen(desired), "r");
+    struct mpls_sync_stats stats;
+    CHECK(mpls_sync_run(&session, in, "desired", 0, &stats) == 0);
+    fclose(in);
+    CHECK(stats.unchanged == 1 && stats.deleted == 1 && stats.failed == 0);
+    CHECK(mpls_fake_routes(fake) == 2);
+
+    mpls_session_close(&session);
+    mpls_fake_close(fake);
+}
+
+/**
+ * @brief Checks that a dump answered with every family's routes yields only the family asked for.
+ */
+static void test_dump_family(void) {
+    struct mpls_session session;
+    struct mpls_fake *fake = mpls_fake_open(&session, 0, NULL);
+    CHECK(fake != NULL);
+    if (!fake) return;
+
+    struct mpls_batch *batch = mpls_batch_open(&session, NULL, NULL);
+    struct mpls_route route;
+    CHECK(test_parse("100 dev lo", &route) == 0);
+    mpls_batch_queue(batch, &route, MPLS_OP_ADD, 0);
+    CHECK(mpls_batch_finish(batch, NULL) == 0);
+
+    // The fake, like a kernel without an IPv6 route table, answers this dump with the LFIB
+    struct test_dump dump = {0, 0, 0};
+    CHECK(mpls_dump_routes(&session, AF_INET6, test_dump_route, &dump) == 0);
+    CHECK(dump.routes == 0);
+    CHECK(mpls_dump_routes(&session, AF_MPLS, test_dump_route, &dump) == 0);
+    CHECK(dump.routes == 1);
+
+    mpls_session_close(&session);
+    mpls_fake_close(fake);
+}
+
+/**
+ * @brief Sets or clears IFF_UP on an interface.
+ *
+ * @param ifname Interface name.
+ * @param up Non-zero to bring it up.
+ * @return 0 on success, -1 on failure.
+ */
+static int test_link_set(const char *ifname, int up) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return -1;
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", ifname);
+    int ret = ioctl(fd, SIOCGIFFLAGS, &ifr);
+    if (ret == 0) {
+        if (up) ifr.ifr_flags |= IFF_UP; else ifr.ifr_flags &= ~IFF_UP;
+        ret = ioctl(fd, SIOCSIFFLAGS, &ifr);
+    }
+    close(fd);
+    return ret;
+}
+
+/**
+ * @brief Arms a protected route while its link flaps, then switches it, in the current namespace.
+ *
+ * @return 0 if every check passed, 1 otherwise.
+ */
+static int test_frr_child(void) {
+    struct mpls_session session;
+    struct mpls_fake *fake = mpls_fake_open(&session, MPLS_SESSION_SOCK_BUF, NULL);
+    struct mpls_frr *frr = fake ? mpls_frr_open(&session) : NULL;
+    CHECK(frr != NULL);
+    if (!frr) return 1;
+
+    struct mpls_route primary, backup;
+    CHECK(test_parse("100 swap_as 200 dev lo", &primary) == 0);
+    CHECK(test_parse("100 swap_as 300 next_hop 10.0.0.9", &backup) == 0);
+    CHECK(mpls_frr_add(frr, &primary, &backup) == 0);
+
+    // Both changes are queued on the link socket and are read during the first dump of arming,
+    // the second one for a link whose state is known already
+    CHECK(test_link_set("lo", 1) == 0);
+    CHECK(test_link_set("lo", 0) == 0);
+    struct mpls_batch_stats stats;
+    CHECK(mpls_frr_arm(frr, &stats) == 0);
+    struct test_dump dump = {0, 0, 300};
+    CHECK(mpls_dump_routes(&session, AF_MPLS, test_dump_route, &dump) == 0);
+    CHECK(dump.routes == 1 && dump.swapped == 1);
+
+    // Back up: the primary returns
+    CHECK(test_link_set("lo", 1) == 0);
+    struct pollfd pfd = {mpls_frr_fd(frr), POLLIN, 0};
+    CHECK(poll(&pfd, 1, 1000) == 1);
+    CHECK(mpls_frr_dispatch(frr, NULL, NULL) >= 1);
+    dump = (struct test_dump){0, 0, 200};
+    CHECK(mpls_dump_routes(&session, AF_MPLS, test_dump_route, &dump) == 0);
+    CHECK(dump.routes == 1 && dump.swapped == 1);
+
+    mpls_frr_close(frr);
+    mpls_session_close(&session);
+    mpls_fake_close(fake);
+    return test_failures ? 1 : 0;
+}
+
+/**
+ * @brief Runs the protected-route test in a child with a network namespace of its own.
+ *
+ * @return 0 if it passed, TEST_SKIP if no namespace could be created, 1 if it failed.
+ */
+static int test_frr_arm_flap(void) {
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) return 1;
+    if (pid == 0) {
+        // An unprivileged user gets a namespace through a user namespace of its own
+        if (unshare(CLONE_NEWNET) < 0 && unshare(CLONE_NEWUSER | CLONE_NEWNET) < 0) _exit(TEST_SKIP);
+        test_failures = 0;
+        _exit(test_frr_child());
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0) return 1;
+    if (WIFSIGNALED(status)) fprintf(stderr, "  killed by signal %d\n", WTERMSIG(status));
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+/**
+ * @brief Runs one test and reports it.
+ *
+ * @param name Name printed with the outcome.
+ * @param failures_before Failure count before the test ran.
+ * @param status Exit status of a test run in a child, 0 otherwise.
+ * @return 1 if the test failed, 0 otherwise.
+ */
+static int test_report(const char *name, int failures_before, int status) {
+    if (status == TEST_SKIP) {
+        printf("skip - %s\n", name);
+        return 0;
+    }
+    int failed = test_failures != failures_before || status != 0;
+    printf("%s - %s\n", failed ? "FAIL" : "ok", name);
+    return failed;
+}
+
+int main(void) {
+    int failed = 0;
+    static const unsigned int drops[] = {0, 1, 3, 97};
+
+    for (int ack_errors = 0; ack_errors < 2; ack_errors++) {
+        for (size_t i = 0; i < sizeof(drops) / sizeof(drops[0]); i++) {
+            char name[64];
+            int before = test_failures;
+            test_batch(ack_errors, drops[i]);
+            snprintf(name, sizeof(name), "batch ack_errors=%d enobufs_every=%u", ack_errors, drops[i]);
+            failed += test_report(name, before, 0);
+
+            before = test_failures;
+            test_async(ack_errors, drops[i]);
+            snprintf(name, sizeof(name), "async ack_errors=%d enobufs_every=%u", ack_errors, drops[i]);
+            failed += test_report(name, before, 0);
+        }
+    }
+
+    int before = test_failures;
+    test_multipath_weight();
+    failed += test_report("multipath weight", before, 0);
+
+    before = test_failures;
+    test_sync_scope();
+    failed += test_report("sync protocol scope", before, 0);
+
+    before = test_failures;
+    test_dump_family();
+    failed += test_report("dump family filter", before, 0);
+
+    failed += test_report("frr arm during link flap", test_failures, test_frr_arm_flap());
+
+    printf("%d failed\n", failed);
+    return failed ? 1 : 0;
+}